@@ -0,0 +1,54 @@
+#pragma once
+
+// What the benchmarks in this directory share: timing and command line
+// options.
+
+// They build and run without openFrameworks or Core Audio, so they can be
+// run on Linux CI machines, where compat/ stands in for the Core Audio types
+// and vDSP. Each one lists its SOURCES at the top; from this directory:
+//
+//   Linux:
+//     g++ -std=c++14 -O2 -Icompat -I../src $SOURCES -lpthread -o name
+//
+//   macOS (without the compat directory):
+//     clang++ -std=c++14 -O2 -I../src $SOURCES -framework AudioToolbox -o name
+//
+//   ./name [--quick] [--dir path] > results.jsonl
+//
+// Add -I../src/TPCircularBuffer for the ones that build TPCircularBuffer.c,
+// and -framework Accelerate on macOS for the ones that build
+// ofxAudioUnitFftCache.cpp. --quick makes the runs short enough for CI, and
+// --dir says where the ones that write files put them. Every result is
+// printed as one JSON object per line, so runs can be diffed or collected
+// over time.
+
+#include <chrono>
+#include <string.h>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+static bool quick = false;
+
+inline double secondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// whether `option` is on the command line
+inline bool hasOption(int argc, char ** argv, const char * option)
+{
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], option) == 0) return true;
+	}
+	return false;
+}
+
+// what follows `option` on the command line ("--dir path"), or fallback
+inline std::string optionValue(int argc, char ** argv, const char * option, const std::string &fallback)
+{
+	for(int i = 1; i + 1 < argc; i++) {
+		if(strcmp(argv[i], option) == 0) return argv[i + 1];
+	}
+	return fallback;
+}
@@ -0,0 +1,378 @@
+// Benchmarks for ofxAudioUnitBiquadFilter, the biquad cascade behind
+// ofxAudioUnitBiquadNode.
+//
+//   SOURCES="biquadBenchmark.cpp ../src/ofxAudioUnitBiquadFilter.cpp"
+//
+// "accuracy" runs noise through a cascade of peaking sections, and through
+// the same cascade one channel at a time in float and in double, and checks
+// they agree; channels beyond the filter's count have to come out
+// untouched. "ramp" uses pure gain sections on a constant input, so the
+// output is the coefficient: it has to move in equal steps from the old
+// value to the new one over exactly the smoothing length, and carry on from
+// where it is when retargeted mid-ramp. It also sweeps a whole cascade from
+// lowpass to highpass, which has to settle onto the highpass output.
+// "throughput" times the filter (up to four channels interleaved, a section
+// at a time) against the plain loop (a channel at a time, a section at a
+// time), from mono up to 64 channels x 8 sections, and reports the load at
+// 48kHz.
+
+#include "ofxAudioUnitBiquadFilter.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef ofxAudioUnitBiquadFilter::Coefficients Coefficients;
+
+static void fillNoise(std::vector<float> &x, unsigned int seed)
+{
+	for(size_t i = 0; i < x.size(); i++) {
+		seed = seed * 1664525u + 1013904223u;
+		x[i] = (seed >> 8) / 8388608.0 - 1;
+	}
+}
+
+// RBJ peaking EQ, as ofxAudioUnitBiquadNode::computeCoefficients makes it
+static Coefficients peak(double frequency, double q, double gain, double sampleRate)
+{
+	const double w0 = 2 * M_PI * frequency / sampleRate;
+	const double alpha = sin(w0) / (2 * q);
+	const double A = pow(10.0, gain / 40);
+	const double a0 = 1 + alpha / A;
+	const Coefficients c = {
+		(float)((1 + alpha * A) / a0), (float)(-2 * cos(w0) / a0), (float)((1 - alpha * A) / a0),
+		(float)(-2 * cos(w0) / a0), (float)((1 - alpha / A) / a0)
+	};
+	return c;
+}
+
+static Coefficients pass(double frequency, double q, double sampleRate, bool high)
+{
+	const double w0 = 2 * M_PI * frequency / sampleRate;
+	const double cosw0 = cos(w0);
+	const double alpha = sin(w0) / (2 * q);
+	const double a0 = 1 + alpha;
+	const double b = high ? (1 + cosw0) / 2 : (1 - cosw0) / 2;
+	const Coefficients c = {
+		(float)(b / a0), (float)((high ? -2 : 2) * b / a0), (float)(b / a0),
+		(float)(-2 * cosw0 / a0), (float)((1 - alpha) / a0)
+	};
+	return c;
+}
+
+static Coefficients gain(float g)
+{
+	const Coefficients c = {g, 0, 0, 0, 0};
+	return c;
+}
+
+// non-interleaved buffers, the way a render callback gets them
+struct Buffers
+{
+	std::vector<std::vector<float> > channels;
+	std::vector<char> listStorage;
+	AudioBufferList * list;
+
+	Buffers(unsigned int channelCount, UInt32 frames)
+	: channels(channelCount, std::vector<float>(frames))
+	, listStorage(sizeof(AudioBufferList) + channelCount * sizeof(AudioBuffer))
+	{
+		list = (AudioBufferList *)&listStorage[0];
+		list->mNumberBuffers = channelCount;
+		for(unsigned int c = 0; c < channelCount; c++) {
+			list->mBuffers[c].mNumberChannels = 1;
+			list->mBuffers[c].mDataByteSize = frames * sizeof(float);
+			list->mBuffers[c].mData = &channels[c][0];
+		}
+	}
+};
+
+// the straightforward version: one channel at a time, transposed direct form II
+static void processPlain(const std::vector<Coefficients> &sections, std::vector<float> &z1, std::vector<float> &z2,
+                         float * x, UInt32 frames, unsigned int channel)
+{
+	for(size_t s = 0; s < sections.size(); s++) {
+		const Coefficients &k = sections[s];
+		float s1 = z1[channel * sections.size() + s];
+		float s2 = z2[channel * sections.size() + s];
+		for(UInt32 i = 0; i < frames; i++) {
+			const float in = x[i];
+			const float out = k.b0 * in + s1;
+			s1 = k.b1 * in - k.a1 * out + s2;
+			s2 = k.b2 * in - k.a2 * out;
+			x[i] = out;
+		}
+		z1[channel * sections.size() + s] = s1;
+		z2[channel * sections.size() + s] = s2;
+	}
+}
+
+static std::vector<Coefficients> makeCascade(unsigned int sections, double sampleRate)
+{
+	std::vector<Coefficients> cascade;
+	for(unsigned int s = 0; s < sections; s++) {
+		cascade.push_back(peak(60 * pow(2.0, s * 1.1), 0.7 + 0.3 * (s % 3), (s % 2 ? -6 : 6), sampleRate));
+	}
+	return cascade;
+}
+
+#pragma mark - Accuracy
+
+static bool accuracy(unsigned int channels, unsigned int sections, UInt32 sliceFrames)
+{
+	const double sampleRate = 48000;
+	const UInt32 length = 48000;
+	const std::vector<Coefficients> cascade = makeCascade(sections, sampleRate);
+
+	ofxAudioUnitBiquadFilter filter(sections, channels);
+	filter.setSmoothingFrames(0);
+	filter.setCoefficients(&cascade[0]);
+
+	// one extra channel, which the filter should leave alone
+	std::vector<std::vector<float> > input(channels + 1, std::vector<float>(length));
+	for(unsigned int c = 0; c <= channels; c++) fillNoise(input[c], 17 + c);
+
+	Buffers buffers(channels + 1, sliceFrames);
+	std::vector<std::vector<float> > output(channels + 1, std::vector<float>(length));
+	for(UInt32 done = 0; done + sliceFrames <= length; done += sliceFrames) {
+		for(unsigned int c = 0; c <= channels; c++) std::copy(&input[c][done], &input[c][done] + sliceFrames, &buffers.channels[c][0]);
+		filter.process(buffers.list, sliceFrames);
+		for(unsigned int c = 0; c <= channels; c++) std::copy(&buffers.channels[c][0], &buffers.channels[c][0] + sliceFrames, &output[c][done]);
+	}
+	const UInt32 rendered = length / sliceFrames * sliceFrames;
+
+	// against the same arithmetic a channel at a time, which should agree to
+	// rounding, and against double precision, which shows float's own error
+	double worst = 0, worstDouble = 0, peakLevel = 0;
+	for(unsigned int c = 0; c < channels; c++) {
+		std::vector<float> plain(input[c].begin(), input[c].begin() + rendered);
+		std::vector<float> z1f(sections, 0), z2f(sections, 0);
+		processPlain(cascade, z1f, z2f, &plain[0], rendered, 0);
+
+		std::vector<double> z1(sections, 0), z2(sections, 0);
+		for(UInt32 i = 0; i < rendered; i++) {
+			double x = input[c][i];
+			for(unsigned int s = 0; s < sections; s++) {
+				const Coefficients &k = cascade[s];
+				const double y = k.b0 * x + z1[s];
+				z1[s] = k.b1 * x - k.a1 * y + z2[s];
+				z2[s] = k.b2 * x - k.a2 * y;
+				x = y;
+			}
+			peakLevel = std::max(peakLevel, fabs(x));
+			worst = std::max(worst, (double)fabs(output[c][i] - plain[i]));
+			worstDouble = std::max(worstDouble, fabs(output[c][i] - x));
+		}
+	}
+
+	bool untouched = true;
+	for(UInt32 i = 0; i < rendered; i++) untouched = untouched && output[channels][i] == input[channels][i];
+
+	const double relative = worst / peakLevel;
+	const double relativeDouble = worstDouble / peakLevel;
+	const bool ok = relative < 1e-5 && relativeDouble < 1e-3 && untouched;
+	printf("{\"benchmark\":\"accuracy\",\"channels\":%u,\"sections\":%u,\"slice\":%u,\"max_error_vs_plain_db\":%.1f,\"max_error_vs_double_db\":%.1f,\"extra_channel_untouched\":%s,\"ok\":%s}\n",
+		   channels, sections, sliceFrames, 20 * log10(std::max(relative, 1e-12)), 20 * log10(std::max(relativeDouble, 1e-12)),
+		   untouched ? "true" : "false", ok ? "true" : "false");
+	return ok;
+}
+
+#pragma mark - Ramp
+
+// runs `frames` of a constant 1 through the filter in slices, appending the
+// first channel's output to `out`
+static void renderConstant(ofxAudioUnitBiquadFilter &filter, Buffers &buffers, UInt32 frames, std::vector<float> &out)
+{
+	const UInt32 slice = buffers.channels[0].size();
+	for(UInt32 done = 0; done < frames; done += slice) {
+		for(size_t c = 0; c < buffers.channels.size(); c++) std::fill(buffers.channels[c].begin(), buffers.channels[c].end(), 1.f);
+		filter.process(buffers.list, slice);
+		out.insert(out.end(), buffers.channels[0].begin(), buffers.channels[0].end());
+	}
+}
+
+static bool ramp()
+{
+	const unsigned int sections = 8;
+	const unsigned int channels = 4;
+	const UInt32 slice = 48;
+	const UInt32 smoothing = 480;
+	bool ok = true;
+
+	// Gain sections on DC: the output is the product of the b0s. One
+	// section goes from 1 to 0.5; the output has to step down by 0.5 / 480
+	// every frame and land on 0.5 after exactly 480 frames
+	{
+		ofxAudioUnitBiquadFilter filter(sections, channels);
+		filter.setSmoothingFrames(smoothing);
+		Buffers buffers(channels, slice);
+
+		std::vector<Coefficients> cascade(sections, gain(1));
+		cascade[3] = gain(0.5);
+		filter.setCoefficients(&cascade[0]);
+
+		std::vector<float> out;
+		renderConstant(filter, buffers, 2 * smoothing, out);
+
+		double worst = 0;
+		UInt32 settledAt = 0;
+		for(UInt32 i = 0; i < out.size(); i++) {
+			const double expected = i + 1 < smoothing ? 1 - 0.5 * (i + 1) / smoothing : 0.5;
+			worst = std::max(worst, fabs(out[i] - expected));
+			if(out[i] != 0.5f) settledAt = i + 1;
+		}
+
+		const bool caseOk = worst < 1e-5 && settledAt <= smoothing;
+		printf("{\"benchmark\":\"ramp\",\"case\":\"linear\",\"smoothing_frames\":%u,\"settled_after\":%u,\"max_error\":%.3g,\"ok\":%s}\n",
+			   smoothing, settledAt, worst, caseOk ? "true" : "false");
+		ok = ok && caseOk;
+	}
+
+	// Retargeted halfway: back to 1 from wherever it got to (0.75), again
+	// over the full smoothing length, without a jump
+	{
+		ofxAudioUnitBiquadFilter filter(sections, channels);
+		filter.setSmoothingFrames(smoothing);
+		Buffers buffers(channels, slice);
+
+		std::vector<Coefficients> cascade(sections, gain(1));
+		cascade[0] = gain(0.5);
+		filter.setCoefficients(&cascade[0]);
+
+		std::vector<float> out;
+		renderConstant(filter, buffers, smoothing / 2, out);
+		const float halfway = out.back();
+
+		cascade[0] = gain(1);
+		filter.setCoefficients(&cascade[0]);
+		renderConstant(filter, buffers, 2 * smoothing, out);
+
+		double largestStep = 0;
+		for(size_t i = 1; i < out.size(); i++) largestStep = std::max(largestStep, (double)fabs(out[i] - out[i - 1]));
+
+		const float end = out.back();
+		const bool caseOk = fabs(halfway - 0.75) < 1e-5 && end == 1.f && largestStep < 0.5 / smoothing + 1e-5;
+		printf("{\"benchmark\":\"ramp\",\"case\":\"retarget\",\"smoothing_frames\":%u,\"halfway\":%.5f,\"end\":%.5f,\"largest_step\":%.6f,\"step_limit\":%.6f,\"ok\":%s}\n",
+			   smoothing, halfway, end, largestStep, 0.5 / smoothing, caseOk ? "true" : "false");
+		ok = ok && caseOk;
+	}
+
+	// A whole cascade swept from lowpass to highpass while noise runs
+	// through it. Interpolating a1 and a2 linearly keeps every section inside
+	// the stability triangle (it's convex), though the filters in between
+	// can have more gain than either end. Once the ramp is over and the state
+	// has settled, the output has to match the highpass cascade on its own
+	{
+		const double sampleRate = 48000;
+		const unsigned int slices = 100, switchAt = 20, settledAt = 40;
+
+		std::vector<Coefficients> lowpass, highpass;
+		for(unsigned int s = 0; s < sections; s++) {
+			lowpass.push_back(pass(200 * (s + 1), 0.7071, sampleRate, false));
+			highpass.push_back(pass(8000 - 500 * s, 0.7071, sampleRate, true));
+		}
+
+		std::vector<float> noise(slice * channels * slices);
+		fillNoise(noise, 23);
+
+		// run 0 is the highpass throughout, run 1 the sweep
+		std::vector<float> out[2];
+		for(int run = 0; run < 2; run++) {
+			ofxAudioUnitBiquadFilter filter(sections, channels);
+			filter.setSmoothingFrames(run == 1 ? smoothing : 0);
+			filter.setCoefficients(run == 1 ? &lowpass[0] : &highpass[0]);
+
+			Buffers buffers(channels, slice);
+			for(unsigned int r = 0; r < slices; r++) {
+				if(run == 1 && r == switchAt) filter.setCoefficients(&highpass[0]);
+				for(unsigned int c = 0; c < channels; c++) std::copy(&noise[(r * channels + c) * slice], &noise[(r * channels + c + 1) * slice], &buffers.channels[c][0]);
+				filter.process(buffers.list, slice);
+				for(unsigned int c = 0; c < channels; c++) out[run].insert(out[run].end(), buffers.channels[c].begin(), buffers.channels[c].end());
+			}
+		}
+
+		bool finite = true;
+		float steady = 0, transient = 0, difference = 0;
+		for(size_t i = 0; i < out[1].size(); i++) {
+			finite = finite && isfinite(out[1][i]);
+			steady = std::max(steady, fabsf(out[0][i]));
+			transient = std::max(transient, fabsf(out[1][i]));
+			if(i >= settledAt * slice * channels) difference = std::max(difference, fabsf(out[1][i] - out[0][i]));
+		}
+
+		const bool caseOk = finite && difference < 1e-3 * steady;
+		printf("{\"benchmark\":\"ramp\",\"case\":\"sweep\",\"sections\":%u,\"smoothing_frames\":%u,\"largest_highpass\":%.3f,\"largest_during_sweep\":%.3f,\"settled_difference\":%.3g,\"ok\":%s}\n",
+			   sections, smoothing, steady, transient, difference, caseOk ? "true" : "false");
+		ok = ok && caseOk;
+	}
+
+	return ok;
+}
+
+#pragma mark - Throughput
+
+static void throughput(unsigned int channels, unsigned int sections)
+{
+	const double sampleRate = 48000;
+	const UInt32 slice = 512;
+	const std::vector<Coefficients> cascade = makeCascade(sections, sampleRate);
+
+	ofxAudioUnitBiquadFilter filter(sections, channels);
+	filter.setCoefficients(&cascade[0]);
+
+	Buffers buffers(channels, slice);
+	std::vector<float> noise(slice);
+	fillNoise(noise, 29);
+
+	const double audioSeconds = quick ? 1 : 10;
+	const unsigned int slices = audioSeconds * sampleRate / slice;
+	float sink = 0;
+
+	Clock::time_point start = Clock::now();
+	for(unsigned int r = 0; r < slices; r++) {
+		for(unsigned int c = 0; c < channels; c++) std::copy(noise.begin(), noise.end(), buffers.channels[c].begin());
+		filter.process(buffers.list, slice);
+		sink += buffers.channels[0][0];
+	}
+	const double filterSeconds = secondsSince(start);
+
+	std::vector<float> z1(channels * sections, 0), z2(channels * sections, 0);
+	start = Clock::now();
+	for(unsigned int r = 0; r < slices; r++) {
+		for(unsigned int c = 0; c < channels; c++) {
+			std::copy(noise.begin(), noise.end(), buffers.channels[c].begin());
+			processPlain(cascade, z1, z2, &buffers.channels[c][0], slice, c);
+		}
+		sink += buffers.channels[0][0];
+	}
+	const double plainSeconds = secondsSince(start);
+
+	const double processed = (double)slices * slice / sampleRate;
+	const double biquads = (double)slices * slice * channels * sections;
+	printf("{\"benchmark\":\"throughput\",\"channels\":%u,\"sections\":%u,\"audio_seconds\":%.2f,\"mbiquads_per_s\":%.1f,\"plain_mbiquads_per_s\":%.1f,\"speedup\":%.2f,\"load_at_48k\":%.4f,\"plain_load_at_48k\":%.4f,\"check\":%.3g}\n",
+		   channels, sections, processed, biquads / filterSeconds / 1e6, biquads / plainSeconds / 1e6, plainSeconds / filterSeconds,
+		   filterSeconds / processed, plainSeconds / processed, sink);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+	ok = accuracy(1, 1, 512) && ok;
+	ok = accuracy(2, 8, 100) && ok;
+	ok = accuracy(7, 3, 300) && ok;
+	ok = accuracy(64, 8, 512) && ok;
+	ok = ramp() && ok;
+
+	const unsigned int channels[] = {1, 2, 8, 64};
+	for(int c = 0; c < 4; c++) {
+		throughput(channels[c], 1);
+		throughput(channels[c], 8);
+	}
+	return ok ? 0 : 1;
+}
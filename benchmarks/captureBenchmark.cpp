@@ -0,0 +1,288 @@
+// Benchmarks for the capture path (the code that copies audio out of the
+// render thread for taps, FFT nodes and inputs).
+//
+//   SOURCES="captureBenchmark.cpp ../src/ofxAudioUnitCaptureBuffer.cpp ../src/TPCircularBuffer/TPCircularBuffer.c"
+//
+// Every result is printed as one JSON object per line, so runs can be
+// diffed or collected over time. "legacy" is the previous design (one
+// TPCircularBuffer per channel, with the writer consuming to make room),
+// kept here as a baseline.
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include "TPCircularBuffer.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// total frames to push through each throughput measurement
+static UInt64 framesPerRun(unsigned int channels)
+{
+	const UInt64 samples = quick ? 20000000 : 200000000;
+	return std::max<UInt64>(samples / channels, 65536);
+}
+
+#pragma mark - Buffers
+
+struct BufferList
+{
+	std::vector<char> storage;
+	std::vector<std::vector<Float32> > channels;
+
+	BufferList(unsigned int channelCount, size_t frames)
+	: storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * std::max(channelCount, 1u))
+	, channels(channelCount, std::vector<Float32>(frames))
+	{
+		AudioBufferList * list = get();
+		list->mNumberBuffers = channelCount;
+		for(unsigned int c = 0; c < channelCount; c++) {
+			for(size_t i = 0; i < frames; i++) {
+				channels[c][i] = (rand() % 2000 - 1000) / 1000.f;
+			}
+			list->mBuffers[c].mNumberChannels = 1;
+			list->mBuffers[c].mDataByteSize = frames * sizeof(Float32);
+			list->mBuffers[c].mData = &channels[c][0];
+		}
+	}
+
+	AudioBufferList * get() {return (AudioBufferList *)&storage[0];}
+};
+
+// the pre-capture-buffer design, for comparison
+struct LegacyRing
+{
+	std::vector<TPCircularBuffer> rings;
+
+	LegacyRing(unsigned int channels, size_t capacity)
+	: rings(channels)
+	{
+		for(size_t c = 0; c < rings.size(); c++) {
+			TPCircularBufferInit(&rings[c], capacity * sizeof(Float32));
+		}
+	}
+
+	~LegacyRing()
+	{
+		for(size_t c = 0; c < rings.size(); c++) {
+			TPCircularBufferCleanup(&rings[c]);
+		}
+	}
+
+	void write(const AudioBufferList * list, size_t frames)
+	{
+		const UInt32 bytes = frames * sizeof(Float32);
+		for(size_t c = 0; c < rings.size() && c < list->mNumberBuffers; c++) {
+			int32_t available;
+			TPCircularBufferHead(&rings[c], &available);
+			if(available < (int32_t)bytes) {
+				TPCircularBufferConsume(&rings[c], bytes - available);
+			}
+			TPCircularBufferProduceBytes(&rings[c], list->mBuffers[c].mData, bytes);
+		}
+	}
+
+	void read(AudioBufferList * list, size_t frames)
+	{
+		const int32_t bytes = frames * sizeof(Float32);
+		for(size_t c = 0; c < rings.size() && c < list->mNumberBuffers; c++) {
+			int32_t available;
+			void * tail = TPCircularBufferTail(&rings[c], &available);
+			const int32_t toCopy = std::min(available, bytes);
+			if(toCopy > 0) {
+				memcpy(list->mBuffers[c].mData, tail, toCopy);
+				TPCircularBufferConsume(&rings[c], toCopy);
+			}
+		}
+	}
+};
+
+#pragma mark - Benchmarks
+
+static void report(const char * benchmark, const char * implementation, unsigned int channels, size_t block, UInt64 frames, double seconds, const std::string &extra = "")
+{
+	const double samplesPerSecond = frames * channels / seconds;
+	printf("{\"benchmark\":\"%s\",\"impl\":\"%s\",\"channels\":%u,\"block\":%zu,"
+		   "\"frames\":%llu,\"seconds\":%.6f,\"msamples_per_sec\":%.2f,\"ns_per_frame\":%.3f%s}\n",
+		   benchmark, implementation, channels, block,
+		   (unsigned long long)frames, seconds, samplesPerSecond / 1e6, seconds * 1e9 / frames,
+		   extra.c_str());
+	fflush(stdout);
+}
+
+// One thread writes a block and immediately reads it back, which isolates the
+// cost of the copies and the atomics from any scheduling effects
+static void produceConsume(unsigned int channels, size_t block, size_t capacity)
+{
+	BufferList in(channels, block);
+	BufferList out(channels, block);
+	const UInt64 frames = framesPerRun(channels) / block * block;
+
+	{
+		ofxAudioUnitCaptureBuffer ring(channels, capacity);
+		UInt64 cursor = 0;
+		Clock::time_point start = Clock::now();
+		for(UInt64 done = 0; done < frames; done += block) {
+			ring.write(in.get(), block);
+			ring.read(cursor, block, out.get());
+			cursor += block;
+		}
+		report("produce_consume", "capture", channels, block, frames, secondsSince(start));
+	}
+
+	{
+		LegacyRing ring(channels, capacity);
+		Clock::time_point start = Clock::now();
+		for(UInt64 done = 0; done < frames; done += block) {
+			ring.write(in.get(), block);
+			ring.read(out.get(), block);
+		}
+		report("produce_consume", "legacy", channels, block, frames, secondsSince(start));
+	}
+}
+
+// A writer thread hammers the ring for a fixed time while reader threads
+// keep pulling the latest window, the way a tap being drawn every frame does
+// (just much faster). Reports the writer's throughput and how often readers
+// were lapped
+static void contention(unsigned int readers, size_t block, size_t capacity)
+{
+	const unsigned int channels = 2;
+	const double duration = quick ? 0.2 : 2.0;
+	BufferList in(channels, block);
+	UInt64 frames = 0;
+
+	ofxAudioUnitCaptureBuffer ring(channels, capacity);
+	std::atomic<bool> running(true);
+	std::atomic<UInt64> reads(0);
+	std::atomic<UInt64> shortReads(0);
+	std::vector<std::thread> threads;
+
+	for(unsigned int r = 0; r < readers; r++) {
+		threads.push_back(std::thread([&, r] {
+			std::vector<Float32> latest;
+			while(running.load(std::memory_order_relaxed)) {
+				ring.readLatest(r % channels, latest);
+				reads.fetch_add(1, std::memory_order_relaxed);
+				if(latest.size() < capacity && ring.getWriteCount() >= capacity) {
+					shortReads.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}));
+	}
+
+	Clock::time_point start = Clock::now();
+	double seconds = 0;
+	while(seconds < duration) {
+		// checking the clock every block would swamp what we're measuring
+		for(int i = 0; i < 64; i++) {
+			ring.write(in.get(), block);
+		}
+		frames += block * 64;
+		seconds = secondsSince(start);
+	}
+
+	running = false;
+	for(size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+
+	char extra[128];
+	snprintf(extra, sizeof(extra), ",\"readers\":%u,\"reads\":%llu,\"overrun_reads\":%llu",
+			 readers, (unsigned long long)reads.load(), (unsigned long long)shortReads.load());
+	report("contention", "capture", channels, block, frames, seconds, extra);
+}
+
+// How long it takes a polling reader to see a block after the writer
+// published it, with the writer running at a real-time cadence
+static void tapLatency(size_t block, double sampleRate)
+{
+	const unsigned int channels = 2;
+	const size_t blocks = quick ? 200 : 2000;
+	BufferList in(channels, block);
+	ofxAudioUnitCaptureBuffer ring(channels, block * 8);
+
+	std::vector<Clock::time_point> published(blocks);
+	std::vector<Clock::time_point> seen(blocks);
+	std::atomic<bool> running(true);
+
+	std::thread reader([&] {
+		std::vector<Float32> latest;
+		UInt64 lastSeen = 0;
+		while(running.load(std::memory_order_relaxed)) {
+			const UInt64 end = ring.readLatest(0, latest);
+			if(end != lastSeen) {
+				const Clock::time_point now = Clock::now();
+				for(UInt64 b = lastSeen / block; b < end / block && b < blocks; b++) {
+					seen[b] = now;
+				}
+				lastSeen = end;
+			}
+		}
+	});
+
+	const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(block / sampleRate));
+	Clock::time_point deadline = Clock::now();
+	for(size_t b = 0; b < blocks; b++) {
+		deadline += period;
+		std::this_thread::sleep_until(deadline);
+		published[b] = Clock::now();
+		ring.write(in.get(), block);
+	}
+
+	// give the reader a moment to catch the last block
+	std::this_thread::sleep_for(period * 2);
+	running = false;
+	reader.join();
+
+	std::vector<double> latencies;
+	for(size_t b = 0; b < blocks; b++) {
+		if(seen[b] >= published[b]) {
+			latencies.push_back(std::chrono::duration<double, std::micro>(seen[b] - published[b]).count());
+		}
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	const double median = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+	const double p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+	printf("{\"benchmark\":\"tap_latency\",\"impl\":\"capture\",\"channels\":%u,\"block\":%zu,"
+		   "\"blocks\":%zu,\"observed\":%zu,\"median_us\":%.2f,\"p99_us\":%.2f}\n",
+		   channels, block, blocks, latencies.size(), median, p99);
+	fflush(stdout);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	srand(1);
+
+	// per block size, at the default tap length
+	const size_t blockSizes[] = {32, 64, 128, 256, 512, 1024, 2048, 4096};
+	for(size_t i = 0; i < sizeof(blockSizes) / sizeof(blockSizes[0]); i++) {
+		produceConsume(2, blockSizes[i], 8192);
+	}
+
+	// channel count scaling
+	const unsigned int channelCounts[] = {2, 8, 32, 128};
+	for(size_t i = 0; i < sizeof(channelCounts) / sizeof(channelCounts[0]); i++) {
+		produceConsume(channelCounts[i], 512, 8192);
+	}
+
+	// reader / writer contention
+	const unsigned int readerCounts[] = {1, 2, 4};
+	for(size_t i = 0; i < sizeof(readerCounts) / sizeof(readerCounts[0]); i++) {
+		contention(readerCounts[i], 512, 2048);
+	}
+
+	tapLatency(256, 48000);
+	tapLatency(512, 48000);
+
+	return 0;
+}
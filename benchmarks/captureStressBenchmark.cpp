@@ -0,0 +1,188 @@
+// Stress test for ofxAudioUnitCaptureBuffer: one writer and several readers
+// hammering a small buffer, so readers get lapped mid-copy all the time.
+// Meant to be run under ThreadSanitizer as well as optimized.
+//
+//   SOURCES="captureStressBenchmark.cpp ../src/ofxAudioUnitCaptureBuffer.cpp"
+//
+// Under ThreadSanitizer, GCC warns that it doesn't instrument the seqlock's
+// fences (the atomics around them are what it checks), hence -Wno-tsan:
+//
+//     g++ -std=c++14 -O1 -g -fsanitize=thread -Wno-tsan -Icompat -I../src $SOURCES -lpthread -o captureStressBenchmark
+//
+// On macOS, clang's -fsanitize=thread works too.
+//
+// Every sample written holds its own sequence number and channel, so each
+// read that succeeds is checked sample by sample: "torn" counts samples that
+// came back from a different write than the one they were read as. Reads
+// that report an overrun are counted, not checked. Any torn sample (or, under
+// ThreadSanitizer, any race report) is a failure.
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// floats hold integers exactly up to 2^24
+static const UInt64 kValueRange = 1 << 24;
+
+static Float32 expected(UInt64 sequence, unsigned int channel, unsigned int channels)
+{
+	return (Float32)((sequence * channels + channel) % kValueRange);
+}
+
+struct BufferList
+{
+	std::vector<char> storage;
+	std::vector<std::vector<Float32> > channels;
+
+	BufferList(unsigned int channelCount, size_t frames)
+	: storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * std::max(channelCount, 1u))
+	, channels(channelCount, std::vector<Float32>(frames))
+	{
+		list()->mNumberBuffers = channelCount;
+		for(unsigned int c = 0; c < channelCount; c++) {
+			list()->mBuffers[c].mNumberChannels = 1;
+			list()->mBuffers[c].mDataByteSize = (UInt32)(frames * sizeof(Float32));
+			list()->mBuffers[c].mData = &channels[c][0];
+		}
+	}
+
+	AudioBufferList * list() {return (AudioBufferList *)&storage[0];}
+};
+
+struct ReaderStats
+{
+	UInt64 reads;
+	UInt64 overruns;
+	UInt64 checked;
+	UInt64 torn;
+};
+
+// read(start, frames, list) over every channel, just behind the writer
+static void readRanges(const ofxAudioUnitCaptureBuffer &buffer, const std::atomic<bool> &running, unsigned int seed, ReaderStats &stats)
+{
+	const unsigned int channels = buffer.channels();
+	const size_t maxFrames = buffer.capacity();
+	BufferList out(channels, maxFrames);
+
+	while(running.load()) {
+		seed = seed * 1664525u + 1013904223u;
+		const size_t frames = 1 + (seed >> 8) % maxFrames;
+		const UInt64 end = buffer.getWriteCount();
+		if(end < frames) continue;
+
+		// anywhere from the newest frames back to the oldest the buffer holds
+		const UInt64 back = (seed >> 4) % (maxFrames - frames + 1);
+		if(end < frames + back) continue;
+		const UInt64 start = end - frames - back;
+
+		stats.reads++;
+		if(!buffer.read(start, frames, out.list())) {
+			stats.overruns++;
+			continue;
+		}
+
+		for(unsigned int c = 0; c < channels; c++) {
+			for(size_t i = 0; i < frames; i++) {
+				if(out.channels[c][i] != expected(start + i, c, channels)) stats.torn++;
+			}
+		}
+		stats.checked += frames * channels;
+	}
+}
+
+// readLatest() on one channel, the way the FFT and pitch nodes use it
+static void readLatest(const ofxAudioUnitCaptureBuffer &buffer, const std::atomic<bool> &running, unsigned int channel, ReaderStats &stats)
+{
+	const unsigned int channels = buffer.channels();
+	std::vector<Float32> samples;
+
+	while(running.load()) {
+		const UInt64 end = buffer.readLatest(channel, samples, buffer.capacity());
+		stats.reads++;
+		if(samples.size() < std::min<UInt64>(buffer.capacity(), end)) stats.overruns++;
+
+		const UInt64 start = end - samples.size();
+		for(size_t i = 0; i < samples.size(); i++) {
+			if(samples[i] != expected(start + i, channel, channels)) stats.torn++;
+		}
+		stats.checked += samples.size();
+	}
+}
+
+static bool stress(unsigned int channels, size_t capacity, unsigned int rangeReaders, unsigned int latestReaders)
+{
+	const double seconds = quick ? 0.5 : 5;
+
+	ofxAudioUnitCaptureBuffer buffer(channels, capacity);
+	std::atomic<bool> running(true);
+
+	const unsigned int readerCount = rangeReaders + latestReaders;
+	std::vector<ReaderStats> stats(readerCount);
+	memset(&stats[0], 0, sizeof(ReaderStats) * readerCount);
+
+	std::vector<std::thread> readers;
+	for(unsigned int r = 0; r < rangeReaders; r++) {
+		readers.push_back(std::thread(readRanges, std::cref(buffer), std::cref(running), 12345 + r, std::ref(stats[r])));
+	}
+	for(unsigned int r = 0; r < latestReaders; r++) {
+		readers.push_back(std::thread(readLatest, std::cref(buffer), std::cref(running), r % channels, std::ref(stats[rangeReaders + r])));
+	}
+
+	// blocks of every size up to twice the capacity, so writes wrap around
+	// the end of the planes and sometimes lap the whole buffer in one go
+	const size_t maxBlock = capacity * 2;
+	BufferList block(channels, maxBlock);
+	UInt64 sequence = 0;
+	UInt64 writes = 0;
+	unsigned int seed = 1;
+
+	const Clock::time_point start = Clock::now();
+	while(std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+		seed = seed * 1664525u + 1013904223u;
+		const size_t frames = 1 + (seed >> 8) % (seed & 0x10 ? maxBlock : 64);
+		for(unsigned int c = 0; c < channels; c++) {
+			for(size_t i = 0; i < frames; i++) block.channels[c][i] = expected(sequence + i, c, channels);
+		}
+		buffer.write(block.list(), frames);
+		sequence += frames;
+		writes++;
+	}
+
+	running.store(false);
+	for(size_t r = 0; r < readers.size(); r++) readers[r].join();
+
+	ReaderStats total;
+	memset(&total, 0, sizeof(total));
+	for(unsigned int r = 0; r < readerCount; r++) {
+		total.reads += stats[r].reads;
+		total.overruns += stats[r].overruns;
+		total.checked += stats[r].checked;
+		total.torn += stats[r].torn;
+	}
+
+	const bool ok = total.torn == 0 && buffer.getWriteCount() == sequence;
+	printf("{\"benchmark\":\"stress\",\"channels\":%u,\"capacity\":%zu,\"range_readers\":%u,\"latest_readers\":%u,\"writes\":%llu,\"frames\":%llu,\"reads\":%llu,\"overrun_reads\":%llu,\"samples_checked\":%llu,\"torn\":%llu,\"ok\":%s}\n",
+		   channels, capacity, rangeReaders, latestReaders, (unsigned long long)writes, (unsigned long long)sequence,
+		   (unsigned long long)total.reads, (unsigned long long)total.overruns, (unsigned long long)total.checked,
+		   (unsigned long long)total.torn, ok ? "true" : "false");
+	return ok;
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+	ok = stress(1, 256, 1, 1) && ok;
+	ok = stress(2, 1000, 2, 2) && ok;
+	ok = stress(8, 4096, 2, 2) && ok;
+	return ok ? 0 : 1;
+}
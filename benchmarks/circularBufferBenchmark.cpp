@@ -0,0 +1,296 @@
+// Test and benchmark for TPCircularBuffer's mirrored mapping, mainly for the
+// Linux backend (a memfd mapped twice, back to back), which nothing else in
+// the addon exercises. Meant to be run under ThreadSanitizer as well as
+// optimized.
+//
+//   SOURCES="circularBufferBenchmark.cpp ../src/TPCircularBuffer/TPCircularBuffer.c"
+//
+// It needs neither compat/ nor AudioToolbox. On macOS, build it with
+// -x c++ so TPCircularBuffer.c is compiled along with it as C++. Under
+// ThreadSanitizer:
+//
+//     g++ -std=c++14 -O1 -g -fsanitize=thread -I../src/TPCircularBuffer $SOURCES -lpthread -o circularBufferBenchmark
+//
+// "mirror" checks that a length is rounded up to whole pages and that bytes
+// written through either copy of the buffer show up in the other. "wrap"
+// produces and consumes odd-sized chunks on one thread, so nearly every
+// write and read straddles the end of the buffer, and checks every byte.
+// "threads" runs a producer and a consumer on their own threads with
+// numbered words in chunks of varying size, and checks that the consumer
+// sees every word, in order, exactly once. "throughput" times the same
+// transfer for a few chunk sizes, against a ring that splits each copy in
+// two at the end of the buffer (what you'd do without the mirror).
+
+#include "TPCircularBuffer.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#pragma mark - Mirror
+
+static bool mirror()
+{
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	const int32_t requested = 10000;
+
+	TPCircularBuffer buffer;
+	if(!TPCircularBufferInit(&buffer, requested)) {
+		printf("{\"benchmark\":\"mirror\",\"error\":\"init failed\",\"ok\":false}\n");
+		return false;
+	}
+
+	const int32_t length = buffer.length;
+	unsigned char * bytes = (unsigned char *)buffer.buffer;
+
+	for(int32_t i = 0; i < length; i++) bytes[i] = (unsigned char)(i * 7 + 1);
+	bool firstToSecond = true;
+	for(int32_t i = 0; i < length; i++) firstToSecond = firstToSecond && bytes[length + i] == (unsigned char)(i * 7 + 1);
+
+	for(int32_t i = 0; i < length; i++) bytes[length + i] = (unsigned char)(i * 13 + 5);
+	bool secondToFirst = true;
+	for(int32_t i = 0; i < length; i++) secondToFirst = secondToFirst && bytes[i] == (unsigned char)(i * 13 + 5);
+
+	TPCircularBufferCleanup(&buffer);
+
+	const bool rounded = length >= requested && length % pageSize == 0 && length - requested < pageSize;
+	const bool cleared = buffer.buffer == NULL && buffer.length == 0;
+	const bool ok = rounded && firstToSecond && secondToFirst && cleared;
+	printf("{\"benchmark\":\"mirror\",\"page_size\":%ld,\"requested\":%d,\"length\":%d,\"first_to_second\":%s,\"second_to_first\":%s,\"cleanup_cleared\":%s,\"ok\":%s}\n",
+		   pageSize, requested, length, firstToSecond ? "true" : "false", secondToFirst ? "true" : "false", cleared ? "true" : "false", ok ? "true" : "false");
+	return ok;
+}
+
+#pragma mark - Wrap
+
+static bool wrap()
+{
+	TPCircularBuffer buffer;
+	if(!TPCircularBufferInit(&buffer, 1)) return false;
+
+	// chunk sizes that don't divide the buffer, so the split point moves
+	// around on every lap
+	const int32_t chunks[] = {1, 97, 1021, 3001, 4093};
+	const int32_t total = quick ? (1 << 22) : (1 << 26);
+
+	unsigned int written = 0, read = 0, straddled = 0, wrong = 0;
+	unsigned int next = 0;
+
+	while(read < (unsigned int)total) {
+		const int32_t size = chunks[next++ % 5];
+
+		int32_t space;
+		unsigned char * head = (unsigned char *)TPCircularBufferHead(&buffer, &space);
+		if(head && space >= size) {
+			if(buffer.head + size > buffer.length) straddled++;
+			for(int32_t i = 0; i < size; i++) head[i] = (unsigned char)(written + i);
+			TPCircularBufferProduce(&buffer, size);
+			written += size;
+		}
+
+		int32_t available;
+		const unsigned char * tail = (const unsigned char *)TPCircularBufferTail(&buffer, &available);
+		const int32_t take = std::min(available, chunks[(next + 2) % 5]);
+		if(tail && take > 0) {
+			for(int32_t i = 0; i < take; i++) wrong += tail[i] != (unsigned char)(read + i);
+			TPCircularBufferConsume(&buffer, take);
+			read += take;
+		}
+	}
+
+	TPCircularBufferCleanup(&buffer);
+
+	const bool ok = wrong == 0 && straddled > 0;
+	printf("{\"benchmark\":\"wrap\",\"bytes\":%u,\"straddling_writes\":%u,\"wrong_bytes\":%u,\"ok\":%s}\n",
+		   read, straddled, wrong, ok ? "true" : "false");
+	return ok;
+}
+
+#pragma mark - Threads
+
+struct Transfer
+{
+	double seconds;
+	unsigned long long words;
+	unsigned long long errors;
+	unsigned long long laps;
+};
+
+// Sends `words` numbered 32-bit words from a producer thread to a consumer
+// thread in chunks of up to `chunkWords` (varying, unless `fixed`)
+static Transfer transfer(int32_t length, unsigned int chunkWords, bool fixed, unsigned long long words)
+{
+	TPCircularBuffer buffer;
+	Transfer result = {0, words, 0, 0};
+	if(!TPCircularBufferInit(&buffer, length)) {
+		result.errors = 1;
+		return result;
+	}
+
+	const Clock::time_point start = Clock::now();
+
+	std::thread producer([&]() {
+		unsigned long long sent = 0;
+		unsigned int step = 0;
+		while(sent < words) {
+			int32_t space;
+			uint32_t * head = (uint32_t *)TPCircularBufferHead(&buffer, &space);
+			unsigned int count = fixed ? chunkWords : 1 + (step++ * 2654435761u) % chunkWords;
+			count = (unsigned int)std::min<unsigned long long>(std::min<unsigned long long>(count, words - sent), space / sizeof(uint32_t));
+			if(!head || count == 0) {
+				std::this_thread::yield();
+				continue;
+			}
+			for(unsigned int i = 0; i < count; i++) head[i] = (uint32_t)(sent + i);
+			TPCircularBufferProduce(&buffer, count * sizeof(uint32_t));
+			sent += count;
+		}
+	});
+
+	unsigned long long received = 0, errors = 0;
+	while(received < words) {
+		int32_t available;
+		const uint32_t * tail = (const uint32_t *)TPCircularBufferTail(&buffer, &available);
+		if(!tail) {
+			std::this_thread::yield();
+			continue;
+		}
+		const unsigned int count = available / sizeof(uint32_t);
+		for(unsigned int i = 0; i < count; i++) errors += tail[i] != (uint32_t)(received + i);
+		TPCircularBufferConsume(&buffer, count * sizeof(uint32_t));
+		received += count;
+	}
+
+	producer.join();
+	result.seconds = secondsSince(start);
+	result.errors = errors;
+	result.laps = words * sizeof(uint32_t) / buffer.length;
+
+	TPCircularBufferCleanup(&buffer);
+	return result;
+}
+
+static bool threads()
+{
+	const unsigned long long words = quick ? (1ull << 22) : (1ull << 25);
+	const Transfer t = transfer(1, 1500, false, words);
+
+	const bool ok = t.errors == 0;
+	printf("{\"benchmark\":\"threads\",\"words\":%llu,\"laps\":%llu,\"errors\":%llu,\"ok\":%s}\n",
+		   t.words, t.laps, t.errors, ok ? "true" : "false");
+	return ok;
+}
+
+#pragma mark - Throughput
+
+// A plain ring without the mirror: copies that cross the end of the buffer
+// are split in two
+struct SplitRing
+{
+	std::vector<unsigned char> data;
+	std::atomic<int32_t> fillCount;
+	int32_t head, tail;
+
+	SplitRing(int32_t length) : data(length), fillCount(0), head(0), tail(0) { }
+
+	bool write(const void * src, int32_t size)
+	{
+		const int32_t length = data.size();
+		if(length - fillCount.load(std::memory_order_acquire) < size) return false;
+		const int32_t first = std::min(size, length - head);
+		memcpy(&data[head], src, first);
+		memcpy(&data[0], (const unsigned char *)src + first, size - first);
+		head = (head + size) % length;
+		fillCount.fetch_add(size, std::memory_order_release);
+		return true;
+	}
+
+	int32_t read(void * dst, int32_t size)
+	{
+		const int32_t length = data.size();
+		size = std::min(size, fillCount.load(std::memory_order_acquire));
+		const int32_t first = std::min(size, length - tail);
+		memcpy(dst, &data[tail], first);
+		memcpy((unsigned char *)dst + first, &data[0], size - first);
+		tail = (tail + size) % length;
+		fillCount.fetch_sub(size, std::memory_order_release);
+		return size;
+	}
+};
+
+// the same copy in and copy out on both, single threaded, so the numbers
+// are about the copies and not the scheduler
+static void throughput(int32_t chunkBytes)
+{
+	const long long total = quick ? (1ll << 28) : (1ll << 31);
+	const long long rounds = total / chunkBytes;
+	std::vector<unsigned char> in(chunkBytes, 1), out(chunkBytes);
+
+	TPCircularBuffer buffer;
+	if(!TPCircularBufferInit(&buffer, 65536)) return;
+	// offset by a byte, so copies keep straddling the end of the buffer
+	TPCircularBufferProduceBytes(&buffer, &in[0], 1);
+	{
+		int32_t available;
+		TPCircularBufferTail(&buffer, &available);
+		TPCircularBufferConsume(&buffer, available);
+	}
+
+	unsigned long long sink = 0;
+	Clock::time_point start = Clock::now();
+	for(long long r = 0; r < rounds; r++) {
+		TPCircularBufferProduceBytes(&buffer, &in[0], chunkBytes);
+		int32_t available;
+		const void * tail = TPCircularBufferTail(&buffer, &available);
+		memcpy(&out[0], tail, chunkBytes);
+		TPCircularBufferConsume(&buffer, chunkBytes);
+		sink += out[r % chunkBytes];
+	}
+	const double mirroredSeconds = secondsSince(start);
+	TPCircularBufferCleanup(&buffer);
+
+	SplitRing ring(65536);
+	ring.write(&in[0], 1);
+	ring.read(&out[0], 1);
+	start = Clock::now();
+	for(long long r = 0; r < rounds; r++) {
+		ring.write(&in[0], chunkBytes);
+		ring.read(&out[0], chunkBytes);
+		sink += out[r % chunkBytes];
+	}
+	const double splitSeconds = secondsSince(start);
+
+	const double megabytes = (double)rounds * chunkBytes / (1 << 20);
+	printf("{\"benchmark\":\"throughput\",\"chunk_bytes\":%d,\"ring_bytes\":65536,\"mb\":%.0f,\"mirrored_mb_per_s\":%.0f,\"split_mb_per_s\":%.0f,\"check\":%llu}\n",
+		   chunkBytes, megabytes, megabytes / mirroredSeconds, megabytes / splitSeconds, sink);
+}
+
+static void threadedThroughput(unsigned int chunkWords)
+{
+	const unsigned long long words = quick ? (1ull << 23) : (1ull << 26);
+	const Transfer t = transfer(65536, chunkWords, true, words);
+	const double megabytes = (double)t.words * sizeof(uint32_t) / (1 << 20);
+	printf("{\"benchmark\":\"threaded_throughput\",\"chunk_bytes\":%u,\"ring_bytes\":65536,\"mb\":%.0f,\"mb_per_s\":%.0f,\"errors\":%llu}\n",
+		   chunkWords * (unsigned int)sizeof(uint32_t), megabytes, megabytes / t.seconds, t.errors);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+	ok = mirror() && ok;
+	ok = wrap() && ok;
+	ok = threads() && ok;
+
+	const int32_t chunks[] = {64, 512, 4096};
+	for(int c = 0; c < 3; c++) throughput(chunks[c]);
+	for(int c = 0; c < 3; c++) threadedThroughput(chunks[c] / sizeof(uint32_t));
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+// Just enough of vDSP to build the analysis code on platforms without
+// Accelerate (i.e. for running the benchmarks on Linux). These are plain
+// reference implementations with vDSP's packing and scaling, not its speed:
+// timings taken with them say how the code scales, not how fast it runs on
+// a Mac. Don't put this directory on the include path when building on a Mac.
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <vector>
+
+typedef unsigned long vDSP_Length;
+typedef long vDSP_Stride;
+
+typedef struct DSPComplex {
+	float real;
+	float imag;
+} DSPComplex;
+
+typedef struct DSPSplitComplex {
+	float * realp;
+	float * imagp;
+} DSPSplitComplex;
+
+typedef DSPComplex COMPLEX;
+typedef DSPSplitComplex COMPLEX_SPLIT;
+
+typedef int FFTDirection;
+typedef int FFTRadix;
+enum { kFFTDirection_Forward = 1, kFFTDirection_Inverse = -1 };
+enum { kFFTRadix2 = 0 };
+
+// twiddles for transforms of up to 2^log2n points
+struct OpaqueFFTSetup
+{
+	vDSP_Length maxSize;
+	std::vector<float> cosine; // cos(2 pi j / maxSize), j < maxSize / 2
+	std::vector<float> sine;
+};
+
+typedef struct OpaqueFFTSetup * FFTSetup;
+
+inline FFTSetup vDSP_create_fftsetup(vDSP_Length log2n, FFTRadix)
+{
+	FFTSetup setup = new OpaqueFFTSetup;
+	setup->maxSize = (vDSP_Length)1 << log2n;
+	const vDSP_Length half = std::max<vDSP_Length>(setup->maxSize / 2, 1);
+	setup->cosine.resize(half);
+	setup->sine.resize(half);
+	for(vDSP_Length j = 0; j < half; j++) {
+		setup->cosine[j] = cos(2 * M_PI * j / setup->maxSize);
+		setup->sine[j] = sin(2 * M_PI * j / setup->maxSize);
+	}
+	return setup;
+}
+
+inline void vDSP_destroy_fftsetup(FFTSetup setup)
+{
+	delete setup;
+}
+
+namespace vDSPCompat {
+	// in-place radix 2 transform of n points, unscaled either way
+	inline void Transform(const OpaqueFFTSetup * setup, float * re, float * im, vDSP_Stride stride, vDSP_Length n, int direction)
+	{
+		for(vDSP_Length i = 1, j = 0; i < n; i++) {
+			vDSP_Length bit = n >> 1;
+			for(; j & bit; bit >>= 1) j ^= bit;
+			j |= bit;
+			if(i < j) {
+				std::swap(re[i * stride], re[j * stride]);
+				std::swap(im[i * stride], im[j * stride]);
+			}
+		}
+
+		for(vDSP_Length length = 2; length <= n; length <<= 1) {
+			const vDSP_Length step = setup->maxSize / length;
+			for(vDSP_Length start = 0; start < n; start += length) {
+				for(vDSP_Length k = 0; k < length / 2; k++) {
+					const float wr = setup->cosine[k * step];
+					const float wi = -direction * setup->sine[k * step];
+					const vDSP_Length a = (start + k) * stride;
+					const vDSP_Length b = (start + k + length / 2) * stride;
+					const float tr = re[b] * wr - im[b] * wi;
+					const float ti = re[b] * wi + im[b] * wr;
+					re[b] = re[a] - tr;
+					im[b] = im[a] - ti;
+					re[a] += tr;
+					im[a] += ti;
+				}
+			}
+		}
+	}
+}
+
+// complex transform, unscaled either way
+inline void vDSP_fft_zip(FFTSetup setup, const DSPSplitComplex * c, vDSP_Stride stride, vDSP_Length log2n, FFTDirection direction)
+{
+	vDSPCompat::Transform(setup, c->realp, c->imagp, stride, (vDSP_Length)1 << log2n, direction);
+}
+
+// Real transform of 2^log2n points packed as even / odd pairs (see
+// vDSP_ctoz). Forward results are twice the DFT, with the purely real DC and
+// Nyquist bins in realp[0] and imagp[0]; the inverse is unscaled, so a round
+// trip scales by 2^(log2n + 1)
+inline void vDSP_fft_zrip(FFTSetup setup, const DSPSplitComplex * c, vDSP_Stride stride, vDSP_Length log2n, FFTDirection direction)
+{
+	const vDSP_Length n = (vDSP_Length)1 << log2n;
+	const vDSP_Length m = n / 2;
+	const vDSP_Length step = setup->maxSize / n;
+	float * re = c->realp;
+	float * im = c->imagp;
+
+	if(m == 0) return;
+
+	if(direction == kFFTDirection_Forward) {
+		vDSPCompat::Transform(setup, re, im, stride, m, kFFTDirection_Forward);
+
+		const float r0 = re[0], i0 = im[0];
+		re[0] = 2 * (r0 + i0);
+		im[0] = 2 * (r0 - i0);
+
+		for(vDSP_Length k = 1; k <= m / 2; k++) {
+			const vDSP_Length a = k * stride, b = (m - k) * stride;
+			// even and odd halves of bins k and m - k
+			const float er = re[a] + re[b], ei = im[a] - im[b];
+			const float or_ = im[a] + im[b], oi = re[b] - re[a];
+			const float wr = setup->cosine[k * step], wi = -setup->sine[k * step];
+			const float tr = or_ * wr - oi * wi, ti = or_ * wi + oi * wr;
+			re[a] = er + tr;
+			im[a] = ei + ti;
+			re[b] = er - tr;
+			im[b] = ti - ei;
+		}
+	} else {
+		const float y0 = re[0], ym = im[0];
+		re[0] = y0 + ym;
+		im[0] = y0 - ym;
+
+		for(vDSP_Length k = 1; k <= m / 2; k++) {
+			const vDSP_Length a = k * stride, b = (m - k) * stride;
+			const float er = re[a] + re[b], ei = im[a] - im[b];
+			const float dr = re[a] - re[b], di = im[a] + im[b];
+			const float wr = setup->cosine[k * step], wi = setup->sine[k * step];
+			const float or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+			re[a] = er - oi;
+			im[a] = ei + or_;
+			re[b] = er + oi;
+			im[b] = or_ - ei;
+		}
+
+		vDSPCompat::Transform(setup, re, im, stride, m, kFFTDirection_Inverse);
+	}
+}
+
+inline void vDSP_ctoz(const DSPComplex * c, vDSP_Stride ic, const DSPSplitComplex * z, vDSP_Stride iz, vDSP_Length n)
+{
+	for(vDSP_Length i = 0; i < n; i++) {
+		z->realp[i * iz] = c[i * ic / 2].real;
+		z->imagp[i * iz] = c[i * ic / 2].imag;
+	}
+}
+
+inline void vDSP_ztoc(const DSPSplitComplex * z, vDSP_Stride iz, DSPComplex * c, vDSP_Stride ic, vDSP_Length n)
+{
+	for(vDSP_Length i = 0; i < n; i++) {
+		c[i * ic / 2].real = z->realp[i * iz];
+		c[i * ic / 2].imag = z->imagp[i * iz];
+	}
+}
+
+inline void vDSP_zvmags(const DSPSplitComplex * a, vDSP_Stride ia, float * c, vDSP_Stride ic, vDSP_Length n)
+{
+	for(vDSP_Length i = 0; i < n; i++) {
+		const float re = a->realp[i * ia], im = a->imagp[i * ia];
+		c[i * ic] = re * re + im * im;
+	}
+}
+
+inline void vDSP_zvabs(const DSPSplitComplex * a, vDSP_Stride ia, float * c, vDSP_Stride ic, vDSP_Length n)
+{
+	for(vDSP_Length i = 0; i < n; i++) {
+		c[i * ic] = hypotf(a->realp[i * ia], a->imagp[i * ia]);
+	}
+}
+
+// d = a * b + c
+inline void vDSP_zvma(const DSPSplitComplex * a, vDSP_Stride ia, const DSPSplitComplex * b, vDSP_Stride ib,
+                      const DSPSplitComplex * c, vDSP_Stride ic, const DSPSplitComplex * d, vDSP_Stride id, vDSP_Length n)
+{
+	for(vDSP_Length i = 0; i < n; i++) {
+		const float ar = a->realp[i * ia], ai = a->imagp[i * ia];
+		const float br = b->realp[i * ib], bi = b->imagp[i * ib];
+		const float re = ar * br - ai * bi + c->realp[i * ic];
+		const float im = ar * bi + ai * br + c->imagp[i * ic];
+		d->realp[i * id] = re;
+		d->imagp[i * id] = im;
+	}
+}
+
+inline void vDSP_vclr(float * c, vDSP_Stride ic, vDSP_Length n)
+{
+	for(vDSP_Length i = 0; i < n; i++) c[i * ic] = 0;
+}
+
+inline void vDSP_vsmul(const float * a, vDSP_Stride ia, const float * b, float * c, vDSP_Stride ic, vDSP_Length n)
+{
+	const float scale = *b;
+	for(vDSP_Length i = 0; i < n; i++) c[i * ic] = a[i * ia] * scale;
+}
+
+inline void vDSP_vclip(const float * a, vDSP_Stride ia, const float * low, const float * high, float * c, vDSP_Stride ic, vDSP_Length n)
+{
+	for(vDSP_Length i = 0; i < n; i++) c[i * ic] = std::min(std::max(a[i * ia], *low), *high);
+}
+
+// flag 0 for power, 1 for amplitude
+inline void vDSP_vdbcon(const float * a, vDSP_Stride ia, const float * b, float * c, vDSP_Stride ic, vDSP_Length n, unsigned int flag)
+{
+	const float factor = flag ? 20 : 10;
+	for(vDSP_Length i = 0; i < n; i++) c[i * ic] = factor * log10f(a[i * ia] / *b);
+}
+
+inline void vDSP_sve(const float * a, vDSP_Stride ia, float * c, vDSP_Length n)
+{
+	float sum = 0;
+	for(vDSP_Length i = 0; i < n; i++) sum += a[i * ia];
+	*c = sum;
+}
+
+inline void vDSP_svesq(const float * a, vDSP_Stride ia, float * c, vDSP_Length n)
+{
+	float sum = 0;
+	for(vDSP_Length i = 0; i < n; i++) sum += a[i * ia] * a[i * ia];
+	*c = sum;
+}
+
+inline void vDSP_maxv(const float * a, vDSP_Stride ia, float * c, vDSP_Length n)
+{
+	float peak = -INFINITY;
+	for(vDSP_Length i = 0; i < n; i++) peak = std::max(peak, a[i * ia]);
+	*c = peak;
+}
+
+// flag 0: the full, unnormalized window
+inline void vDSP_hann_window(float * c, vDSP_Length n, int)
+{
+	for(vDSP_Length i = 0; i < n; i++) c[i] = 0.5 * (1 - cos(2 * M_PI * i / n));
+}
+
+inline void vDSP_hamm_window(float * c, vDSP_Length n, int)
+{
+	for(vDSP_Length i = 0; i < n; i++) c[i] = 0.54 - 0.46 * cos(2 * M_PI * i / n);
+}
+
+inline void vDSP_blkman_window(float * c, vDSP_Length n, int)
+{
+	for(vDSP_Length i = 0; i < n; i++) c[i] = 0.42 - 0.5 * cos(2 * M_PI * i / n) + 0.08 * cos(4 * M_PI * i / n);
+}
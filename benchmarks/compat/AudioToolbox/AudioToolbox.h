@@ -0,0 +1,64 @@
+#pragma once
+
+// Just enough of AudioToolbox's types to build the capture path on
+// platforms without Core Audio (i.e. for running the benchmarks on Linux).
+// Don't put this directory on the include path when building on a Mac.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef float    Float32;
+typedef double   Float64;
+typedef uint8_t  UInt8;
+typedef uint16_t UInt16;
+typedef int16_t  SInt16;
+typedef uint32_t UInt32;
+typedef int32_t  SInt32;
+typedef uint64_t UInt64;
+typedef int64_t  SInt64;
+typedef SInt32   OSStatus;
+
+enum { noErr = 0 };
+
+struct AudioBuffer
+{
+	UInt32 mNumberChannels;
+	UInt32 mDataByteSize;
+	void * mData;
+};
+
+struct AudioBufferList
+{
+	UInt32 mNumberBuffers;
+	AudioBuffer mBuffers[1];
+};
+
+enum { kAudioTimeStampSampleTimeValid = 1 << 0, kAudioTimeStampHostTimeValid = 1 << 1 };
+
+struct AudioTimeStamp
+{
+	Float64 mSampleTime;
+	UInt64  mHostTime;
+	Float64 mRateScalar;
+	UInt64  mWordClockTime;
+	UInt32  mFlags;
+	UInt32  mReserved;
+};
+
+enum { kAudioUnitErr_TooManyFramesToProcess = -10874 };
+
+typedef struct ComponentInstanceRecord * AudioUnit;
+typedef UInt32 AudioUnitRenderActionFlags;
+
+typedef OSStatus (*AURenderCallback)(void * inRefCon,
+									 AudioUnitRenderActionFlags * ioActionFlags,
+									 const AudioTimeStamp * inTimeStamp,
+									 UInt32 inBusNumber,
+									 UInt32 inNumberFrames,
+									 AudioBufferList * ioData);
+
+struct AURenderCallbackStruct
+{
+	AURenderCallback inputProc;
+	void * inputProcRefCon;
+};
@@ -0,0 +1,232 @@
+// Benchmarks for ofxAudioUnitConstantQ, the transform behind
+// ofxAudioUnitConstantQNode.
+//
+//   SOURCES="constantQBenchmark.cpp ../src/ofxAudioUnitConstantQ.cpp ../src/ofxAudioUnitFftCache.cpp"
+//
+// "accuracy" runs the sparse spectral kernels and a direct constant-Q
+// transform (every bin's windowed complex exponential correlated with the
+// end of the window in double precision, no FFT, nothing dropped) over the
+// same signals: full-scale sines on bin centers, a chord between bins, and
+// white noise. The largest difference over all bins, relative to the
+// largest bin, has to stay within a small multiple of the kernels'
+// sparsity threshold, and a sine on a bin's center has to read as about 1
+// there. "cost" times building the kernels, one sparse transform, and one
+// direct one, for a few bin resolutions.
+
+#include "ofxAudioUnitConstantQ.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#pragma mark - Direct transform
+
+// the textbook definition, with the same kernels the sparse version starts
+// from (Hamming windowed, aligned to the end of the window)
+struct DirectConstantQ
+{
+	std::vector<std::vector<double> > real;
+	std::vector<std::vector<double> > imag;
+	unsigned int fftSize;
+
+	DirectConstantQ(const ofxAudioUnitConstantQ &cqt)
+	: fftSize(cqt.getFftSize())
+	{
+		const ofxAudioUnitConstantQ::Settings &settings = cqt.getSettings();
+		const double Q = 1.0 / (pow(2.0, 1.0 / settings.binsPerOctave) - 1.0);
+
+		for(unsigned int k = 0; k < cqt.getNumBins(); k++) {
+			const double frequency = settings.minFrequency * pow(2.0, k / (double)settings.binsPerOctave);
+			const unsigned int length = std::min<unsigned int>(fftSize, ceil(Q * cqt.getSampleRate() / frequency));
+
+			std::vector<double> window(length);
+			double windowSum = 0;
+			for(unsigned int n = 0; n < length; n++) {
+				window[n] = 0.54 - 0.46 * cos(2 * M_PI * n / length);
+				windowSum += window[n];
+			}
+
+			real.push_back(std::vector<double>(length));
+			imag.push_back(std::vector<double>(length));
+			for(unsigned int n = 0; n < length; n++) {
+				const double phase = 2 * M_PI * Q * n / length;
+				real.back()[n] = 2 * window[n] / windowSum * cos(phase);
+				imag.back()[n] = 2 * window[n] / windowSum * sin(phase);
+			}
+		}
+	}
+
+	void transform(const Float32 * x, float * amplitude) const
+	{
+		for(size_t k = 0; k < real.size(); k++) {
+			const size_t length = real[k].size();
+			const Float32 * end = x + fftSize - length;
+			double re = 0, im = 0;
+			for(size_t n = 0; n < length; n++) {
+				re += end[n] * real[k][n];
+				im -= end[n] * imag[k][n];
+			}
+			amplitude[k] = sqrt(re * re + im * im);
+		}
+	}
+};
+
+#pragma mark - Signals
+
+static void addSine(std::vector<Float32> &x, double frequency, double amplitude, double phase, double sampleRate)
+{
+	for(size_t i = 0; i < x.size(); i++) x[i] += amplitude * sin(2 * M_PI * frequency * i / sampleRate + phase);
+}
+
+static void addNoise(std::vector<Float32> &x, double amplitude, unsigned int seed)
+{
+	for(size_t i = 0; i < x.size(); i++) {
+		seed = seed * 1664525u + 1013904223u;
+		x[i] += amplitude * ((seed >> 8) / 8388608.0 - 1);
+	}
+}
+
+#pragma mark - Cases
+
+static bool compare(const char * signal, const ofxAudioUnitConstantQ::Settings &settings, Float64 sampleRate,
+                    const std::vector<Float32> &x, int centeredBin, double allowance = 2)
+{
+	ofxAudioUnitConstantQ cqt;
+	cqt.setup(settings, sampleRate);
+	const DirectConstantQ direct(cqt);
+
+	std::vector<float> sparse(cqt.getNumBins()), reference(cqt.getNumBins());
+	cqt.transform(&x[0], &sparse[0]);
+	direct.transform(&x[0], &reference[0]);
+
+	double peak = 0, worst = 0;
+	unsigned int worstBin = 0;
+	for(size_t k = 0; k < sparse.size(); k++) {
+		peak = std::max<double>(peak, reference[k]);
+		const double error = fabs(sparse[k] - reference[k]);
+		if(error > worst) {
+			worst = error;
+			worstBin = k;
+		}
+	}
+
+	// dropping kernel values under the threshold leaves errors of around
+	// that size, relative to the peak
+	const double relative = peak > 0 ? worst / peak : 0;
+	const double limit = allowance * settings.sparsityThreshold;
+	bool ok = relative < limit;
+
+	double centered = 0;
+	if(centeredBin >= 0) {
+		centered = sparse[centeredBin];
+		ok = ok && fabs(centered - 1) < 0.05;
+	}
+
+	printf("{\"benchmark\":\"accuracy\",\"signal\":\"%s\",\"sample_rate\":%.0f,\"bins_per_octave\":%u,\"bins\":%u,\"fft_size\":%u,\"max_error\":%.6f,\"max_error_db\":%.1f,\"worst_bin\":%u,\"limit_db\":%.1f",
+		   signal, sampleRate, settings.binsPerOctave, cqt.getNumBins(), cqt.getFftSize(), relative, 20 * log10(std::max(relative, 1e-12)),
+		   worstBin, 20 * log10(limit));
+	if(centeredBin >= 0) printf(",\"centered_bin\":%d,\"centered_amplitude\":%.4f", centeredBin, centered);
+	printf(",\"ok\":%s}\n", ok ? "true" : "false");
+	return ok;
+}
+
+static bool accuracy(Float64 sampleRate, unsigned int binsPerOctave)
+{
+	ofxAudioUnitConstantQ::Settings settings;
+	settings.binsPerOctave = binsPerOctave;
+
+	ofxAudioUnitConstantQ cqt;
+	cqt.setup(settings, sampleRate);
+	const unsigned int bins = cqt.getNumBins();
+
+	bool ok = true;
+
+	// sines on bin centers, low, middle and high
+	const unsigned int centered[] = {binsPerOctave / 2, bins / 2, bins - binsPerOctave / 2};
+	for(int c = 0; c < 3; c++) {
+		std::vector<Float32> x(cqt.getFftSize(), 0);
+		addSine(x, cqt.getBinFrequency(centered[c]), 1, 0.3 * c, sampleRate);
+		ok = compare("sine", settings, sampleRate, x, centered[c]) && ok;
+	}
+
+	// a chord a third of a bin off, over some noise
+	{
+		std::vector<Float32> x(cqt.getFftSize(), 0);
+		const double third = pow(2.0, 1.0 / (3.0 * binsPerOctave));
+		addSine(x, 110 * third, 0.3, 0, sampleRate);
+		addSine(x, 138.59 * third, 0.3, 1, sampleRate);
+		addSine(x, 164.81 * third, 0.3, 2, sampleRate);
+		addNoise(x, 0.01, 3);
+		ok = compare("chord", settings, sampleRate, x, -1) && ok;
+	}
+
+	{
+		std::vector<Float32> x(cqt.getFftSize(), 0);
+		addNoise(x, 0.5, 11);
+		// noise has energy under every value that was dropped, so the
+		// errors add up
+		ok = compare("noise", settings, sampleRate, x, -1, 4) && ok;
+	}
+
+	return ok;
+}
+
+static void cost(unsigned int binsPerOctave)
+{
+	const Float64 sampleRate = 48000;
+	ofxAudioUnitConstantQ::Settings settings;
+	settings.binsPerOctave = binsPerOctave;
+
+	ofxAudioUnitConstantQ cqt;
+	const Clock::time_point setupStart = Clock::now();
+	cqt.setup(settings, sampleRate);
+	const double setupSeconds = secondsSince(setupStart);
+
+	const DirectConstantQ direct(cqt);
+
+	std::vector<Float32> x(cqt.getFftSize(), 0);
+	addNoise(x, 0.5, 5);
+	std::vector<float> amplitude(cqt.getNumBins());
+
+	const unsigned int runs = quick ? 20 : 200;
+	float sink = 0;
+
+	Clock::time_point start = Clock::now();
+	for(unsigned int r = 0; r < runs; r++) {
+		cqt.transform(&x[0], &amplitude[0]);
+		sink += amplitude[0];
+	}
+	const double sparseSeconds = secondsSince(start) / runs;
+
+	const unsigned int directRuns = std::max(1u, runs / 10);
+	start = Clock::now();
+	for(unsigned int r = 0; r < directRuns; r++) {
+		direct.transform(&x[0], &amplitude[0]);
+		sink += amplitude[0];
+	}
+	const double directSeconds = secondsSince(start) / directRuns;
+
+	// the node transforms once per hop, 512 frames by default
+	const double hop = 512 / sampleRate;
+	printf("{\"benchmark\":\"cost\",\"bins_per_octave\":%u,\"bins\":%u,\"fft_size\":%u,\"kernel_values\":%zu,\"setup_ms\":%.2f,\"sparse_us\":%.1f,\"direct_us\":%.1f,\"speedup\":%.1f,\"load_at_hop_512\":%.4f,\"check\":%.3f}\n",
+		   binsPerOctave, cqt.getNumBins(), cqt.getFftSize(), cqt.getKernelSize(), setupSeconds * 1e3,
+		   sparseSeconds * 1e6, directSeconds * 1e6, directSeconds / sparseSeconds, sparseSeconds / hop, sink / (runs + directRuns));
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+	ok = accuracy(44100, 12) && ok;
+	ok = accuracy(48000, 12) && ok;
+	ok = accuracy(48000, 24) && ok;
+	cost(12);
+	cost(24);
+	cost(36);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,350 @@
+// Benchmarks for ofxAudioUnitSampleConverter against the plain scalar loops
+// it replaces.
+//
+//   SOURCES="converterBenchmark.cpp ../src/ofxAudioUnitSampleConverter.cpp"
+//
+// "exact" checks that undithered conversions come out bit for bit the same
+// as the scalar reference, both ways, for every format, including samples
+// past full scale and halfway between two integers.
+// "interleave", "deinterleave" and "quantize" time both over the same
+// buffers, in millions of samples a second, with the speedup.
+// "dither" measures the quantization error of a quiet signal at 16 bits:
+// its mean and power, how much that power moves with the signal (it shouldn't
+// with dither), and how much of it is below 4 kHz, where noise shaping
+// should have taken it out.
+
+#include "ofxAudioUnitSampleConverter.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const double kSampleRate = 48000;
+
+static const char * formatName(ofxAudioUnitSampleFormat format)
+{
+	switch(format) {
+		case OFXAU_SAMPLE_INT16:   return "int16";
+		case OFXAU_SAMPLE_INT24:   return "int24";
+		case OFXAU_SAMPLE_INT32:   return "int32";
+		case OFXAU_SAMPLE_FLOAT32: return "float32";
+		case OFXAU_SAMPLE_FLOAT64: return "float64";
+	}
+	return "?";
+}
+
+static const char * ditherName(ofxAudioUnitDither dither)
+{
+	switch(dither) {
+		case OFXAU_DITHER_NONE:   return "none";
+		case OFXAU_DITHER_TPDF:   return "tpdf";
+		case OFXAU_DITHER_SHAPED: return "shaped";
+	}
+	return "?";
+}
+
+static const ofxAudioUnitSampleFormat kFormats[] = {OFXAU_SAMPLE_INT16, OFXAU_SAMPLE_INT24, OFXAU_SAMPLE_INT32, OFXAU_SAMPLE_FLOAT32, OFXAU_SAMPLE_FLOAT64};
+static const size_t kNumFormats = sizeof(kFormats) / sizeof(kFormats[0]);
+
+#pragma mark - Scalar reference
+
+// what ofxAudioUnitWavWriter and ofxAudioUnitFlacWriter did before
+static inline SInt32 ReferenceQuantize(Float32 sample, double scale)
+{
+	const double x = std::min(std::max(sample * scale, -scale), scale - 1);
+	return (SInt32)lrint(x);
+}
+
+static void referenceInterleave(const Float32 * const * planes, unsigned int channels, size_t frames, ofxAudioUnitSampleFormat format, unsigned char * out)
+{
+	const unsigned int sampleBytes = ofxAudioUnitSampleConverter::bytesPerSample(format);
+	const size_t frameBytes = sampleBytes * channels;
+
+	for(unsigned int c = 0; c < channels; c++) {
+		const Float32 * in = planes[c];
+		unsigned char * o = out + c * sampleBytes;
+
+		for(size_t i = 0; i < frames; i++, o += frameBytes) {
+			UInt64 v = 0;
+			switch(format) {
+				case OFXAU_SAMPLE_INT16: v = (UInt32)ReferenceQuantize(in[i], 32768.); break;
+				case OFXAU_SAMPLE_INT24: v = (UInt32)ReferenceQuantize(in[i], 8388608.); break;
+				case OFXAU_SAMPLE_INT32: v = (UInt32)ReferenceQuantize(in[i], 2147483648.); break;
+				case OFXAU_SAMPLE_FLOAT32: {UInt32 bits; memcpy(&bits, &in[i], 4); v = bits; break;}
+				case OFXAU_SAMPLE_FLOAT64: {const double x = in[i]; memcpy(&v, &x, 8); break;}
+			}
+			for(unsigned int b = 0; b < sampleBytes; b++) o[b] = v >> (8 * b);
+		}
+	}
+}
+
+static void referenceDeinterleave(const unsigned char * in, ofxAudioUnitSampleFormat format, unsigned int channels, size_t frames, Float32 * const * planes)
+{
+	const unsigned int sampleBytes = ofxAudioUnitSampleConverter::bytesPerSample(format);
+	const size_t frameBytes = sampleBytes * channels;
+
+	for(unsigned int c = 0; c < channels; c++) {
+		const unsigned char * p = in + c * sampleBytes;
+		for(size_t i = 0; i < frames; i++, p += frameBytes) {
+			UInt64 v = 0;
+			for(unsigned int b = 0; b < sampleBytes; b++) v |= (UInt64)p[b] << (8 * b);
+
+			Float32 x = 0;
+			switch(format) {
+				case OFXAU_SAMPLE_INT16: x = (SInt16)v * (1.f / 32768.f); break;
+				case OFXAU_SAMPLE_INT24: x = ((SInt32)(v << 8) >> 8) * (1.f / 8388608.f); break;
+				case OFXAU_SAMPLE_INT32: x = (SInt32)v * (1.f / 2147483648.f); break;
+				case OFXAU_SAMPLE_FLOAT32: {UInt32 bits = v; memcpy(&x, &bits, 4); break;}
+				case OFXAU_SAMPLE_FLOAT64: {double d; memcpy(&d, &v, 8); x = d; break;}
+			}
+			planes[c][i] = x;
+		}
+	}
+}
+
+#pragma mark - Material
+
+// Music-like levels, with some of everything awkward mixed in: samples past
+// full scale, and samples exactly halfway between two integers
+struct Material
+{
+	std::vector<Float32> samples;
+	std::vector<const Float32 *> planes;
+	std::vector<Float32 *> outPlanes;
+	std::vector<Float32> out;
+	unsigned int channels;
+	size_t frames;
+
+	Material(unsigned int channelCount, size_t frameCount)
+	: samples(channelCount * frameCount)
+	, planes(channelCount)
+	, outPlanes(channelCount)
+	, out(channelCount * frameCount)
+	, channels(channelCount)
+	, frames(frameCount)
+	{
+		srand(channelCount);
+		for(size_t i = 0; i < samples.size(); i++) {
+			const double noise = (rand() % 20001 - 10000) / 10000.;
+			switch(rand() % 8) {
+				case 0:  samples[i] = noise * 1.5; break; // clipping
+				case 1:  samples[i] = (rand() % 65536 - 32768 + 0.5) / 32768.; break;
+				case 2:  samples[i] = (rand() % 16777216 - 8388608 + 0.5) / 8388608.; break;
+				default: samples[i] = 0.5 * sin(i * 0.01) + 0.01 * noise; break;
+			}
+		}
+		for(unsigned int c = 0; c < channels; c++) {
+			planes[c] = &samples[c * frames];
+			outPlanes[c] = &out[c * frames];
+		}
+	}
+};
+
+template<typename F>
+static double timeIt(F f, size_t samples)
+{
+	// best of a few, in millions of samples a second
+	double best = 1e9;
+	for(int run = 0; run < (quick ? 3 : 10); run++) {
+		const Clock::time_point start = Clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+	}
+	return samples / best * 1e-6;
+}
+
+#pragma mark - Cases
+
+static bool exact(ofxAudioUnitSampleFormat format, unsigned int channels)
+{
+	Material material(channels, 9999); // not a multiple of anything
+	const size_t bytes = material.samples.size() * ofxAudioUnitSampleConverter::bytesPerSample(format);
+	std::vector<unsigned char> expected(bytes), actual(bytes);
+
+	referenceInterleave(&material.planes[0], channels, material.frames, format, &expected[0]);
+	ofxAudioUnitSampleConverter converter;
+	converter.interleave(&material.planes[0], channels, material.frames, &actual[0], format);
+
+	size_t byteMismatches = 0;
+	for(size_t i = 0; i < bytes; i++) byteMismatches += expected[i] != actual[i];
+
+	std::vector<Float32> reference(material.samples.size());
+	std::vector<Float32 *> referencePlanes(channels);
+	for(unsigned int c = 0; c < channels; c++) referencePlanes[c] = &reference[c * material.frames];
+	referenceDeinterleave(&expected[0], format, channels, material.frames, &referencePlanes[0]);
+	ofxAudioUnitSampleConverter::deinterleave(&expected[0], format, channels, material.frames, &material.outPlanes[0]);
+
+	size_t sampleMismatches = 0;
+	for(size_t i = 0; i < reference.size(); i++) sampleMismatches += memcmp(&reference[i], &material.out[i], sizeof(Float32)) != 0;
+
+	const bool ok = byteMismatches == 0 && sampleMismatches == 0;
+	printf("{\"benchmark\":\"exact\",\"format\":\"%s\",\"channels\":%u,\"frames\":%zu,\"interleave_mismatched_bytes\":%zu,\"deinterleave_mismatched_samples\":%zu,\"ok\":%s}\n",
+		   formatName(format), channels, material.frames, byteMismatches, sampleMismatches, ok ? "true" : "false");
+	return ok;
+}
+
+static void interleave(ofxAudioUnitSampleFormat format, unsigned int channels, ofxAudioUnitDither dither)
+{
+	Material material(channels, (quick ? 1 << 18 : 1 << 20) / channels);
+	std::vector<unsigned char> out(material.samples.size() * ofxAudioUnitSampleConverter::bytesPerSample(format));
+	ofxAudioUnitSampleConverter converter(dither);
+
+	const double scalar = timeIt([&] {referenceInterleave(&material.planes[0], channels, material.frames, format, &out[0]);}, material.samples.size());
+	const double vector = timeIt([&] {converter.interleave(&material.planes[0], channels, material.frames, &out[0], format);}, material.samples.size());
+
+	printf("{\"benchmark\":\"interleave\",\"format\":\"%s\",\"channels\":%u,\"dither\":\"%s\",\"scalar_msamples_per_sec\":%.1f,\"converter_msamples_per_sec\":%.1f,\"speedup\":%.2f}\n",
+		   formatName(format), channels, ditherName(dither), scalar, vector, vector / scalar);
+}
+
+static void deinterleave(ofxAudioUnitSampleFormat format, unsigned int channels)
+{
+	Material material(channels, (quick ? 1 << 18 : 1 << 20) / channels);
+	std::vector<unsigned char> in(material.samples.size() * ofxAudioUnitSampleConverter::bytesPerSample(format));
+	ofxAudioUnitSampleConverter().interleave(&material.planes[0], channels, material.frames, &in[0], format);
+
+	const double scalar = timeIt([&] {referenceDeinterleave(&in[0], format, channels, material.frames, &material.outPlanes[0]);}, material.samples.size());
+	const double vector = timeIt([&] {ofxAudioUnitSampleConverter::deinterleave(&in[0], format, channels, material.frames, &material.outPlanes[0]);}, material.samples.size());
+
+	printf("{\"benchmark\":\"deinterleave\",\"format\":\"%s\",\"channels\":%u,\"scalar_msamples_per_sec\":%.1f,\"converter_msamples_per_sec\":%.1f,\"speedup\":%.2f}\n",
+		   formatName(format), channels, scalar, vector, vector / scalar);
+}
+
+static void quantize(unsigned int bits)
+{
+	Material material(1, quick ? 1 << 18 : 1 << 20);
+	std::vector<SInt32> out(material.frames);
+	const double scale = ldexp(1, bits - 1);
+	ofxAudioUnitSampleConverter converter;
+
+	const double scalar = timeIt([&] {
+		for(size_t i = 0; i < material.frames; i++) out[i] = ReferenceQuantize(material.samples[i], scale);
+	}, material.frames);
+	const double vector = timeIt([&] {converter.quantize(&material.samples[0], material.frames, bits, &out[0]);}, material.frames);
+
+	printf("{\"benchmark\":\"quantize\",\"bits\":%u,\"scalar_msamples_per_sec\":%.1f,\"converter_msamples_per_sec\":%.1f,\"speedup\":%.2f}\n",
+		   bits, scalar, vector, vector / scalar);
+}
+
+// The error's power in dB relative to one LSB squared: all of it, and the
+// average spectral density from 100 Hz to 4 kHz (Hann windowed blocks, through
+// Goertzel filters), on the same scale, so white noise reads the same on both
+static void errorPower(const std::vector<double> &error, double &total, double &low, double &mean)
+{
+	const size_t block = 1024;
+	std::vector<double> window(block);
+	double windowPower = 0;
+	for(size_t i = 0; i < block; i++) {
+		window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / block);
+		windowPower += window[i] * window[i];
+	}
+
+	const size_t firstBin = ceil(100 * block / kSampleRate);
+	const size_t lastBin = 4000 * block / kSampleRate;
+	double bandPower = 0;
+	size_t bands = 0;
+	for(size_t start = 0; start + block <= error.size(); start += block) {
+		for(size_t k = firstBin; k <= lastBin; k++, bands++) {
+			const double coefficient = 2 * cos(2 * M_PI * k / block);
+			double s1 = 0, s2 = 0;
+			for(size_t i = 0; i < block; i++) {
+				const double s = error[start + i] * window[i] + coefficient * s1 - s2;
+				s2 = s1;
+				s1 = s;
+			}
+			bandPower += (s1 * s1 + s2 * s2 - coefficient * s1 * s2) / windowPower;
+		}
+	}
+
+	double sum = 0, sumSquares = 0;
+	for(size_t i = 0; i < error.size(); i++) {
+		sum += error[i];
+		sumSquares += error[i] * error[i];
+	}
+	mean = sum / error.size();
+	total = 10 * log10(sumSquares / error.size());
+	low = 10 * log10(bandPower / bands);
+}
+
+static bool dither(ofxAudioUnitDither dither)
+{
+	const size_t frames = quick ? 1 << 17 : 1 << 20;
+	std::vector<Float32> quiet(frames), offset(frames);
+	std::vector<SInt32> q(frames);
+	std::vector<double> error(frames);
+
+	// a sine a few LSBs high, and a constant a third of an LSB up
+	for(size_t i = 0; i < frames; i++) {
+		quiet[i] = 4 * sin(2 * M_PI * 1000 * i / kSampleRate) / 32768;
+		offset[i] = 0.33f / 32768;
+	}
+
+	double total, low, mean, offsetTotal, offsetLow, offsetMean;
+	ofxAudioUnitSampleConverter converter(dither);
+
+	converter.quantize(&quiet[0], frames, 16, &q[0]);
+	for(size_t i = 0; i < frames; i++) error[i] = q[i] - quiet[i] * 32768.;
+	errorPower(error, total, low, mean);
+
+	converter.reset();
+	converter.quantize(&offset[0], frames, 16, &q[0]);
+	for(size_t i = 0; i < frames; i++) error[i] = q[i] - offset[i] * 32768.;
+	errorPower(error, offsetTotal, offsetLow, offsetMean);
+
+	// Undithered, a constant's error is a constant, which is all distortion.
+	// Dithered, it's noise of the same power whatever the signal, with no DC
+	const double modulation = fabs(total - offsetTotal);
+	bool ok = true;
+	if(dither != OFXAU_DITHER_NONE) {
+		ok = fabs(mean) < 0.05 && fabs(offsetMean) < 0.05 && modulation < 0.5;
+	}
+	if(dither == OFXAU_DITHER_TPDF) {
+		ok = ok && fabs(total - 10 * log10(0.25)) < 0.5; // 1/12 from rounding and 1/6 from the dither
+	}
+	if(dither == OFXAU_DITHER_SHAPED) {
+		ok = ok && low < 10 * log10(0.25) - 10; // at least 10 dB under plain TPDF
+	}
+
+	printf("{\"benchmark\":\"dither\",\"dither\":\"%s\",\"bits\":16,\"error_mean_lsb\":%.4f,\"offset_error_mean_lsb\":%.4f,\"error_db\":%.2f,\"offset_error_db\":%.2f,\"error_below_4k_db\":%.2f,\"ok\":%s}\n",
+		   ditherName(dither), mean, offsetMean, total, offsetTotal, low, ok ? "true" : "false");
+	return ok;
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+	const unsigned int channelCounts[] = {1, 2, 8, 32};
+	for(size_t f = 0; f < kNumFormats; f++) {
+		for(size_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); c++) {
+			ok = exact(kFormats[f], channelCounts[c]) && ok;
+		}
+	}
+
+	for(size_t f = 0; f < kNumFormats; f++) {
+		interleave(kFormats[f], 2, OFXAU_DITHER_NONE);
+		interleave(kFormats[f], 32, OFXAU_DITHER_NONE);
+	}
+	interleave(OFXAU_SAMPLE_INT16, 2, OFXAU_DITHER_TPDF);
+	interleave(OFXAU_SAMPLE_INT16, 2, OFXAU_DITHER_SHAPED);
+	interleave(OFXAU_SAMPLE_INT24, 32, OFXAU_DITHER_TPDF);
+
+	for(size_t f = 0; f < kNumFormats; f++) {
+		deinterleave(kFormats[f], 2);
+		deinterleave(kFormats[f], 32);
+	}
+
+	quantize(16);
+	quantize(24);
+
+	ok = dither(OFXAU_DITHER_NONE) && ok;
+	ok = dither(OFXAU_DITHER_TPDF) && ok;
+	ok = dither(OFXAU_DITHER_SHAPED) && ok;
+
+	return ok ? 0 : 1;
+}
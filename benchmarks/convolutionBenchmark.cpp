@@ -0,0 +1,223 @@
+// Benchmarks for ofxAudioUnitConvolution, the partitioned convolution engine
+// behind ofxAudioUnitConvolutionNode.
+//
+//   SOURCES="convolutionBenchmark.cpp ../src/ofxAudioUnitConvolution.cpp ../src/ofxAudioUnitFftCache.cpp"
+//
+// On Linux the timings are for compat/Accelerate's reference FFT, not
+// vDSP's.
+//
+// "accuracy" runs noise through the engine and through a direct convolution
+// (in double, delayed by the block size like the engine's wet signal) and
+// compares them, for IRs shorter than, equal to and longer than a block.
+// "realtime" times stereo processing at 48kHz for IR lengths from 0.1s to
+// 10s and a few block sizes, and reports the realtime factor (seconds of
+// audio processed per second of CPU). "swap" renders constant input on one
+// thread while another keeps replacing the impulse response, and checks
+// that a cycle never outputs the raw input at full level: cycles that find
+// a swap under way must scale it by the dry level. The lock is only held
+// for the swap itself, so the render thread needs a core of its own to run
+// into it with any regularity; "cores" is in the output for that reason.
+
+#include "ofxAudioUnitConvolution.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static void fillNoise(std::vector<float> &x, unsigned int seed)
+{
+	for(size_t i = 0; i < x.size(); i++) {
+		seed = seed * 1664525u + 1013904223u;
+		x[i] = (seed >> 8) / 8388608.0 - 1;
+	}
+}
+
+// decaying noise, roughly what a room IR looks like
+static std::vector<float> makeImpulseResponse(size_t length, unsigned int seed)
+{
+	std::vector<float> ir(length);
+	fillNoise(ir, seed);
+	for(size_t i = 0; i < length; i++) {
+		ir[i] *= 0.1 * exp(-5.0 * i / length);
+	}
+	return ir;
+}
+
+// runs channels of audio through the engine in slices of `frames`, the
+// way a render callback would
+struct Renderer
+{
+	std::vector<std::vector<float> > buffers;
+	std::vector<char> listStorage;
+	AudioBufferList * list;
+
+	Renderer(unsigned int channels, UInt32 frames)
+	: buffers(channels, std::vector<float>(frames))
+	, listStorage(sizeof(AudioBufferList) + channels * sizeof(AudioBuffer))
+	{
+		list = (AudioBufferList *)&listStorage[0];
+		list->mNumberBuffers = channels;
+		for(unsigned int c = 0; c < channels; c++) {
+			list->mBuffers[c].mNumberChannels = 1;
+			list->mBuffers[c].mDataByteSize = frames * sizeof(float);
+			list->mBuffers[c].mData = &buffers[c][0];
+		}
+	}
+};
+
+#pragma mark - Accuracy
+
+static bool accuracy(unsigned int blockSize, size_t irLength, UInt32 sliceFrames)
+{
+	const std::vector<float> ir = makeImpulseResponse(irLength, 7);
+	ofxAudioUnitConvolution conv(blockSize);
+	conv.setImpulseResponse(std::vector<std::vector<float> >(1, ir), 1);
+
+	const size_t length = irLength + 4 * blockSize + 3 * sliceFrames;
+	std::vector<float> input(length);
+	fillNoise(input, 3);
+
+	std::vector<float> output(length);
+	Renderer renderer(1, sliceFrames);
+	for(size_t done = 0; done + sliceFrames <= length; done += sliceFrames) {
+		std::copy(input.begin() + done, input.begin() + done + sliceFrames, renderer.buffers[0].begin());
+		conv.process(renderer.list, sliceFrames);
+		std::copy(renderer.buffers[0].begin(), renderer.buffers[0].end(), output.begin() + done);
+	}
+	const size_t rendered = length / sliceFrames * sliceFrames;
+
+	double worst = 0, peak = 0;
+	for(size_t n = 0; n < rendered; n++) {
+		double expected = 0;
+		if(n >= blockSize) {
+			const size_t m = n - blockSize;
+			for(size_t k = 0; k < irLength && k <= m; k++) expected += (double)ir[k] * input[m - k];
+		}
+		peak = std::max(peak, fabs(expected));
+		worst = std::max(worst, fabs(output[n] - expected));
+	}
+
+	const double relative = peak > 0 ? worst / peak : 1;
+	const bool ok = relative < 1e-4;
+	printf("{\"benchmark\":\"accuracy\",\"block_size\":%u,\"ir_length\":%zu,\"slice\":%u,\"max_error\":%.3g,\"max_error_db\":%.1f,\"ok\":%s}\n",
+		   blockSize, irLength, sliceFrames, relative, 20 * log10(std::max(relative, 1e-12)), ok ? "true" : "false");
+	return ok;
+}
+
+#pragma mark - Realtime
+
+static void realtime(unsigned int blockSize, double irSeconds)
+{
+	const Float64 sampleRate = 48000;
+	const unsigned int channels = 2;
+	const UInt32 sliceFrames = 512;
+
+	std::vector<std::vector<float> > ir;
+	for(unsigned int c = 0; c < channels; c++) ir.push_back(makeImpulseResponse(irSeconds * sampleRate, 11 + c));
+
+	ofxAudioUnitConvolution conv(blockSize);
+	const Clock::time_point setupStart = Clock::now();
+	conv.setImpulseResponse(ir, channels);
+	const double setupSeconds = secondsSince(setupStart);
+
+	Renderer renderer(channels, sliceFrames);
+	std::vector<float> noise(sliceFrames);
+	fillNoise(noise, 5);
+
+	// enough audio to cycle the whole delay line a few times, within reason
+	const double audioSeconds = quick ? 1 : std::max(4.0, std::min(20.0, 2 * irSeconds));
+	const unsigned int slices = audioSeconds * sampleRate / sliceFrames;
+
+	float sink = 0;
+	const Clock::time_point start = Clock::now();
+	for(unsigned int s = 0; s < slices; s++) {
+		for(unsigned int c = 0; c < channels; c++) std::copy(noise.begin(), noise.end(), renderer.buffers[c].begin());
+		conv.process(renderer.list, sliceFrames);
+		sink += renderer.buffers[0][0];
+	}
+	const double cpuSeconds = secondsSince(start);
+	const double processed = (double)slices * sliceFrames / sampleRate;
+
+	printf("{\"benchmark\":\"realtime\",\"block_size\":%u,\"ir_seconds\":%.1f,\"ir_length\":%zu,\"channels\":%u,\"partitions\":%zu,\"setup_ms\":%.2f,\"audio_seconds\":%.2f,\"cpu_seconds\":%.3f,\"realtime_factor\":%.1f,\"cpu_load\":%.4f,\"check\":%.3g}\n",
+		   blockSize, irSeconds, ir[0].size(), channels, (ir[0].size() + conv.getBlockSize() - 1) / conv.getBlockSize(),
+		   setupSeconds * 1e3, processed, cpuSeconds, processed / cpuSeconds, cpuSeconds / processed, sink);
+}
+
+#pragma mark - Swap
+
+static bool swap()
+{
+	const unsigned int channels = 2;
+	const UInt32 sliceFrames = 128;
+	const float dry = 0.25f;
+	const float input = 1.0f;
+
+	ofxAudioUnitConvolution conv(256);
+	conv.setDryLevel(dry);
+
+	// an IR of all zeros makes the wet signal silent, so every output
+	// sample should be exactly the dry signal
+	const std::vector<std::vector<float> > silentIR(1, std::vector<float>(4096, 0));
+	conv.setImpulseResponse(silentIR, channels);
+
+	std::atomic<bool> done(false);
+	std::atomic<unsigned int> rebuilds(0);
+	std::thread loader([&]() {
+		while(!done.load()) {
+			conv.setImpulseResponse(silentIR, channels);
+			rebuilds++;
+		}
+	});
+
+	Renderer renderer(channels, sliceFrames);
+	const unsigned int cycles = quick ? 20000 : 200000;
+	unsigned int fullLevel = 0, wrongLevel = 0;
+
+	for(unsigned int r = 0; r < cycles; r++) {
+		for(unsigned int c = 0; c < channels; c++) std::fill(renderer.buffers[c].begin(), renderer.buffers[c].end(), input);
+		conv.process(renderer.list, sliceFrames);
+
+		for(unsigned int c = 0; c < channels; c++) {
+			for(UInt32 i = 0; i < sliceFrames; i++) {
+				const float x = renderer.buffers[c][i];
+				if(x == input) fullLevel++;
+				else if(fabsf(x - dry * input) > 1e-6f) wrongLevel++;
+			}
+		}
+	}
+
+	done = true;
+	loader.join();
+
+	const bool ok = fullLevel == 0 && wrongLevel == 0;
+	printf("{\"benchmark\":\"swap\",\"cores\":%u,\"cycles\":%u,\"rebuilds\":%u,\"dry_level\":%.2f,\"full_level_samples\":%u,\"wrong_level_samples\":%u,\"ok\":%s}\n",
+		   std::thread::hardware_concurrency(), cycles, rebuilds.load(), dry, fullLevel, wrongLevel, ok ? "true" : "false");
+	return ok;
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+	ok = accuracy(64, 40, 48) && ok;
+	ok = accuracy(64, 64, 64) && ok;
+	ok = accuracy(64, 1000, 100) && ok;
+	ok = accuracy(256, 3000, 512) && ok;
+	ok = swap() && ok;
+
+	const double irSeconds[] = {0.1, 0.5, 1, 2, 5, 10};
+	const unsigned int blockSizes[] = {128, 512, 2048};
+	for(int b = 0; b < 3; b++) {
+		for(int s = 0; s < 6; s++) {
+			realtime(blockSizes[b], irSeconds[s]);
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,366 @@
+// Benchmarks for ofxAudioUnitDiskPlayer, the engine behind
+// ofxAudioUnitStreamingFilePlayer.
+//
+//   SOURCES="diskPlayerBenchmark.cpp ../src/ofxAudioUnitDiskPlayer.cpp ../src/ofxAudioUnitCaptureBuffer.cpp ../src/ofxAudioUnitWavReader.cpp ../src/ofxAudioUnitWavWriter.cpp ../src/ofxAudioUnitSampleConverter.cpp"
+//
+// "exact" plays files of each format into as many output channels as they
+// have, and into fewer and more, with 1 MB reads and with 4 KB ones (which
+// split frames across reads), and checks every frame against
+// ofxAudioUnitWavReader. "seek" jumps around a file and checks the first
+// block played after each seek, and reports how long the seeks took to be
+// ready. "underrun" renders as fast as it can with a small read-ahead, so
+// the ring keeps running dry, and checks that the audio it did play, joined
+// up, is the whole file with nothing skipped or repeated. "stream" plays a
+// long file at a multiple of real time with the page cache dropped first
+// (Linux only; the directory should be on a real disk rather than tmpfs),
+// with 64 KB and 1 MB reads, and reports underruns, how long reads took and
+// how long render cycles took.
+
+#include "ofxAudioUnitDiskPlayer.h"
+#include "ofxAudioUnitWavReader.h"
+#include "ofxAudioUnitWavWriter.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static std::string directory = "/tmp";
+
+static const double kSampleRate = 48000;
+static const UInt32 kBlockFrames = 512;
+
+static const char * formatName(ofxAudioUnitWavFormat format)
+{
+	switch(format) {
+		case OFXAU_WAV_INT16:   return "int16";
+		case OFXAU_WAV_INT24:   return "int24";
+		case OFXAU_WAV_INT32:   return "int32";
+		case OFXAU_WAV_FLOAT32: return "float32";
+	}
+	return "?";
+}
+
+// noise, written a second at a time so long files don't need it all in memory
+static bool writeFile(const std::string &path, unsigned int channels, size_t frames, ofxAudioUnitWavFormat format)
+{
+	ofxAudioUnitWavWriter writer;
+	if(!writer.open(path, channels, kSampleRate, format)) return false;
+
+	const size_t chunk = kSampleRate;
+	std::vector<std::vector<Float32> > source(channels, std::vector<Float32>(chunk));
+	std::vector<const Float32 *> planes;
+	for(unsigned int c = 0; c < channels; c++) planes.push_back(&source[c][0]);
+
+	UInt32 state = 1;
+	for(size_t done = 0; done < frames; done += chunk) {
+		const size_t count = std::min(chunk, frames - done);
+		for(unsigned int c = 0; c < channels; c++) {
+			for(size_t i = 0; i < count; i++) {
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				source[c][i] = ((state >> 8) / 8388608.f - 1.f) * 0.5f;
+			}
+		}
+		if(!writer.write(&planes[0], count)) return false;
+	}
+	return writer.close();
+}
+
+// a buffer list over planar output, as a render callback gets
+struct Output {
+	std::vector<std::vector<Float32> > planes;
+	std::vector<char> storage;
+
+	Output(unsigned int channels, UInt32 frames)
+	: planes(channels, std::vector<Float32>(frames))
+	, storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channels)
+	{
+		list()->mNumberBuffers = channels;
+		for(unsigned int c = 0; c < channels; c++) {
+			list()->mBuffers[c].mNumberChannels = 1;
+			list()->mBuffers[c].mDataByteSize = frames * sizeof(Float32);
+			list()->mBuffers[c].mData = &planes[c][0];
+		}
+	}
+
+	AudioBufferList * list() {return (AudioBufferList *)&storage[0];}
+};
+
+// the largest difference between `frames` of each planar buffer and the
+// file's frames from `start`
+static double compare(const std::vector<std::vector<Float32> > &planes, size_t offset, size_t frames, ofxAudioUnitWavReader &reader, UInt64 start)
+{
+	const ofxAudioUnitWavReader::Info &info = reader.getInfo();
+	std::vector<std::vector<Float32> > expected(info.channels, std::vector<Float32>(frames));
+	std::vector<Float32 *> expectedPlanes(info.channels);
+	for(unsigned int c = 0; c < info.channels; c++) expectedPlanes[c] = &expected[c][0];
+	if(frames > 0 && reader.read(start, frames, &expectedPlanes[0]) != frames) return INFINITY;
+
+	double maxError = 0;
+	for(size_t b = 0; b < planes.size(); b++) {
+		for(size_t i = 0; i < frames; i++) {
+			maxError = std::max<double>(maxError, fabs(planes[b][offset + i] - expected[b % info.channels][i]));
+		}
+	}
+	return maxError;
+}
+
+// waits (a while) for the I/O thread to have `frames` ready to play
+static bool waitForFrames(ofxAudioUnitDiskPlayer &player, UInt64 frames)
+{
+	const Clock::time_point start = Clock::now();
+	while(!player.isReady() || player.getStats().bufferedFrames < frames) {
+		if(secondsSince(start) > 5) return false;
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	return true;
+}
+
+static bool exact(ofxAudioUnitWavFormat format, unsigned int channels, unsigned int outputChannels, size_t readBytes)
+{
+	const std::string path = directory + "/diskPlayerBenchmark.wav";
+	const size_t frames = kBlockFrames * 40 + 123;
+	if(!writeFile(path, channels, frames, format)) return false;
+
+	ofxAudioUnitWavReader reader;
+	ofxAudioUnitDiskPlayer player;
+	if(!reader.open(path) || !player.open(path, 0.1, readBytes)) return false;
+
+	Output block(outputChannels, kBlockFrames);
+	double maxError = 0;
+	bool ready = true;
+
+	// straight through, to past the end
+	player.play();
+	UInt64 position = 0;
+	for(; position + kBlockFrames <= frames; position += kBlockFrames) {
+		ready = waitForFrames(player, kBlockFrames) && ready;
+		player.render(kBlockFrames, block.list());
+		maxError = std::max(maxError, compare(block.planes, 0, kBlockFrames, reader, position));
+	}
+	ready = waitForFrames(player, frames - position) && ready;
+	player.render(kBlockFrames, block.list());
+	maxError = std::max(maxError, compare(block.planes, 0, frames - position, reader, position));
+	bool silentAtEnd = !player.isPlaying() && player.getPosition() == frames;
+	for(size_t b = 0; b < block.planes.size(); b++) {
+		for(UInt32 i = frames - position; i < kBlockFrames; i++) silentAtEnd = silentAtEnd && block.planes[b][i] == 0;
+	}
+
+	const ofxAudioUnitDiskPlayer::Stats stats = player.getStats();
+	const bool ok = ready && maxError == 0 && silentAtEnd && stats.underruns == 0 && !stats.failed;
+	printf("{\"benchmark\":\"exact\",\"format\":\"%s\",\"channels\":%u,\"output_channels\":%u,\"read_bytes\":%zu,\"reads\":%llu,\"max_error\":%.3g,\"silent_at_end\":%s,\"ok\":%s}\n",
+		   formatName(format), channels, outputChannels, readBytes, (unsigned long long)stats.reads, maxError,
+		   silentAtEnd ? "true" : "false", ok ? "true" : "false");
+
+	player.close();
+	remove(path.c_str());
+	return ok;
+}
+
+static bool seek(ofxAudioUnitWavFormat format)
+{
+	const std::string path = directory + "/diskPlayerBenchmark.wav";
+	const size_t frames = kSampleRate * 20;
+	const int seeks = quick ? 50 : 200;
+	if(!writeFile(path, 2, frames, format)) return false;
+
+	ofxAudioUnitWavReader reader;
+	ofxAudioUnitDiskPlayer player;
+	if(!reader.open(path) || !player.open(path)) return false;
+
+	Output block(2, kBlockFrames);
+	double maxError = 0, totalMs = 0, maxMs = 0;
+	bool ready = true;
+	srand(1);
+
+	player.play();
+	for(int s = 0; s < seeks; s++) {
+		// play a little from where it is, then jump
+		ready = waitForFrames(player, kBlockFrames) && ready;
+		player.render(kBlockFrames, block.list());
+
+		const UInt64 to = (UInt64)rand() % (frames - kBlockFrames);
+		player.setPosition(to);
+		ready = player.getPosition() == to && ready;
+
+		ready = waitForFrames(player, kBlockFrames) && ready;
+		const double ms = player.getStats().lastSeekMs;
+		totalMs += ms;
+		maxMs = std::max(maxMs, ms);
+
+		player.render(kBlockFrames, block.list());
+		maxError = std::max(maxError, compare(block.planes, 0, kBlockFrames, reader, to));
+		ready = player.getPosition() == to + kBlockFrames && ready;
+	}
+
+	const bool ok = ready && maxError == 0;
+	printf("{\"benchmark\":\"seek\",\"format\":\"%s\",\"seeks\":%d,\"mean_seek_ms\":%.3f,\"max_seek_ms\":%.3f,\"max_error\":%.3g,\"ok\":%s}\n",
+		   formatName(format), seeks, totalMs / seeks, maxMs, maxError, ok ? "true" : "false");
+
+	player.close();
+	remove(path.c_str());
+	return ok;
+}
+
+static bool underrun()
+{
+	const std::string path = directory + "/diskPlayerBenchmark.wav";
+	const size_t frames = kSampleRate * (quick ? 10 : 60) + 77;
+	if(!writeFile(path, 2, frames, OFXAU_WAV_INT24)) return false;
+
+	ofxAudioUnitWavReader reader;
+	ofxAudioUnitDiskPlayer player;
+	if(!reader.open(path) || !player.open(path, 0.05, 4096)) return false;
+
+	// whatever each cycle really played is the first (position moved) frames
+	// of the block; the rest is silence from the underrun
+	Output block(2, kBlockFrames);
+	std::vector<std::vector<Float32> > played(2, std::vector<Float32>(frames + kBlockFrames));
+	size_t playedFrames = 0;
+	size_t cycles = 0;
+	bool ok = true;
+
+	const Clock::time_point start = Clock::now();
+	player.play();
+	while(player.isPlaying() && secondsSince(start) < 60) {
+		const UInt64 before = player.getPosition();
+		player.render(kBlockFrames, block.list());
+		const UInt64 moved = player.getPosition() - before;
+		if(moved > kBlockFrames || playedFrames + moved > frames) {
+			ok = false;
+			break;
+		}
+		for(size_t c = 0; c < 2; c++) std::copy(&block.planes[c][0], &block.planes[c][0] + moved, &played[c][playedFrames]);
+		playedFrames += moved;
+		cycles++;
+	}
+
+	const double maxError = compare(played, 0, playedFrames, reader, 0);
+	const ofxAudioUnitDiskPlayer::Stats stats = player.getStats();
+	ok = ok && playedFrames == frames && maxError == 0 && !stats.failed;
+	printf("{\"benchmark\":\"underrun\",\"frames\":%zu,\"played_frames\":%zu,\"cycles\":%zu,\"underruns\":%llu,\"underrun_frames\":%llu,\"max_error\":%.3g,\"ok\":%s}\n",
+		   frames, playedFrames, cycles, (unsigned long long)stats.underruns, (unsigned long long)stats.underrunFrames,
+		   maxError, ok ? "true" : "false");
+
+	player.close();
+	remove(path.c_str());
+	return ok;
+}
+
+#pragma mark - Streaming
+
+// drops the file from the page cache (where the platform can), and says how
+// much of it is still there
+static double dropFromCache(const std::string &path, bool drop)
+{
+	const int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) return -1;
+#if defined(POSIX_FADV_DONTNEED)
+	if(drop) {
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	}
+#endif
+
+	struct stat st;
+	fstat(fd, &st);
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const size_t pages = (st.st_size + page - 1) / page;
+	void * map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	std::vector<unsigned char> resident(pages);
+	size_t count = 0;
+	if(map != MAP_FAILED && mincore(map, st.st_size, (decltype(&resident[0]))&resident[0]) == 0) {
+		for(size_t i = 0; i < pages; i++) count += resident[i] & 1;
+	}
+	if(map != MAP_FAILED) munmap(map, st.st_size);
+	close(fd);
+	return pages > 0 ? (double)count / pages : 0;
+}
+
+static void stream(const std::string &path, ofxAudioUnitWavFormat format, size_t readBytes, double speed)
+{
+	const double residentBefore = dropFromCache(path, true);
+
+	ofxAudioUnitDiskPlayer player;
+	if(!player.open(path, 2, readBytes)) return;
+	const UInt64 frames = player.getInfo().frames;
+	const size_t blocks = frames / kBlockFrames;
+
+	// the head start it would get between loading a file and pressing play
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	Output block(2, kBlockFrames);
+	std::vector<double> times(blocks);
+	const std::chrono::duration<double> interval(kBlockFrames / kSampleRate / speed);
+
+	player.play();
+	const Clock::time_point start = Clock::now();
+	for(size_t b = 0; b < blocks; b++) {
+		std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(interval * b));
+		const Clock::time_point blockStart = Clock::now();
+		player.render(kBlockFrames, block.list());
+		times[b] = secondsSince(blockStart);
+	}
+
+	const ofxAudioUnitDiskPlayer::Stats stats = player.getStats();
+	std::vector<double> sorted(times);
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0;
+	for(size_t b = 0; b < blocks; b++) total += times[b];
+
+	printf("{\"benchmark\":\"stream\",\"format\":\"%s\",\"resident_before\":%.2f,\"read_kb\":%zu,\"speed\":%.0f,\"megabytes\":%.0f,\"blocks\":%zu,\"mean_block_us\":%.2f,\"p99_block_us\":%.2f,\"max_block_us\":%.1f,\"underruns\":%llu,\"underrun_frames\":%llu,\"reads\":%llu,\"mean_read_ms\":%.3f,\"max_read_ms\":%.3f}\n",
+		   formatName(format), residentBefore, readBytes / 1024, speed, frames * 2.0 * (format == OFXAU_WAV_INT24 ? 3 : 4) / 1e6, blocks,
+		   total / blocks * 1e6, sorted[blocks * 99 / 100] * 1e6, sorted.back() * 1e6,
+		   (unsigned long long)stats.underruns, (unsigned long long)stats.underrunFrames, (unsigned long long)stats.reads,
+		   stats.meanReadMs, stats.maxReadMs);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+	directory = optionValue(argc, argv, "--dir", directory);
+
+	bool ok = true;
+	const ofxAudioUnitWavFormat wavFormats[] = {OFXAU_WAV_INT16, OFXAU_WAV_INT24, OFXAU_WAV_INT32, OFXAU_WAV_FLOAT32};
+	const size_t readSizes[] = {4096, 1 << 20};
+	for(size_t f = 0; f < sizeof(wavFormats) / sizeof(wavFormats[0]); f++) {
+		for(size_t r = 0; r < 2; r++) {
+			ok = exact(wavFormats[f], 2, 2, readSizes[r]) && ok;
+			ok = exact(wavFormats[f], 2, 1, readSizes[r]) && ok;
+			ok = exact(wavFormats[f], 1, 2, readSizes[r]) && ok;
+			ok = exact(wavFormats[f], 6, 6, readSizes[r]) && ok;
+		}
+	}
+
+	ok = seek(OFXAU_WAV_INT24) && ok;
+	ok = seek(OFXAU_WAV_FLOAT32) && ok;
+	ok = underrun() && ok;
+
+	const double speed = 20;
+	const size_t frames = (quick ? 60 : 300) * kSampleRate;
+	const ofxAudioUnitWavFormat streamFormats[] = {OFXAU_WAV_FLOAT32, OFXAU_WAV_INT24};
+	for(size_t f = 0; f < 2; f++) {
+		const std::string path = directory + "/diskPlayerBenchmark-long.wav";
+		if(!writeFile(path, 2, frames, streamFormats[f])) {
+			printf("{\"benchmark\":\"stream\",\"error\":\"couldn't write %s\"}\n", path.c_str());
+			return 1;
+		}
+		stream(path, streamFormats[f], 64 << 10, speed);
+		stream(path, streamFormats[f], 1 << 20, speed);
+		remove(path.c_str());
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+// Benchmarks for ofxAudioUnitFftCache, which the FFT, pitch, constant-Q and
+// convolution nodes get their FFT setups and window tables from.
+//
+//   SOURCES="fftCacheBenchmark.cpp ../src/ofxAudioUnitFftCache.cpp ../src/ofxAudioUnitPitchDetector.cpp"
+//
+// "sharing" sets up N analyzers the way ofxAudioUnitFftNode does (a setup
+// and a window table each) and N ofxAudioUnitPitchDetectors, and checks
+// through getSetupCount() / getWindowCount() (the cache's weak_ptr maps)
+// that they hold one setup per size and one window table between them, all
+// the same objects, and that the maps empty out once they're gone.
+// "threads" has several threads asking for the same entries at once and
+// checks they all get the same ones. "startup" times setting up N analyzers
+// and measures how much heap they take, with the cache and with a private
+// setup and table each (what the nodes did before).
+
+#include "ofxAudioUnitFftCache.h"
+#include "ofxAudioUnitPitchDetector.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#if defined(__APPLE__)
+	#include <malloc/malloc.h>
+#elif defined(__GLIBC__)
+	#include <malloc.h>
+#endif
+
+// bytes of heap in use, or -1 where there's no way to ask
+static long long heapInUse()
+{
+#if defined(__APPLE__)
+	return (long long)mstats().bytes_used;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	return (long long)mallinfo2().uordblks;
+#else
+	return -1;
+#endif
+}
+
+// what ofxAudioUnitFftNode holds on to
+struct FftAnalyzer
+{
+	FFTSetupRef setup;
+	FFTWindowRef window;
+
+	FftAnalyzer(unsigned int log2N, bool cached)
+	{
+		const size_t N = (size_t)1 << log2N;
+		if(cached) {
+			setup = ofxAudioUnitFftCache::getSetup(log2N);
+			window = ofxAudioUnitFftCache::getWindow(OFXAU_WINDOW_HANNING, N);
+		} else {
+			setup = FFTSetupRef(vDSP_create_fftsetup(log2N, kFFTRadix2), vDSP_destroy_fftsetup);
+			std::shared_ptr<std::vector<float> > table = std::make_shared<std::vector<float> >(N);
+			generateWindow(OFXAU_WINDOW_HANNING, &(*table)[0], N);
+			window = table;
+		}
+	}
+};
+
+#pragma mark - Sharing
+
+static bool sharing(unsigned int count)
+{
+	const unsigned int log2N = 11;
+	bool same = true;
+
+	size_t setupsWhileAlive = 0, windowsWhileAlive = 0, setupsMixed = 0;
+	{
+		std::vector<std::unique_ptr<FftAnalyzer> > analyzers;
+		std::vector<std::unique_ptr<ofxAudioUnitPitchDetector> > detectors;
+		for(unsigned int i = 0; i < count; i++) {
+			analyzers.push_back(std::unique_ptr<FftAnalyzer>(new FftAnalyzer(log2N, true)));
+		}
+
+		for(unsigned int i = 0; i < count; i++) {
+			same = same && analyzers[i]->setup == analyzers[0]->setup && analyzers[i]->window == analyzers[0]->window;
+		}
+
+		setupsWhileAlive = ofxAudioUnitFftCache::getSetupCount();
+		windowsWhileAlive = ofxAudioUnitFftCache::getWindowCount();
+
+		// pitch detectors zero pad to twice their window, so a 1024 point
+		// detector shares the FFT nodes' 2048 point setup, and a 2048 point
+		// one adds a 4096 point setup
+		for(unsigned int i = 0; i < count; i++) {
+			detectors.push_back(std::unique_ptr<ofxAudioUnitPitchDetector>(new ofxAudioUnitPitchDetector(i % 2 ? 1024 : 2048)));
+		}
+		setupsMixed = ofxAudioUnitFftCache::getSetupCount();
+	}
+
+	const size_t setupsAfter = ofxAudioUnitFftCache::getSetupCount();
+	const size_t windowsAfter = ofxAudioUnitFftCache::getWindowCount();
+
+	const bool ok = same && setupsWhileAlive == 1 && windowsWhileAlive == 1 && setupsMixed == 2 && setupsAfter == 0 && windowsAfter == 0;
+	printf("{\"benchmark\":\"sharing\",\"analyzers\":%u,\"pitch_detectors\":%u,\"same_objects\":%s,\"setups\":%zu,\"windows\":%zu,\"setups_with_detectors\":%zu,\"setups_after\":%zu,\"windows_after\":%zu,\"ok\":%s}\n",
+		   count, count, same ? "true" : "false", setupsWhileAlive, windowsWhileAlive, setupsMixed, setupsAfter, windowsAfter, ok ? "true" : "false");
+	return ok;
+}
+
+static bool threads()
+{
+	const unsigned int threadCount = 8;
+	const unsigned int rounds = quick ? 200 : 2000;
+
+	std::vector<std::vector<OpaqueFFTSetup *> > seen(threadCount);
+	std::vector<std::thread> workers;
+
+	// every thread keeps the first ones it got alive, so they can't be freed
+	// and rebuilt at another address in between
+	const FFTSetupRef keepSetup = ofxAudioUnitFftCache::getSetup(10);
+	const FFTWindowRef keepWindow = ofxAudioUnitFftCache::getWindow(OFXAU_WINDOW_BLACKMAN, 1024);
+
+	bool windowsSame = true;
+	std::vector<char> windowMatches(threadCount, 1);
+	for(unsigned int t = 0; t < threadCount; t++) {
+		workers.push_back(std::thread([&, t]() {
+			for(unsigned int r = 0; r < rounds; r++) {
+				seen[t].push_back(ofxAudioUnitFftCache::getSetup(10).get());
+				if(ofxAudioUnitFftCache::getWindow(OFXAU_WINDOW_BLACKMAN, 1024) != keepWindow) windowMatches[t] = 0;
+
+				// churn: entries nobody else holds come and go
+				ofxAudioUnitFftCache::getSetup(4 + (r + t) % 4);
+			}
+		}));
+	}
+	for(unsigned int t = 0; t < threadCount; t++) workers[t].join();
+
+	bool setupsSame = true;
+	for(unsigned int t = 0; t < threadCount; t++) {
+		windowsSame = windowsSame && windowMatches[t];
+		for(size_t i = 0; i < seen[t].size(); i++) setupsSame = setupsSame && seen[t][i] == keepSetup.get();
+	}
+
+	const bool ok = setupsSame && windowsSame;
+	printf("{\"benchmark\":\"threads\",\"threads\":%u,\"lookups\":%u,\"same_setup\":%s,\"same_window\":%s,\"ok\":%s}\n",
+		   threadCount, threadCount * rounds * 3, setupsSame ? "true" : "false", windowsSame ? "true" : "false", ok ? "true" : "false");
+	return ok;
+}
+
+#pragma mark - Startup
+
+static void startup(unsigned int count, unsigned int log2N, bool cached)
+{
+	const long long heapBefore = heapInUse();
+	const Clock::time_point start = Clock::now();
+
+	std::vector<std::unique_ptr<FftAnalyzer> > analyzers;
+	for(unsigned int i = 0; i < count; i++) {
+		analyzers.push_back(std::unique_ptr<FftAnalyzer>(new FftAnalyzer(log2N, cached)));
+	}
+
+	const double seconds = secondsSince(start);
+	const long long heapAfter = heapInUse();
+	const long long bytes = heapBefore >= 0 && heapAfter >= 0 ? heapAfter - heapBefore : -1;
+
+	printf("{\"benchmark\":\"startup\",\"cached\":%s,\"analyzers\":%u,\"fft_size\":%u,\"ms\":%.3f,\"us_per_analyzer\":%.2f,\"heap_bytes\":%lld,\"heap_bytes_per_analyzer\":%lld}\n",
+		   cached ? "true" : "false", count, 1u << log2N, seconds * 1e3, seconds / count * 1e6, bytes, bytes >= 0 ? bytes / count : -1);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+	ok = sharing(1) && ok;
+	ok = sharing(40) && ok;
+	ok = threads() && ok;
+
+	const unsigned int counts[] = {1, 10, 40, 100};
+	for(int c = 0; c < 4; c++) {
+		startup(counts[c], 11, false);
+		startup(counts[c], 11, true);
+	}
+	startup(40, 14, false);
+	startup(40, 14, true);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,507 @@
+// Benchmarks for FLAC recording: the encoder on its own
+// (ofxAudioUnitFlacWriter), and the recorder that runs one encoder thread
+// per channel group (ofxAudioUnitFlacRecorder), driven by a synthetic source
+// thread that stands in for the render thread.
+//
+//   SOURCES="flacBenchmark.cpp ../src/ofxAudioUnitFlacRecorder.cpp ../src/ofxAudioUnitFlacWriter.cpp ../src/ofxAudioUnitDiskRecorder.cpp ../src/ofxAudioUnitWavWriter.cpp ../src/ofxAudioUnitCaptureBuffer.cpp ../src/ofxAudioUnitSampleConverter.cpp"
+//
+// "encode" runs the encoder flat out on one thread, for tonal material,
+// white noise and silence, and reports how many channels of real-time audio
+// one core can keep up with, and the compression ratio.
+// "throughput" feeds the recorder as fast as its encoders can keep up (the
+// source waits while the backlog is over a second, which a real render
+// thread never would) and reports the sustained rate as a multiple of real
+// time, with one encoder thread per group of channels.
+// "realtime" feeds it at the sample rate and reports drops and backlog, and
+// what write() costs the render thread next to the WAV recorder's.
+// Every file written is decoded and checked against what was fed in, with
+// the small decoder below (which checks every frame's CRC as well).
+
+#include "ofxAudioUnitDiskRecorder.h"
+#include "ofxAudioUnitFlacRecorder.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::string directory = ".";
+
+static const Float64 kSampleRate = 48000;
+static const size_t kBlock = 512;
+
+#pragma mark - Source
+
+typedef enum {
+	TONAL, // a few drifting partials over a quiet noise floor, like a mix
+	NOISE, // full scale white noise, which doesn't compress
+	SILENCE
+}
+Material;
+
+static const char * materialName(Material material)
+{
+	switch(material) {
+		case TONAL:   return "tonal";
+		case NOISE:   return "noise";
+		case SILENCE: return "silence";
+	}
+	return "?";
+}
+
+// A second or so of audio per channel, fed out a block at a time
+struct Source
+{
+	static const size_t kLength = kBlock * 97;
+
+	std::vector<std::vector<Float32> > channels;
+	std::vector<char> storage;
+	size_t position;
+
+	Source(unsigned int channelCount, Material material)
+	: channels(channelCount, std::vector<Float32>(kLength))
+	, storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channelCount)
+	, position(0)
+	{
+		for(unsigned int c = 0; c < channelCount; c++) {
+			for(size_t i = 0; i < kLength; i++) {
+				const double t = i / kSampleRate;
+				const double noise = (rand() % 20001 - 10000) / 10000.;
+				double x = 0;
+				switch(material) {
+					case TONAL:
+						for(int p = 1; p <= 4; p++) {
+							x += 0.15 / p * sin(2 * M_PI * (110 * (c % 5 + 1) * p) * t * (1 + 0.01 * sin(2 * M_PI * 0.5 * t)));
+						}
+						x += 0.001 * noise;
+						break;
+					case NOISE:
+						x = noise;
+						break;
+					case SILENCE:
+						break;
+				}
+				channels[c][i] = x;
+			}
+		}
+		list()->mNumberBuffers = channelCount;
+	}
+
+	AudioBufferList * list() {return (AudioBufferList *)&storage[0];}
+
+	AudioBufferList * next()
+	{
+		for(size_t c = 0; c < channels.size(); c++) {
+			list()->mBuffers[c].mNumberChannels = 1;
+			list()->mBuffers[c].mDataByteSize = kBlock * sizeof(Float32);
+			list()->mBuffers[c].mData = &channels[c][position];
+		}
+		position = (position + kBlock) % kLength;
+		return list();
+	}
+
+	// what the encoder should have made of a sample
+	SInt32 quantized(unsigned int channel, UInt64 frame, unsigned int bits) const
+	{
+		const double scale = 1 << (bits - 1);
+		const double x = std::min(std::max(channels[channel][frame % kLength] * scale, -scale), scale - 1);
+		return (SInt32)lrint(x);
+	}
+};
+
+#pragma mark - Checking
+
+// Just enough of a FLAC decoder to read back what ofxAudioUnitFlacWriter
+// writes (and most other fixed block size streams)
+class FlacReader
+{
+public:
+	unsigned int channels, bits;
+	UInt64 totalFrames;
+	std::vector<std::vector<SInt32> > samples;
+	std::string problem;
+
+	FlacReader(const std::string &path) : channels(0), bits(0), totalFrames(0), _p(0), _bit(0)
+	{
+		FILE * f = fopen(path.c_str(), "rb");
+		if(!f) {problem = "can't open"; return;}
+		unsigned char chunk[65536];
+		size_t n;
+		while((n = fread(chunk, 1, sizeof(chunk), f)) > 0) _data.insert(_data.end(), chunk, chunk + n);
+		fclose(f);
+
+		if(_data.size() < 42 || memcmp(&_data[0], "fLaC", 4) != 0) {problem = "not a FLAC file"; return;}
+		_p = 4;
+		bool last = false;
+		while(!last && problem.empty()) {
+			last = bits1(1);
+			const unsigned int type = bits1(7);
+			const UInt32 length = bits1(24);
+			if(type == 0) {
+				bits1(16); bits1(16); bits1(24); bits1(24); bits1(20);
+				channels = bits1(3) + 1;
+				bits = bits1(5) + 1;
+				totalFrames = (UInt64)bits1(4) << 32;
+				totalFrames |= bits1(32);
+				_p += 16;
+			} else {
+				_p += length;
+			}
+		}
+		samples.resize(channels);
+		while(_p < _data.size() && problem.empty()) frame();
+		if(problem.empty() && samples[0].size() != totalFrames) problem = "STREAMINFO has the wrong length";
+	}
+
+private:
+	std::vector<unsigned char> _data;
+	size_t _p;
+	unsigned int _bit;
+
+	UInt32 bits1(unsigned int count)
+	{
+		UInt32 value = 0;
+		while(count--) {
+			if(_p >= _data.size()) {problem = "truncated"; return 0;}
+			value = (value << 1) | ((_data[_p] >> (7 - _bit)) & 1);
+			if(++_bit == 8) {_bit = 0; _p++;}
+		}
+		return value;
+	}
+
+	SInt32 signedBits(unsigned int count)
+	{
+		const UInt32 value = bits1(count);
+		return count == 0 ? 0 : (SInt32)(value << (32 - count)) >> (32 - count);
+	}
+
+	UInt32 unary()
+	{
+		UInt32 q = 0;
+		while(problem.empty() && bits1(1) == 0) q++;
+		return q;
+	}
+
+	void frame()
+	{
+		const size_t start = _p;
+		if(bits1(15) != 0x7FFC) {problem = "lost sync"; return;}
+		bits1(1);
+		const unsigned int sizeCode = bits1(4);
+		bits1(4);
+		const unsigned int assignment = bits1(4);
+		bits1(3);
+		bits1(1);
+
+		// the frame number, which we don't need
+		const UInt32 first = bits1(8);
+		for(int extra = 0; extra < 7 && (first & (0x40 >> extra)) && (first & 0x80); extra++) bits1(8);
+
+		size_t frames = 0;
+		if(sizeCode == 6) frames = bits1(8) + 1;
+		else if(sizeCode == 7) frames = bits1(16) + 1;
+		else if(sizeCode >= 8) frames = 256 << (sizeCode - 8);
+		else if(sizeCode >= 2 && sizeCode <= 5) frames = 576 << (sizeCode - 2);
+		else frames = 192;
+		bits1(8); // CRC-8
+
+		std::vector<std::vector<SInt32> > decoded(channels, std::vector<SInt32>(frames));
+		for(unsigned int c = 0; c < channels && problem.empty(); c++) {
+			const bool side = (assignment == 8 && c == 1) || (assignment == 9 && c == 0) || (assignment == 10 && c == 1);
+			subframe(&decoded[c][0], frames, bits + (side ? 1 : 0));
+		}
+		if(!problem.empty()) return;
+
+		for(size_t i = 0; i < frames; i++) {
+			if(assignment == 8) {
+				decoded[1][i] = decoded[0][i] - decoded[1][i];
+			} else if(assignment == 9) {
+				decoded[0][i] = decoded[0][i] + decoded[1][i];
+			} else if(assignment == 10) {
+				const SInt64 mid = ((SInt64)decoded[0][i] << 1) | (decoded[1][i] & 1);
+				const SInt64 side = decoded[1][i];
+				decoded[0][i] = (mid + side) >> 1;
+				decoded[1][i] = (mid - side) >> 1;
+			}
+		}
+
+		if(_bit) {_bit = 0; _p++;}
+		UInt16 crc = 0;
+		for(size_t i = start; i < _p; i++) {
+			crc ^= _data[i] << 8;
+			for(int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+		}
+		if(bits1(16) != crc) {problem = "bad frame CRC"; return;}
+
+		for(unsigned int c = 0; c < channels; c++) {
+			samples[c].insert(samples[c].end(), decoded[c].begin(), decoded[c].end());
+		}
+	}
+
+	void subframe(SInt32 * out, size_t frames, unsigned int sampleBits)
+	{
+		bits1(1);
+		const unsigned int type = bits1(6);
+		unsigned int wasted = 0;
+		if(bits1(1)) wasted = unary() + 1;
+		sampleBits -= wasted;
+
+		if(type == 0) {
+			const SInt32 value = signedBits(sampleBits);
+			std::fill(out, out + frames, value);
+		} else if(type == 1) {
+			for(size_t i = 0; i < frames; i++) out[i] = signedBits(sampleBits);
+		} else if(type >= 8 && type <= 12) {
+			const unsigned int order = type - 8;
+			for(unsigned int i = 0; i < order; i++) out[i] = signedBits(sampleBits);
+			residual(out, frames, order);
+			static const int fixed[5][4] = {{0}, {1}, {2, -1}, {3, -3, 1}, {4, -6, 4, -1}};
+			for(size_t i = order; i < frames; i++) {
+				SInt64 prediction = 0;
+				for(unsigned int j = 0; j < order; j++) prediction += (SInt64)fixed[order][j] * out[i - 1 - j];
+				out[i] += prediction;
+			}
+		} else if(type >= 32) {
+			const unsigned int order = type - 31;
+			for(unsigned int i = 0; i < order; i++) out[i] = signedBits(sampleBits);
+			const unsigned int precision = bits1(4) + 1;
+			const int shift = signedBits(5);
+			SInt32 coefficients[32];
+			for(unsigned int i = 0; i < order; i++) coefficients[i] = signedBits(precision);
+			residual(out, frames, order);
+			for(size_t i = order; i < frames; i++) {
+				SInt64 sum = 0;
+				for(unsigned int j = 0; j < order; j++) sum += (SInt64)coefficients[j] * out[i - 1 - j];
+				out[i] += sum >> shift;
+			}
+		} else {
+			problem = "reserved subframe type";
+		}
+
+		if(wasted) {
+			for(size_t i = 0; i < frames; i++) out[i] <<= wasted;
+		}
+	}
+
+	void residual(SInt32 * out, size_t frames, unsigned int order)
+	{
+		const unsigned int method = bits1(2);
+		const unsigned int parameterBits = method == 0 ? 4 : 5;
+		const unsigned int escape = method == 0 ? 15 : 31;
+		const unsigned int partitionOrder = bits1(4);
+		size_t i = order;
+		for(size_t p = 0; p < ((size_t)1 << partitionOrder) && problem.empty(); p++) {
+			const size_t count = (frames >> partitionOrder) - (p == 0 ? order : 0);
+			const unsigned int k = bits1(parameterBits);
+			if(k == escape) {
+				const unsigned int raw = bits1(5);
+				for(size_t j = 0; j < count; j++) out[i++] = signedBits(raw);
+				continue;
+			}
+			for(size_t j = 0; j < count && problem.empty(); j++) {
+				const UInt32 u = (unary() << k) | bits1(k);
+				out[i++] = (SInt32)(u >> 1) ^ -(SInt32)(u & 1);
+			}
+		}
+	}
+};
+
+// Decodes a file and compares it with channels [firstChannel, + its channel
+// count) of the source. Returns an empty string if it's fine
+static std::string check(const std::string &path, const Source &source, unsigned int firstChannel, unsigned int bits, UInt64 frames)
+{
+	FlacReader reader(path);
+	if(!reader.problem.empty()) return reader.problem;
+	if(reader.bits != bits) return "wrong sample size";
+	if(reader.totalFrames != frames) return "wrong length";
+
+	for(unsigned int c = 0; c < reader.channels; c++) {
+		for(UInt64 i = 0; i < frames; i++) {
+			if(reader.samples[c][i] != source.quantized(firstChannel + c, i, bits)) return "samples don't match the source";
+		}
+	}
+	return "";
+}
+
+// checks (then deletes) every group's file, adding up their sizes
+static std::string checkGroups(const std::string &path, const Source &source, unsigned int channels, unsigned int perGroup, unsigned int bits, UInt64 frames, UInt64 &bytes)
+{
+	std::string problem;
+	bytes = 0;
+	for(unsigned int first = 0; first < channels; first += perGroup) {
+		const std::string groupPath = channels <= perGroup ? path : ofxAudioUnitFlacRecorder::groupPath(path, first, std::min(perGroup, channels - first));
+		if(problem.empty()) problem = check(groupPath, source, first, bits, frames);
+
+		FILE * f = fopen(groupPath.c_str(), "rb");
+		if(f) {
+			fseek(f, 0, SEEK_END);
+			bytes += ftell(f);
+			fclose(f);
+		}
+		remove(groupPath.c_str());
+	}
+	return problem;
+}
+
+static void printProblem(const std::string &problem)
+{
+	printf("\"ok\":%s%s%s%s}\n", problem.empty() ? "true" : "false",
+		   problem.empty() ? "" : ",\"problem\":\"", problem.c_str(), problem.empty() ? "" : "\"");
+	fflush(stdout);
+}
+
+#pragma mark - Benchmarks
+
+static void encode(unsigned int channels, unsigned int bits, Material material, double audioSeconds)
+{
+	const std::string path = directory + "/flacBenchmark.flac";
+	const UInt64 frames = (UInt64)(audioSeconds * kSampleRate) / kBlock * kBlock;
+	Source source(channels, material);
+
+	ofxAudioUnitFlacWriter writer;
+	if(!writer.open(path, channels, kSampleRate, bits)) return;
+
+	std::vector<const Float32 *> planes(channels);
+	Clock::time_point start = Clock::now();
+	for(UInt64 done = 0; done < frames; done += kBlock) {
+		const AudioBufferList * list = source.next();
+		for(unsigned int c = 0; c < channels; c++) planes[c] = (const Float32 *)list->mBuffers[c].mData;
+		writer.write(&planes[0], kBlock);
+	}
+	const bool closed = writer.close();
+	const double seconds = secondsSince(start);
+
+	const double rawBytes = (double)frames * channels * bits / 8;
+	std::string problem = closed ? check(path, source, 0, bits, frames) : "couldn't write the file";
+	remove(path.c_str());
+
+	printf("{\"benchmark\":\"encode\",\"channels\":%u,\"bits\":%u,\"material\":\"%s\",\"frames\":%llu,\"seconds\":%.3f,"
+		   "\"x_realtime\":%.1f,\"realtime_channels_per_core\":%.0f,\"ratio\":%.3f,",
+		   channels, bits, materialName(material), (unsigned long long)frames, seconds,
+		   frames / kSampleRate / seconds, channels * frames / kSampleRate / seconds,
+		   writer.getBytesWritten() / rawBytes);
+	printProblem(problem);
+}
+
+static void report(const char * benchmark, unsigned int channels, unsigned int perGroup, unsigned int bits, UInt64 frames, double seconds, const ofxAudioUnitFlacRecorder::Stats &stats)
+{
+	const double rawBytes = (double)frames * channels * bits / 8;
+	printf("{\"benchmark\":\"%s\",\"channels\":%u,\"channels_per_group\":%u,\"groups\":%u,\"bits\":%u,\"frames\":%llu,\"seconds\":%.3f,"
+		   "\"x_realtime\":%.2f,\"encoder_load\":%.3f,\"ratio\":%.3f,\"dropped\":%llu,\"max_backlog_ms\":%.1f,",
+		   benchmark, channels, perGroup, stats.groups, bits, (unsigned long long)frames, seconds,
+		   frames / kSampleRate / seconds, stats.encodeSeconds / (frames / kSampleRate), stats.bytesWritten / rawBytes,
+		   (unsigned long long)stats.droppedFrames, stats.maxBacklog * 1000. / kSampleRate);
+}
+
+static void throughput(unsigned int channels, unsigned int perGroup, unsigned int bits, double audioSeconds)
+{
+	const std::string path = directory + "/flacBenchmark.flac";
+	const UInt64 frames = (UInt64)(audioSeconds * kSampleRate) / kBlock * kBlock;
+	Source source(channels, TONAL);
+	ofxAudioUnitFlacRecorder recorder;
+
+	if(!recorder.start(path, channels, kSampleRate, bits, perGroup)) return;
+
+	Clock::time_point start = Clock::now();
+	for(UInt64 done = 0; done < frames; done += kBlock) {
+		while(recorder.getStats().backlog > kSampleRate) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		recorder.write(source.next(), kBlock);
+	}
+	ofxAudioUnitFlacRecorder::Stats stats = recorder.getStats();
+	const bool ok = recorder.stop();
+	const double seconds = secondsSince(start);
+
+	// the stats go with the recorder's groups, so they're from just before
+	// stop(); the files' sizes are only settled after it
+	const std::string problem = ok ? checkGroups(path, source, channels, perGroup, bits, frames, stats.bytesWritten) : "couldn't write the files";
+	report("throughput", channels, perGroup, bits, frames, seconds, stats);
+	printProblem(problem);
+}
+
+static void realtime(unsigned int channels, unsigned int perGroup, unsigned int bits, double audioSeconds)
+{
+	const std::string path = directory + "/flacBenchmark.flac";
+	const UInt64 frames = (UInt64)(audioSeconds * kSampleRate) / kBlock * kBlock;
+	const std::chrono::duration<double> period(kBlock / kSampleRate);
+	Source source(channels, TONAL);
+	ofxAudioUnitFlacRecorder recorder;
+
+	if(!recorder.start(path, channels, kSampleRate, bits, perGroup)) return;
+
+	// what write() costs the render thread, and the same for the WAV recorder
+	std::vector<double> costs;
+	costs.reserve(frames / kBlock);
+
+	Clock::time_point start = Clock::now();
+	for(UInt64 done = 0; done < frames; done += kBlock) {
+		std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(period * (done / kBlock)));
+		AudioBufferList * list = source.next();
+		Clock::time_point before = Clock::now();
+		recorder.write(list, kBlock);
+		costs.push_back(secondsSince(before));
+	}
+	ofxAudioUnitFlacRecorder::Stats stats = recorder.getStats();
+	const bool ok = recorder.stop();
+	const double seconds = secondsSince(start);
+
+	std::sort(costs.begin(), costs.end());
+	const double median = costs[costs.size() / 2];
+	const double worst = costs.back();
+
+	std::vector<double> wavCosts;
+	ofxAudioUnitDiskRecorder wav;
+	const std::string wavPath = directory + "/flacBenchmark.wav";
+	if(wav.start(wavPath, channels, kSampleRate, OFXAU_WAV_INT24)) {
+		for(size_t i = 0; i < costs.size(); i++) {
+			AudioBufferList * list = source.next();
+			Clock::time_point before = Clock::now();
+			wav.write(list, kBlock);
+			wavCosts.push_back(secondsSince(before));
+			if(i % 64 == 63) std::this_thread::sleep_for(period * 64);
+		}
+		wav.stop();
+		remove(wavPath.c_str());
+		std::sort(wavCosts.begin(), wavCosts.end());
+	}
+
+	const std::string problem = ok ? checkGroups(path, source, channels, perGroup, bits, frames, stats.bytesWritten) : "couldn't write the files";
+	report("realtime", channels, perGroup, bits, frames, seconds, stats);
+	printf("\"write_median_us\":%.2f,\"write_max_us\":%.2f,\"wav_write_median_us\":%.2f,",
+		   median * 1e6, worst * 1e6, wavCosts.empty() ? 0 : wavCosts[wavCosts.size() / 2] * 1e6);
+	printProblem(problem);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+	directory = optionValue(argc, argv, "--dir", directory);
+
+	const double encodeSeconds = quick ? 5 : 30;
+	const Material materials[] = {TONAL, NOISE, SILENCE};
+	for(size_t m = 0; m < sizeof(materials) / sizeof(materials[0]); m++) {
+		encode(2, 16, materials[m], encodeSeconds);
+		encode(2, 24, materials[m], encodeSeconds);
+		encode(8, 24, materials[m], encodeSeconds);
+	}
+
+	// 32 channels on four and on eight encoder threads, and smaller
+	// recordings on one
+	const double recordSeconds = quick ? 5 : 60;
+	throughput(32, 8, 24, recordSeconds);
+	throughput(32, 4, 24, recordSeconds);
+	throughput(8, 8, 24, recordSeconds);
+	throughput(2, 2, 16, recordSeconds);
+
+	realtime(32, 8, 24, quick ? 3 : 30);
+	realtime(64, 8, 24, quick ? 3 : 30);
+
+	return 0;
+}
@@ -0,0 +1,590 @@
+// Simulated callback driver for ofxAudioUnitInput's capture path (the code in
+// ofxAudioUnitInputCapture): a fake input device calls InputCaptureCallback()
+// the way the HAL unit's input callback would, and fake destinations call
+// InputPullCallback() the way their render callbacks would.
+//
+//   SOURCES="inputDriverBenchmark.cpp ../src/ofxAudioUnitInputCapture.cpp ../src/ofxAudioUnitCaptureBuffer.cpp ../src/ofxAudioUnitJitterBuffer.cpp"
+//
+// The fake device numbers its frames from its own sample clock (frame n
+// holds n + 1 on every channel, so 0 only ever means silence). Whatever a
+// consumer pulls can then be checked against its counters: the values it
+// sees have to keep increasing, the frames it never saw have to add up to
+// droppedFrames and the silent ones to zeroFilledFrames.
+//
+// "prealloc" sizes the buffers for a device rate and maximum slice, then
+// makes callbacks of every size up to that maximum plus some beyond it. The
+// source checks that every buffer it's handed fits inside the preallocated
+// storage; oversized callbacks have to be turned away with
+// kAudioUnitErr_TooManyFramesToProcess and counted as dropped. "fanout" runs
+// the device and several consumers on their own threads, paced like real
+// devices (4x faster than realtime), with and without a consumer that falls
+// behind. "reconnect" stops one of two consumers for longer than
+// kStaleConsumerTime, as if its destination had been connected elsewhere,
+// and starts it again: it has to be stale only while it's stopped, and the
+// frames it missed mustn't be counted as dropped. Connecting it again has to
+// count it as live before it pulls. "realloc" free-runs like "fanout" while
+// the main thread keeps reallocating the buffers and adding destinations,
+// which is what the BufferGuard is for; run it under ThreadSanitizer. "cost"
+// times a capture callback and a pull callback with 1, 4 and 16 consumers,
+// drift compensation off.
+
+#include "ofxAudioUnitInputCapture.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+struct BufferList
+{
+	std::vector<char> storage;
+	std::vector<std::vector<Float32> > channels;
+
+	BufferList(unsigned int channelCount, size_t frames)
+	: storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * std::max(channelCount, 1u))
+	, channels(channelCount, std::vector<Float32>(frames))
+	{
+		list()->mNumberBuffers = channelCount;
+		for(unsigned int c = 0; c < channelCount; c++) {
+			list()->mBuffers[c].mNumberChannels = 1;
+			list()->mBuffers[c].mDataByteSize = (UInt32)(frames * sizeof(Float32));
+			list()->mBuffers[c].mData = &channels[c][0];
+		}
+	}
+
+	AudioBufferList * list() {return (AudioBufferList *)&storage[0];}
+};
+
+#pragma mark - Fake device
+
+// Stands in for AudioUnitRender on the input unit. Checks that it was handed
+// room for exactly the frames asked for, inside the preallocated storage
+struct Device
+{
+	InputContext * ctx;
+	std::atomic<UInt64> badBuffers;
+
+	static OSStatus render(void *inRefCon,
+						   AudioUnitRenderActionFlags *ioActionFlags,
+						   const AudioTimeStamp *inTimeStamp,
+						   UInt32 inBusNumber,
+						   UInt32 inNumberFrames,
+						   AudioBufferList *ioData)
+	{
+		Device * device = static_cast<Device *>(inRefCon);
+		const std::vector<Float32> &storage = device->ctx->bufferData;
+		const Float32 * begin = storage.empty() ? NULL : &storage[0];
+		const Float32 * end = begin + storage.size();
+		const UInt64 first = (UInt64)inTimeStamp->mSampleTime;
+
+		for(UInt32 c = 0; c < ioData->mNumberBuffers; c++) {
+			Float32 * out = (Float32 *)ioData->mBuffers[c].mData;
+			if(ioData->mBuffers[c].mDataByteSize != inNumberFrames * sizeof(Float32) ||
+			   out < begin || out + inNumberFrames > end) {
+				device->badBuffers.fetch_add(1);
+				return -50;
+			}
+			for(UInt32 i = 0; i < inNumberFrames; i++) {
+				out[i] = (Float32)(first + i + 1);
+			}
+		}
+		return noErr;
+	}
+};
+
+// one callback from the device, starting at sampleTime
+static OSStatus capture(InputContext &ctx, UInt64 sampleTime, UInt32 frames)
+{
+	AudioUnitRenderActionFlags flags = 0;
+	AudioTimeStamp timestamp;
+	memset(&timestamp, 0, sizeof(timestamp));
+	timestamp.mSampleTime = sampleTime;
+	timestamp.mFlags = kAudioTimeStampSampleTimeValid;
+	return InputCaptureCallback(&ctx, &flags, &timestamp, 1, frames, NULL);
+}
+
+static void setUp(InputContext &ctx, Device &device, unsigned int channels, UInt32 maxFrames, unsigned int samplesToBuffer, Float64 sampleRate)
+{
+	device.ctx = &ctx;
+	device.badBuffers = 0;
+	AURenderCallbackStruct source = {Device::render, &device};
+	ctx.source = source;
+	ctx.maxFrames = 0;
+	ctx.sampleRate = 0;
+	ctx.compensateDrift = false;
+	ctx.counters.reset();
+	AllocateInputBuffers(ctx, channels, maxFrames, samplesToBuffer, sampleRate);
+}
+
+// a destination that can't be confused with a real one
+static AudioUnit fakeDestination(size_t index)
+{
+	return reinterpret_cast<AudioUnit>((uintptr_t)(index + 1) * 16);
+}
+
+#pragma mark - Fake destination
+
+// What a consumer has seen so far, for checking against its counters
+struct Tally
+{
+	UInt64 pulls;
+	UInt64 lastValue;
+	UInt64 gaps;        // frames skipped between values
+	UInt64 silent;      // frames of silence
+	UInt64 backwards;   // values that didn't increase
+	UInt64 mismatched;  // frames whose channels disagree
+	bool started;       // frames from before the first one seen weren't for it
+
+	Tally() : pulls(0), lastValue(0), gaps(0), silent(0), backwards(0), mismatched(0), started(false) { }
+
+	void check(const BufferList &out, UInt32 frames)
+	{
+		pulls++;
+		for(UInt32 i = 0; i < frames; i++) {
+			const Float32 value = out.channels[0][i];
+			for(size_t c = 1; c < out.channels.size(); c++) {
+				if(out.channels[c][i] != value) mismatched++;
+			}
+
+			if(value == 0) {
+				silent++;
+			} else if(started && (UInt64)value <= lastValue) {
+				backwards++;
+			} else {
+				if(started) gaps += (UInt64)value - lastValue - 1;
+				lastValue = (UInt64)value;
+				started = true;
+			}
+		}
+	}
+};
+
+static OSStatus pull(InputConsumer * consumer, BufferList &out, UInt32 frames)
+{
+	AudioUnitRenderActionFlags flags = 0;
+	AudioTimeStamp timestamp;
+	memset(&timestamp, 0, sizeof(timestamp));
+	for(size_t c = 0; c < out.channels.size(); c++) {
+		out.list()->mBuffers[c].mDataByteSize = frames * sizeof(Float32);
+	}
+	return InputPullCallback(consumer, &flags, &timestamp, 0, frames, out.list());
+}
+
+#pragma mark - Cases
+
+static bool prealloc(Float64 sampleRate, UInt32 maxFrames)
+{
+	const unsigned int channels = 2;
+	InputContext ctx;
+	Device device;
+	setUp(ctx, device, channels, maxFrames, 0, sampleRate);
+	InputConsumer * consumer = ConsumerFor(ctx, fakeDestination(0), 0, 0);
+
+	BufferList out(channels, maxFrames * 2);
+	Tally tally;
+	UInt64 sampleTime = 0;
+	UInt64 expectedDropped = 0;
+	unsigned int rejected = 0;
+	unsigned int wrongErrors = 0;
+	unsigned int seed = 7;
+
+	// every slice size up to the maximum, then random ones with a few too
+	// big mixed in, stopping short of 2^24 frames (see realloc below)
+	const unsigned int maxCallbacks = quick ? 2000 : 20000;
+	unsigned int callbacks = 0;
+	for(unsigned int n = 0; n < maxCallbacks && sampleTime < (1 << 24) - maxFrames * 2; n++, callbacks++) {
+		seed = seed * 1664525u + 1013904223u;
+		UInt32 frames = n < maxFrames ? n + 1 : 1 + (seed >> 8) % maxFrames;
+		const bool oversized = n >= maxFrames && (seed & 0xf) == 0;
+		if(oversized) frames = maxFrames + 1 + (seed >> 4) % maxFrames;
+
+		const OSStatus s = capture(ctx, sampleTime, frames);
+		sampleTime += frames;
+
+		if(oversized) {
+			rejected++;
+			expectedDropped += frames;
+			if(s != kAudioUnitErr_TooManyFramesToProcess) wrongErrors++;
+		} else if(s != noErr) {
+			wrongErrors++;
+		}
+
+		// drain everything captured, so the consumer never falls behind
+		const UInt32 available = (UInt32)(ctx.captureBuffer.getWriteCount() - consumer->readCursor);
+		if(available > 0) {
+			pull(consumer, out, available);
+			tally.check(out, available);
+		}
+	}
+
+	const bool ok =
+		device.badBuffers == 0 && wrongErrors == 0 &&
+		ctx.maxFrames == maxFrames && ctx.sampleRate == sampleRate &&
+		consumer->jitterBuffer.sampleRate() == sampleRate &&
+		ctx.counters.droppedFrames == expectedDropped &&
+		consumer->counters.droppedFrames == 0 && consumer->counters.zeroFilledFrames == 0 &&
+		tally.backwards == 0 && tally.mismatched == 0 && tally.silent == 0 &&
+		tally.gaps == expectedDropped && tally.lastValue == sampleTime;
+
+	printf("{\"benchmark\":\"prealloc\",\"sample_rate\":%.0f,\"max_frames\":%u,\"capacity\":%zu,\"callbacks\":%u,\"rejected\":%u,\"dropped_frames\":%llu,\"bad_buffers\":%llu,\"wrong_errors\":%u,\"gaps\":%llu,\"ok\":%s}\n",
+		   sampleRate, maxFrames, ctx.captureBuffer.capacity(), callbacks, rejected,
+		   (unsigned long long)ctx.counters.droppedFrames.load(), (unsigned long long)device.badBuffers.load(),
+		   wrongErrors, (unsigned long long)tally.gaps, ok ? "true" : "false");
+	return ok;
+}
+
+// Runs a consumer until told to stop, pulling frames at a time every
+// period (0 for as fast as it can). A slow consumer sleeps through some of
+// its periods, so it falls behind and has to skip ahead
+static void consume(InputConsumer * consumer, unsigned int channels, UInt32 frames, double period, bool slow,
+					const std::atomic<bool> &running, Tally &tally)
+{
+	BufferList out(channels, frames);
+	const Clock::time_point start = Clock::now();
+	UInt64 n = 0;
+
+	while(running.load()) {
+		pull(consumer, out, frames);
+		tally.check(out, frames);
+		n++;
+
+		if(slow && n % 64 == 0) {
+			std::this_thread::sleep_for(std::chrono::duration<double>(period * 32));
+		}
+		if(period > 0) {
+			std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period * n)));
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+// Checks one consumer's tally against its counters. Frames the input lost
+// before they reached the capture buffer show up as gaps too, unless the
+// buffers were reallocated along the way (which throws away whatever hadn't
+// been read yet), in which case there's only a lower bound
+static bool consistent(const Tally &tally, const InputConsumer * consumer, UInt64 inputDropped, bool reallocated)
+{
+	const UInt64 dropped = consumer->counters.droppedFrames.load();
+	const UInt64 zeroFilled = consumer->counters.zeroFilledFrames.load();
+
+	if(tally.backwards || tally.mismatched) return false;
+	if(tally.silent != zeroFilled) return false;
+	if(reallocated) return tally.gaps >= dropped;
+	return tally.gaps == dropped + inputDropped;
+}
+
+static bool fanout(unsigned int consumerCount, bool withSlowConsumer)
+{
+	const unsigned int channels = 2;
+	const Float64 sampleRate = 48000;
+	const UInt32 inputFrames = 256;
+	const UInt32 outputFrames = 512;
+	const double speed = 4;
+	const double seconds = quick ? 0.5 : 4;
+
+	InputContext ctx;
+	Device device;
+	setUp(ctx, device, channels, 1024, 4096, sampleRate);
+
+	std::vector<InputConsumer *> consumers;
+	for(unsigned int i = 0; i < consumerCount; i++) {
+		consumers.push_back(ConsumerFor(ctx, fakeDestination(i), 0, 0));
+	}
+
+	std::atomic<bool> running(true);
+	std::vector<Tally> tallies(consumerCount);
+	std::vector<std::thread> threads;
+	for(unsigned int i = 0; i < consumerCount; i++) {
+		const bool slow = withSlowConsumer && i == consumerCount - 1;
+		threads.push_back(std::thread(consume, consumers[i], channels, outputFrames, outputFrames / sampleRate / speed, slow,
+									  std::cref(running), std::ref(tallies[i])));
+	}
+
+	const double period = inputFrames / sampleRate / speed;
+	const Clock::time_point start = Clock::now();
+	UInt64 sampleTime = 0;
+	UInt64 callbacks = 0;
+	while(secondsSince(start) < seconds) {
+		capture(ctx, sampleTime, inputFrames);
+		sampleTime += inputFrames;
+		callbacks++;
+		std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period * callbacks)));
+	}
+
+	running.store(false);
+	for(size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+	bool ok = device.badBuffers == 0;
+	UInt64 totalDropped = 0;
+	UInt64 totalSilent = 0;
+	UInt64 totalPulls = 0;
+	for(unsigned int i = 0; i < consumerCount; i++) {
+		ok = consistent(tallies[i], consumers[i], ctx.counters.droppedFrames, false) && ok;
+		totalDropped += consumers[i]->counters.droppedFrames;
+		totalSilent += tallies[i].silent;
+		totalPulls += tallies[i].pulls;
+	}
+
+	// the slow consumer has to have noticed it fell behind
+	if(withSlowConsumer) {
+		ok = ok && consumers.back()->counters.overruns > 0 && consumers.back()->counters.droppedFrames > 0;
+	}
+
+	printf("{\"benchmark\":\"fanout\",\"consumers\":%u,\"slow_consumer\":%s,\"cores\":%u,\"frames\":%llu,\"pulls\":%llu,\"dropped_frames\":%llu,\"zero_filled_frames\":%llu,\"input_dropped_frames\":%llu,\"ok\":%s}\n",
+		   consumerCount, withSlowConsumer ? "true" : "false", std::thread::hardware_concurrency(),
+		   (unsigned long long)sampleTime, (unsigned long long)totalPulls, (unsigned long long)totalDropped,
+		   (unsigned long long)totalSilent, (unsigned long long)ctx.counters.droppedFrames.load(), ok ? "true" : "false");
+	return ok;
+}
+
+// One consumer keeps pulling while the other stops for a while, then starts
+// again, counted in a fresh tally since what it missed wasn't lost
+static void reconnecting(InputConsumer * consumer, unsigned int channels, UInt32 frames, double period,
+						 double stopAt, double restartAt, double stopAfter, Tally &before, Tally &after)
+{
+	BufferList out(channels, frames);
+	const Clock::time_point start = Clock::now();
+	UInt64 n = 0;
+
+	for(double t = 0; t < stopAfter; t = secondsSince(start)) {
+		if(t < stopAt || t >= restartAt) {
+			pull(consumer, out, frames);
+			(t < stopAt ? before : after).check(out, frames);
+		}
+		n++;
+		std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period * n)));
+	}
+}
+
+static bool reconnect()
+{
+	const unsigned int channels = 2;
+	const Float64 sampleRate = 48000;
+	const UInt32 inputFrames = 256;
+	const UInt32 outputFrames = 512;
+	const double speed = 4;
+	const double stopAt = 0.3;
+	const double restartAt = stopAt + kStaleConsumerTime + 0.2;
+	const double seconds = restartAt + (quick ? 0.3 : 2);
+
+	InputContext ctx;
+	Device device;
+	setUp(ctx, device, channels, 1024, 4096, sampleRate);
+
+	InputConsumer * steady = ConsumerFor(ctx, fakeDestination(0), 0, 0);
+	InputConsumer * stopping = ConsumerFor(ctx, fakeDestination(1), 0, 0);
+
+	std::atomic<bool> running(true);
+	Tally steadyTally, before, after;
+	const double outputPeriod = outputFrames / sampleRate / speed;
+	std::thread steadyThread(consume, steady, channels, outputFrames, outputPeriod, false, std::cref(running), std::ref(steadyTally));
+	std::thread stoppingThread(reconnecting, stopping, channels, outputFrames, outputPeriod, stopAt, restartAt, seconds,
+							   std::ref(before), std::ref(after));
+
+	// while it's stopped, only it should be stale, and only once it's been
+	// stopped long enough
+	bool freshWhilePulling = true;
+	bool staleWhileStopped = false;
+	bool otherStale = false;
+
+	const double period = inputFrames / sampleRate / speed;
+	const Clock::time_point start = Clock::now();
+	UInt64 sampleTime = 0;
+	UInt64 callbacks = 0;
+	for(double t = 0; t < seconds; t = secondsSince(start)) {
+		capture(ctx, sampleTime, inputFrames);
+		sampleTime += inputFrames;
+		callbacks++;
+
+		if(IsStale(ctx, *steady)) otherStale = true;
+		if(t > 0.1 && t < stopAt - 0.05 && IsStale(ctx, *stopping)) freshWhilePulling = false;
+		if(t > stopAt + kStaleConsumerTime + 0.05 && t < restartAt - 0.05 && IsStale(ctx, *stopping)) staleWhileStopped = true;
+
+		std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period * callbacks)));
+	}
+
+	running.store(false);
+	steadyThread.join();
+	stoppingThread.join();
+
+	const bool freshAfterRestart = !IsStale(ctx, *stopping);
+
+	// connecting a destination again counts it as live straight away, before
+	// it's pulled anything
+	bool freshOnReconnect = false;
+	{
+		const double now = stopping->lastPull.load();
+		stopping->lastPull = now - 2 * kStaleConsumerTime;
+		stopping->connectedAt = now - 2 * kStaleConsumerTime;
+		const bool staleBefore = IsStale(ctx, *stopping);
+		freshOnReconnect = staleBefore && ConsumerFor(ctx, fakeDestination(1), 0, 0) == stopping && !IsStale(ctx, *stopping);
+	}
+
+	// the frames it missed while stopped mustn't show up in its counters
+	Tally both = before;
+	both.pulls += after.pulls;
+	both.gaps += after.gaps;
+	both.silent += after.silent;
+	both.backwards += after.backwards + (after.started && after.lastValue <= before.lastValue ? 1 : 0);
+	both.mismatched += after.mismatched;
+
+	bool ok = device.badBuffers == 0 && freshWhilePulling && staleWhileStopped && !otherStale && freshAfterRestart && freshOnReconnect;
+	ok = consistent(steadyTally, steady, ctx.counters.droppedFrames, false) && ok;
+	ok = before.pulls > 0 && after.pulls > 0 && consistent(both, stopping, ctx.counters.droppedFrames, false) && ok;
+
+	printf("{\"benchmark\":\"reconnect\",\"frames\":%llu,\"stale_while_stopped\":%s,\"fresh_after_restart\":%s,\"fresh_on_reconnect\":%s,\"overruns\":%llu,\"dropped_frames\":%llu,\"zero_filled_frames\":%llu,\"ok\":%s}\n",
+		   (unsigned long long)sampleTime, staleWhileStopped ? "true" : "false", freshAfterRestart ? "true" : "false", freshOnReconnect ? "true" : "false",
+		   (unsigned long long)stopping->counters.overruns.load(), (unsigned long long)stopping->counters.droppedFrames.load(),
+		   (unsigned long long)stopping->counters.zeroFilledFrames.load(), ok ? "true" : "false");
+	return ok;
+}
+
+static bool reallocation(unsigned int consumerCount)
+{
+	const unsigned int channels = 2;
+	const Float64 sampleRate = 48000;
+	const UInt32 maxFrames = 1024;
+	const UInt32 outputFrames = 512;
+	const double seconds = quick ? 0.5 : 4;
+
+	InputContext ctx;
+	Device device;
+	setUp(ctx, device, channels, maxFrames, 4096, sampleRate);
+
+	std::vector<InputConsumer *> consumers;
+	for(unsigned int i = 0; i < consumerCount; i++) {
+		consumers.push_back(ConsumerFor(ctx, fakeDestination(i), 0, 0));
+	}
+
+	std::atomic<bool> running(true);
+	std::vector<Tally> tallies(consumerCount);
+	std::vector<std::thread> threads;
+	for(unsigned int i = 0; i < consumerCount; i++) {
+		threads.push_back(std::thread(consume, consumers[i], channels, outputFrames, 0., false,
+									  std::cref(running), std::ref(tallies[i])));
+	}
+
+	// the device free-runs with slices of every size it's allowed to make.
+	// Stops short of 2^24 frames, where floats stop holding integers exactly
+	std::atomic<UInt64> sampleTime(0);
+	std::atomic<UInt64> badStatus(0);
+	std::thread input([&] {
+		unsigned int seed = 3;
+		UInt64 t = 0;
+		while(running.load() && t < (1 << 24) - maxFrames) {
+			seed = seed * 1664525u + 1013904223u;
+			const UInt32 frames = 1 + (seed >> 8) % maxFrames;
+			if(capture(ctx, t, frames) != noErr) badStatus.fetch_add(1);
+			t += frames;
+			sampleTime.store(t);
+			std::this_thread::yield();
+		}
+	});
+
+	// meanwhile, keep resizing the capture buffer and connecting new
+	// destinations (which nobody pulls from)
+	const Clock::time_point start = Clock::now();
+	unsigned int reallocations = 0;
+	size_t destinations = consumerCount;
+	while(secondsSince(start) < seconds) {
+		AllocateInputBuffers(ctx, channels, maxFrames, reallocations % 2 ? 8192 : 4096, sampleRate);
+		reallocations++;
+		if(destinations < consumerCount + 32) {
+			ConsumerFor(ctx, fakeDestination(destinations++), 0, 0);
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+	}
+
+	running.store(false);
+	input.join();
+	for(size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+	bool ok = device.badBuffers == 0 && badStatus == 0;
+	UInt64 totalPulls = 0;
+	UInt64 totalSilent = 0;
+	for(unsigned int i = 0; i < consumerCount; i++) {
+		ok = consistent(tallies[i], consumers[i], ctx.counters.droppedFrames, true) && ok;
+		totalPulls += tallies[i].pulls;
+		totalSilent += tallies[i].silent;
+	}
+
+	printf("{\"benchmark\":\"realloc\",\"consumers\":%u,\"cores\":%u,\"reallocations\":%u,\"destinations\":%zu,\"frames\":%llu,\"pulls\":%llu,\"zero_filled_frames\":%llu,\"input_dropped_frames\":%llu,\"ok\":%s}\n",
+		   consumerCount, std::thread::hardware_concurrency(), reallocations, destinations,
+		   (unsigned long long)sampleTime.load(), (unsigned long long)totalPulls, (unsigned long long)totalSilent,
+		   (unsigned long long)ctx.counters.droppedFrames.load(), ok ? "true" : "false");
+	return ok;
+}
+
+static void cost(unsigned int consumerCount, UInt32 frames)
+{
+	const unsigned int channels = 2;
+	const unsigned int blocks = quick ? 2000 : 20000;
+
+	InputContext ctx;
+	Device device;
+	setUp(ctx, device, channels, frames, 4096, 48000);
+
+	std::vector<InputConsumer *> consumers;
+	for(unsigned int i = 0; i < consumerCount; i++) {
+		consumers.push_back(ConsumerFor(ctx, fakeDestination(i), 0, 0));
+	}
+
+	BufferList out(channels, frames);
+	double captureSeconds = 0;
+	double pullSeconds = 0;
+	UInt64 sampleTime = 0;
+
+	for(unsigned int b = 0; b < blocks; b++) {
+		const Clock::time_point captureStart = Clock::now();
+		capture(ctx, sampleTime, frames);
+		captureSeconds += secondsSince(captureStart);
+		sampleTime += frames;
+
+		const Clock::time_point pullStart = Clock::now();
+		for(unsigned int i = 0; i < consumerCount; i++) {
+			pull(consumers[i], out, frames);
+		}
+		pullSeconds += secondsSince(pullStart);
+	}
+
+	printf("{\"benchmark\":\"cost\",\"consumers\":%u,\"frames\":%u,\"channels\":%u,\"capture_ns\":%.0f,\"pull_ns\":%.0f,\"realtime_fraction\":%.5f}\n",
+		   consumerCount, frames, channels, captureSeconds / blocks * 1e9, pullSeconds / (blocks * (double)consumerCount) * 1e9,
+		   (captureSeconds + pullSeconds) / (blocks * frames / 48000.));
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+
+	const Float64 rates[] = {44100, 48000, 96000};
+	const UInt32 maxFrames[] = {512, 1024, 4096};
+	for(int r = 0; r < 3; r++) {
+		for(int m = 0; m < 3; m++) {
+			ok = prealloc(rates[r], maxFrames[m]) && ok;
+		}
+	}
+
+	ok = fanout(1, false) && ok;
+	ok = fanout(3, false) && ok;
+	ok = fanout(3, true) && ok;
+
+	ok = reconnect() && ok;
+
+	ok = reallocation(2) && ok;
+
+	const unsigned int consumerCounts[] = {1, 4, 16};
+	for(int c = 0; c < 3; c++) {
+		cost(consumerCounts[c], 256);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+// Drifting clock simulation for ofxAudioUnitJitterBuffer, the PI controlled,
+// Kaiser-sinc resampling reader between ofxAudioUnitInput's capture buffer
+// and a destination running on another device's clock.
+//
+//   SOURCES="jitterBufferBenchmark.cpp ../src/ofxAudioUnitJitterBuffer.cpp ../src/ofxAudioUnitCaptureBuffer.cpp"
+//
+// Nothing runs in real time: an input device and an output device are
+// simulated on their own clocks, each off its nominal 48kHz by some ppm, and
+// their callbacks are interleaved in simulated time (with up to a millisecond
+// of scheduling jitter on top). The input writes a 997Hz sine to a capture
+// buffer and timestamps every write; the output reads it back through the
+// jitter buffer.
+//
+// "drift" runs each pair of clocks for a few simulated minutes and reports,
+// once the controller has had time to settle: the clock ratio it estimated
+// against the true one (in ppm), the latency it holds against its target,
+// how far the read rate wanders from the true ratio while holding it, how
+// often it had to resync, and the SNR of the resampled sine against the
+// best fitting sine (within 100ppm of the true output frequency, as the
+// wandering read rate moves it about). "step" changes the input clock
+// halfway through, the way a device switching its clock source would, and
+// checks that it settles again without a resync. "cost" is the CPU time per
+// output frame and channel.
+
+#include "ofxAudioUnitJitterBuffer.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const double kSampleRate = 48000;
+static const double kFrequency = 997;
+static const double kAmplitude = 0.5;
+
+struct BufferList
+{
+	std::vector<char> storage;
+	std::vector<std::vector<Float32> > channels;
+
+	BufferList(unsigned int channelCount, size_t frames)
+	: storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * std::max(channelCount, 1u))
+	, channels(channelCount, std::vector<Float32>(frames))
+	{
+		list()->mNumberBuffers = channelCount;
+		for(unsigned int c = 0; c < channelCount; c++) {
+			list()->mBuffers[c].mNumberChannels = 1;
+			list()->mBuffers[c].mDataByteSize = (UInt32)(frames * sizeof(Float32));
+			list()->mBuffers[c].mData = &channels[c][0];
+		}
+	}
+
+	AudioBufferList * list() {return (AudioBufferList *)&storage[0];}
+};
+
+// Least squares fit of a sine at a given frequency (plus DC) to x, returns
+// the ratio of the fitted sine's power to the residual's, in dB
+static double sineSnrAt(const std::vector<Float32> &x, double omega)
+{
+	// normal equations for [sin, cos, 1]
+	double a[3][3] = {{0}};
+	double b[3] = {0};
+	for(size_t i = 0; i < x.size(); i++) {
+		const double basis[3] = {sin(omega * i), cos(omega * i), 1};
+		for(int r = 0; r < 3; r++) {
+			b[r] += basis[r] * x[i];
+			for(int c = 0; c < 3; c++) a[r][c] += basis[r] * basis[c];
+		}
+	}
+
+	// Gaussian elimination, the matrix is well conditioned
+	for(int p = 0; p < 3; p++) {
+		for(int r = p + 1; r < 3; r++) {
+			const double f = a[r][p] / a[p][p];
+			for(int c = p; c < 3; c++) a[r][c] -= f * a[p][c];
+			b[r] -= f * b[p];
+		}
+	}
+	double coef[3];
+	for(int r = 2; r >= 0; r--) {
+		double sum = b[r];
+		for(int c = r + 1; c < 3; c++) sum -= a[r][c] * coef[c];
+		coef[r] = sum / a[r][r];
+	}
+
+	double signal = 0;
+	double noise = 0;
+	for(size_t i = 0; i < x.size(); i++) {
+		const double fit = coef[0] * sin(omega * i) + coef[1] * cos(omega * i);
+		signal += fit * fit;
+		noise += (x[i] - fit - coef[2]) * (x[i] - fit - coef[2]);
+	}
+	return 10 * log10(signal / std::max(noise, 1e-30));
+}
+
+// The same, at whichever frequency within 100ppm of omega fits best. The
+// controller steering the latency moves the frequency a little, which is
+// inaudible but would swamp the resampler's own errors
+static double sineSnr(const std::vector<Float32> &x, double omega)
+{
+	const double golden = (sqrt(5.) - 1) / 2;
+	double lo = omega * (1 - 100e-6);
+	double hi = omega * (1 + 100e-6);
+	double a = hi - golden * (hi - lo);
+	double b = lo + golden * (hi - lo);
+	double snrA = sineSnrAt(x, a);
+	double snrB = sineSnrAt(x, b);
+
+	for(int i = 0; i < 30; i++) {
+		if(snrA > snrB) {
+			hi = b; b = a; snrB = snrA;
+			a = hi - golden * (hi - lo);
+			snrA = sineSnrAt(x, a);
+		} else {
+			lo = a; a = b; snrA = snrB;
+			b = lo + golden * (hi - lo);
+			snrB = sineSnrAt(x, b);
+		}
+	}
+	return std::max(snrA, snrB);
+}
+
+struct Scenario
+{
+	const char * name;
+	double inputPpm;
+	double outputPpm;
+	double inputPpmLater; // from halfway through
+	UInt32 inputFrames;
+	UInt32 outputFrames;
+	double jitter;        // seconds
+};
+
+struct Result
+{
+	double estimatedPpm;
+	double truePpm;
+	double latency;
+	double latencyError;  // worst distance from the target once settled
+	double ratioError;    // worst distance of the read rate from the true ratio, in ppm
+	double targetLatency;
+	UInt64 resyncs;
+	UInt64 silentFrames;  // after priming
+	double snr;           // worst over the settled windows
+	double cpuSeconds;
+	UInt64 outputFrames;
+};
+
+static Result simulate(const Scenario &scenario, unsigned int channels, double seconds, double settleSeconds)
+{
+	ofxAudioUnitCaptureBuffer capture(channels, 8192);
+	ofxAudioUnitJitterBuffer jitter;
+	jitter.allocate(channels, kSampleRate);
+
+	BufferList in(channels, scenario.inputFrames);
+	BufferList out(channels, scenario.outputFrames);
+
+	// the analysis window is 0.1s of output, checked every second
+	const size_t window = kSampleRate / 10;
+	std::vector<Float32> analysis;
+	analysis.reserve(window);
+
+	Result result;
+	memset(&result, 0, sizeof(result));
+	result.snr = INFINITY;
+
+	double inputRate = kSampleRate * (1 + scenario.inputPpm * 1e-6);
+	const double outputRate = kSampleRate * (1 + scenario.outputPpm * 1e-6);
+	const double stepAt = scenario.inputPpmLater != scenario.inputPpm ? seconds / 2 : INFINITY;
+	const double settledAt = std::isinf(stepAt) ? settleSeconds : stepAt + settleSeconds;
+	double nextWindow = settledAt;
+
+	UInt64 inputWritten = 0;
+	double inputTime = 0;   // when the next input callback is due
+	double outputTime = 0;
+	double inputPhase = 0;  // of the sine, in cycles
+	UInt64 cursor = 0;
+	UInt64 outputFrames = 0;
+	bool primed = false;
+	unsigned int seed = 1;
+	double cpu = 0;
+
+	while(outputTime < seconds) {
+		seed = seed * 1664525u + 1013904223u;
+		const double late = scenario.jitter * ((seed >> 8) / 16777216.0);
+
+		if(inputTime <= outputTime) {
+			if(inputTime >= stepAt && inputRate != kSampleRate * (1 + scenario.inputPpmLater * 1e-6)) {
+				inputRate = kSampleRate * (1 + scenario.inputPpmLater * 1e-6);
+			}
+
+			for(UInt32 i = 0; i < scenario.inputFrames; i++) {
+				const Float32 sample = kAmplitude * sin(2 * M_PI * inputPhase);
+				for(unsigned int c = 0; c < channels; c++) in.channels[c][i] = sample;
+				inputPhase += kFrequency / kSampleRate;
+				if(inputPhase >= 1) inputPhase -= 1;
+			}
+			capture.write(in.list(), scenario.inputFrames);
+			inputWritten += scenario.inputFrames;
+			jitter.timestampWrite(inputWritten, inputTime + late);
+			inputTime += scenario.inputFrames / inputRate;
+			continue;
+		}
+
+		const Clock::time_point start = Clock::now();
+		const ofxAudioUnitJitterBuffer::ReadResult read =
+			jitter.read(capture, cursor, out.list(), scenario.outputFrames, outputTime + late);
+		cpu += secondsSince(start);
+
+		primed = primed || read.silentFrames < scenario.outputFrames;
+		if(primed) result.silentFrames += read.silentFrames;
+		outputTime += scenario.outputFrames / outputRate;
+		outputFrames += scenario.outputFrames;
+
+		if(outputTime < settledAt) continue;
+
+		const ofxAudioUnitJitterBuffer::Stats stats = jitter.getStats();
+		result.latencyError = std::max(result.latencyError, fabs(stats.latency - stats.targetLatency));
+		result.ratioError = std::max(result.ratioError, fabs(stats.ratio / (inputRate / outputRate) - 1) * 1e6);
+
+		if(outputTime >= nextWindow || !analysis.empty()) {
+			for(UInt32 i = 0; i < scenario.outputFrames && analysis.size() < window; i++) {
+				analysis.push_back(out.channels[0][i]);
+			}
+			if(analysis.size() == window) {
+				const double ratio = inputRate / outputRate;
+				result.snr = std::min(result.snr, sineSnr(analysis, 2 * M_PI * kFrequency / kSampleRate * ratio));
+				analysis.clear();
+				nextWindow = outputTime + 1;
+			}
+		}
+	}
+
+	const ofxAudioUnitJitterBuffer::Stats stats = jitter.getStats();
+	result.estimatedPpm = (stats.estimatedRatio - 1) * 1e6;
+	result.truePpm = (inputRate / outputRate - 1) * 1e6;
+	result.latency = stats.latency;
+	result.targetLatency = stats.targetLatency;
+	result.resyncs = stats.resyncs;
+	result.cpuSeconds = cpu;
+	result.outputFrames = outputFrames;
+	return result;
+}
+
+static bool drift(const Scenario &scenario)
+{
+	// the controller's loop period is 20s, so give it a few of those
+	const double seconds = quick ? 120 : 300;
+	const double settle = 90;
+	const Result r = simulate(scenario, 1, seconds, settle);
+
+	const bool ok =
+		fabs(r.estimatedPpm - r.truePpm) < 10 &&
+		r.latencyError < 8 && r.ratioError < 100 &&
+		r.resyncs == 0 && r.silentFrames == 0 &&
+		r.snr > 70;
+
+	printf("{\"benchmark\":\"%s\",\"input_ppm\":%.0f,\"output_ppm\":%.0f,\"input_ppm_later\":%.0f,\"input_frames\":%u,\"output_frames\":%u,\"jitter_ms\":%.1f,"
+		   "\"simulated_s\":%.0f,\"true_ppm\":%.2f,\"estimated_ppm\":%.2f,\"latency_frames\":%.1f,\"target_latency_frames\":%.1f,\"latency_ms\":%.2f,"
+		   "\"max_latency_error_frames\":%.2f,\"max_ratio_error_ppm\":%.1f,\"resyncs\":%llu,\"silent_frames\":%llu,\"snr_db\":%.1f,\"ok\":%s}\n",
+		   scenario.name, scenario.inputPpm, scenario.outputPpm, scenario.inputPpmLater, scenario.inputFrames, scenario.outputFrames,
+		   scenario.jitter * 1000, seconds, r.truePpm, r.estimatedPpm, r.latency, r.targetLatency, r.latency / kSampleRate * 1000,
+		   r.latencyError, r.ratioError, (unsigned long long)r.resyncs, (unsigned long long)r.silentFrames, r.snr, ok ? "true" : "false");
+	return ok;
+}
+
+static void cost(unsigned int channels)
+{
+	const Scenario scenario = {"cost", 50, -50, 50, 512, 512, 0};
+	const Result r = simulate(scenario, channels, quick ? 10 : 60, INFINITY);
+
+	printf("{\"benchmark\":\"cost\",\"channels\":%u,\"ns_per_frame_channel\":%.2f,\"realtime_fraction\":%.5f}\n",
+		   channels, r.cpuSeconds / (r.outputFrames * (double)channels) * 1e9, r.cpuSeconds / (r.outputFrames / kSampleRate));
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+
+	const Scenario scenarios[] = {
+		{"drift",    0,    0,    0,  512,  512, 0},
+		{"drift",   50,  -50,   50,  512,  512, 0.001},
+		{"drift", -100,  100, -100,  256,  512, 0.001},
+		{"drift",  200,    0,  200,   64, 1024, 0.001},
+		{"drift", -300,   50, -300, 1024,   64, 0.001},
+		{"step",    50,    0,  -50,  512,  256, 0.001},
+	};
+
+	for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		if(quick && strcmp(scenarios[i].name, "step") == 0) continue;
+		ok = drift(scenarios[i]) && ok;
+	}
+
+	cost(1);
+	cost(2);
+	cost(8);
+
+	return ok ? 0 : 1;
+}
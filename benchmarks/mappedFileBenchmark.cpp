@@ -0,0 +1,294 @@
+// Benchmarks for ofxAudioUnitMappedFile, the engine behind
+// ofxAudioUnitMappedFilePlayer, with the page cache cold and warm.
+//
+//   SOURCES="mappedFileBenchmark.cpp ../src/ofxAudioUnitMappedFile.cpp ../src/ofxAudioUnitWavReader.cpp ../src/ofxAudioUnitWavWriter.cpp ../src/ofxAudioUnitSampleConverter.cpp"
+//
+// "exact" plays files of each format into as many output channels as they
+// have, and into fewer and more, and checks every frame against
+// ofxAudioUnitWavReader; then seeks and loops, and checks where it lands.
+// "page_cache" plays a long file at a multiple of real time, one 512 frame
+// cycle after another, and reports how long the cycles took and how many
+// page faults the rendering thread took: with the file already in memory
+// ("warm"), and with it dropped from the page cache first ("cold"), with and
+// without the prefetch thread. Cold needs posix_fadvise(POSIX_FADV_DONTNEED),
+// and the fault counts need RUSAGE_THREAD, both of which are Linux; the
+// directory should be on a real disk rather than tmpfs.
+
+#include "ofxAudioUnitMappedFile.h"
+#include "ofxAudioUnitWavReader.h"
+#include "ofxAudioUnitWavWriter.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static std::string directory = "/tmp";
+
+static const double kSampleRate = 48000;
+static const UInt32 kBlockFrames = 512;
+
+static const char * formatName(ofxAudioUnitWavFormat format)
+{
+	switch(format) {
+		case OFXAU_WAV_INT16:   return "int16";
+		case OFXAU_WAV_INT24:   return "int24";
+		case OFXAU_WAV_INT32:   return "int32";
+		case OFXAU_WAV_FLOAT32: return "float32";
+	}
+	return "?";
+}
+
+// noise, written a second at a time so long files don't need it all in memory
+static bool writeFile(const std::string &path, unsigned int channels, size_t frames, ofxAudioUnitWavFormat format)
+{
+	ofxAudioUnitWavWriter writer;
+	if(!writer.open(path, channels, kSampleRate, format)) return false;
+
+	const size_t chunk = kSampleRate;
+	std::vector<std::vector<Float32> > source(channels, std::vector<Float32>(chunk));
+	std::vector<const Float32 *> planes;
+	for(unsigned int c = 0; c < channels; c++) planes.push_back(&source[c][0]);
+
+	UInt32 state = 1;
+	for(size_t done = 0; done < frames; done += chunk) {
+		const size_t count = std::min(chunk, frames - done);
+		for(unsigned int c = 0; c < channels; c++) {
+			for(size_t i = 0; i < count; i++) {
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				source[c][i] = ((state >> 8) / 8388608.f - 1.f) * 0.5f;
+			}
+		}
+		if(!writer.write(&planes[0], count)) return false;
+	}
+	return writer.close();
+}
+
+// a buffer list over planar output, as a render callback gets
+struct Output {
+	std::vector<std::vector<Float32> > planes;
+	std::vector<char> storage;
+
+	Output(unsigned int channels, UInt32 frames)
+	: planes(channels, std::vector<Float32>(frames))
+	, storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channels)
+	{
+		list()->mNumberBuffers = channels;
+		for(unsigned int c = 0; c < channels; c++) {
+			list()->mBuffers[c].mNumberChannels = 1;
+			list()->mBuffers[c].mDataByteSize = frames * sizeof(Float32);
+			list()->mBuffers[c].mData = &planes[c][0];
+		}
+	}
+
+	AudioBufferList * list() {return (AudioBufferList *)&storage[0];}
+};
+
+// the largest difference between a rendered block and the file's frames from
+// `start`, wrapping around at the end
+static double compare(Output &block, ofxAudioUnitWavReader &reader, UInt64 start)
+{
+	const ofxAudioUnitWavReader::Info &info = reader.getInfo();
+	std::vector<std::vector<Float32> > expected(info.channels, std::vector<Float32>(kBlockFrames));
+	std::vector<Float32 *> planes(info.channels);
+
+	for(UInt32 done = 0; done < kBlockFrames;) {
+		const UInt64 at = (start + done) % info.frames;
+		for(unsigned int c = 0; c < info.channels; c++) planes[c] = &expected[c][done];
+		const size_t count = reader.read(at, std::min<UInt64>(kBlockFrames - done, info.frames - at), &planes[0]);
+		if(count == 0) return INFINITY;
+		done += count;
+	}
+
+	double maxError = 0;
+	for(size_t b = 0; b < block.planes.size(); b++) {
+		for(UInt32 i = 0; i < kBlockFrames; i++) {
+			maxError = std::max<double>(maxError, fabs(block.planes[b][i] - expected[b % info.channels][i]));
+		}
+	}
+	return maxError;
+}
+
+static bool exact(ofxAudioUnitWavFormat format, unsigned int channels, unsigned int outputChannels)
+{
+	const std::string path = directory + "/mappedFileBenchmark.wav";
+	const size_t frames = kBlockFrames * 40 + 123;
+	if(!writeFile(path, channels, frames, format)) return false;
+
+	ofxAudioUnitWavReader reader;
+	ofxAudioUnitMappedFile file;
+	if(!reader.open(path) || !file.open(path, 0.1)) return false;
+
+	Output block(outputChannels, kBlockFrames);
+	double maxError = 0;
+
+	// straight through, to past the end
+	file.play();
+	UInt64 position = 0;
+	for(; position + kBlockFrames <= frames; position += kBlockFrames) {
+		file.render(kBlockFrames, block.list());
+		maxError = std::max(maxError, compare(block, reader, position));
+	}
+	file.render(kBlockFrames, block.list());
+	bool silentAtEnd = !file.isPlaying();
+	for(size_t b = 0; b < block.planes.size(); b++) {
+		for(UInt32 i = frames - position; i < kBlockFrames; i++) silentAtEnd = silentAtEnd && block.planes[b][i] == 0;
+	}
+
+	// seeking, and looping around the end
+	const UInt64 seekTo = frames - 300;
+	file.setLooping(true);
+	file.setPosition(seekTo);
+	file.play();
+	file.render(kBlockFrames, block.list());
+	maxError = std::max(maxError, compare(block, reader, seekTo));
+	const bool wrapped = file.getPosition() == seekTo + kBlockFrames - frames;
+
+	const bool ok = maxError == 0 && silentAtEnd && wrapped;
+	printf("{\"benchmark\":\"exact\",\"format\":\"%s\",\"channels\":%u,\"output_channels\":%u,\"max_error\":%.3g,\"silent_at_end\":%s,\"wrapped\":%s,\"ok\":%s}\n",
+		   formatName(format), channels, outputChannels, maxError, silentAtEnd ? "true" : "false", wrapped ? "true" : "false", ok ? "true" : "false");
+
+	file.close();
+	remove(path.c_str());
+	return ok;
+}
+
+#pragma mark - Page cache
+
+// drops the file from the page cache (where the platform can), and says how
+// much of it is still there
+static double dropFromCache(const std::string &path, bool drop)
+{
+	const int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) return -1;
+#if defined(POSIX_FADV_DONTNEED)
+	if(drop) {
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	}
+#endif
+
+	struct stat st;
+	fstat(fd, &st);
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const size_t pages = (st.st_size + page - 1) / page;
+	void * map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	std::vector<unsigned char> resident(pages);
+	size_t count = 0;
+	if(map != MAP_FAILED && mincore(map, st.st_size, (decltype(&resident[0]))&resident[0]) == 0) {
+		for(size_t i = 0; i < pages; i++) count += resident[i] & 1;
+	}
+	if(map != MAP_FAILED) munmap(map, st.st_size);
+	close(fd);
+	return pages > 0 ? (double)count / pages : 0;
+}
+
+static long threadMajorFaults()
+{
+#if defined(RUSAGE_THREAD)
+	struct rusage usage;
+	getrusage(RUSAGE_THREAD, &usage);
+	return usage.ru_majflt;
+#else
+	return -1;
+#endif
+}
+
+static void pageCache(const std::string &path, ofxAudioUnitWavFormat format, const char * cache, double prefetchSeconds, double speed)
+{
+	const bool cold = strcmp(cache, "cold") == 0;
+	if(!cold) {
+		// read it all once
+		ofxAudioUnitMappedFile warmer;
+		warmer.open(path, 0);
+		Output block(2, 65536);
+		warmer.play();
+		while(warmer.isPlaying()) warmer.render(65536, block.list());
+	}
+	const double residentBefore = dropFromCache(path, cold);
+
+	ofxAudioUnitMappedFile file;
+	if(!file.open(path, prefetchSeconds)) return;
+	const UInt64 frames = file.getInfo().frames;
+	const size_t blocks = frames / kBlockFrames;
+
+	// give the prefetch thread the head start it would get between loading a
+	// file and pressing play
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	Output block(2, kBlockFrames);
+	std::vector<double> times(blocks);
+	const std::chrono::duration<double> interval(kBlockFrames / kSampleRate / speed);
+	const double budget = kBlockFrames / kSampleRate;
+
+	file.play();
+	const long faultsBefore = threadMajorFaults();
+	const Clock::time_point start = Clock::now();
+	for(size_t b = 0; b < blocks; b++) {
+		std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(interval * b));
+		const Clock::time_point blockStart = Clock::now();
+		file.render(kBlockFrames, block.list());
+		times[b] = secondsSince(blockStart);
+	}
+	const long faults = faultsBefore >= 0 ? threadMajorFaults() - faultsBefore : -1;
+
+	const ofxAudioUnitMappedFile::Stats stats = file.getStats();
+	std::vector<double> sorted(times);
+	std::sort(sorted.begin(), sorted.end());
+	size_t overBudget = 0;
+	double total = 0;
+	for(size_t b = 0; b < blocks; b++) {
+		if(times[b] > budget) overBudget++;
+		total += times[b];
+	}
+
+	printf("{\"benchmark\":\"page_cache\",\"format\":\"%s\",\"cache\":\"%s\",\"resident_before\":%.2f,\"prefetch_seconds\":%.1f,\"speed\":%.0f,\"megabytes\":%.0f,\"blocks\":%zu,\"mean_block_us\":%.2f,\"p99_block_us\":%.2f,\"max_block_us\":%.1f,\"blocks_over_realtime\":%zu,\"render_thread_major_faults\":%ld,\"prefetch_misses\":%llu,\"prefetched_mb\":%.1f}\n",
+		   formatName(format), cache, residentBefore, prefetchSeconds, speed, frames * 2.0 * (format == OFXAU_WAV_INT24 ? 3 : 4) / 1e6, blocks,
+		   total / blocks * 1e6, sorted[blocks * 99 / 100] * 1e6, sorted.back() * 1e6, overBudget, faults,
+		   (unsigned long long)stats.prefetchMisses, stats.prefetchedBytes / 1e6);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+	directory = optionValue(argc, argv, "--dir", directory);
+
+	bool ok = true;
+	const ofxAudioUnitWavFormat wavFormats[] = {OFXAU_WAV_INT16, OFXAU_WAV_INT24, OFXAU_WAV_INT32, OFXAU_WAV_FLOAT32};
+	for(size_t f = 0; f < sizeof(wavFormats) / sizeof(wavFormats[0]); f++) {
+		ok = exact(wavFormats[f], 2, 2) && ok;
+		ok = exact(wavFormats[f], 2, 1) && ok;
+		ok = exact(wavFormats[f], 1, 2) && ok;
+		ok = exact(wavFormats[f], 6, 6) && ok;
+	}
+
+	const double speed = 20;
+	const size_t frames = (quick ? 60 : 300) * kSampleRate;
+	const ofxAudioUnitWavFormat pageFormats[] = {OFXAU_WAV_FLOAT32, OFXAU_WAV_INT24};
+	for(size_t f = 0; f < 2; f++) {
+		const std::string path = directory + "/mappedFileBenchmark-long.wav";
+		if(!writeFile(path, 2, frames, pageFormats[f])) {
+			printf("{\"benchmark\":\"page_cache\",\"error\":\"couldn't write %s\"}\n", path.c_str());
+			return 1;
+		}
+		pageCache(path, pageFormats[f], "warm", 2, speed);
+		pageCache(path, pageFormats[f], "cold", 0, speed);
+		pageCache(path, pageFormats[f], "cold", 2, speed);
+		remove(path.c_str());
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,346 @@
+// Benchmarks for ofxAudioUnitWaveformOverview, which ofxAudioUnitFilePlayer
+// and ofxAudioUnitStreamingFilePlayer draw their overviews from.
+//
+//   SOURCES="overviewBenchmark.cpp ../src/ofxAudioUnitWaveformOverview.cpp ../src/ofxAudioUnitWavReader.cpp ../src/ofxAudioUnitWavWriter.cpp ../src/ofxAudioUnitSampleConverter.cpp"
+//
+// "scan" makes the overview of a long stereo file (a swelling sine and
+// noise with spikes in it) with no sidecar to go on, and reports how long it
+// took and how big the sidecar is. It checks views at random ranges and
+// widths against the min, max and RMS of the frames under each column's
+// bins, read back from the file. "cached" loads it again from the sidecar,
+// checks it's the same overview, and reports how long that took. "stale"
+// rewrites the file with different audio (the same size), and checks the
+// sidecar isn't used and the new overview has the new audio in it; "corrupt"
+// does the same for a truncated sidecar. "directory" keeps the sidecar in a
+// cache directory rather than next to the file. "cancel" abandons a scan
+// part way through.
+
+#include "ofxAudioUnitWaveformOverview.h"
+#include "ofxAudioUnitWavReader.h"
+#include "ofxAudioUnitWavWriter.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+static std::string directory = "/tmp";
+
+static const double kSampleRate = 48000;
+static const size_t kWriteFrames = 1 << 16;
+
+static UInt64 fileSize(const std::string &path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+static bool exists(const std::string &path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
+
+// moves the modification time on, so a rewrite within the same clock tick
+// still counts as a change
+static void touch(const std::string &path, long seconds)
+{
+	struct stat st;
+	stat(path.c_str(), &st);
+	struct timeval times[2];
+	times[0].tv_sec = times[1].tv_sec = st.st_mtime + seconds;
+	times[0].tv_usec = times[1].tv_usec = 0;
+	utimes(path.c_str(), times);
+}
+
+// channel 0 is a 220 Hz sine swelling every 7 seconds, channel 1 noise with
+// a spike now and then. `variant` shifts everything about
+static float sampleAt(unsigned int channel, UInt64 i, unsigned int variant)
+{
+	const UInt64 swell = kSampleRate * 7;
+	if(channel == 0) {
+		const double envelope = 0.1 + 0.85 * ((i + variant * 12345) % swell) / (double)swell;
+		return envelope * sin(2 * M_PI * 220 * i / kSampleRate);
+	}
+	if((i + variant * 777) % 100003 == 0) return variant % 2 ? -0.99f : 0.99f;
+	UInt64 x = (i + variant * 0x9E3779B97F4A7C15ULL) * 0xD1B54A32D192ED03ULL;
+	x ^= x >> 29;
+	return (x % 100000) / 100000.f * 0.5f - 0.25f;
+}
+
+static bool writeFile(const std::string &path, UInt64 frames, unsigned int variant)
+{
+	ofxAudioUnitWavWriter writer;
+	if(!writer.open(path, 2, kSampleRate, OFXAU_WAV_FLOAT32)) return false;
+	std::vector<Float32> left(kWriteFrames), right(kWriteFrames);
+	const Float32 * planes[] = {&left[0], &right[0]};
+	for(UInt64 done = 0; done < frames;) {
+		const size_t count = std::min<UInt64>(kWriteFrames, frames - done);
+		for(size_t i = 0; i < count; i++) {
+			left[i] = sampleAt(0, done + i, variant);
+			right[i] = sampleAt(1, done + i, variant);
+		}
+		if(!writer.write(planes, count)) return false;
+		done += count;
+	}
+	return writer.close();
+}
+
+// what the frames under a column's bins come to, straight from the file
+static ofxAudioUnitWaveformOverview::Peak reference(ofxAudioUnitWavReader &reader, unsigned int channel, UInt64 from, UInt64 to)
+{
+	std::vector<Float32> left(to - from), right(to - from);
+	Float32 * planes[] = {&left[0], &right[0]};
+	reader.read(from, to - from, planes);
+	const std::vector<Float32> &x = channel == 0 ? left : right;
+
+	ofxAudioUnitWaveformOverview::Peak peak = {x[0], x[0], 0};
+	double squares = 0;
+	for(size_t i = 0; i < x.size(); i++) {
+		peak.min = std::min(peak.min, x[i]);
+		peak.max = std::max(peak.max, x[i]);
+		squares += (double)x[i] * x[i];
+	}
+	peak.rms = sqrt(squares / x.size());
+	return peak;
+}
+
+// Random views, each column checked against the frames of the bins it was
+// made from. The envelope may only be wider than the audio's, by at most
+// one step of 16 bits
+static size_t checkViews(const ofxAudioUnitWaveformOverview &overview, const std::string &path, size_t views, double &maxRmsError)
+{
+	ofxAudioUnitWavReader reader;
+	if(!reader.open(path)) return views;
+
+	const UInt64 frames = overview.getLength();
+	const double step = 1 / 32767.;
+	size_t bad = 0;
+	srand(7);
+	for(size_t v = 0; v < views; v++) {
+		const unsigned int channel = v % 2;
+		const size_t columns = 1 + rand() % 2000;
+		UInt64 from = (UInt64)(rand() / (double)RAND_MAX * frames);
+		UInt64 to = from + (UInt64)(pow(rand() / (double)RAND_MAX, 3) * (frames - from)) + 1;
+		to = std::min(to, frames);
+		if(v == 0) {from = 0; to = frames; }
+
+		std::vector<ofxAudioUnitWaveformOverview::Peak> peaks(columns);
+		if(overview.getPeaks(channel, from, to, columns, &peaks[0]) != columns) {
+			bad++;
+			continue;
+		}
+
+		// the level and bins getPeaks() will have used
+		const double span = (double)(to - from) / columns;
+		UInt64 framesPerBin = ofxAudioUnitWaveformOverview::kBaseFrames;
+		while(framesPerBin * ofxAudioUnitWaveformOverview::kLevelFactor <= span
+			  && (frames + framesPerBin - 1) / framesPerBin > ofxAudioUnitWaveformOverview::kLevelFactor) {
+			framesPerBin *= ofxAudioUnitWaveformOverview::kLevelFactor;
+		}
+
+		// a few columns of each view, to keep the reading down
+		for(size_t k = 0; k < std::min<size_t>(columns, 4); k++) {
+			const size_t column = k == 0 ? 0 : k == 1 ? columns - 1 : rand() % columns;
+			const UInt64 start = from + (UInt64)(column * span);
+			const UInt64 end = column + 1 == columns ? to : std::max<UInt64>(from + (UInt64)((column + 1) * span), start + 1);
+			const UInt64 first = start / framesPerBin * framesPerBin;
+			const UInt64 last = std::min(((end - 1) / framesPerBin + 1) * framesPerBin, frames);
+			if(last - first > 8 * kSampleRate * 60) continue; // whole-file columns are checked by the small ones
+
+			const ofxAudioUnitWaveformOverview::Peak expected = reference(reader, channel, first, last);
+			const ofxAudioUnitWaveformOverview::Peak &got = peaks[column];
+			const bool ok = got.min <= expected.min + 1e-7 && got.min >= expected.min - step - 1e-7
+				&& got.max >= expected.max - 1e-7 && got.max <= expected.max + step + 1e-7
+				&& fabs(got.rms - expected.rms) < 1e-4;
+			maxRmsError = std::max<double>(maxRmsError, fabs(got.rms - expected.rms));
+			if(!ok) bad++;
+		}
+	}
+	return bad;
+}
+
+static bool samePeaks(const ofxAudioUnitWaveformOverview &a, const ofxAudioUnitWaveformOverview &b)
+{
+	if(a.getLength() != b.getLength() || a.getChannels() != b.getChannels()) return false;
+	const size_t columns = 4096;
+	std::vector<ofxAudioUnitWaveformOverview::Peak> pa(columns), pb(columns);
+	for(unsigned int c = 0; c < a.getChannels(); c++) {
+		for(UInt64 length = a.getLength(); length > ofxAudioUnitWaveformOverview::kBaseFrames; length /= 8) {
+			a.getPeaks(c, 0, length, columns, &pa[0]);
+			b.getPeaks(c, 0, length, columns, &pb[0]);
+			if(memcmp(&pa[0], &pb[0], columns * sizeof(pa[0])) != 0) return false;
+		}
+	}
+	return true;
+}
+
+static bool scanAndCache(const std::string &path, UInt64 frames)
+{
+	const std::string sidecar = ofxAudioUnitWaveformOverview::getSidecarPath(path);
+	remove(sidecar.c_str());
+
+	ofxAudioUnitWaveformOverview scanned;
+	Clock::time_point start = Clock::now();
+	scanned.load(path);
+	const bool scannedReady = scanned.wait();
+	const double scanSeconds = secondsSince(start);
+
+	double maxRmsError = 0;
+	const size_t views = quick ? 100 : 400;
+	const size_t bad = scannedReady ? checkViews(scanned, path, views, maxRmsError) : views;
+	const UInt64 sidecarBytes = fileSize(sidecar);
+	const bool scanOk = scannedReady && !scanned.wasCached() && scanned.getLength() == frames
+		&& scanned.getChannels() == 2 && scanned.getSampleRate() == kSampleRate
+		&& scanned.getProgress() == 1 && bad == 0 && sidecarBytes > 0;
+	printf("{\"benchmark\":\"scan\",\"seconds_of_audio\":%.0f,\"file_mb\":%.1f,\"scan_ms\":%.1f,\"x_realtime\":%.0f,\"sidecar_bytes\":%llu,\"sidecar_mb_per_stereo_hour\":%.2f,\"views\":%zu,\"bad_columns\":%zu,\"max_rms_error\":%.2e,\"ok\":%s}\n",
+		frames / kSampleRate, fileSize(path) / 1e6, scanSeconds * 1e3, frames / kSampleRate / scanSeconds,
+		(unsigned long long)sidecarBytes, sidecarBytes / 1e6 * (3600 * kSampleRate / frames), views, bad, maxRmsError,
+		scanOk ? "true" : "false");
+
+	ofxAudioUnitWaveformOverview cached;
+	start = Clock::now();
+	cached.load(path);
+	const bool cachedReady = cached.wait();
+	const double loadSeconds = secondsSince(start);
+	const bool cachedOk = cachedReady && cached.wasCached() && samePeaks(scanned, cached);
+	printf("{\"benchmark\":\"cached\",\"load_ms\":%.2f,\"speedup\":%.0f,\"was_cached\":%s,\"same_peaks\":%s,\"ok\":%s}\n",
+		loadSeconds * 1e3, scanSeconds / loadSeconds, cached.wasCached() ? "true" : "false",
+		cachedReady && samePeaks(scanned, cached) ? "true" : "false", cachedOk ? "true" : "false");
+
+	return scanOk && cachedOk;
+}
+
+// the channel 1 spikes are at different frames in each variant, which
+// shows in the finest bins
+static bool hasSpike(const ofxAudioUnitWaveformOverview &overview, UInt64 frame, float level)
+{
+	ofxAudioUnitWaveformOverview::Peak peak;
+	const UInt64 from = frame / ofxAudioUnitWaveformOverview::kBaseFrames * ofxAudioUnitWaveformOverview::kBaseFrames;
+	if(overview.getPeaks(1, from, from + ofxAudioUnitWaveformOverview::kBaseFrames, 1, &peak) != 1) return false;
+	return level > 0 ? peak.max >= level - 1e-4 : peak.min <= level + 1e-4;
+}
+
+static bool stale(const std::string &path, UInt64 frames)
+{
+	// the same length, so only the modification time gives it away
+	writeFile(path, frames, 1);
+	touch(path, 2);
+
+	ofxAudioUnitWaveformOverview overview;
+	overview.load(path);
+	const bool ready = overview.wait();
+	const bool rescanned = ready && !overview.wasCached();
+	const bool fresh = ready && hasSpike(overview, 100003 - 777, -0.99f) && !hasSpike(overview, 100003, 0.99f);
+	double maxRmsError = 0;
+	const size_t bad = ready ? checkViews(overview, path, 20, maxRmsError) : 20;
+
+	// and the sidecar it wrote is good from then on
+	ofxAudioUnitWaveformOverview again;
+	again.load(path);
+	const bool cachedAfter = again.wait() && again.wasCached();
+
+	const bool ok = rescanned && fresh && bad == 0 && cachedAfter;
+	printf("{\"benchmark\":\"stale\",\"rescanned\":%s,\"new_audio\":%s,\"bad_columns\":%zu,\"cached_after\":%s,\"ok\":%s}\n",
+		rescanned ? "true" : "false", fresh ? "true" : "false", bad, cachedAfter ? "true" : "false", ok ? "true" : "false");
+	return ok;
+}
+
+static bool corrupt(const std::string &path)
+{
+	const std::string sidecar = ofxAudioUnitWaveformOverview::getSidecarPath(path);
+	const UInt64 bytes = fileSize(sidecar);
+	if(truncate(sidecar.c_str(), bytes / 2) != 0) return false;
+
+	ofxAudioUnitWaveformOverview overview;
+	overview.load(path);
+	const bool rescanned = overview.wait() && !overview.wasCached();
+	const bool rewritten = fileSize(sidecar) == bytes;
+
+	const bool ok = rescanned && rewritten;
+	printf("{\"benchmark\":\"corrupt\",\"rescanned\":%s,\"rewritten\":%s,\"ok\":%s}\n",
+		rescanned ? "true" : "false", rewritten ? "true" : "false", ok ? "true" : "false");
+	return ok;
+}
+
+static bool cacheDirectory(const std::string &path)
+{
+	const std::string cache = directory + "/overviewBenchmarkCache";
+	mkdir(cache.c_str(), 0755);
+	const std::string sidecar = ofxAudioUnitWaveformOverview::getSidecarPath(path, cache);
+	remove(sidecar.c_str());
+
+	ofxAudioUnitWaveformOverview first;
+	first.load(path, cache);
+	const bool scanned = first.wait() && !first.wasCached() && exists(sidecar);
+
+	ofxAudioUnitWaveformOverview second;
+	second.load(path, cache);
+	const bool cached = second.wait() && second.wasCached() && samePeaks(first, second);
+
+	// a file of the same name somewhere else gets a sidecar of its own
+	const bool distinct = ofxAudioUnitWaveformOverview::getSidecarPath("/a/take.wav", cache)
+		!= ofxAudioUnitWaveformOverview::getSidecarPath("/b/take.wav", cache);
+
+	remove(sidecar.c_str());
+	rmdir(cache.c_str());
+
+	const bool ok = scanned && cached && distinct;
+	printf("{\"benchmark\":\"directory\",\"scanned\":%s,\"cached\":%s,\"distinct_names\":%s,\"ok\":%s}\n",
+		scanned ? "true" : "false", cached ? "true" : "false", distinct ? "true" : "false", ok ? "true" : "false");
+	return ok;
+}
+
+static bool cancel(const std::string &path)
+{
+	const std::string sidecar = ofxAudioUnitWaveformOverview::getSidecarPath(path);
+	remove(sidecar.c_str());
+
+	ofxAudioUnitWaveformOverview overview;
+	overview.load(path);
+	while(overview.getProgress() < 0.2 && !overview.isReady()) {
+		struct timespec pause = {0, 100000};
+		nanosleep(&pause, NULL);
+	}
+	const float progress = overview.getProgress();
+	const Clock::time_point start = Clock::now();
+	overview.clear();
+	const double clearMs = secondsSince(start) * 1e3;
+
+	const bool ok = !overview.isReady() && !overview.hasFailed() && overview.getFilePath().empty()
+		&& !exists(sidecar) && !exists(sidecar + ".tmp");
+	printf("{\"benchmark\":\"cancel\",\"progress\":%.2f,\"clear_ms\":%.2f,\"ok\":%s}\n", progress, clearMs, ok ? "true" : "false");
+	return ok;
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+	directory = optionValue(argc, argv, "--dir", directory);
+
+	const std::string path = directory + "/overviewBenchmark.wav";
+	const UInt64 frames = (quick ? 60 : 600) * kSampleRate + 12345;
+	if(!writeFile(path, frames, 0)) {
+		printf("{\"benchmark\":\"scan\",\"error\":\"couldn't write %s\"}\n", path.c_str());
+		return 1;
+	}
+
+	bool ok = true;
+	ok = scanAndCache(path, frames) && ok;
+	ok = stale(path, frames) && ok;
+	ok = corrupt(path) && ok;
+	ok = cacheDirectory(path) && ok;
+	ok = cancel(path) && ok;
+
+	remove(ofxAudioUnitWaveformOverview::getSidecarPath(path).c_str());
+	remove(path.c_str());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+// Benchmarks for ofxAudioUnitPitchDetector, the analysis behind
+// ofxAudioUnitPitchNode, and for how the node times its windows.
+//
+//   SOURCES="pitchBenchmark.cpp ../src/ofxAudioUnitPitchDetector.cpp ../src/ofxAudioUnitFftCache.cpp ../src/ofxAudioUnitCaptureBuffer.cpp"
+//
+// "accuracy" analyzes synthetic tones across the default 60 - 1500 Hz range
+// (sines, band limited sawtooths, and sines under white noise at 20 dB SNR)
+// and checks the error in cents and that no octave is missed. "silence"
+// checks that quiet and noise-only windows come back unpitched. "cost" times
+// one analysis per window size.
+//
+// "window_time" runs a writer thread that renders a tone stepping between
+// pitches into an ofxAudioUnitCaptureBuffer, block by block, while the
+// reader analyzes the newest window, the way the node does. Each window is
+// timed with the sequence number readLatest() returns (what the node does
+// now), and with the write count read just before (what it used to do).
+// Every window that the first puts entirely inside one step has to have
+// that step's pitch; the second is reported for comparison, since how often
+// a block lands in between depends on scheduling.
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include "ofxAudioUnitPitchDetector.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static const double kSampleRate = 48000;
+
+static double cents(double frequency, double reference)
+{
+	return 1200 * log2(frequency / reference);
+}
+
+enum Waveform {
+	WaveSine,
+	WaveSaw,
+	WaveNoisySine
+};
+
+static const char * waveformName(Waveform waveform)
+{
+	switch(waveform) {
+		case WaveSine: return "sine";
+		case WaveSaw: return "saw";
+		default: return "sine_noise";
+	}
+}
+
+static void makeTone(Waveform waveform, double frequency, double phase, unsigned int seed, std::vector<Float32> &out)
+{
+	const double w = 2 * M_PI * frequency / kSampleRate;
+	for(size_t i = 0; i < out.size(); i++) {
+		double x = 0;
+		if(waveform == WaveSaw) {
+			// every harmonic under Nyquist, at 1 / k
+			for(unsigned int k = 1; k * frequency < kSampleRate / 2; k++) x += sin(k * (w * i + phase)) / k;
+			x *= 0.4;
+		} else {
+			x = 0.5 * sin(w * i + phase);
+		}
+		if(waveform == WaveNoisySine) {
+			// uniform noise at a tenth of the sine's RMS
+			seed = seed * 1664525u + 1013904223u;
+			x += 0.1 * 0.5 / sqrt(2) * sqrt(3) * ((seed >> 8) / 8388608.0 - 1);
+		}
+		out[i] = x;
+	}
+}
+
+#pragma mark - Accuracy
+
+static bool accuracy(Waveform waveform, unsigned int windowSize)
+{
+	ofxAudioUnitPitchDetector detector(windowSize);
+	const unsigned int tones = quick ? 24 : 96;
+	const double lowest = 80, highest = 1400;
+
+	std::vector<Float32> window(windowSize);
+	double totalError = 0, worstError = 0;
+	unsigned int unpitched = 0, octaveErrors = 0, analyzed = 0;
+
+	for(unsigned int t = 0; t < tones; t++) {
+		const double frequency = lowest * pow(highest / lowest, t / (tones - 1.0));
+		makeTone(waveform, frequency, t * 0.7, t + 1, window);
+
+		const ofxAudioUnitPitchDetector::Estimate estimate = detector.analyze(&window[0], kSampleRate);
+		analyzed++;
+		if(estimate.frequency <= 0) {
+			unpitched++;
+			continue;
+		}
+
+		const double error = fabs(cents(estimate.frequency, frequency));
+		if(error > 600) {
+			octaveErrors++;
+			continue;
+		}
+		totalError += error;
+		worstError = std::max(worstError, error);
+	}
+
+	const unsigned int pitched = analyzed - unpitched - octaveErrors;
+	const double limit = waveform == WaveNoisySine ? 10 : 5;
+	const bool ok = unpitched == 0 && octaveErrors == 0 && worstError < limit;
+	printf("{\"benchmark\":\"accuracy\",\"waveform\":\"%s\",\"window\":%u,\"tones\":%u,\"unpitched\":%u,\"octave_errors\":%u,\"mean_cents\":%.3f,\"max_cents\":%.3f,\"limit_cents\":%.0f,\"ok\":%s}\n",
+		   waveformName(waveform), windowSize, analyzed, unpitched, octaveErrors,
+		   pitched ? totalError / pitched : 0, worstError, limit, ok ? "true" : "false");
+	return ok;
+}
+
+static bool silence()
+{
+	ofxAudioUnitPitchDetector detector(2048);
+	std::vector<Float32> window(2048);
+
+	// under the default silenceRMS of 0.001
+	makeTone(WaveSine, 440, 0, 1, window);
+	for(size_t i = 0; i < window.size(); i++) window[i] *= 0.001;
+	const float quiet = detector.analyze(&window[0], kSampleRate).frequency;
+
+	unsigned int seed = 7;
+	for(size_t i = 0; i < window.size(); i++) {
+		seed = seed * 1664525u + 1013904223u;
+		window[i] = 0.5 * ((seed >> 8) / 8388608.0 - 1);
+	}
+	const ofxAudioUnitPitchDetector::Estimate noise = detector.analyze(&window[0], kSampleRate);
+
+	const bool ok = quiet == 0 && noise.frequency == 0;
+	printf("{\"benchmark\":\"silence\",\"quiet_frequency\":%.1f,\"noise_frequency\":%.1f,\"noise_confidence\":%.3f,\"ok\":%s}\n",
+		   quiet, noise.frequency, noise.confidence, ok ? "true" : "false");
+	return ok;
+}
+
+static void cost(unsigned int windowSize)
+{
+	ofxAudioUnitPitchDetector detector(windowSize);
+	std::vector<Float32> window(windowSize);
+	makeTone(WaveSaw, 220, 0, 1, window);
+
+	const unsigned int runs = quick ? 200 : 2000;
+	float sink = 0;
+	const Clock::time_point start = Clock::now();
+	for(unsigned int r = 0; r < runs; r++) sink += detector.analyze(&window[0], kSampleRate).frequency;
+	const double seconds = secondsSince(start);
+
+	// at the default hop of 512, one analysis per 512 frames
+	const double perAnalysis = seconds / runs;
+	printf("{\"benchmark\":\"cost\",\"window\":%u,\"us_per_analysis\":%.2f,\"load_at_hop_512\":%.5f,\"check\":%.0f}\n",
+		   windowSize, perAnalysis * 1e6, perAnalysis / (512 / kSampleRate), sink / runs);
+}
+
+#pragma mark - Window time
+
+static const UInt64 kStepFrames = 8192;
+static const double kSteps[] = {220, 330, 165, 440, 262, 196};
+static const unsigned int kStepCount = sizeof(kSteps) / sizeof(kSteps[0]);
+
+static double stepFrequency(UInt64 frame)
+{
+	return kSteps[(frame / kStepFrames) % kStepCount];
+}
+
+static bool windowTime()
+{
+	const unsigned int N = 2048;
+	const UInt32 blockFrames = 256;
+
+	// the sample time of the first frame, as if the graph had been running
+	const Float64 timeOffset = 1000000;
+
+	ofxAudioUnitCaptureBuffer buffer(1, N);
+	std::atomic<bool> running(true);
+
+	std::thread writer([&]() {
+		std::vector<Float32> block(blockFrames);
+		AudioBufferList list;
+		list.mNumberBuffers = 1;
+		list.mBuffers[0].mNumberChannels = 1;
+		list.mBuffers[0].mDataByteSize = blockFrames * sizeof(Float32);
+		list.mBuffers[0].mData = &block[0];
+
+		UInt64 frame = 0;
+		double phase = 0;
+		while(running.load()) {
+			for(UInt32 i = 0; i < blockFrames; i++, frame++) {
+				phase += 2 * M_PI * stepFrequency(frame) / kSampleRate;
+				block[i] = 0.5 * sin(phase);
+			}
+			buffer.write(&list, blockFrames);
+			std::this_thread::yield();
+		}
+	});
+
+	ofxAudioUnitPitchDetector detector(N);
+	std::vector<Float32> samples;
+	unsigned int windows = 0, checked = 0, wrong = 0, checkedBefore = 0, wrongBefore = 0;
+
+	const double seconds = quick ? 0.5 : 5;
+	const Clock::time_point start = Clock::now();
+	while(secondsSince(start) < seconds) {
+		const UInt64 before = buffer.getWriteCount();
+		const UInt64 end = buffer.readLatest(0, samples, N);
+		if(samples.size() < N) continue;
+		windows++;
+
+		const float frequency = detector.analyze(&samples[0], kSampleRate).frequency;
+
+		// both labels, made into sample times and back into frames
+		const UInt64 labels[2] = {
+			(UInt64)((end + timeOffset) - timeOffset),
+			(UInt64)((before + timeOffset) - timeOffset)
+		};
+
+		for(int l = 0; l < 2; l++) {
+			const UInt64 last = labels[l] - 1, first = labels[l] - N;
+			if(labels[l] < N || first / kStepFrames != last / kStepFrames) continue;
+			const bool matches = frequency > 0 && fabs(cents(frequency, stepFrequency(first))) < 20;
+			if(l == 0) {
+				checked++;
+				if(!matches) wrong++;
+			} else {
+				checkedBefore++;
+				if(!matches) wrongBefore++;
+			}
+		}
+	}
+
+	running.store(false);
+	writer.join();
+
+	const bool ok = checked > 0 && wrong == 0;
+	printf("{\"benchmark\":\"window_time\",\"windows\":%u,\"checked\":%u,\"mislabeled\":%u,\"checked_write_count_before\":%u,\"mislabeled_write_count_before\":%u,\"ok\":%s}\n",
+		   windows, checked, wrong, checkedBefore, wrongBefore, ok ? "true" : "false");
+	return ok;
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	bool ok = true;
+	const Waveform waveforms[] = {WaveSine, WaveSaw, WaveNoisySine};
+	for(int w = 0; w < 3; w++) {
+		ok = accuracy(waveforms[w], 2048) && ok;
+	}
+	ok = accuracy(WaveSine, 4096) && ok;
+	ok = silence() && ok;
+	cost(1024);
+	cost(2048);
+	cost(4096);
+	ok = windowTime() && ok;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,617 @@
+// Benchmarks for the streaming recorder (ofxAudioUnitDiskRecorder writing
+// through ofxAudioUnitWavWriter), driven by a synthetic source thread that
+// stands in for the render thread.
+//
+//   SOURCES="recorderBenchmark.cpp ../src/ofxAudioUnitDiskRecorder.cpp ../src/ofxAudioUnitStemRecorder.cpp ../src/ofxAudioUnitWavWriter.cpp ../src/ofxAudioUnitCaptureBuffer.cpp ../src/ofxAudioUnitSampleConverter.cpp"
+//
+// "throughput" feeds the recorder as fast as the writer thread can keep up
+// (the source waits when the ring is half full, which a real render thread
+// never would) and reports the sustained rate as a multiple of real time.
+// "realtime" feeds it at the sample rate and reports drops and backlog.
+// "preroll" starts an armed recorder partway through a real-time feed.
+// "rearm" stops feeding an armed recorder for a while (as ofxAudioUnitRecorder
+// does during an m4a or FLAC take), rearms it, and checks the next start()
+// only picks up what came after.
+// "rotation" splits a recording into segments by duration and by size, and
+// checks they join up without a gap and their indexes say where they start.
+// "stems" records several sources with ofxAudioUnitStemRecorder, started
+// mid-cycle, with one source joining late and the sample times starting over
+// partway through, and checks every frame of every file came from the same
+// point in the take.
+// Every file written is read back and checked against what was fed in.
+// --rf64 also writes a file past 4 GB, to check the RF64 conversion.
+
+#include "ofxAudioUnitDiskRecorder.h"
+#include "ofxAudioUnitStemRecorder.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::string directory = ".";
+
+static const Float64 kSampleRate = 48000;
+static const size_t kBlock = 512;
+
+static const char * formatName(ofxAudioUnitWavFormat format)
+{
+	switch(format) {
+		case OFXAU_WAV_INT16:   return "int16";
+		case OFXAU_WAV_INT24:   return "int24";
+		case OFXAU_WAV_INT32:   return "int32";
+		case OFXAU_WAV_FLOAT32: return "float32";
+	}
+	return "?";
+}
+
+#pragma mark - Source
+
+// A few seconds of noise per channel, fed out a block at a time, so the
+// frame a sample came from can be worked out when checking the file
+struct Source
+{
+	static const size_t kLength = kBlock * 97;
+
+	std::vector<std::vector<Float32> > channels;
+	std::vector<char> storage;
+	size_t position;
+
+	Source(unsigned int channelCount)
+	: channels(channelCount, std::vector<Float32>(kLength))
+	, storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channelCount)
+	, position(0)
+	{
+		for(unsigned int c = 0; c < channelCount; c++) {
+			for(size_t i = 0; i < kLength; i++) {
+				channels[c][i] = (rand() % 20001 - 10000) / 10000.f;
+			}
+		}
+		list()->mNumberBuffers = channelCount;
+	}
+
+	AudioBufferList * list() {return (AudioBufferList *)&storage[0];}
+
+	AudioBufferList * next()
+	{
+		for(size_t c = 0; c < channels.size(); c++) {
+			list()->mBuffers[c].mNumberChannels = 1;
+			list()->mBuffers[c].mDataByteSize = kBlock * sizeof(Float32);
+			list()->mBuffers[c].mData = &channels[c][position];
+		}
+		position = (position + kBlock) % kLength;
+		return list();
+	}
+};
+
+#pragma mark - Checking
+
+static UInt32 get32(const unsigned char * p) {return p[0] | p[1] << 8 | p[2] << 16 | (UInt32)p[3] << 24;}
+static UInt64 get64(const unsigned char * p) {return get32(p) | (UInt64)get32(p + 4) << 32;}
+
+static double decode(const unsigned char * p, ofxAudioUnitWavFormat format)
+{
+	switch(format) {
+		case OFXAU_WAV_INT16:   return (SInt16)(p[0] | p[1] << 8) / 32768.;
+		case OFXAU_WAV_INT24:   return ((SInt32)(p[0] << 8 | p[1] << 16 | (UInt32)p[2] << 24) >> 8) / 8388608.;
+		case OFXAU_WAV_INT32:   return (SInt32)get32(p) / 2147483648.;
+		case OFXAU_WAV_FLOAT32: {
+			const UInt32 bits = get32(p);
+			Float32 f;
+			memcpy(&f, &bits, sizeof(f));
+			return f;
+		}
+	}
+	return 0;
+}
+
+// Reads the header back, checks the sizes add up, and compares the first
+// checkFrames frames with the source, from firstFrame on. Returns an empty
+// string if it's fine
+static std::string check(const std::string &path, const Source &source, ofxAudioUnitWavFormat format, UInt64 frames, size_t checkFrames, UInt64 firstFrame = 0)
+{
+	FILE * f = fopen(path.c_str(), "rb");
+	if(!f) return "can't open";
+
+	unsigned char header[4096];
+	if(fread(header, 1, sizeof(header), f) != sizeof(header)) {fclose(f); return "short header";}
+
+	const unsigned int channels = source.channels.size();
+	const unsigned int sampleBytes = ofxAudioUnitWavWriter::bytesPerSample(format);
+	const UInt64 dataBytes = frames * channels * sampleBytes;
+	const bool rf64 = memcmp(header, "RF64", 4) == 0;
+
+	fseeko(f, 0, SEEK_END);
+	const UInt64 fileBytes = ftello(f);
+
+	if(!rf64 && memcmp(header, "RIFF", 4) != 0) {fclose(f); return "not RIFF or RF64";}
+	if(memcmp(header + 8, "WAVE", 4) != 0) {fclose(f); return "not WAVE";}
+	if(memcmp(header + 4088, "data", 4) != 0) {fclose(f); return "data chunk isn't where it should be";}
+	if(rf64 != (fileBytes - 8 > 0xFFFFFFFFull)) {fclose(f); return "RF64 when it shouldn't be, or the other way round";}
+
+	const UInt64 riffSize = rf64 ? get64(header + 20) : get32(header + 4);
+	const UInt64 dataSize = rf64 ? get64(header + 28) : get32(header + 4092);
+	if(rf64 && memcmp(header + 12, "ds64", 4) != 0) {fclose(f); return "RF64 without ds64";}
+	if(riffSize != fileBytes - 8) {fclose(f); return "RIFF size doesn't match the file";}
+	if(dataSize != dataBytes) {fclose(f); return "data size doesn't match what was written";}
+
+	const size_t frameBytes = channels * sampleBytes;
+	std::vector<unsigned char> data(std::min<UInt64>(checkFrames, frames) * frameBytes);
+	fseeko(f, 4096, SEEK_SET);
+	const size_t got = fread(data.empty() ? NULL : &data[0], 1, data.size(), f);
+	fclose(f);
+	if(got != data.size()) return "short data";
+
+	const double tolerance = format == OFXAU_WAV_FLOAT32 ? 0 : ldexp(1.01, 1 - (int)sampleBytes * 8);
+	for(size_t i = 0; i < data.size() / frameBytes; i++) {
+		for(unsigned int c = 0; c < channels; c++) {
+			const double expected = std::min<double>(source.channels[c][(i + firstFrame) % Source::kLength], 1. - tolerance);
+			if(fabs(decode(&data[i * frameBytes + c * sampleBytes], format) - expected) > tolerance) {
+				return "samples don't match";
+			}
+		}
+	}
+
+	return "";
+}
+
+// where in the source a float32 file's first frame came from
+static UInt64 findFirstFrame(const std::string &path, const Source &source)
+{
+	const unsigned int channels = source.channels.size();
+	std::vector<Float32> frame(channels);
+	FILE * f = fopen(path.c_str(), "rb");
+	if(!f) return 0;
+	fseeko(f, 4096, SEEK_SET);
+	const size_t got = fread(&frame[0], sizeof(Float32), channels, f);
+	fclose(f);
+	if(got != channels) return 0;
+
+	for(size_t i = 0; i < Source::kLength; i++) {
+		unsigned int c = 0;
+		while(c < channels && source.channels[c][i] == frame[c]) c++;
+		if(c == channels) return i;
+	}
+	return 0;
+}
+
+#pragma mark - Benchmarks
+
+static void report(const char * benchmark, unsigned int channels, ofxAudioUnitWavFormat format, UInt64 frames, double seconds, const ofxAudioUnitDiskRecorder::Stats &stats, const std::string &problem)
+{
+	printf("{\"benchmark\":\"%s\",\"channels\":%u,\"format\":\"%s\",\"frames\":%llu,\"seconds\":%.3f,"
+		   "\"x_realtime\":%.2f,\"mb_per_sec\":%.1f,\"dropped\":%llu,\"max_backlog_ms\":%.1f,\"ok\":%s%s%s%s}\n",
+		   benchmark, channels, formatName(format), (unsigned long long)frames, seconds,
+		   frames / kSampleRate / seconds, stats.bytesWritten / seconds / 1e6,
+		   (unsigned long long)stats.droppedFrames, stats.maxBacklog * 1000. / kSampleRate,
+		   problem.empty() && !stats.failed ? "true" : "false",
+		   problem.empty() ? "" : ",\"problem\":\"", problem.c_str(), problem.empty() ? "" : "\"");
+	fflush(stdout);
+}
+
+// as fast as the disk and the writer thread allow
+static void throughput(unsigned int channels, ofxAudioUnitWavFormat format, double audioSeconds)
+{
+	const std::string path = directory + "/recorderBenchmark.wav";
+	const UInt64 frames = (UInt64)(audioSeconds * kSampleRate) / kBlock * kBlock;
+	Source source(channels);
+	ofxAudioUnitDiskRecorder recorder;
+
+	if(!recorder.start(path, channels, kSampleRate, format)) return;
+
+	const UInt64 ringHalf = kSampleRate * 2;
+	Clock::time_point start = Clock::now();
+	for(UInt64 done = 0; done < frames; done += kBlock) {
+		while(recorder.getStats().backlog > ringHalf) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		recorder.write(source.next(), kBlock);
+	}
+	recorder.stop();
+	const double seconds = secondsSince(start);
+
+	const ofxAudioUnitDiskRecorder::Stats stats = recorder.getStats();
+	report("throughput", channels, format, frames, seconds, stats, check(path, source, format, frames, quick ? 48000 : 480000));
+	remove(path.c_str());
+}
+
+// at the sample rate, the way a render thread would
+static void realtime(unsigned int channels, ofxAudioUnitWavFormat format, double audioSeconds)
+{
+	const std::string path = directory + "/recorderBenchmark.wav";
+	const UInt64 frames = (UInt64)(audioSeconds * kSampleRate) / kBlock * kBlock;
+	Source source(channels);
+	ofxAudioUnitDiskRecorder recorder;
+
+	if(!recorder.start(path, channels, kSampleRate, format)) return;
+
+	const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(kBlock / kSampleRate));
+	Clock::time_point start = Clock::now();
+	Clock::time_point deadline = start;
+	for(UInt64 done = 0; done < frames; done += kBlock) {
+		deadline += period;
+		std::this_thread::sleep_until(deadline);
+		recorder.write(source.next(), kBlock);
+	}
+	recorder.stop();
+	const double seconds = secondsSince(start);
+
+	const ofxAudioUnitDiskRecorder::Stats stats = recorder.getStats();
+	report("realtime", channels, format, frames, seconds, stats, check(path, source, format, frames, frames));
+	remove(path.c_str());
+}
+
+// A source running at the sample rate into an armed recorder, started
+// partway through. Reports how long start() and stop() took, and checks the
+// file picks up the pre-roll and runs without a gap until stop()
+static void preRoll(unsigned int channels, double preRollSeconds, double recordSeconds)
+{
+	const std::string path = directory + "/recorderBenchmark.wav";
+	Source source(channels);
+	ofxAudioUnitDiskRecorder recorder;
+
+	if(!recorder.arm(channels, kSampleRate, preRollSeconds)) return;
+
+	std::atomic<bool> running(true);
+	std::thread render([&] {
+		const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(kBlock / kSampleRate));
+		Clock::time_point deadline = Clock::now();
+		while(running.load()) {
+			deadline += period;
+			std::this_thread::sleep_until(deadline);
+			recorder.write(source.next(), kBlock);
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(preRollSeconds + 0.5));
+
+	Clock::time_point t = Clock::now();
+	const bool started = recorder.start(path, channels, kSampleRate, OFXAU_WAV_FLOAT32);
+	const double startSeconds = secondsSince(t);
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(recordSeconds));
+
+	t = Clock::now();
+	recorder.stop();
+	const double stopSeconds = secondsSince(t);
+
+	running = false;
+	render.join();
+
+	const ofxAudioUnitDiskRecorder::Stats stats = recorder.getStats();
+	std::string problem;
+	if(!started) {
+		problem = "didn't start";
+	} else if(stats.preRollFrames != (UInt64)(preRollSeconds * kSampleRate)) {
+		problem = "pre-roll is the wrong length";
+	} else if(stats.framesWritten < stats.preRollFrames + recordSeconds * kSampleRate * 0.9) {
+		problem = "file is too short";
+	} else {
+		problem = check(path, source, OFXAU_WAV_FLOAT32, stats.framesWritten, stats.framesWritten, findFirstFrame(path, source));
+	}
+
+	printf("{\"benchmark\":\"preroll\",\"channels\":%u,\"preroll_frames\":%llu,\"frames\":%llu,"
+		   "\"start_ms\":%.3f,\"stop_ms\":%.3f,\"dropped\":%llu,\"ok\":%s%s%s%s}\n",
+		   channels, (unsigned long long)stats.preRollFrames, (unsigned long long)stats.framesWritten,
+		   startSeconds * 1000, stopSeconds * 1000, (unsigned long long)stats.droppedFrames,
+		   problem.empty() && !stats.failed ? "true" : "false",
+		   problem.empty() ? "" : ",\"problem\":\"", problem.c_str(), problem.empty() ? "" : "\"");
+	fflush(stdout);
+	remove(path.c_str());
+}
+
+// An armed recorder fed for a while, then not at all, then rearmed and fed
+// a little more before start(): the file has to begin after the gap
+static void rearm(unsigned int channels)
+{
+	const std::string path = directory + "/recorderBenchmark.wav";
+	Source source(channels);
+	ofxAudioUnitDiskRecorder recorder;
+
+	if(!recorder.arm(channels, kSampleRate, 1)) return;
+
+	const size_t blocksBefore = kSampleRate * 2 / kBlock;
+	const size_t blocksAfter = 20;
+	for(size_t b = 0; b < blocksBefore; b++) recorder.write(source.next(), kBlock);
+
+	// ... the feed stops here, and picks up again some time later
+	recorder.rearm();
+	for(size_t b = 0; b < blocksAfter; b++) recorder.write(source.next(), kBlock);
+
+	const bool started = recorder.start(path, channels, kSampleRate, OFXAU_WAV_FLOAT32);
+	for(size_t b = 0; b < blocksAfter; b++) recorder.write(source.next(), kBlock);
+	recorder.stop();
+
+	const ofxAudioUnitDiskRecorder::Stats stats = recorder.getStats();
+	const UInt64 firstFrame = (blocksBefore * kBlock) % Source::kLength;
+	std::string problem;
+	if(!started) {
+		problem = "didn't start";
+	} else if(stats.preRollFrames != blocksAfter * kBlock) {
+		problem = "pre-roll reaches back across the gap";
+	} else if(stats.framesWritten != blocksAfter * kBlock * 2) {
+		problem = "file is the wrong length";
+	} else {
+		problem = check(path, source, OFXAU_WAV_FLOAT32, stats.framesWritten, stats.framesWritten, firstFrame);
+	}
+
+	printf("{\"benchmark\":\"rearm\",\"channels\":%u,\"preroll_frames\":%llu,\"frames\":%llu,\"ok\":%s%s%s%s}\n",
+		   channels, (unsigned long long)stats.preRollFrames, (unsigned long long)stats.framesWritten,
+		   problem.empty() && !stats.failed ? "true" : "false",
+		   problem.empty() ? "" : ",\"problem\":\"", problem.c_str(), problem.empty() ? "" : "\"");
+	fflush(stdout);
+	remove(path.c_str());
+}
+
+// a number from a segment's index file, NaN if it isn't there
+static double indexValue(const std::string &path, const char * key)
+{
+	FILE * f = fopen(path.c_str(), "r");
+	if(!f) return NAN;
+	char text[1024];
+	const size_t length = fread(text, 1, sizeof(text) - 1, f);
+	fclose(f);
+	text[length] = 0;
+
+	const std::string pattern = std::string("\"") + key + "\": ";
+	const char * found = strstr(text, pattern.c_str());
+	double value = NAN;
+	if(found) sscanf(found + pattern.size(), "%lf", &value);
+	return value;
+}
+
+static void rotation(unsigned int channels, ofxAudioUnitWavFormat format, double segmentSeconds, UInt64 segmentBytes, double audioSeconds)
+{
+	const std::string path = directory + "/recorderBenchmark.wav";
+	const UInt64 frames = (UInt64)(audioSeconds * kSampleRate) / kBlock * kBlock;
+	const Float64 firstSampleTime = 5000;
+	const Float64 firstHostTime = 1000;
+	Source source(channels);
+	ofxAudioUnitDiskRecorder recorder;
+
+	recorder.setRotation(segmentSeconds, segmentBytes);
+	if(!recorder.start(path, channels, kSampleRate, format)) return;
+
+	Clock::time_point start = Clock::now();
+	for(UInt64 done = 0; done < frames; done += kBlock) {
+		while(recorder.getStats().backlog > kSampleRate) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		recorder.write(source.next(), kBlock, firstSampleTime + done, firstHostTime + done / kSampleRate);
+	}
+	recorder.stop();
+	const double seconds = secondsSince(start);
+	const ofxAudioUnitDiskRecorder::Stats stats = recorder.getStats();
+
+	UInt64 segmentFrames = segmentSeconds > 0 ? (UInt64)(segmentSeconds * kSampleRate) : UINT64_MAX;
+	if(segmentBytes > 0) {
+		segmentFrames = std::min<UInt64>(segmentFrames, (segmentBytes - 4096) / (channels * ofxAudioUnitWavWriter::bytesPerSample(format)));
+	}
+	const unsigned int segments = (frames + segmentFrames - 1) / segmentFrames;
+
+	std::string problem;
+	if(stats.segment != segments) problem = "wrong number of segments";
+	for(unsigned int n = 1; n <= segments && problem.empty(); n++) {
+		const std::string segment = ofxAudioUnitDiskRecorder::segmentPath(path, n);
+		const std::string index = ofxAudioUnitDiskRecorder::indexPath(segment);
+		const UInt64 first = (n - 1) * segmentFrames;
+		const UInt64 length = std::min(segmentFrames, frames - first);
+
+		problem = check(segment, source, format, length, length, first);
+		if(problem.empty() && (indexValue(index, "startFrame") != first || indexValue(index, "frames") != length)) {
+			problem = "index has the wrong frames";
+		}
+		if(problem.empty() && indexValue(index, "startSampleTime") != firstSampleTime + first) {
+			problem = "index has the wrong sample time";
+		}
+		if(problem.empty() && fabs(indexValue(index, "startHostTime") - (firstHostTime + first / kSampleRate)) > 1e-6) {
+			problem = "index has the wrong host time";
+		}
+		remove(segment.c_str());
+		remove(index.c_str());
+	}
+
+	// the file opened ahead for the segment that never came shouldn't be left behind
+	FILE * unused = fopen(ofxAudioUnitDiskRecorder::segmentPath(path, segments + 1).c_str(), "rb");
+	if(unused) {
+		fclose(unused);
+		remove(ofxAudioUnitDiskRecorder::segmentPath(path, segments + 1).c_str());
+		if(problem.empty()) problem = "left an unused segment behind";
+	}
+
+	printf("{\"benchmark\":\"rotation\",\"channels\":%u,\"format\":\"%s\",\"segment_frames\":%llu,\"segments\":%u,"
+		   "\"frames\":%llu,\"seconds\":%.3f,\"x_realtime\":%.2f,\"dropped\":%llu,\"ok\":%s%s%s%s}\n",
+		   channels, formatName(format), (unsigned long long)segmentFrames, stats.segment,
+		   (unsigned long long)stats.framesWritten, seconds, frames / kSampleRate / seconds,
+		   (unsigned long long)stats.droppedFrames,
+		   problem.empty() && !stats.failed ? "true" : "false",
+		   problem.empty() ? "" : ",\"problem\":\"", problem.c_str(), problem.empty() ? "" : "\"");
+	fflush(stdout);
+}
+
+// the data chunk of a float32 file written by ofxAudioUnitWavWriter
+static std::vector<Float32> readFloatData(const std::string &path)
+{
+	std::vector<Float32> data;
+	FILE * f = fopen(path.c_str(), "rb");
+	if(!f) return data;
+
+	unsigned char header[4096];
+	if(fread(header, 1, sizeof(header), f) == sizeof(header)) {
+		data.resize(get32(header + 4092) / sizeof(Float32));
+		if(!data.empty() && fread(&data[0], sizeof(Float32), data.size(), f) != data.size()) {
+			data.clear();
+		}
+	}
+	fclose(f);
+	return data;
+}
+
+// Every sample is its own time in the take (plus a quarter per channel), so
+// each frame of each file says where it came from. Rendering is offline: one
+// loop plays the part of the render cycle, calling the sources in a different
+// order each time. Partway through, the sample times start over from 0, as
+// they do when the output is restarted, and the files should carry on
+static void stems(ofxAudioUnitStemLayout layout)
+{
+	const std::string path = directory + "/recorderBenchmark.wav";
+	const unsigned int channels[] = {2, 1, 4};
+	const size_t sources = sizeof(channels) / sizeof(channels[0]);
+	const size_t lateSource = 2;
+	const size_t lateCycles = 3;
+	const size_t cycles = (quick ? 5 : 30) * kSampleRate / kBlock;
+	const size_t startCycle = 20;
+	const Float64 firstSampleTime = 123456;
+	const size_t restartCycle = startCycle + lateCycles + 10;
+
+	ofxAudioUnitStemRecorder recorder;
+	for(size_t s = 0; s < sources; s++) {
+		char name[16];
+		snprintf(name, sizeof(name), "src%zu", s);
+		recorder.addSource(channels[s], name);
+	}
+
+	std::vector<std::vector<Float32> > planes(4, std::vector<Float32>(kBlock));
+	std::vector<char> storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * 4);
+	AudioBufferList * list = (AudioBufferList *)&storage[0];
+
+	Clock::time_point start = Clock::now();
+	for(size_t cycle = 0; cycle < cycles; cycle++) {
+		const Float64 sampleTime = firstSampleTime + cycle * kBlock;
+		const Float64 renderTime = cycle < restartCycle ? sampleTime : (cycle - restartCycle) * kBlock;
+
+		for(size_t n = 0; n < sources; n++) {
+			const size_t s = (cycle + n) % sources;
+
+			// start partway through a render cycle
+			if(cycle == startCycle && n == 1) {
+				recorder.start(path, kSampleRate, OFXAU_WAV_FLOAT32, layout);
+			}
+
+			if(s == lateSource && cycle < startCycle + lateCycles) continue;
+
+			list->mNumberBuffers = channels[s];
+			for(unsigned int c = 0; c < channels[s]; c++) {
+				for(size_t i = 0; i < kBlock; i++) {
+					planes[c][i] = sampleTime + i + c * 0.25f;
+				}
+				list->mBuffers[c].mNumberChannels = 1;
+				list->mBuffers[c].mDataByteSize = kBlock * sizeof(Float32);
+				list->mBuffers[c].mData = &planes[c][0];
+			}
+			recorder.write(s, renderTime, list, kBlock);
+		}
+
+		// offline, so don't outrun the writer thread
+		while(recorder.getStats().backlog > kSampleRate) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	recorder.stop();
+	const double seconds = secondsSince(start);
+
+	const ofxAudioUnitStemRecorder::Stats stats = recorder.getStats();
+	const Float64 endSampleTime = firstSampleTime + cycles * kBlock;
+	const UInt64 expectedFrames = endSampleTime - stats.startSampleTime;
+
+	// the frames to expect, as (file, first channel in it, channels in it)
+	std::string problem;
+	UInt64 misaligned = 0;
+	std::vector<std::string> files;
+	if(layout == OFXAU_STEMS_INTERLEAVED) {
+		files.push_back(path);
+	} else {
+		for(size_t s = 0; s < sources; s++) {
+			char name[16];
+			snprintf(name, sizeof(name), "src%zu", s);
+			files.push_back(ofxAudioUnitStemRecorder::stemPath(path, name));
+		}
+	}
+
+	size_t source = 0;
+	for(size_t f = 0; f < files.size(); f++) {
+		const size_t firstSource = source;
+		const size_t lastSource = layout == OFXAU_STEMS_INTERLEAVED ? sources : source + 1;
+		unsigned int frameChannels = 0;
+		for(size_t s = firstSource; s < lastSource; s++) frameChannels += channels[s];
+
+		const std::vector<Float32> data = readFloatData(files[f]);
+		if(data.size() != expectedFrames * frameChannels) {
+			problem = "file is the wrong length";
+		}
+
+		for(UInt64 i = 0; i < expectedFrames && problem.empty(); i++) {
+			const Float64 sampleTime = stats.startSampleTime + i;
+			unsigned int channel = 0;
+			for(size_t s = firstSource; s < lastSource; s++) {
+				const bool silent = s == lateSource && sampleTime < firstSampleTime + (startCycle + lateCycles) * kBlock;
+				for(unsigned int c = 0; c < channels[s]; c++, channel++) {
+					const Float32 expected = silent ? 0 : sampleTime + c * 0.25f;
+					if(data[i * frameChannels + channel] != expected) misaligned++;
+				}
+			}
+		}
+		source = lastSource;
+		remove(files[f].c_str());
+	}
+
+	if(problem.empty() && misaligned > 0) problem = "samples came from the wrong sample time";
+	if(problem.empty() && stats.startSampleTime != firstSampleTime + (startCycle + 1) * kBlock) problem = "started on the wrong cycle";
+	if(problem.empty() && stats.discontinuities != 1) problem = "the restart wasn't counted once";
+
+	printf("{\"benchmark\":\"stems\",\"layout\":\"%s\",\"sources\":%zu,\"frames\":%llu,\"seconds\":%.3f,"
+		   "\"start_sample_time\":%.0f,\"misaligned_samples\":%llu,\"discontinuities\":%llu,\"dropped\":%llu,\"missing\":%llu,\"ok\":%s%s%s%s}\n",
+		   layout == OFXAU_STEMS_INTERLEAVED ? "interleaved" : "separate", sources,
+		   (unsigned long long)stats.framesWritten, seconds, stats.startSampleTime, (unsigned long long)misaligned,
+		   (unsigned long long)stats.discontinuities,
+		   (unsigned long long)stats.droppedFrames, (unsigned long long)stats.missingFrames,
+		   problem.empty() && !stats.failed ? "true" : "false",
+		   problem.empty() ? "" : ",\"problem\":\"", problem.c_str(), problem.empty() ? "" : "\"");
+	fflush(stdout);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+	const bool rf64 = hasOption(argc, argv, "--rf64");
+	directory = optionValue(argc, argv, "--dir", directory);
+
+	srand(1);
+
+	const ofxAudioUnitWavFormat formats[] = {OFXAU_WAV_INT16, OFXAU_WAV_INT24, OFXAU_WAV_INT32, OFXAU_WAV_FLOAT32};
+	const unsigned int channelCounts[] = {2, 8, 32, 64};
+	for(size_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); c++) {
+		for(size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+			throughput(channelCounts[c], formats[f], (quick ? 60. : 600.) / channelCounts[c]);
+		}
+	}
+
+	realtime(32, OFXAU_WAV_INT24, quick ? 2 : 20);
+	realtime(32, OFXAU_WAV_FLOAT32, quick ? 2 : 20);
+
+	preRoll(8, quick ? 2 : 10, quick ? 1 : 5);
+	preRoll(32, quick ? 2 : 30, quick ? 1 : 5);
+	rearm(8);
+
+	// by duration, by size, and a segment much shorter than a write batch
+	rotation(8, OFXAU_WAV_INT24, 1, 0, quick ? 5.3 : 60.3);
+	rotation(8, OFXAU_WAV_FLOAT32, 0, 1 << 20, quick ? 5.3 : 60.3);
+	rotation(2, OFXAU_WAV_INT16, 0.01, 0, 1.3);
+
+	stems(OFXAU_STEMS_SEPARATE);
+	stems(OFXAU_STEMS_INTERLEAVED);
+
+	// 8 channels of float at 48 kHz passes 4 GB after about 47 minutes
+	if(rf64) {
+		throughput(8, OFXAU_WAV_FLOAT32, 2900);
+	}
+
+	return 0;
+}
@@ -0,0 +1,409 @@
+// Benchmarks for ofxAudioUnitSampleCache and the voices behind
+// ofxAudioUnitSamplePlayer, playing from the cache.
+//
+//   SOURCES="sampleCacheBenchmark.cpp ../src/ofxAudioUnitSampleCache.cpp ../src/ofxAudioUnitSampleVoices.cpp ../src/ofxAudioUnitWavReader.cpp ../src/ofxAudioUnitWavWriter.cpp ../src/ofxAudioUnitSampleConverter.cpp"
+//
+// On Linux the cache reads files with ofxAudioUnitWavReader.
+//
+// "formats" writes a file in each WAV format and checks what the cache
+// decodes from it against what went in.
+// "shared" has a crowd of threads load the same file at once, checks it's
+// decoded once and everyone gets the same buffer, and compares the first
+// load's time with a load that's already cached.
+// "budget" loads more than the memory budget holds and checks the least
+// recently used samples are let go, but never one that's still held.
+// "onsets" schedules triggers on arbitrary frames (across render cycle
+// boundaries, overlapping, and one too late) and checks every frame of the
+// output against the sample mixed in at those frames.
+// "stop" checks stopAt() fades out on time, and that a sample swapped out
+// while playing keeps playing and is let go afterwards.
+// "voices" times rendering with every voice playing.
+
+#include "ofxAudioUnitSampleCache.h"
+#include "ofxAudioUnitSampleVoices.h"
+#include "ofxAudioUnitWavWriter.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::string directory = "/tmp";
+
+static const double kSampleRate = 48000;
+static const UInt32 kBlockFrames = 512;
+
+static const char * formatName(ofxAudioUnitWavFormat format)
+{
+	switch(format) {
+		case OFXAU_WAV_INT16:   return "int16";
+		case OFXAU_WAV_INT24:   return "int24";
+		case OFXAU_WAV_INT32:   return "int32";
+		case OFXAU_WAV_FLOAT32: return "float32";
+	}
+	return "?";
+}
+
+// noise, different for every channel and reproducible
+static std::vector<std::vector<Float32> > makeSource(unsigned int channels, size_t frames, unsigned int seed)
+{
+	std::vector<std::vector<Float32> > source(channels, std::vector<Float32>(frames));
+	UInt32 state = seed * 2654435761u + 1;
+	for(unsigned int c = 0; c < channels; c++) {
+		for(size_t i = 0; i < frames; i++) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			source[c][i] = ((state >> 8) / 8388608.f - 1.f) * 0.5f;
+		}
+	}
+	return source;
+}
+
+static bool writeFile(const std::string &path, const std::vector<std::vector<Float32> > &source, ofxAudioUnitWavFormat format)
+{
+	std::vector<const Float32 *> planes;
+	for(size_t c = 0; c < source.size(); c++) planes.push_back(&source[c][0]);
+
+	ofxAudioUnitWavWriter writer;
+	return writer.open(path, source.size(), kSampleRate, format) &&
+		   writer.write(&planes[0], source[0].size()) &&
+		   writer.close();
+}
+
+// a buffer list over planar output, as a render callback gets
+struct Output {
+	std::vector<std::vector<Float32> > planes;
+	std::vector<char> storage;
+
+	Output(unsigned int channels, UInt32 frames)
+	: planes(channels, std::vector<Float32>(frames))
+	, storage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channels)
+	{
+		list()->mNumberBuffers = channels;
+		for(unsigned int c = 0; c < channels; c++) {
+			list()->mBuffers[c].mNumberChannels = 1;
+			list()->mBuffers[c].mDataByteSize = frames * sizeof(Float32);
+			list()->mBuffers[c].mData = &planes[c][0];
+		}
+	}
+
+	AudioBufferList * list() {return (AudioBufferList *)&storage[0];}
+};
+
+// renders `frames` frames in blocks starting at sampleTime, appending them
+// to `out` (one vector per channel)
+static void renderBlocks(ofxAudioUnitSampleVoices &voices, Float64 sampleTime, size_t frames, std::vector<std::vector<Float32> > &out)
+{
+	Output block(out.size(), kBlockFrames);
+	AudioTimeStamp timeStamp = {};
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+
+	for(size_t done = 0; done < frames; done += kBlockFrames) {
+		timeStamp.mSampleTime = sampleTime + done;
+		voices.render(&timeStamp, kBlockFrames, block.list());
+		for(size_t c = 0; c < out.size(); c++) {
+			out[c].insert(out[c].end(), block.planes[c].begin(), block.planes[c].end());
+		}
+	}
+}
+
+#pragma mark - Cache
+
+static bool formats(ofxAudioUnitWavFormat format, unsigned int channels)
+{
+	const std::string path = directory + "/sampleCacheBenchmark.wav";
+	const size_t frames = 48000 + 17;
+	const std::vector<std::vector<Float32> > source = makeSource(channels, frames, 1);
+
+	if(!writeFile(path, source, format)) {
+		printf("{\"benchmark\":\"formats\",\"format\":\"%s\",\"error\":\"couldn't write the file\",\"ok\":false}\n", formatName(format));
+		return false;
+	}
+
+	const double tolerance = format == OFXAU_WAV_INT16 ? 1.0 / 32768 : format == OFXAU_WAV_INT24 ? 1.0 / 8388608 : 1e-7;
+	const ofxAudioUnitSampleCache::Stats before = ofxAudioUnitSampleCache::getStats();
+	ofxAudioUnitSampleRef sample = ofxAudioUnitSampleCache::load(path);
+	const ofxAudioUnitSampleCache::Stats after = ofxAudioUnitSampleCache::getStats();
+
+	double maxError = INFINITY;
+	if(sample && sample->channels == channels && sample->frames == frames) {
+		maxError = 0;
+		for(unsigned int c = 0; c < channels; c++) {
+			for(size_t i = 0; i < frames; i++) {
+				maxError = std::max<double>(maxError, fabs(sample->channel(c)[i] - source[c][i]));
+			}
+		}
+	}
+
+	const bool ok = maxError <= tolerance && after.decodes == before.decodes + 1;
+	printf("{\"benchmark\":\"formats\",\"format\":\"%s\",\"channels\":%u,\"frames\":%zu,\"max_error\":%.3g,\"ok\":%s}\n",
+		   formatName(format), channels, sample ? sample->frames : 0, maxError, ok ? "true" : "false");
+
+	sample.reset();
+	ofxAudioUnitSampleCache::purge();
+	remove(path.c_str());
+	return ok;
+}
+
+static bool shared()
+{
+	const std::string path = directory + "/sampleCacheBenchmark.wav";
+	const unsigned int threadCount = 20;
+	const size_t frames = quick ? 48000 * 5 : 48000 * 30;
+	if(!writeFile(path, makeSource(2, frames, 2), OFXAU_WAV_INT24)) return false;
+
+	ofxAudioUnitSampleCache::purge();
+	const ofxAudioUnitSampleCache::Stats before = ofxAudioUnitSampleCache::getStats();
+
+	std::vector<ofxAudioUnitSampleRef> loaded(threadCount);
+	std::vector<double> seconds(threadCount);
+	std::vector<std::thread> threads;
+	for(unsigned int t = 0; t < threadCount; t++) {
+		threads.push_back(std::thread([&, t] {
+			const Clock::time_point start = Clock::now();
+			loaded[t] = ofxAudioUnitSampleCache::load(path);
+			seconds[t] = secondsSince(start);
+		}));
+	}
+	for(size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+	const ofxAudioUnitSampleCache::Stats after = ofxAudioUnitSampleCache::getStats();
+
+	// and once it's in memory
+	const int hitRuns = 1000;
+	Clock::time_point start = Clock::now();
+	for(int i = 0; i < hitRuns; i++) {
+		ofxAudioUnitSampleRef hit = ofxAudioUnitSampleCache::load(path);
+	}
+	const double hitSeconds = secondsSince(start) / hitRuns;
+
+	bool same = loaded[0] != NULL;
+	for(unsigned int t = 1; t < threadCount; t++) same = same && loaded[t] == loaded[0];
+	const UInt64 decodes = after.decodes - before.decodes;
+	const double decodeSeconds = *std::max_element(seconds.begin(), seconds.end());
+
+	const bool ok = same && decodes == 1 && after.hits - before.hits == threadCount - 1 && after.bytes == loaded[0]->bytes();
+	printf("{\"benchmark\":\"shared\",\"threads\":%u,\"frames\":%zu,\"decodes\":%llu,\"same_buffer\":%s,\"bytes\":%zu,\"first_load_ms\":%.2f,\"cached_load_us\":%.3f,\"ok\":%s}\n",
+		   threadCount, frames, (unsigned long long)decodes, same ? "true" : "false", after.bytes,
+		   decodeSeconds * 1e3, hitSeconds * 1e6, ok ? "true" : "false");
+
+	loaded.clear();
+	ofxAudioUnitSampleCache::purge();
+	remove(path.c_str());
+	return ok;
+}
+
+static bool budget()
+{
+	const unsigned int fileCount = 6;
+	const size_t frames = 48000;
+	const size_t sampleBytes = frames * 2 * sizeof(Float32);
+	std::vector<std::string> paths;
+	for(unsigned int i = 0; i < fileCount; i++) {
+		paths.push_back(directory + "/sampleCacheBenchmark-" + std::to_string(i) + ".wav");
+		if(!writeFile(paths.back(), makeSource(2, frames, 10 + i), OFXAU_WAV_INT16)) return false;
+	}
+
+	ofxAudioUnitSampleCache::purge();
+	const size_t oldBudget = ofxAudioUnitSampleCache::getMemoryBudget();
+	ofxAudioUnitSampleCache::setMemoryBudget(sampleBytes * 3);
+	const ofxAudioUnitSampleCache::Stats before = ofxAudioUnitSampleCache::getStats();
+
+	// the first one stays in use throughout; the rest are loaded and let go
+	ofxAudioUnitSampleRef held = ofxAudioUnitSampleCache::load(paths[0]);
+	const ofxAudioUnitSampleData * heldData = held.get();
+	for(unsigned int i = 1; i < fileCount; i++) {
+		ofxAudioUnitSampleCache::load(paths[i]);
+	}
+	const ofxAudioUnitSampleCache::Stats full = ofxAudioUnitSampleCache::getStats();
+
+	// the two most recent should still be there; the oldest unused ones not
+	const UInt64 decodesBefore = full.decodes;
+	const bool recentKept = ofxAudioUnitSampleCache::load(paths[fileCount - 1]) &&
+							ofxAudioUnitSampleCache::load(paths[fileCount - 2]) &&
+							ofxAudioUnitSampleCache::getStats().decodes == decodesBefore;
+	const bool heldKept = ofxAudioUnitSampleCache::load(paths[0]).get() == heldData;
+	ofxAudioUnitSampleCache::load(paths[1]);
+	const bool oldestDropped = ofxAudioUnitSampleCache::getStats().decodes == decodesBefore + 1;
+
+	held.reset();
+	ofxAudioUnitSampleCache::setMemoryBudget(0);
+	const ofxAudioUnitSampleCache::Stats empty = ofxAudioUnitSampleCache::getStats();
+	ofxAudioUnitSampleCache::setMemoryBudget(oldBudget);
+
+	const bool ok = full.bytes <= sampleBytes * 3 && full.bytesInUse == sampleBytes &&
+					recentKept && heldKept && oldestDropped && empty.samples == 0 && empty.bytes == 0;
+	printf("{\"benchmark\":\"budget\",\"budget_bytes\":%zu,\"files\":%u,\"bytes_after_loading\":%zu,\"bytes_in_use\":%zu,\"evictions\":%llu,\"recent_kept\":%s,\"held_kept\":%s,\"oldest_dropped\":%s,\"ok\":%s}\n",
+		   sampleBytes * 3, fileCount, full.bytes, full.bytesInUse, (unsigned long long)(full.evictions - before.evictions),
+		   recentKept ? "true" : "false", heldKept ? "true" : "false", oldestDropped ? "true" : "false", ok ? "true" : "false");
+
+	for(unsigned int i = 0; i < fileCount; i++) remove(paths[i].c_str());
+	return ok;
+}
+
+#pragma mark - Voices
+
+static ofxAudioUnitSampleRef makeSample(unsigned int channels, size_t frames, unsigned int seed)
+{
+	std::shared_ptr<ofxAudioUnitSampleData> sample = std::make_shared<ofxAudioUnitSampleData>();
+	const std::vector<std::vector<Float32> > source = makeSource(channels, frames, seed);
+	sample->sampleRate = kSampleRate;
+	sample->channels = channels;
+	sample->frames = frames;
+	for(unsigned int c = 0; c < channels; c++) {
+		sample->samples.insert(sample->samples.end(), source[c].begin(), source[c].end());
+	}
+	return sample;
+}
+
+static bool onsets()
+{
+	const Float64 startTime = 1000000; // sample times don't start at 0 in a running graph
+	const size_t frames = kBlockFrames * 64;
+	const unsigned int triggerCount = 40;
+	ofxAudioUnitSampleRef sample = makeSample(1, 700, 3);
+	ofxAudioUnitSampleVoices voices;
+	voices.setSample(sample);
+
+	// triggers anywhere in the first 90%, a few of them landing on or either
+	// side of a block boundary, plus one for a time that's already passed
+	std::vector<SInt64> offsets;
+	srand(4);
+	for(unsigned int i = 0; i < triggerCount; i++) {
+		offsets.push_back(rand() % (frames * 9 / 10));
+	}
+	offsets[0] = 0;
+	offsets[1] = kBlockFrames - 1;
+	offsets[2] = kBlockFrames;
+	offsets[3] = kBlockFrames * 7 + 1;
+	for(unsigned int i = 0; i < triggerCount; i++) {
+		voices.playAt(startTime + offsets[i], 0.5f);
+	}
+
+	std::vector<std::vector<Float32> > out(2);
+	renderBlocks(voices, startTime, kBlockFrames * 8, out);
+
+	// late: asked for before the cycle it arrives in, so it starts that cycle
+	const Float64 lateStart = startTime + kBlockFrames * 8;
+	voices.playAt(lateStart - 100, 0.5f);
+	offsets.push_back(kBlockFrames * 8);
+	renderBlocks(voices, lateStart, frames - kBlockFrames * 8, out);
+
+	// what it should have come out as
+	std::vector<Float32> expected(frames, 0);
+	for(size_t t = 0; t < offsets.size(); t++) {
+		for(size_t i = 0; i < sample->frames && offsets[t] + i < frames; i++) {
+			expected[offsets[t] + i] += 0.5f * sample->channel(0)[i];
+		}
+	}
+
+	double maxError = 0;
+	for(size_t c = 0; c < out.size(); c++) {
+		for(size_t i = 0; i < frames; i++) maxError = std::max<double>(maxError, fabs(out[c][i] - expected[i]));
+	}
+
+	const ofxAudioUnitSampleVoices::Stats stats = voices.getStats();
+	const bool ok = maxError < 1e-5 && stats.triggers == triggerCount + 1 && stats.lateTriggers == 1 &&
+					stats.maxLateness == 100 && stats.stolenVoices == 0 && stats.activeVoices == 0;
+	printf("{\"benchmark\":\"onsets\",\"block_frames\":%u,\"triggers\":%llu,\"late_triggers\":%llu,\"max_lateness\":%llu,\"stolen_voices\":%llu,\"max_error\":%.3g,\"ok\":%s}\n",
+		   kBlockFrames, (unsigned long long)stats.triggers, (unsigned long long)stats.lateTriggers,
+		   (unsigned long long)stats.maxLateness, (unsigned long long)stats.stolenVoices, maxError, ok ? "true" : "false");
+	return ok;
+}
+
+static bool stop()
+{
+	const Float64 startTime = 5000;
+	ofxAudioUnitSampleRef first = makeSample(2, 48000, 5);
+	std::weak_ptr<const ofxAudioUnitSampleData> firstWeak = first;
+	ofxAudioUnitSampleVoices voices;
+	voices.setSample(first);
+	voices.playAt(startTime + 100);
+	voices.stopAt(startTime + 3000);
+	first.reset();
+
+	// swapped while the first one's playing, and played straight after
+	std::vector<std::vector<Float32> > out(2);
+	renderBlocks(voices, startTime, kBlockFrames * 2, out);
+	ofxAudioUnitSampleRef second = makeSample(2, 1000, 6);
+	voices.setSample(second);
+	voices.playAt(startTime + 2000, 1);
+	renderBlocks(voices, startTime + kBlockFrames * 2, kBlockFrames * 6, out);
+
+	// the first voice: unchanged up to the stop, faded out over 64 frames after
+	ofxAudioUnitSampleRef firstHeld = firstWeak.lock();
+	double maxError = firstHeld ? 0 : INFINITY;
+	for(unsigned int c = 0; c < 2 && firstHeld; c++) {
+		for(size_t i = 0; i < out[c].size(); i++) {
+			Float32 expected = 0;
+			if(i >= 100 && i < 3000) expected = firstHeld->channel(c)[i - 100];
+			if(i >= 3000 && i < 3064) expected = firstHeld->channel(c)[i - 100] * (64 - (i - 3000)) / 64.f;
+			if(i >= 2000 && i < 3000) expected += second->channel(c)[i - 2000];
+			maxError = std::max<double>(maxError, fabs(out[c][i] - expected));
+		}
+	}
+
+	// let go on the next call from the main thread, now the render thread's
+	// done with it
+	const long heldBefore = firstHeld.use_count(); // ours and the voices'
+	voices.stop();
+	const long heldAfter = firstHeld.use_count();
+	firstHeld.reset();
+	const bool ok = maxError < 1e-5 && heldBefore == 2 && heldAfter == 1 && firstWeak.expired();
+
+	printf("{\"benchmark\":\"stop\",\"max_error\":%.3g,\"swapped_sample_released\":%s,\"ok\":%s}\n",
+		   maxError, firstWeak.expired() ? "true" : "false", ok ? "true" : "false");
+	return ok;
+}
+
+static void voicesCost(unsigned int channels)
+{
+	ofxAudioUnitSampleRef sample = makeSample(channels, 48000 * 10, 7);
+	ofxAudioUnitSampleVoices voices;
+	voices.setSample(sample);
+	for(unsigned int v = 0; v < ofxAudioUnitSampleVoices::kMaxVoices; v++) voices.play(0.1f);
+
+	Output block(channels, kBlockFrames);
+	AudioTimeStamp timeStamp = {};
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+	const size_t blocks = (quick ? 48000 * 2 : 48000 * 9) / kBlockFrames;
+
+	const Clock::time_point start = Clock::now();
+	for(size_t b = 0; b < blocks; b++) {
+		timeStamp.mSampleTime = b * kBlockFrames;
+		voices.render(&timeStamp, kBlockFrames, block.list());
+	}
+	const double seconds = secondsSince(start);
+	const double audioSeconds = blocks * kBlockFrames / kSampleRate;
+
+	printf("{\"benchmark\":\"voices\",\"channels\":%u,\"voices\":%u,\"active_at_end\":%u,\"ns_per_voice_frame\":%.2f,\"realtime_multiple\":%.1f}\n",
+		   channels, ofxAudioUnitSampleVoices::kMaxVoices, voices.getStats().activeVoices,
+		   seconds * 1e9 / (blocks * kBlockFrames * ofxAudioUnitSampleVoices::kMaxVoices), audioSeconds / seconds);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+	directory = optionValue(argc, argv, "--dir", directory);
+
+	bool ok = true;
+	const ofxAudioUnitWavFormat wavFormats[] = {OFXAU_WAV_INT16, OFXAU_WAV_INT24, OFXAU_WAV_INT32, OFXAU_WAV_FLOAT32};
+	for(size_t f = 0; f < sizeof(wavFormats) / sizeof(wavFormats[0]); f++) {
+		ok = formats(wavFormats[f], 1) && ok;
+		ok = formats(wavFormats[f], 6) && ok;
+	}
+	ok = shared() && ok;
+	ok = budget() && ok;
+	ok = onsets() && ok;
+	ok = stop() && ok;
+	voicesCost(1);
+	voicesCost(2);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+// Benchmarks for ofxAudioUnitTimeStretch, which ofxAudioUnitStretchPlayer
+// plays samples through.
+//
+//   SOURCES="timeStretchBenchmark.cpp ../src/ofxAudioUnitTimeStretch.cpp ../src/ofxAudioUnitFftCache.cpp"
+//
+// Each case runs in both modes, on samples made up in memory. "identity"
+// plays a chord with noise at tempo and pitch 1 and checks what comes out is
+// what went in. "stretch" plays a 440 Hz tone at a few tempos and pitches,
+// and checks the output lasts 1 / tempo as long as the sample, has the
+// frequency 440 * pitch (from its zero crossings) and keeps its level.
+// "voices" renders stereo voices of a chord at tempo 0.9 and pitch 1.1 in
+// 512 frame cycles, and reports the load of one voice and how many of them
+// a core could run.
+
+#include "ofxAudioUnitTimeStretch.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const double kSampleRate = 48000;
+static const UInt32 kBlockFrames = 512;
+
+static const char * modeName(ofxAudioUnitStretchMode mode)
+{
+	return mode == OFXAU_STRETCH_WSOLA ? "wsola" : "vocoder";
+}
+
+// sine partials (in Hz, at a level each) plus a little white noise
+static ofxAudioUnitSampleRef makeSample(unsigned int channels, double seconds, const std::vector<double> &partials, double level, double noise)
+{
+	std::shared_ptr<ofxAudioUnitSampleData> sample(new ofxAudioUnitSampleData);
+	sample->sampleRate = kSampleRate;
+	sample->channels = channels;
+	sample->frames = seconds * kSampleRate;
+	sample->samples.resize(channels * sample->frames);
+
+	srand(1);
+	for(unsigned int c = 0; c < channels; c++) {
+		Float32 * out = &sample->samples[c * sample->frames];
+		for(size_t i = 0; i < sample->frames; i++) {
+			double x = noise * (rand() / (double)RAND_MAX - 0.5);
+			for(size_t p = 0; p < partials.size(); p++) {
+				x += level * sin(2 * M_PI * partials[p] * i / kSampleRate + c);
+			}
+			out[i] = x;
+		}
+	}
+	return sample;
+}
+
+// plays it from the top until it stops, into one plane per channel
+static std::vector<std::vector<Float32> > playThrough(ofxAudioUnitTimeStretch &stretch, unsigned int channels)
+{
+	std::vector<std::vector<Float32> > out(channels);
+	std::vector<std::vector<Float32> > block(channels, std::vector<Float32>(kBlockFrames));
+	std::vector<char> storage(sizeof(AudioBufferList) + channels * sizeof(AudioBuffer));
+	AudioBufferList * bufferList = (AudioBufferList *)&storage[0];
+	bufferList->mNumberBuffers = channels;
+	for(unsigned int c = 0; c < channels; c++) {
+		bufferList->mBuffers[c].mNumberChannels = 1;
+		bufferList->mBuffers[c].mDataByteSize = kBlockFrames * sizeof(Float32);
+		bufferList->mBuffers[c].mData = &block[c][0];
+	}
+
+	stretch.setPosition(0);
+	stretch.play();
+	while(stretch.isPlaying()) {
+		const UInt64 before = stretch.getPosition();
+		stretch.render(kBlockFrames, bufferList);
+		// the last cycle is only partly sound
+		UInt32 frames = kBlockFrames;
+		if(!stretch.isPlaying()) {
+			const double left = (stretch.getSample()->frames - before) / stretch.getTempo();
+			frames = std::min<double>(kBlockFrames, ceil(left));
+		}
+		for(unsigned int c = 0; c < channels; c++) {
+			out[c].insert(out[c].end(), block[c].begin(), block[c].begin() + frames);
+		}
+	}
+	return out;
+}
+
+// from rising zero crossings, between the first and last
+static double frequency(const std::vector<Float32> &x, size_t from, size_t to)
+{
+	size_t first = 0, last = 0, count = 0;
+	for(size_t i = from + 1; i < to; i++) {
+		if(x[i - 1] < 0 && x[i] >= 0) {
+			// to a fraction of a sample
+			const double at = i - 1 + x[i - 1] / (x[i - 1] - x[i]);
+			if(count == 0) first = at * 1000;
+			last = at * 1000;
+			count++;
+		}
+	}
+	return count > 1 ? (count - 1) / ((last - first) / 1000. / kSampleRate) : 0;
+}
+
+static double rms(const std::vector<Float32> &x, size_t from, size_t to)
+{
+	double sum = 0;
+	for(size_t i = from; i < to; i++) sum += (double)x[i] * x[i];
+	return to > from ? sqrt(sum / (to - from)) : 0;
+}
+
+static bool identity(ofxAudioUnitStretchMode mode)
+{
+	const double chord[] = {220, 277.18, 329.63, 1000, 4321};
+	ofxAudioUnitSampleRef sample = makeSample(2, 2, std::vector<double>(chord, chord + 5), 0.15, 0.05);
+
+	ofxAudioUnitTimeStretch stretch(mode);
+	stretch.setSample(sample);
+	const std::vector<std::vector<Float32> > out = playThrough(stretch, 2);
+
+	double maxError = 0;
+	for(unsigned int c = 0; c < 2; c++) {
+		const Float32 * in = sample->channel(c);
+		for(size_t i = 0; i < std::min(out[c].size(), sample->frames); i++) {
+			maxError = std::max<double>(maxError, fabs(out[c][i] - in[i]));
+		}
+	}
+
+	const bool ok = out[0].size() == sample->frames && maxError < (mode == OFXAU_STRETCH_WSOLA ? 1e-5 : 2e-3);
+	printf("{\"benchmark\":\"identity\",\"mode\":\"%s\",\"frames\":%zu,\"rendered\":%zu,\"max_error\":%.2e,\"ok\":%s}\n",
+		modeName(mode), sample->frames, out[0].size(), maxError, ok ? "true" : "false");
+	return ok;
+}
+
+static bool stretch(ofxAudioUnitStretchMode mode, double tempo, double pitch)
+{
+	const double level = 0.5;
+	ofxAudioUnitSampleRef sample = makeSample(1, 2, std::vector<double>(1, 440), level, 0);
+
+	ofxAudioUnitTimeStretch stretch(mode);
+	stretch.setSample(sample);
+	stretch.setTempo(tempo);
+	stretch.setPitch(pitch);
+	const std::vector<Float32> out = playThrough(stretch, 1)[0];
+
+	// leaving out the fade in and out at the ends
+	const double expectedFrames = sample->frames / tempo;
+	const size_t margin = 0.1 * kSampleRate;
+	const size_t end = std::min(out.size(), (size_t)expectedFrames) - margin;
+	const double hz = frequency(out, margin, end);
+	const double gain = rms(out, margin, end) / (level / sqrt(2.));
+
+	const bool ok = fabs(out.size() - expectedFrames) <= 1
+		&& fabs(hz / (440 * pitch) - 1) < 0.01
+		&& fabs(gain - 1) < 0.1;
+	printf("{\"benchmark\":\"stretch\",\"mode\":\"%s\",\"tempo\":%.2f,\"pitch\":%.4f,\"expected_frames\":%.0f,\"rendered\":%zu,\"expected_hz\":%.1f,\"hz\":%.2f,\"gain\":%.3f,\"ok\":%s}\n",
+		modeName(mode), tempo, pitch, expectedFrames, out.size(), 440 * pitch, hz, gain, ok ? "true" : "false");
+	return ok;
+}
+
+static void voices(ofxAudioUnitStretchMode mode)
+{
+	const double chord[] = {110, 220, 277.18, 329.63, 440, 554.37, 659.26, 1760};
+	ofxAudioUnitSampleRef sample = makeSample(2, 10, std::vector<double>(chord, chord + 8), 0.1, 0.02);
+	const size_t count = 8;
+	const double seconds = quick ? 2 : 10;
+
+	std::vector<std::unique_ptr<ofxAudioUnitTimeStretch> > voices;
+	for(size_t v = 0; v < count; v++) {
+		voices.emplace_back(new ofxAudioUnitTimeStretch(mode));
+		voices.back()->setSample(sample);
+		voices.back()->setTempo(0.9);
+		voices.back()->setPitch(1.1);
+		voices.back()->setLooping(true);
+		voices.back()->setPosition(v * 4800);
+		voices.back()->play();
+	}
+
+	std::vector<Float32> left(kBlockFrames), right(kBlockFrames);
+	char storage[sizeof(AudioBufferList) + sizeof(AudioBuffer)];
+	AudioBufferList * bufferList = (AudioBufferList *)storage;
+	bufferList->mNumberBuffers = 2;
+	bufferList->mBuffers[0].mNumberChannels = 1;
+	bufferList->mBuffers[0].mDataByteSize = kBlockFrames * sizeof(Float32);
+	bufferList->mBuffers[0].mData = &left[0];
+	bufferList->mBuffers[1] = bufferList->mBuffers[0];
+	bufferList->mBuffers[1].mData = &right[0];
+
+	const size_t cycles = seconds * kSampleRate / kBlockFrames;
+	for(size_t i = 0; i < cycles; i++) {
+		for(size_t v = 0; v < count; v++) voices[v]->render(kBlockFrames, bufferList);
+	}
+
+	double load = 0, peak = 0, cycle = 0;
+	for(size_t v = 0; v < count; v++) {
+		const ofxAudioUnitTimeStretch::Stats stats = voices[v]->getStats();
+		load += stats.meanLoad / count;
+		cycle += stats.meanCycleUs / count;
+		peak = std::max(peak, stats.peakLoad);
+	}
+	printf("{\"benchmark\":\"voices\",\"mode\":\"%s\",\"channels\":2,\"block\":%u,\"voices\":%zu,\"seconds\":%.0f,\"mean_cycle_us\":%.1f,\"mean_load_per_voice\":%.5f,\"peak_load\":%.4f,\"voices_per_core\":%.0f}\n",
+		modeName(mode), kBlockFrames, count, seconds, cycle, load, peak, load > 0 ? 1 / load : 0);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+
+	const ofxAudioUnitStretchMode modes[] = {OFXAU_STRETCH_WSOLA, OFXAU_STRETCH_PHASE_VOCODER};
+	bool ok = true;
+	for(size_t m = 0; m < 2; m++) {
+		ok = identity(modes[m]) && ok;
+		ok = stretch(modes[m], 0.5, 1) && ok;
+		ok = stretch(modes[m], 2, 1) && ok;
+		ok = stretch(modes[m], 1, pow(2, 7 / 12.)) && ok;
+		ok = stretch(modes[m], 1, pow(2, -5 / 12.)) && ok;
+		ok = stretch(modes[m], 1.5, 0.8) && ok;
+	}
+	for(size_t m = 0; m < 2; m++) voices(modes[m]);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,444 @@
+// Benchmarks for ofxAudioUnitTimeline and ofxAudioUnitTimelineTrack, which
+// ofxAudioUnitMappedFilePlayer schedules its starts, stops and loops with.
+//
+//   SOURCES="timelineBenchmark.cpp ../src/ofxAudioUnitTimeline.cpp ../src/ofxAudioUnitMappedFile.cpp ../src/ofxAudioUnitWavReader.cpp ../src/ofxAudioUnitWavWriter.cpp ../src/ofxAudioUnitSampleConverter.cpp"
+//
+// "exact" renders many tracks cycle by cycle, offline, the way a graph would
+// pull them, while scheduling random starts, stops, loop changes and clears
+// on them and starting, stopping and moving the timeline between cycles.
+// Half the tracks play ofxAudioUnitMappedFile (the same way
+// ofxAudioUnitMappedFilePlayer does) from a file whose every frame holds its
+// own index, and half a counter that does the same without a file. Every
+// output sample is checked against a sample-by-sample model of what should
+// have happened, with fixed and with random cycle sizes. "late" schedules an
+// event in the past and checks it lands at the top of the next cycle and is
+// counted. "reset" starts the output's sample times over in the middle of
+// playback and checks the transport and the tracks carry on without a gap.
+// "overhead" times a cycle of 40 file players with and without a
+// timeline.
+
+#include "ofxAudioUnitMappedFile.h"
+#include "ofxAudioUnitTimeline.h"
+#include "ofxAudioUnitWavWriter.h"
+#include "benchmarkUtils.h"
+
+#include <algorithm>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::string directory = "/tmp";
+
+static const double kSampleRate = 48000;
+static const UInt32 kMaxBlockFrames = 1024;
+static const UInt64 kFileFrames = 48000 + 17;
+static const float kScale = 16777216.f; // 2^24, so frame indexes are exact floats
+
+// each frame holds (its index + 1) / 2^24, so silence reads as 0
+static bool writeFile(const std::string &path)
+{
+	ofxAudioUnitWavWriter writer;
+	if(!writer.open(path, 1, kSampleRate, OFXAU_WAV_FLOAT32)) return false;
+	std::vector<Float32> frames(kFileFrames);
+	for(UInt64 i = 0; i < kFileFrames; i++) frames[i] = (i + 1) / kScale;
+	const Float32 * planes[] = {&frames[0]};
+	return writer.write(planes, kFileFrames) && writer.close();
+}
+
+// the mapped file, as ofxAudioUnitMappedFilePlayer hands it to its track
+class FileTarget : public ofxAudioUnitTimelineTrack::Target
+{
+public:
+	ofxAudioUnitMappedFile file;
+
+	void prepare(UInt64 frame) {file.preload(frame);}
+	void start(UInt64 frame) {file.cue(frame);}
+	void stop() {file.stop();}
+	void setLooping(bool looping) {file.setLooping(looping);}
+	void render(UInt32 frames, AudioBufferList * bufferList) {file.render(frames, bufferList);}
+};
+
+// the same, without a file
+class CounterTarget : public ofxAudioUnitTimelineTrack::Target
+{
+public:
+	CounterTarget() : _playing(false), _looping(false), _position(0) {}
+
+	void start(UInt64 frame) {_playing = true; _position = std::min(frame, kFileFrames);}
+	void stop() {_playing = false;}
+	void setLooping(bool looping) {_looping = looping;}
+
+	void render(UInt32 frames, AudioBufferList * bufferList)
+	{
+		Float32 * out = (Float32 *)bufferList->mBuffers[0].mData;
+		for(UInt32 i = 0; i < frames; i++) {
+			if(_playing && _position >= kFileFrames) {
+				if(_looping) _position = 0;
+				else _playing = false;
+			}
+			out[i] = _playing ? (_position++ + 1) / kScale : 0;
+		}
+	}
+
+private:
+	bool _playing;
+	bool _looping;
+	UInt64 _position;
+};
+
+#pragma mark - Model
+
+// what a track should do, worked out a sample at a time
+struct ModelEvent {
+	int type; // 0 start, 1 stop, 2 looping
+	UInt64 time;
+	UInt64 frame;
+	bool looping;
+};
+
+struct ModelTrack {
+	std::vector<ModelEvent> pending; // in time order, in the order sent for the same time
+	bool playing;
+	bool looping;
+	UInt64 position;
+
+	ModelTrack() : playing(false), looping(false), position(0) {}
+
+	void schedule(const ModelEvent &event)
+	{
+		std::vector<ModelEvent>::iterator at = pending.end();
+		while(at != pending.begin() && (at - 1)->time > event.time) --at;
+		pending.insert(at, event);
+	}
+
+	// the value of the sample at timeline time t
+	float sample(UInt64 t)
+	{
+		size_t due = 0;
+		for(; due < pending.size() && pending[due].time <= t; due++) {
+			const ModelEvent &event = pending[due];
+			if(event.type == 0) {
+				playing = true;
+				position = std::min(event.frame, kFileFrames);
+			} else if(event.type == 1) {
+				playing = false;
+			} else {
+				looping = event.looping;
+			}
+		}
+		pending.erase(pending.begin(), pending.begin() + due);
+
+		if(playing && position >= kFileFrames) {
+			if(looping) position = 0;
+			else playing = false;
+		}
+		return playing ? position++ + 1 : 0;
+	}
+};
+
+// a buffer list over one planar channel, as a render callback gets
+struct Output {
+	std::vector<Float32> samples;
+	AudioBufferList list;
+
+	Output() : samples(kMaxBlockFrames)
+	{
+		list.mNumberBuffers = 1;
+		list.mBuffers[0].mNumberChannels = 1;
+		list.mBuffers[0].mData = &samples[0];
+	}
+
+	AudioBufferList * set(UInt32 frames)
+	{
+		list.mBuffers[0].mDataByteSize = frames * sizeof(Float32);
+		return &list;
+	}
+};
+
+static UInt32 next(UInt32 &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static bool exact(const std::string &path, size_t trackCount, bool randomBlocks)
+{
+	std::vector<std::unique_ptr<ofxAudioUnitTimelineTrack::Target> > targets;
+	std::vector<std::unique_ptr<ofxAudioUnitTimelineTrack> > tracks;
+	std::vector<ModelTrack> models(trackCount);
+	std::shared_ptr<ofxAudioUnitTimeline> timeline(new ofxAudioUnitTimeline);
+
+	for(size_t t = 0; t < trackCount; t++) {
+		if(t % 2 == 0) {
+			FileTarget * target = new FileTarget;
+			if(!target->file.open(path, 0.5)) return false;
+			targets.push_back(std::unique_ptr<ofxAudioUnitTimelineTrack::Target>(target));
+		} else {
+			targets.push_back(std::unique_ptr<ofxAudioUnitTimelineTrack::Target>(new CounterTarget));
+		}
+		tracks.push_back(std::unique_ptr<ofxAudioUnitTimelineTrack>(new ofxAudioUnitTimelineTrack(*targets.back())));
+		tracks.back()->setTimeline(timeline);
+	}
+
+	const size_t cycles = quick ? 4000 : 40000;
+	UInt32 state = 12345;
+	Output output;
+	AudioTimeStamp timeStamp;
+	memset(&timeStamp, 0, sizeof(timeStamp));
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+	timeStamp.mSampleTime = 987654; // anywhere; the graph's clock doesn't start at 0
+
+	bool modelRunning = false, requestedRunning = false;
+	UInt64 modelPosition = 0;
+	bool locate = false;
+	UInt64 locateTo = 0;
+
+	size_t mismatches = 0, events = 0, checked = 0;
+	UInt64 firstMismatchTime = 0;
+	timeline->start();
+	requestedRunning = true;
+
+	for(size_t c = 0; c < cycles; c++) {
+		const UInt32 frames = randomBlocks ? 1 + next(state) % kMaxBlockFrames : 512;
+
+		// the transport, now and again
+		const UInt32 roll = next(state) % 1000;
+		if(roll < 5) {
+			requestedRunning = !requestedRunning;
+			if(requestedRunning) timeline->start();
+			else timeline->stop();
+		} else if(roll < 8) {
+			locate = true;
+			locateTo = next(state) % (UInt32)(kSampleRate * 30);
+			timeline->setPosition(locateTo);
+		}
+
+		// events, mostly a little ahead of where the timeline is
+		const UInt64 now = timeline->getPosition();
+		for(size_t t = 0; t < trackCount; t++) {
+			if(next(state) % 100 >= 3) continue;
+			ModelEvent event = {(int)(next(state) % 3), now + next(state) % 4096, next(state) % (kFileFrames + 500), next(state) % 2 == 0};
+			bool pushed = false;
+			if(next(state) % 200 == 0) {
+				pushed = tracks[t]->clear();
+				if(pushed) models[t].pending.clear();
+				continue;
+			} else if(event.type == 0) {
+				pushed = tracks[t]->startAt(event.time, event.frame);
+			} else if(event.type == 1) {
+				pushed = tracks[t]->stopAt(event.time);
+			} else {
+				pushed = tracks[t]->setLoopingAt(event.time, event.looping);
+			}
+			if(pushed) {
+				models[t].schedule(event);
+				events++;
+			}
+		}
+
+		// the model's transport for this cycle
+		modelRunning = requestedRunning;
+		if(locate) modelPosition = locateTo;
+		locate = false;
+
+		for(size_t t = 0; t < trackCount; t++) {
+			tracks[t]->render(&timeStamp, frames, output.set(frames));
+			for(UInt32 i = 0; i < frames; i++) {
+				const float expected = modelRunning ? models[t].sample(modelPosition + i) : 0;
+				const float got = output.samples[i] * kScale;
+				if(got != expected) {
+					if(mismatches == 0) firstMismatchTime = modelPosition + i;
+					mismatches++;
+				}
+				checked++;
+			}
+		}
+
+		if(modelRunning) modelPosition += frames;
+		timeStamp.mSampleTime += frames;
+	}
+
+	UInt64 late = 0, dropped = 0, applied = 0;
+	for(size_t t = 0; t < trackCount; t++) {
+		const ofxAudioUnitTimelineTrack::Stats stats = tracks[t]->getStats();
+		late += stats.lateEvents;
+		dropped += stats.droppedEvents;
+		applied += stats.events;
+	}
+
+	const bool ok = mismatches == 0 && dropped == 0;
+	printf("{\"benchmark\":\"exact\",\"tracks\":%zu,\"blocks\":\"%s\",\"cycles\":%zu,\"events\":%zu,\"applied\":%llu,\"late\":%llu,\"samples_checked\":%zu,\"mismatches\":%zu,\"first_mismatch_at\":%llu,\"ok\":%s}\n",
+		   trackCount, randomBlocks ? "random" : "512", cycles, events, (unsigned long long)applied, (unsigned long long)late,
+		   checked, mismatches, (unsigned long long)firstMismatchTime, ok ? "true" : "false");
+	return ok;
+}
+
+static bool late()
+{
+	CounterTarget target;
+	ofxAudioUnitTimelineTrack track(target);
+	std::shared_ptr<ofxAudioUnitTimeline> timeline(new ofxAudioUnitTimeline);
+	track.setTimeline(timeline);
+	timeline->start();
+
+	Output output;
+	AudioTimeStamp timeStamp;
+	memset(&timeStamp, 0, sizeof(timeStamp));
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+
+	for(int c = 0; c < 4; c++) {
+		track.render(&timeStamp, 512, output.set(512));
+		timeStamp.mSampleTime += 512;
+	}
+
+	// 100 frames before the start of the next cycle
+	track.startAt(timeline->getPosition() - 100, 1000);
+	track.render(&timeStamp, 512, output.set(512));
+
+	const ofxAudioUnitTimelineTrack::Stats stats = track.getStats();
+	const bool ok = output.samples[0] * kScale == 1001 && stats.lateEvents == 1 && stats.maxLateness == 100;
+	printf("{\"benchmark\":\"late\",\"first_sample\":%.0f,\"late_events\":%llu,\"max_lateness\":%llu,\"ok\":%s}\n",
+		   output.samples[0] * kScale, (unsigned long long)stats.lateEvents, (unsigned long long)stats.maxLateness, ok ? "true" : "false");
+	return ok;
+}
+
+// The output's sample times start over twice, as they do when it's stopped
+// and started or its device changes: back to 0, then to somewhere in between.
+// The transport has to carry on from where it was each time, the track
+// already playing has to carry on without a gap, and a start scheduled after
+// the reset has to land on its frame
+static bool reset()
+{
+	const UInt32 frames = 512;
+	const UInt64 delay = 2048;
+
+	CounterTarget playing, restarted;
+	ofxAudioUnitTimelineTrack playingTrack(playing), restartedTrack(restarted);
+	std::shared_ptr<ofxAudioUnitTimeline> timeline(new ofxAudioUnitTimeline);
+	playingTrack.setTimeline(timeline);
+	restartedTrack.setTimeline(timeline);
+	playing.setLooping(true);
+	playingTrack.startAt(0);
+	timeline->start();
+
+	Output output;
+	AudioTimeStamp timeStamp;
+	memset(&timeStamp, 0, sizeof(timeStamp));
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+
+	const SInt64 resets[] = {0, 37 * frames + 5};
+	UInt64 stuck = 0, gaps = 0, misplaced = 0;
+	UInt64 position = 0, startTime = 0;
+
+	for(int r = 0; r < 3; r++) {
+		if(r > 0) {
+			timeStamp.mSampleTime = resets[r - 1];
+			startTime = timeline->getPosition() + delay;
+			restartedTrack.startAt(startTime);
+		}
+
+		for(int c = 0; c < 100; c++) {
+			playingTrack.render(&timeStamp, frames, output.set(frames));
+			for(UInt32 i = 0; i < frames; i++) {
+				if(output.samples[i] * kScale != (position + i) % kFileFrames + 1) gaps++;
+			}
+
+			restartedTrack.render(&timeStamp, frames, output.set(frames));
+			for(UInt32 i = 0; r > 0 && i < frames; i++) {
+				// the previous start has run to the end of the file by then
+				const UInt64 t = position + i;
+				const float expected = t < startTime || t - startTime >= kFileFrames ? 0 : t - startTime + 1;
+				if(output.samples[i] * kScale != expected) misplaced++;
+			}
+
+			position += frames;
+			if(timeline->getPosition() != position) stuck++;
+			timeStamp.mSampleTime += frames;
+		}
+	}
+
+	const bool ok = stuck == 0 && gaps == 0 && misplaced == 0 && restartedTrack.getStats().events == 2;
+	printf("{\"benchmark\":\"reset\",\"resets\":2,\"position\":%llu,\"stuck_cycles\":%llu,\"gaps\":%llu,\"misplaced\":%llu,\"ok\":%s}\n",
+		   (unsigned long long)timeline->getPosition(), (unsigned long long)stuck, (unsigned long long)gaps,
+		   (unsigned long long)misplaced, ok ? "true" : "false");
+	return ok;
+}
+
+static void overhead(const std::string &path, bool withTimeline)
+{
+	const size_t trackCount = 40;
+	const UInt32 frames = 512;
+	const size_t cycles = quick ? 2000 : 20000;
+
+	std::vector<std::unique_ptr<FileTarget> > targets;
+	std::vector<std::unique_ptr<ofxAudioUnitTimelineTrack> > tracks;
+	std::shared_ptr<ofxAudioUnitTimeline> timeline(new ofxAudioUnitTimeline);
+	for(size_t t = 0; t < trackCount; t++) {
+		targets.push_back(std::unique_ptr<FileTarget>(new FileTarget));
+		if(!targets.back()->file.open(path, 0)) return;
+		targets.back()->file.setLooping(true);
+		targets.back()->file.play();
+		tracks.push_back(std::unique_ptr<ofxAudioUnitTimelineTrack>(new ofxAudioUnitTimelineTrack(*targets.back())));
+		if(withTimeline) tracks.back()->setTimeline(timeline);
+	}
+	timeline->start();
+
+	Output output;
+	AudioTimeStamp timeStamp;
+	memset(&timeStamp, 0, sizeof(timeStamp));
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+
+	// every track restarts on its own beat, a few times a second
+	double total = 0, worst = 0;
+	size_t events = 0;
+	for(size_t c = 0; c < cycles; c++) {
+		if(withTimeline && c % 8 == 0) {
+			const UInt64 now = timeline->getPosition();
+			for(size_t t = 0; t < trackCount; t++) {
+				tracks[t]->startAt(now + frames * 4 + t * 97 % 4096, t * 1000);
+				events++;
+			}
+		}
+
+		const Clock::time_point start = Clock::now();
+		for(size_t t = 0; t < trackCount; t++) {
+			tracks[t]->render(&timeStamp, frames, output.set(frames));
+		}
+		const double seconds = secondsSince(start);
+		total += seconds;
+		worst = std::max(worst, seconds);
+		timeStamp.mSampleTime += frames;
+	}
+
+	printf("{\"benchmark\":\"overhead\",\"timeline\":%s,\"tracks\":%zu,\"cycles\":%zu,\"events\":%zu,\"mean_cycle_us\":%.2f,\"max_cycle_us\":%.1f,\"budget_us\":%.0f}\n",
+		   withTimeline ? "true" : "false", trackCount, cycles, events, total / cycles * 1e6, worst * 1e6, frames / kSampleRate * 1e6);
+}
+
+int main(int argc, char ** argv)
+{
+	quick = hasOption(argc, argv, "--quick");
+	directory = optionValue(argc, argv, "--dir", directory);
+
+	const std::string path = directory + "/timelineBenchmark.wav";
+	if(!writeFile(path)) {
+		printf("{\"benchmark\":\"exact\",\"error\":\"couldn't write %s\"}\n", path.c_str());
+		return 1;
+	}
+
+	bool ok = true;
+	ok = exact(path, 40, false) && ok;
+	ok = exact(path, 40, true) && ok;
+	ok = late() && ok;
+	ok = reset() && ok;
+	overhead(path, false);
+	overhead(path, true);
+
+	remove(path.c_str());
+	return ok ? 0 : 1;
+}
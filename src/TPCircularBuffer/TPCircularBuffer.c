@@ -6,10 +6,17 @@
 //  Copyright 2011-2012 A Tasty Pixel. All rights reserved.
 
 
+#if !defined(__APPLE__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // for MFD_CLOEXEC
+#endif
+
 #include "TPCircularBuffer.h"
-#include <mach/mach.h>
 #include <stdio.h>
 
+#ifdef __APPLE__
+
+#include <mach/mach.h>
+
 #define reportResult(result,operation) (_reportResult((result),(operation),strrchr(__FILE__, '/')+1,__LINE__))
 static inline bool _reportResult(kern_return_t result, const char *operation, const char* file, int line) {
     if ( result != ERR_SUCCESS ) {
@@ -107,6 +114,82 @@ void TPCircularBufferCleanup(TPCircularBuffer *buffer) {
     memset(buffer, 0, sizeof(TPCircularBuffer));
 }
 
+#else
+
+// Linux: back the buffer with an anonymous memory file (memfd), and map that
+// file twice into a contiguous reservation of twice the buffer length
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+#define reportError(operation) (_reportError((operation),strrchr(__FILE__, '/')+1,__LINE__))
+static inline void _reportError(const char *operation, const char* file, int line) {
+    printf("%s:%d: %s: %s\n", file, line, operation, strerror(errno));
+}
+
+bool TPCircularBufferInit(TPCircularBuffer *buffer, int length) {
+
+    // We need whole page sizes
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    buffer->length = (int32_t)(((length + pageSize - 1) / pageSize) * pageSize);
+    
+    // memfd_create is called through syscall() so that this builds against
+    // C libraries that predate its wrapper
+    int fd = (int)syscall(SYS_memfd_create, "TPCircularBuffer", MFD_CLOEXEC);
+    if ( fd < 0 ) {
+        reportError("Buffer allocation");
+        return false;
+    }
+    
+    if ( ftruncate(fd, buffer->length) != 0 ) {
+        reportError("Buffer allocation");
+        close(fd);
+        return false;
+    }
+    
+    // Reserve twice the length, so we have the contiguous address space to
+    // support a second instance of the buffer directly after. Mapping over our
+    // own reservation with MAP_FIXED can't race with other allocations, so
+    // unlike the Mach version there's nothing to retry
+    char *bufferAddress = (char *)mmap(NULL, buffer->length * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( bufferAddress == MAP_FAILED ) {
+        reportError("Buffer reservation");
+        close(fd);
+        return false;
+    }
+    
+    void *first  = mmap(bufferAddress,                  buffer->length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    void *second = mmap(bufferAddress + buffer->length, buffer->length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    
+    // the mappings keep the memory alive on their own
+    close(fd);
+    
+    if ( first != bufferAddress || second != bufferAddress + buffer->length ) {
+        reportError("Remap buffer memory");
+        munmap(bufferAddress, buffer->length * 2);
+        return false;
+    }
+    
+    buffer->buffer = bufferAddress;
+    buffer->fillCount = 0;
+    buffer->head = buffer->tail = 0;
+    
+    return true;
+}
+
+void TPCircularBufferCleanup(TPCircularBuffer *buffer) {
+    munmap(buffer->buffer, buffer->length * 2);
+    memset(buffer, 0, sizeof(TPCircularBuffer));
+}
+
+#endif
+
 void TPCircularBufferClear(TPCircularBuffer *buffer) {
     int32_t fillCount;
     if ( TPCircularBufferTail(buffer, &fillCount) ) {
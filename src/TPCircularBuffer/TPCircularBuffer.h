@@ -18,13 +18,27 @@
 //  adapted to Darwin by Kurt Revis (http://www.snoize.com,
 //  http://www.snoize.com/Code/PlayBufferedSoundFile.tar.gz)
 //
+//  On Linux, the mirror is built from a memfd mapped twice in a row.
+//
 
 #ifndef TPCircularBuffer_h
 #define TPCircularBuffer_h
 
-#include <libkern/OSAtomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
+#ifdef __APPLE__
+#include <libkern/OSAtomic.h>
+#define TPCircularBufferAtomicAdd32(amount, value) OSAtomicAdd32Barrier((amount), (value))
+#define TPCircularBufferAtomicLoad32(value) (*(value))
+#else
+// The fill count is read with acquire ordering so the bytes the other side
+// produced (or finished reading) are visible once the count says so
+#define TPCircularBufferAtomicAdd32(amount, value) __atomic_add_fetch((value), (amount), __ATOMIC_SEQ_CST)
+#define TPCircularBufferAtomicLoad32(value) __atomic_load_n((value), __ATOMIC_ACQUIRE)
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -79,7 +93,7 @@ void  TPCircularBufferClear(TPCircularBuffer *buffer);
  * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
  */
 static __inline__ __attribute__((always_inline)) void* TPCircularBufferTail(TPCircularBuffer *buffer, int32_t* availableBytes) {
-    *availableBytes = buffer->fillCount;
+    *availableBytes = TPCircularBufferAtomicLoad32(&buffer->fillCount);
     if ( *availableBytes == 0 ) return NULL;
     return (void*)((char*)buffer->buffer + buffer->tail);
 }
@@ -94,7 +108,7 @@ static __inline__ __attribute__((always_inline)) void* TPCircularBufferTail(TPCi
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferConsume(TPCircularBuffer *buffer, int32_t amount) {
     buffer->tail = (buffer->tail + amount) % buffer->length;
-    OSAtomicAdd32Barrier(-amount, &buffer->fillCount);
+    TPCircularBufferAtomicAdd32(-amount, &buffer->fillCount);
 }
 
 /*!
@@ -116,7 +130,7 @@ static __inline__ __attribute__((always_inline)) void TPCircularBufferConsume(TP
  * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
  */
 static __inline__ __attribute__((always_inline)) void* TPCircularBufferHead(TPCircularBuffer *buffer, int32_t* availableBytes) {
-    *availableBytes = (buffer->length - buffer->fillCount);
+    *availableBytes = (buffer->length - TPCircularBufferAtomicLoad32(&buffer->fillCount));
     if ( *availableBytes == 0 ) return NULL;
     return (void*)((char*)buffer->buffer + buffer->head);
 }
@@ -133,7 +147,7 @@ static __inline__ __attribute__((always_inline)) void* TPCircularBufferHead(TPCi
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferProduce(TPCircularBuffer *buffer, int amount) {
     buffer->head = (buffer->head + amount) % buffer->length;
-    OSAtomicAdd32Barrier(amount, &buffer->fillCount);
+    TPCircularBufferAtomicAdd32(amount, &buffer->fillCount);
 }
 
 /*!
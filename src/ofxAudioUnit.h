@@ -16,8 +16,17 @@
 	#include "ofxAudioUnitNetSend.h"
 	#include "ofxAudioUnitSpeechSynth.h"
 	#include "ofxAudioUnitRecorder.h"
+	#include "ofxAudioUnitStemSession.h"
 
 	// ofxAudioUnitDSPNode subclasses for specific DSP tasks
 	#include "ofxAudioUnitTap.h"
 	#include "ofxAudioUnitFftNode.h"
+	#include "ofxAudioUnitPitchNode.h"
+	#include "ofxAudioUnitConstantQNode.h"
+	#include "ofxAudioUnitConvolutionNode.h"
+	#include "ofxAudioUnitBiquadNode.h"
+	#include "ofxAudioUnitSamplePlayer.h"
+	#include "ofxAudioUnitMappedFilePlayer.h"
+	#include "ofxAudioUnitStreamingFilePlayer.h"
+	#include "ofxAudioUnitStretchPlayer.h"
 #endif
@@ -0,0 +1,263 @@
+#include "ofxAudioUnitBiquadFilter.h"
+#include <algorithm>
+
+static const unsigned int kCoefficientCount = 5;
+static const unsigned int kScratchFrames = 256;
+
+// ----------------------------------------------------------
+ofxAudioUnitBiquadFilter::ofxAudioUnitBiquadFilter(unsigned int sections, unsigned int channels)
+: _sections(std::max(sections, 1u))
+, _channels(std::max(channels, 1u))
+, _stride((_channels + 3) & ~3)
+, _sequence(0)
+, _published(new std::atomic<float>[kCoefficientCount * _sections])
+, _smoothingFrames(0)
+, _resetPending(false)
+, _lastSequence(0)
+, _rampRemaining(0)
+, _current(kCoefficientCount * _sections, 0)
+, _target(kCoefficientCount * _sections, 0)
+, _step(kCoefficientCount * _sections, 0)
+, _z1(_sections * _stride, 0)
+, _z2(_sections * _stride, 0)
+, _scratch(kScratchFrames * _stride, 0)
+// ----------------------------------------------------------
+{
+	// every section starts out as a pass-through
+	for(unsigned int i = 0; i < kCoefficientCount * _sections; i++) {
+		_published[i].store(i < _sections ? 1 : 0, std::memory_order_relaxed);
+		_current[i] = i < _sections ? 1 : 0;
+	}
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitBiquadFilter::~ofxAudioUnitBiquadFilter()
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadFilter::setCoefficients(const Coefficients * coefficients)
+// ----------------------------------------------------------
+{
+	const unsigned int sections = _sections;
+	std::atomic<float> * published = _published.get();
+
+	_sequence.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for(unsigned int s = 0; s < sections; s++) {
+		published[s               ].store(coefficients[s].b0, std::memory_order_relaxed);
+		published[s + sections    ].store(coefficients[s].b1, std::memory_order_relaxed);
+		published[s + sections * 2].store(coefficients[s].b2, std::memory_order_relaxed);
+		published[s + sections * 3].store(coefficients[s].a1, std::memory_order_relaxed);
+		published[s + sections * 4].store(coefficients[s].a2, std::memory_order_relaxed);
+	}
+
+	_sequence.fetch_add(1, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadFilter::setSmoothingFrames(float frames)
+// ----------------------------------------------------------
+{
+	_smoothingFrames.store(std::max(frames, 0.f));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadFilter::reset()
+// ----------------------------------------------------------
+{
+	_resetPending.store(true);
+}
+
+#pragma mark - Filter
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadFilter::pollTargets()
+// ----------------------------------------------------------
+{
+	const UInt32 before = _sequence.load(std::memory_order_acquire);
+	if(before == _lastSequence || (before & 1)) {
+		return;
+	}
+
+	for(unsigned int i = 0; i < _target.size(); i++) {
+		_target[i] = _published[i].load(std::memory_order_relaxed);
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(_sequence.load(std::memory_order_relaxed) != before) {
+		// the main thread wrote over us mid-copy; try again next cycle
+		return;
+	}
+
+	_lastSequence = before;
+
+	// ramp from wherever we are now, even if a previous ramp hadn't finished
+	const UInt32 rampFrames = std::max(1.f, _smoothingFrames.load(std::memory_order_relaxed));
+	for(unsigned int i = 0; i < _target.size(); i++) {
+		_step[i] = (_target[i] - _current[i]) / rampFrames;
+	}
+	_rampRemaining = rampFrames;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadFilter::rampCoefficients()
+// ----------------------------------------------------------
+{
+	if(--_rampRemaining == 0) {
+		_current = _target;
+	} else {
+		for(unsigned int i = 0; i < _current.size(); i++) {
+			_current[i] += _step[i];
+		}
+	}
+}
+
+// Runs one frame (one sample of every channel) through the whole cascade,
+// using the transposed direct form II
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadFilter::processFrame(float * x)
+// ----------------------------------------------------------
+{
+	const unsigned int sections = _sections;
+	const unsigned int stride = _stride;
+
+	for(unsigned int s = 0; s < sections; s++) {
+		// copied into locals so the compiler knows the stores below can't change them
+		const float b0 = _current[s];
+		const float b1 = _current[s + sections];
+		const float b2 = _current[s + sections * 2];
+		const float a1 = _current[s + sections * 3];
+		const float a2 = _current[s + sections * 4];
+
+		float * s1 = &_z1[s * stride];
+		float * s2 = &_z2[s * stride];
+
+		for(unsigned int c = 0; c < stride; c++) {
+			const float in = x[c];
+			const float out = b0 * in + s1[c];
+			s1[c] = b1 * in - a1 * out + s2[c];
+			s2[c] = b2 * in - a2 * out;
+			x[c] = out;
+		}
+	}
+}
+
+// Runs `lanes` channels through the whole cascade in place, a section at a
+// time. Their recursions are independent, so interleaving them lets each one
+// overlap the others instead of waiting on its own previous output
+template <unsigned int lanes>
+static void Cascade(float * const * x, UInt32 frames, const float * coefficients, unsigned int sections,
+					float * z1, float * z2, unsigned int stride)
+{
+	for(unsigned int s = 0; s < sections; s++) {
+		const float b0 = coefficients[s];
+		const float b1 = coefficients[s + sections];
+		const float b2 = coefficients[s + sections * 2];
+		const float a1 = coefficients[s + sections * 3];
+		const float a2 = coefficients[s + sections * 4];
+
+		float s1[lanes], s2[lanes];
+		for(unsigned int k = 0; k < lanes; k++) {
+			s1[k] = z1[s * stride + k];
+			s2[k] = z2[s * stride + k];
+		}
+
+		for(UInt32 i = 0; i < frames; i++) {
+			for(unsigned int k = 0; k < lanes; k++) {
+				const float in = x[k][i];
+				const float out = b0 * in + s1[k];
+				s1[k] = b1 * in - a1 * out + s2[k];
+				s2[k] = b2 * in - a2 * out;
+				x[k][i] = out;
+			}
+		}
+
+		for(unsigned int k = 0; k < lanes; k++) {
+			z1[s * stride + k] = s1[k];
+			z2[s * stride + k] = s2[k];
+		}
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadFilter::processBlock(AudioBufferList * ioData, UInt32 offset, UInt32 frames, unsigned int channels)
+// ----------------------------------------------------------
+{
+	float * x[4];
+	unsigned int c = 0;
+
+	while(c < channels) {
+		const unsigned int lanes = channels - c >= 4 ? 4 : channels - c >= 2 ? 2 : 1;
+		for(unsigned int k = 0; k < lanes; k++) {
+			x[k] = (Float32 *)ioData->mBuffers[c + k].mData + offset;
+		}
+
+		switch(lanes) {
+			case 4:  Cascade<4>(x, frames, &_current[0], _sections, &_z1[c], &_z2[c], _stride); break;
+			case 2:  Cascade<2>(x, frames, &_current[0], _sections, &_z1[c], &_z2[c], _stride); break;
+			default: Cascade<1>(x, frames, &_current[0], _sections, &_z1[c], &_z2[c], _stride); break;
+		}
+		c += lanes;
+	}
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadFilter::process(AudioBufferList * ioData, UInt32 inNumberFrames)
+// ----------------------------------------------------------
+{
+	if(_resetPending.exchange(false)) {
+		std::fill(_z1.begin(), _z1.end(), 0);
+		std::fill(_z2.begin(), _z2.end(), 0);
+	}
+
+	pollTargets();
+
+	const unsigned int stride = _stride;
+	const unsigned int channels = std::min<unsigned int>(ioData->mNumberBuffers, _channels);
+
+	for(UInt32 done = 0; done < inNumberFrames; done += kScratchFrames) {
+		const UInt32 frames = std::min(inNumberFrames - done, kScratchFrames);
+
+		// the coefficients only change from frame to frame during a ramp
+		if(_rampRemaining == 0) {
+			processBlock(ioData, done, frames, channels);
+			continue;
+		}
+
+		// Otherwise the channels are interleaved into the scratch buffer and
+		// run through the cascade a frame at a time. Lanes without a channel
+		// behind them are fed silence. Their state starts at zero and stays
+		// there, so they never have to be masked out
+		float * scratch = &_scratch[0];
+		if(channels < stride) {
+			std::fill(_scratch.begin(), _scratch.end(), 0);
+		}
+
+		for(unsigned int c = 0; c < channels; c++) {
+			const Float32 * in = (const Float32 *)ioData->mBuffers[c].mData + done;
+			for(UInt32 i = 0; i < frames; i++) {
+				scratch[i * stride + c] = in[i];
+			}
+		}
+
+		for(UInt32 i = 0; i < frames; i++) {
+			if(_rampRemaining) {
+				rampCoefficients();
+			}
+			processFrame(scratch + i * stride);
+		}
+
+		for(unsigned int c = 0; c < channels; c++) {
+			Float32 * out = (Float32 *)ioData->mBuffers[c].mData + done;
+			for(UInt32 i = 0; i < frames; i++) {
+				out[i] = scratch[i * stride + c];
+			}
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// ofxAudioUnitBiquadFilter runs audio through a cascade of biquad sections,
+// in place. It's the filter behind ofxAudioUnitBiquadNode (see there for how
+// coefficients and state are laid out).
+
+// setCoefficients() publishes new coefficients without locking. process()
+// picks them up at the start of its next call and ramps to them over the
+// smoothing length, starting from wherever it is (even mid-ramp).
+
+// process() is for the render thread and never blocks or allocates. The
+// number of sections and channels is fixed at construction; channels beyond
+// that count pass through unfiltered.
+
+class ofxAudioUnitBiquadFilter
+{
+public:
+	// normalized so that a0 is 1
+	struct Coefficients {
+		float b0, b1, b2, a1, a2;
+	};
+
+	ofxAudioUnitBiquadFilter(unsigned int sections = 1, unsigned int channels = 2);
+	~ofxAudioUnitBiquadFilter();
+
+	unsigned int getNumSections() const {return _sections;}
+	unsigned int getNumChannels() const {return _channels;}
+
+	// one set of coefficients per section
+	void setCoefficients(const Coefficients * coefficients);
+
+	// how long coefficient changes take to ramp in (in frames)
+	void setSmoothingFrames(float frames);
+	float getSmoothingFrames() const {return _smoothingFrames.load();}
+
+	// clears the filter state at the start of the next process() call
+	void reset();
+
+	void process(AudioBufferList * ioData, UInt32 frames);
+
+private:
+	const unsigned int _sections;
+	const unsigned int _channels;
+	const unsigned int _stride; // channels, padded to a multiple of 4
+
+	// Targets published by the main thread. The sequence counter is odd while
+	// a write is in progress; the render thread only takes a snapshot if the
+	// counter was even and unchanged on both sides of its copy
+	std::atomic<UInt32> _sequence;
+	std::unique_ptr<std::atomic<float>[]> _published; // [coefficient][section]
+	std::atomic<float> _smoothingFrames;
+	std::atomic<bool> _resetPending;
+
+	// render thread only
+	UInt32 _lastSequence;
+	UInt32 _rampRemaining;
+	std::vector<float> _current; // [coefficient][section]
+	std::vector<float> _target;
+	std::vector<float> _step;
+	std::vector<float> _z1;      // [section][stride]
+	std::vector<float> _z2;
+	std::vector<float> _scratch; // [frame][stride], while ramping
+
+	ofxAudioUnitBiquadFilter(const ofxAudioUnitBiquadFilter &);
+	ofxAudioUnitBiquadFilter& operator=(const ofxAudioUnitBiquadFilter &);
+
+	void pollTargets();
+	void rampCoefficients();
+	void processFrame(float * x);
+	void processBlock(AudioBufferList * ioData, UInt32 offset, UInt32 frames, unsigned int channels);
+};
@@ -0,0 +1,270 @@
+#include "ofxAudioUnitBiquadNode.h"
+#include "ofxAudioUnitBase.h"
+#include <math.h>
+
+// filters the audio passing through the node, in place
+static OSStatus Filter(void * inRefCon,
+					   AudioUnitRenderActionFlags * ioActionFlags,
+					   const AudioTimeStamp * inTimeStamp,
+					   UInt32 inBusNumber,
+					   UInt32 inNumberFrames,
+					   AudioBufferList * ioData);
+
+#pragma mark - ofxAudioUnitBiquadNode
+
+// ----------------------------------------------------------
+ofxAudioUnitBiquadNode::ofxAudioUnitBiquadNode(unsigned int sections, unsigned int channels)
+: _filter(new ofxAudioUnitBiquadFilter(sections, channels))
+, _sections(std::max(sections, 1u))
+, _coefficients(std::max(sections, 1u), computeCoefficients(Section(), 44100))
+, _smoothingTime(0.01)
+, _sampleRate(0)
+, _coefficientRate(44100)
+// ----------------------------------------------------------
+{
+	setProcessCallback((AURenderCallbackStruct){Filter, _filter.get()});
+	setSmoothingTime(_smoothingTime);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitBiquadNode::~ofxAudioUnitBiquadNode()
+// ----------------------------------------------------------
+{
+	setProcessCallback((AURenderCallbackStruct){0});
+}
+
+// ----------------------------------------------------------
+ofxAudioUnit& ofxAudioUnitBiquadNode::connectTo(ofxAudioUnit &destination, int destinationBus, int sourceBus)
+// ----------------------------------------------------------
+{
+	updateSampleRate();
+	return ofxAudioUnitDSPNode::connectTo(destination, destinationBus, sourceBus);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDSPNode& ofxAudioUnitBiquadNode::connectTo(ofxAudioUnitDSPNode &destination, int destinationBus, int sourceBus)
+// ----------------------------------------------------------
+{
+	updateSampleRate();
+	return ofxAudioUnitDSPNode::connectTo(destination, destinationBus, sourceBus);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadNode::setSection(unsigned int index, const Section &section)
+// ----------------------------------------------------------
+{
+	if(index >= _sections.size()) return;
+
+	// the source may have been connected, or changed format, since the
+	// other sections were computed
+	updateSampleRate();
+
+	_sections[index] = section;
+	_coefficients[index] = computeCoefficients(section, _coefficientRate);
+	publish();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadNode::setSection(unsigned int index, ofxAudioUnitBiquadType type, float frequency, float q, float gain)
+// ----------------------------------------------------------
+{
+	setSection(index, Section(type, frequency, q, gain));
+}
+
+// ----------------------------------------------------------
+const ofxAudioUnitBiquadNode::Section& ofxAudioUnitBiquadNode::getSection(unsigned int index) const
+// ----------------------------------------------------------
+{
+	return _sections[std::min<size_t>(index, _sections.size() - 1)];
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadNode::setCoefficients(unsigned int index, const Coefficients &coefficients)
+// ----------------------------------------------------------
+{
+	if(index >= _sections.size()) return;
+
+	_sections[index] = Section();
+	_coefficients[index] = coefficients;
+	publish();
+}
+
+// ----------------------------------------------------------
+const ofxAudioUnitBiquadNode::Coefficients& ofxAudioUnitBiquadNode::getCoefficients(unsigned int index) const
+// ----------------------------------------------------------
+{
+	return _coefficients[std::min<size_t>(index, _coefficients.size() - 1)];
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitBiquadNode::getNumSections() const
+// ----------------------------------------------------------
+{
+	return _filter->getNumSections();
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitBiquadNode::getNumChannels() const
+// ----------------------------------------------------------
+{
+	return _filter->getNumChannels();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadNode::setSmoothingTime(float seconds)
+// ----------------------------------------------------------
+{
+	_smoothingTime = std::max(seconds, 0.f);
+	_filter->setSmoothingFrames(_smoothingTime * currentSampleRate());
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadNode::reset()
+// ----------------------------------------------------------
+{
+	_filter->reset();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadNode::setSampleRate(Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	_sampleRate = sampleRate;
+	updateSampleRate();
+}
+
+// ----------------------------------------------------------
+Float64 ofxAudioUnitBiquadNode::currentSampleRate() const
+// ----------------------------------------------------------
+{
+	if(_sampleRate > 0) {
+		return _sampleRate;
+	}
+
+	const Float64 sourceRate = getSourceASBD().mSampleRate;
+	return sourceRate > 0 ? sourceRate : 44100;
+}
+
+// Recomputes the sections from their parameters if the rate they were
+// computed for is out of date. Sections set with setCoefficients() are left
+// as they are
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadNode::updateSampleRate()
+// ----------------------------------------------------------
+{
+	const Float64 sampleRate = currentSampleRate();
+	if(sampleRate == _coefficientRate) return;
+
+	_coefficientRate = sampleRate;
+	for(size_t i = 0; i < _sections.size(); i++) {
+		if(_sections[i].type != OFXAU_BIQUAD_BYPASS) {
+			_coefficients[i] = computeCoefficients(_sections[i], _coefficientRate);
+		}
+	}
+
+	setSmoothingTime(_smoothingTime);
+	publish();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitBiquadNode::publish()
+// ----------------------------------------------------------
+{
+	_filter->setCoefficients(&_coefficients[0]);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitBiquadNode::Coefficients ofxAudioUnitBiquadNode::computeCoefficients(const Section &section, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	const double frequency = std::min<double>(std::max(section.frequency, 1.f), sampleRate * 0.49);
+	const double w0 = 2.0 * M_PI * frequency / sampleRate;
+	const double cosw0 = cos(w0);
+	const double alpha = sin(w0) / (2.0 * std::max(section.q, 0.001f));
+	const double A = pow(10.0, section.gain / 40.0);
+	const double shelf = 2.0 * sqrt(A) * alpha;
+
+	double b0 = 1, b1 = 0, b2 = 0, a0 = 1, a1 = 0, a2 = 0;
+
+	switch(section.type) {
+		case OFXAU_BIQUAD_LOWPASS:
+			b0 = (1 - cosw0) / 2; b1 = 1 - cosw0; b2 = (1 - cosw0) / 2;
+			a0 = 1 + alpha; a1 = -2 * cosw0; a2 = 1 - alpha;
+			break;
+		case OFXAU_BIQUAD_HIGHPASS:
+			b0 = (1 + cosw0) / 2; b1 = -(1 + cosw0); b2 = (1 + cosw0) / 2;
+			a0 = 1 + alpha; a1 = -2 * cosw0; a2 = 1 - alpha;
+			break;
+		case OFXAU_BIQUAD_BANDPASS:
+			b0 = alpha; b1 = 0; b2 = -alpha;
+			a0 = 1 + alpha; a1 = -2 * cosw0; a2 = 1 - alpha;
+			break;
+		case OFXAU_BIQUAD_NOTCH:
+			b0 = 1; b1 = -2 * cosw0; b2 = 1;
+			a0 = 1 + alpha; a1 = -2 * cosw0; a2 = 1 - alpha;
+			break;
+		case OFXAU_BIQUAD_ALLPASS:
+			b0 = 1 - alpha; b1 = -2 * cosw0; b2 = 1 + alpha;
+			a0 = 1 + alpha; a1 = -2 * cosw0; a2 = 1 - alpha;
+			break;
+		case OFXAU_BIQUAD_PEAK:
+			b0 = 1 + alpha * A; b1 = -2 * cosw0; b2 = 1 - alpha * A;
+			a0 = 1 + alpha / A; a1 = -2 * cosw0; a2 = 1 - alpha / A;
+			break;
+		case OFXAU_BIQUAD_LOWSHELF:
+			b0 =     A * ((A + 1) - (A - 1) * cosw0 + shelf);
+			b1 = 2 * A * ((A - 1) - (A + 1) * cosw0);
+			b2 =     A * ((A + 1) - (A - 1) * cosw0 - shelf);
+			a0 =          (A + 1) + (A - 1) * cosw0 + shelf;
+			a1 =     -2 * ((A - 1) + (A + 1) * cosw0);
+			a2 =          (A + 1) + (A - 1) * cosw0 - shelf;
+			break;
+		case OFXAU_BIQUAD_HIGHSHELF:
+			b0 =      A * ((A + 1) + (A - 1) * cosw0 + shelf);
+			b1 = -2 * A * ((A - 1) + (A + 1) * cosw0);
+			b2 =      A * ((A + 1) + (A - 1) * cosw0 - shelf);
+			a0 =           (A + 1) - (A - 1) * cosw0 + shelf;
+			a1 =      2 * ((A - 1) - (A + 1) * cosw0);
+			a2 =           (A + 1) - (A - 1) * cosw0 - shelf;
+			break;
+		case OFXAU_BIQUAD_BYPASS:
+		default:
+			break;
+	}
+
+	Coefficients coefficients = {
+		(float)(b0 / a0),
+		(float)(b1 / a0),
+		(float)(b2 / a0),
+		(float)(a1 / a0),
+		(float)(a2 / a0)
+	};
+
+	return coefficients;
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitBiquadNode::getName()
+// ----------------------------------------------------------
+{
+	if(name.empty()) {
+		return "ofxAudioUnitBiquadNode";
+	} else {
+		return name;
+	}
+}
+
+#pragma mark - Render callbacks
+
+// ----------------------------------------------------------
+OSStatus Filter(void * inRefCon,
+				AudioUnitRenderActionFlags * ioActionFlags,
+				const AudioTimeStamp * inTimeStamp,
+				UInt32 inBusNumber,
+				UInt32 inNumberFrames,
+				AudioBufferList * ioData)
+// ----------------------------------------------------------
+{
+	static_cast<ofxAudioUnitBiquadFilter *>(inRefCon)->process(ioData, inNumberFrames);
+	return noErr;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "ofxAudioUnitBiquadFilter.h"
+#include "ofxAudioUnitDSPNode.h"
+
+typedef enum {
+	OFXAU_BIQUAD_BYPASS,
+	OFXAU_BIQUAD_LOWPASS,
+	OFXAU_BIQUAD_HIGHPASS,
+	OFXAU_BIQUAD_BANDPASS,
+	OFXAU_BIQUAD_NOTCH,
+	OFXAU_BIQUAD_ALLPASS,
+	OFXAU_BIQUAD_PEAK,
+	OFXAU_BIQUAD_LOWSHELF,
+	OFXAU_BIQUAD_HIGHSHELF
+}
+ofxAudioUnitBiquadType;
+
+// ofxAudioUnitBiquadNode filters the audio passing through it with a cascade
+// of biquad sections (e.g. a parametric EQ, or one side of a crossover),
+// without the overhead of an Apple filter unit per band.
+
+// Each section is run over a whole render cycle before the next, in place,
+// with up to four channels interleaved so their recursions overlap. While a
+// parameter change is ramping in, the coefficients move every frame, so the
+// channels are gathered side by side and the cascade runs a frame at a time.
+
+// Parameter changes are published to the render thread without locking, and
+// are ramped in over the smoothing time to avoid zipper noise. The filter
+// doing all this is ofxAudioUnitBiquadFilter.
+
+// The number of sections and channels is fixed at construction. Channels
+// beyond that count pass through unfiltered.
+
+class ofxAudioUnitBiquadNode : public ofxAudioUnitDSPNode
+{
+public:
+	struct Section {
+		ofxAudioUnitBiquadType type;
+		float frequency; // center or corner frequency (Hz)
+		float q;
+		float gain;      // in dB, for peak and shelf sections
+
+		Section(ofxAudioUnitBiquadType type = OFXAU_BIQUAD_BYPASS,
+				float frequency = 1000,
+				float q = 0.7071,
+				float gain = 0)
+		: type(type)
+		, frequency(frequency)
+		, q(q)
+		, gain(gain)
+		{ }
+	};
+
+	// normalized so that a0 is 1
+	typedef ofxAudioUnitBiquadFilter::Coefficients Coefficients;
+
+	ofxAudioUnitBiquadNode(unsigned int sections = 1, unsigned int channels = 2);
+	virtual ~ofxAudioUnitBiquadNode();
+
+	// as ofxAudioUnitDSPNode's, after picking up the source's sample rate
+	ofxAudioUnit& connectTo(ofxAudioUnit &destination, int destinationBus = 0, int sourceBus = 0);
+	ofxAudioUnitDSPNode& connectTo(ofxAudioUnitDSPNode &destination, int destinationBus = 0, int sourceBus = 0);
+
+	void setSection(unsigned int index, const Section &section);
+	void setSection(unsigned int index, ofxAudioUnitBiquadType type, float frequency, float q = 0.7071, float gain = 0);
+	const Section& getSection(unsigned int index) const;
+
+	// sets a section's coefficients directly (the section's type will be
+	// reported as OFXAU_BIQUAD_BYPASS afterwards)
+	void setCoefficients(unsigned int index, const Coefficients &coefficients);
+	const Coefficients& getCoefficients(unsigned int index) const;
+
+	unsigned int getNumSections() const;
+	unsigned int getNumChannels() const;
+
+	// how long parameter changes take to ramp in (in seconds)
+	void setSmoothingTime(float seconds);
+	float getSmoothingTime() const {return _smoothingTime;}
+
+	// clears the filter state at the start of the next render cycle
+	void reset();
+
+	// the sample rate is read from the source unit where possible, when the
+	// node is connected and again whenever a section changes. Set it here if
+	// the node is being fed from a callback or another DSP node
+	void setSampleRate(Float64 sampleRate);
+
+	// RBJ "Audio EQ Cookbook" coefficients for a section
+	static Coefficients computeCoefficients(const Section &section, Float64 sampleRate);
+
+	virtual std::string getName();
+
+private:
+	std::shared_ptr<ofxAudioUnitBiquadFilter> _filter;
+	std::vector<Section> _sections;
+	std::vector<Coefficients> _coefficients;
+	float _smoothingTime;
+	Float64 _sampleRate;
+	Float64 _coefficientRate; // what _coefficients were computed for
+
+	// a copy would share the DSP context, and tear down its process callback
+	// when destroyed
+	ofxAudioUnitBiquadNode(const ofxAudioUnitBiquadNode &);
+	ofxAudioUnitBiquadNode& operator=(const ofxAudioUnitBiquadNode &);
+
+	Float64 currentSampleRate() const;
+	void updateSampleRate();
+	void publish();
+};
@@ -0,0 +1,238 @@
+#include "ofxAudioUnitCaptureBuffer.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <new>
+
+static const size_t kCacheLineSize = 64;
+static const size_t kPageSize = 4096;
+
+static_assert(sizeof(std::atomic<Float32>) == sizeof(Float32), "samples are laid out as plain floats");
+
+// Sample copies, one relaxed atomic at a time. Compilers won't merge or
+// vectorize atomics, so these are unrolled by hand
+
+static inline void Store(std::atomic<Float32> * to, const Float32 * from, size_t count)
+{
+	const std::memory_order relaxed = std::memory_order_relaxed;
+	size_t i = 0;
+	if(from) {
+		for(; i + 4 <= count; i += 4) {
+			to[i].store(from[i], relaxed);
+			to[i + 1].store(from[i + 1], relaxed);
+			to[i + 2].store(from[i + 2], relaxed);
+			to[i + 3].store(from[i + 3], relaxed);
+		}
+		for(; i < count; i++) to[i].store(from[i], relaxed);
+	} else {
+		for(; i < count; i++) to[i].store(0.f, relaxed);
+	}
+}
+
+static inline void Load(Float32 * to, const std::atomic<Float32> * from, size_t count)
+{
+	const std::memory_order relaxed = std::memory_order_relaxed;
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		to[i] = from[i].load(relaxed);
+		to[i + 1] = from[i + 1].load(relaxed);
+		to[i + 2] = from[i + 2].load(relaxed);
+		to[i + 3] = from[i + 3].load(relaxed);
+	}
+	for(; i < count; i++) to[i] = from[i].load(relaxed);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitCaptureBuffer::ofxAudioUnitCaptureBuffer(unsigned int channels, size_t capacity)
+: _samples(NULL)
+, _channels(0)
+, _capacity(0)
+, _planeStride(0)
+, _writeBegin(0)
+, _writeEnd(0)
+// ----------------------------------------------------------
+{
+	allocate(channels, capacity);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitCaptureBuffer::~ofxAudioUnitCaptureBuffer()
+// ----------------------------------------------------------
+{
+	free(_samples);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitCaptureBuffer::allocate(unsigned int channels, size_t capacity)
+// ----------------------------------------------------------
+{
+	free(_samples);
+	_samples = NULL;
+
+	// Round each plane up to a whole number of cache lines. If that lands on
+	// a multiple of the page size, every plane would start at the same offset
+	// within a page and compete for the same cache sets, so nudge it by a line
+	const size_t samplesPerLine = kCacheLineSize / sizeof(std::atomic<Float32>);
+	_planeStride = (capacity + samplesPerLine - 1) / samplesPerLine * samplesPerLine;
+	if(channels > 1 && (_planeStride * sizeof(Float32)) % kPageSize == 0) {
+		_planeStride += samplesPerLine;
+	}
+
+	const size_t samples = _planeStride * channels;
+	const size_t bytes = std::max<size_t>(samples * sizeof(std::atomic<Float32>), kCacheLineSize);
+	void * memory = NULL;
+	if(posix_memalign(&memory, kCacheLineSize, bytes) != 0) {
+		channels = 0;
+		capacity = 0;
+	} else {
+		_samples = (std::atomic<Float32> *)memory;
+		for(size_t i = 0; i < samples; i++) new (&_samples[i]) std::atomic<Float32>(0.f);
+	}
+
+	_channels = channels;
+	_capacity = capacity;
+	_writeBegin.store(0);
+	_writeEnd.store(0);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitCaptureBuffer::getWriteCount() const
+// ----------------------------------------------------------
+{
+	return _writeEnd.load(std::memory_order_acquire);
+}
+
+#pragma mark - Writing
+
+// ----------------------------------------------------------
+void ofxAudioUnitCaptureBuffer::write(const AudioBufferList * bufferList, size_t frames)
+// ----------------------------------------------------------
+{
+	if(_capacity == 0 || frames == 0) return;
+
+	const UInt64 end = _writeEnd.load(std::memory_order_relaxed) + frames;
+
+	// only the newest frames can survive a write bigger than the buffer
+	const size_t skip = frames > _capacity ? frames - _capacity : 0;
+	const size_t count = frames - skip;
+
+	// Announce the overwrite before doing it. Everything before
+	// (end - capacity) is fair game from here on
+	_writeBegin.store(end, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const unsigned int channelsToCopy = std::min<unsigned int>(_channels, bufferList->mNumberBuffers);
+
+	for(unsigned int c = 0; c < channelsToCopy; c++) {
+		const Float32 * samples = (const Float32 *)bufferList->mBuffers[c].mData + skip;
+		copyIn(plane(c), end - count, samples, count);
+	}
+
+	for(unsigned int c = channelsToCopy; c < _channels; c++) {
+		copyIn(plane(c), end - count, NULL, count);
+	}
+
+	// one publish for every channel
+	_writeEnd.store(end, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitCaptureBuffer::copyIn(std::atomic<Float32> * plane, UInt64 start, const Float32 * samples, size_t count)
+// ----------------------------------------------------------
+{
+	// silence if there are no samples
+	const size_t offset = start % _capacity;
+	const size_t firstPart = std::min(count, _capacity - offset);
+	Store(plane + offset, samples, firstPart);
+	Store(plane, samples ? samples + firstPart : NULL, count - firstPart);
+}
+
+#pragma mark - Reading
+
+// ----------------------------------------------------------
+void ofxAudioUnitCaptureBuffer::copyOut(const std::atomic<Float32> * plane, UInt64 start, Float32 * outSamples, size_t count) const
+// ----------------------------------------------------------
+{
+	const size_t offset = start % _capacity;
+	const size_t firstPart = std::min(count, _capacity - offset);
+	Load(outSamples, plane + offset, firstPart);
+	Load(outSamples + firstPart, plane, count - firstPart);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitCaptureBuffer::readable(UInt64 start, size_t frames, UInt64 end) const
+// ----------------------------------------------------------
+{
+	return frames <= _capacity && start + frames <= end && start + _capacity >= end;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitCaptureBuffer::survived(UInt64 start) const
+// ----------------------------------------------------------
+{
+	// if the writer announced an overwrite that reaches our range while we
+	// were copying, some of what we copied may be torn
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return start + _capacity >= _writeBegin.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitCaptureBuffer::read(UInt64 start, size_t frames, AudioBufferList * outBufferList) const
+// ----------------------------------------------------------
+{
+	if(frames == 0) return true;
+
+	if(!readable(start, frames, _writeEnd.load(std::memory_order_acquire))) {
+		return false;
+	}
+
+	const unsigned int channelsToCopy = std::min<unsigned int>(_channels, outBufferList->mNumberBuffers);
+	for(unsigned int c = 0; c < channelsToCopy; c++) {
+		copyOut(plane(c), start, (Float32 *)outBufferList->mBuffers[c].mData, frames);
+	}
+
+	return survived(start);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitCaptureBuffer::read(unsigned int channel, UInt64 start, Float32 * outSamples, size_t frames) const
+// ----------------------------------------------------------
+{
+	if(frames == 0) return true;
+
+	if(channel >= _channels || !readable(start, frames, _writeEnd.load(std::memory_order_acquire))) {
+		return false;
+	}
+
+	copyOut(plane(channel), start, outSamples, frames);
+	return survived(start);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitCaptureBuffer::readLatest(unsigned int channel, std::vector<Float32> &outSamples, size_t maxFrames) const
+// ----------------------------------------------------------
+{
+	const UInt64 end = _writeEnd.load(std::memory_order_acquire);
+
+	if(channel >= _channels) {
+		outSamples.clear();
+		return end;
+	}
+
+	const size_t count = std::min<UInt64>(std::min(maxFrames, _capacity), end);
+	const UInt64 start = end - count;
+
+	outSamples.resize(count);
+	if(count > 0) {
+		copyOut(plane(channel), start, &outSamples[0], count);
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const UInt64 begin = _writeBegin.load(std::memory_order_relaxed);
+
+	if(start + _capacity < begin) {
+		const size_t overwritten = std::min<UInt64>(count, begin - _capacity - start);
+		outSamples.erase(outSamples.begin(), outSamples.begin() + overwritten);
+	}
+
+	return end;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <vector>
+
+// ofxAudioUnitCaptureBuffer keeps the most recent N frames written to it,
+// for any number of channels. It's built for one writer (the render thread)
+// and any number of readers that never block the writer: when the buffer is
+// full, new frames simply overwrite the oldest ones.
+
+// All channels live in one allocation, one plane per channel, with every
+// plane starting on its own cache line. The channels share a single frame
+// cursor, so a block of audio is published with one atomic store no matter
+// how many channels it has.
+
+// Every frame gets a sequence number (its index in the stream since the
+// buffer was allocated). The writer announces which frames it's about to
+// overwrite before touching them, and publishes the new end of the stream
+// with release semantics afterwards. Readers copy first and check the
+// announced range afterwards, so a reader that was lapped by the writer
+// mid-copy finds out, rather than returning torn data. Samples are relaxed
+// atomics, so the copies that do race with the writer are well defined (and
+// clean under ThreadSanitizer); on every platform we build for they compile
+// to plain loads and stores.
+
+// allocate() is not thread safe; callers have to make sure nobody is reading
+// or writing while the buffer is resized.
+
+class ofxAudioUnitCaptureBuffer
+{
+public:
+	ofxAudioUnitCaptureBuffer(unsigned int channels = 0, size_t capacity = 0);
+	~ofxAudioUnitCaptureBuffer();
+
+	// discards everything in the buffer and resets the sequence to 0
+	void allocate(unsigned int channels, size_t capacity);
+	unsigned int channels() const {return _channels;}
+	size_t capacity() const {return _capacity;}
+
+	// Writer: appends frames from a non-interleaved buffer list, overwriting
+	// the oldest ones if needed. Channels the buffer list doesn't have are
+	// filled with silence. Never blocks or allocates
+	void write(const AudioBufferList * bufferList, size_t frames);
+
+	// the total number of frames written since allocate(), i.e. the sequence
+	// number one past the newest frame
+	UInt64 getWriteCount() const;
+
+	// Copies frames [start, start + frames) of every channel the buffer list
+	// has room for. Returns false if any of them haven't been written yet, or
+	// had already been overwritten by the time the copy finished
+	bool read(UInt64 start, size_t frames, AudioBufferList * outBufferList) const;
+
+	// the same, for a single channel
+	bool read(unsigned int channel, UInt64 start, Float32 * outSamples, size_t frames) const;
+
+	// Fills outSamples with up to maxFrames of a channel's most recent
+	// samples, oldest first. Samples overwritten while copying are dropped
+	// from the front. Returns the sequence number one past the last sample
+	// returned
+	UInt64 readLatest(unsigned int channel, std::vector<Float32> &outSamples, size_t maxFrames = SIZE_MAX) const;
+
+private:
+	std::atomic<Float32> * _samples;
+	unsigned int _channels;
+	size_t _capacity;
+	size_t _planeStride; // distance between the starts of two planes, in samples
+
+	// _writeBegin is bumped before the writer starts overwriting frames,
+	// and _writeEnd once the new frames are in place
+	std::atomic<UInt64> _writeBegin;
+	std::atomic<UInt64> _writeEnd;
+
+	ofxAudioUnitCaptureBuffer(const ofxAudioUnitCaptureBuffer &);
+	ofxAudioUnitCaptureBuffer& operator=(const ofxAudioUnitCaptureBuffer &);
+
+	std::atomic<Float32> * plane(unsigned int channel) const {return _samples + channel * _planeStride;}
+	bool readable(UInt64 start, size_t frames, UInt64 end) const;
+	bool survived(UInt64 start) const;
+	void copyIn(std::atomic<Float32> * plane, UInt64 start, const Float32 * samples, size_t count);
+	void copyOut(const std::atomic<Float32> * plane, UInt64 start, Float32 * outSamples, size_t count) const;
+};
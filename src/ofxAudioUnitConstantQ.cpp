@@ -0,0 +1,152 @@
+#include "ofxAudioUnitConstantQ.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// ----------------------------------------------------------
+ofxAudioUnitConstantQ::ofxAudioUnitConstantQ()
+: _sampleRate(0)
+, _fftSize(0)
+, _log2FftSize(0)
+// ----------------------------------------------------------
+{
+	_fftData.realp = NULL;
+	_fftData.imagp = NULL;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitConstantQ::~ofxAudioUnitConstantQ()
+// ----------------------------------------------------------
+{
+	freeBuffers();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConstantQ::freeBuffers()
+// ----------------------------------------------------------
+{
+	if(_fftData.realp) free(_fftData.realp);
+	if(_fftData.imagp) free(_fftData.imagp);
+	_fftData.realp = NULL;
+	_fftData.imagp = NULL;
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitConstantQ::getNumBins() const
+// ----------------------------------------------------------
+{
+	return _settings.binsPerOctave * _settings.octaves;
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitConstantQ::getBinFrequency(unsigned int bin) const
+// ----------------------------------------------------------
+{
+	return _settings.minFrequency * powf(2, bin / (float)_settings.binsPerOctave);
+}
+
+#pragma mark - Kernels
+
+// ----------------------------------------------------------
+void ofxAudioUnitConstantQ::setup(const Settings &settings, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	_settings = settings;
+	_sampleRate = sampleRate;
+
+	const unsigned int binCount = getNumBins();
+	const double Q = 1.0 / (pow(2.0, 1.0 / std::max(1u, _settings.binsPerOctave)) - 1.0);
+
+	// the lowest bin has the longest kernel, which sets the FFT size
+	const unsigned int longestKernel = ceil(Q * sampleRate / _settings.minFrequency);
+	const unsigned int log2FftSize = std::max(1u, (unsigned int) ceil(log2(longestKernel)));
+
+	if(log2FftSize != _log2FftSize) {
+		freeBuffers();
+		_log2FftSize = log2FftSize;
+		_fftSize = 1 << _log2FftSize;
+		_fftData.realp = (float *)calloc(_fftSize, sizeof(float));
+		_fftData.imagp = (float *)calloc(_fftSize, sizeof(float));
+		_fftSetup = ofxAudioUnitFftCache::getSetup(_log2FftSize);
+	}
+
+	_kernelRowStart.assign(1, 0);
+	_kernelIndex.clear();
+	_kernelReal.clear();
+	_kernelImag.clear();
+
+	std::vector<float> window(_fftSize);
+	std::vector<float> magnitudes(_fftSize / 2);
+
+	for(unsigned int k = 0; k < binCount; k++) {
+		const unsigned int kernelLength = std::min<unsigned int>(_fftSize, ceil(Q * sampleRate / getBinFrequency(k)));
+		const unsigned int offset = _fftSize - kernelLength;
+
+		generateWindow(_settings.window, &window[0], kernelLength);
+		float windowSum;
+		vDSP_sve(&window[0], 1, &windowSum, kernelLength);
+
+		// temporal kernel: a windowed complex exponential at the bin's center
+		// frequency, scaled so that a unit-amplitude sine reads as 1
+		memset(_fftData.realp, 0, _fftSize * sizeof(float));
+		memset(_fftData.imagp, 0, _fftSize * sizeof(float));
+
+		for(unsigned int n = 0; n < kernelLength; n++) {
+			const double phase = 2.0 * M_PI * Q * n / kernelLength;
+			const double amplitude = 2.0 * window[n] / windowSum;
+			_fftData.realp[offset + n] = amplitude * cos(phase);
+			_fftData.imagp[offset + n] = amplitude * sin(phase);
+		}
+
+		vDSP_fft_zip(_fftSetup.get(), &_fftData, 1, _log2FftSize, kFFTDirection_Forward);
+
+		// the kernel's energy is concentrated around its center frequency, so
+		// only the positive half of the spectrum is worth keeping
+		vDSP_zvabs(&_fftData, 1, &magnitudes[0], 1, _fftSize / 2);
+		float peak;
+		vDSP_maxv(&magnitudes[0], 1, &peak, _fftSize / 2);
+		const float threshold = peak * _settings.sparsityThreshold;
+
+		// Parseval: sum(x * conj(k)) = sum(X * conj(K)) / N. The spectrum coming
+		// out of vDSP's real FFT is scaled by 2, so that's folded in here too
+		const float scale = 1.0 / (2.0 * _fftSize);
+
+		for(unsigned int j = 0; j < _fftSize / 2; j++) {
+			if(magnitudes[j] > threshold) {
+				_kernelIndex.push_back(j);
+				_kernelReal.push_back( _fftData.realp[j] * scale);
+				_kernelImag.push_back(-_fftData.imagp[j] * scale);
+			}
+		}
+
+		_kernelRowStart.push_back(_kernelIndex.size());
+	}
+}
+
+#pragma mark - Transform
+
+// ----------------------------------------------------------
+void ofxAudioUnitConstantQ::transform(const Float32 * window, float * amplitude)
+// ----------------------------------------------------------
+{
+	vDSP_ctoz((const COMPLEX *)window, 2, &_fftData, 1, _fftSize / 2);
+	vDSP_fft_zrip(_fftSetup.get(), &_fftData, 1, _log2FftSize, kFFTDirection_Forward);
+
+	// imagp[0] holds the Nyquist bin, which the kernels don't use. Zeroing it
+	// makes bin 0 look like the purely real DC value it is
+	_fftData.imagp[0] = 0;
+
+	const unsigned int binCount = getNumBins();
+	for(unsigned int k = 0; k < binCount; k++) {
+		float real = 0;
+		float imag = 0;
+
+		for(UInt32 i = _kernelRowStart[k]; i < _kernelRowStart[k + 1]; i++) {
+			const UInt32 j = _kernelIndex[i];
+			real += _fftData.realp[j] * _kernelReal[i] - _fftData.imagp[j] * _kernelImag[i];
+			imag += _fftData.realp[j] * _kernelImag[i] + _fftData.imagp[j] * _kernelReal[i];
+		}
+
+		amplitude[k] = sqrtf(real * real + imag * imag);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ofxAudioUnitFftCache.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <vector>
+
+// ofxAudioUnitConstantQ is the constant-Q transform behind
+// ofxAudioUnitConstantQNode: bins spaced logarithmically (e.g. one per
+// semitone), each with a bandwidth proportional to its center frequency.
+
+// It uses the sparse spectral kernel method described by Brown & Puckette
+// ("An efficient algorithm for the calculation of a constant Q transform",
+// 1992). setup() builds one kernel per bin: a windowed complex exponential,
+// transformed, with everything below sparsityThreshold of its peak dropped.
+// After that, each transform costs one real FFT plus a sparse multiply,
+// instead of one long correlation per bin.
+
+// The longest kernel (i.e. the lowest bin) decides the FFT size. All kernels
+// are aligned to the end of the window.
+
+class ofxAudioUnitConstantQ
+{
+public:
+	struct Settings {
+		float minFrequency;         // center frequency of the lowest bin (Hz)
+		unsigned int binsPerOctave;
+		unsigned int octaves;
+		float sparsityThreshold;    // kernel values below this magnitude are dropped
+		ofxAudioUnitWindowType window;
+
+		Settings()
+		: minFrequency(55) // A1
+		, binsPerOctave(12)
+		, octaves(7)
+		, sparsityThreshold(0.0054)
+		, window(OFXAU_WINDOW_HAMMING)
+		{ }
+	};
+
+	ofxAudioUnitConstantQ();
+	~ofxAudioUnitConstantQ();
+
+	// builds the kernels; allocates, so keep it off the render thread
+	void setup(const Settings &settings, Float64 sampleRate);
+	const Settings& getSettings() const {return _settings;}
+	Float64 getSampleRate() const {return _sampleRate;}
+
+	unsigned int getNumBins() const;
+	float getBinFrequency(unsigned int bin) const;
+
+	// the number of samples in each window
+	unsigned int getFftSize() const {return _fftSize;}
+
+	// the number of kernel values kept, over all bins
+	size_t getKernelSize() const {return _kernelIndex.size();}
+
+	// Fills amplitude (getNumBins() values, lowest frequency first) from the
+	// getFftSize() samples in window. A full-scale sine wave centered on a
+	// bin reads as roughly 1
+	void transform(const Float32 * window, float * amplitude);
+
+private:
+	Settings _settings;
+	Float64 _sampleRate;
+	unsigned int _fftSize;
+	unsigned int _log2FftSize;
+	FFTSetupRef _fftSetup;
+	COMPLEX_SPLIT _fftData;
+
+	// sparse spectral kernels, one row per bin (compressed sparse row layout)
+	std::vector<UInt32>  _kernelRowStart;
+	std::vector<UInt32>  _kernelIndex;
+	std::vector<Float32> _kernelReal;
+	std::vector<Float32> _kernelImag;
+
+	ofxAudioUnitConstantQ(const ofxAudioUnitConstantQ &);
+	ofxAudioUnitConstantQ& operator=(const ofxAudioUnitConstantQ &);
+
+	void freeBuffers();
+};
@@ -0,0 +1,147 @@
+#include "TargetConditionals.h"
+#if !TARGET_OS_IPHONE
+
+#include "ofxAudioUnitConstantQNode.h"
+#include <math.h>
+
+ofxAudioUnitConstantQNode::ofxAudioUnitConstantQNode(Settings settings)
+: _settings(settings)
+, _sampleRate(0)
+, _lastAnalyzedFrame(0)
+{
+	buildKernels(currentSampleRate());
+}
+
+ofxAudioUnitConstantQNode::ofxAudioUnitConstantQNode(const ofxAudioUnitConstantQNode &orig)
+: _settings(orig._settings)
+, _sampleRate(orig._sampleRate)
+, _lastAnalyzedFrame(0)
+{
+	buildKernels(currentSampleRate());
+}
+
+ofxAudioUnitConstantQNode& ofxAudioUnitConstantQNode::operator=(const ofxAudioUnitConstantQNode &orig)
+{
+	if(this == &orig) return *this;
+
+	_settings = orig._settings;
+	_sampleRate = orig._sampleRate;
+	buildKernels(currentSampleRate());
+	return *this;
+}
+
+ofxAudioUnitConstantQNode::~ofxAudioUnitConstantQNode()
+{
+}
+
+#pragma mark - Settings
+
+void ofxAudioUnitConstantQNode::setSettings(const Settings &settings)
+{
+	_settings = settings;
+	buildKernels(currentSampleRate());
+}
+
+void ofxAudioUnitConstantQNode::setSampleRate(Float64 sampleRate)
+{
+	_sampleRate = sampleRate;
+	if(currentSampleRate() != _cqt.getSampleRate()) {
+		buildKernels(currentSampleRate());
+	}
+}
+
+Float64 ofxAudioUnitConstantQNode::currentSampleRate() const
+{
+	if(_sampleRate > 0) {
+		return _sampleRate;
+	}
+
+	const Float64 sourceRate = getSourceASBD().mSampleRate;
+	return sourceRate > 0 ? sourceRate : 44100;
+}
+
+unsigned int ofxAudioUnitConstantQNode::getNumBins() const
+{
+	return _cqt.getNumBins();
+}
+
+float ofxAudioUnitConstantQNode::getBinFrequency(unsigned int bin) const
+{
+	return _cqt.getBinFrequency(bin);
+}
+
+std::vector<float> ofxAudioUnitConstantQNode::getBinFrequencies() const
+{
+	std::vector<float> frequencies(getNumBins());
+	for(unsigned int k = 0; k < frequencies.size(); k++) {
+		frequencies[k] = getBinFrequency(k);
+	}
+	return frequencies;
+}
+
+std::string ofxAudioUnitConstantQNode::getName()
+{
+	if(name.empty()) {
+		return "ofxAudioUnitConstantQNode";
+	} else {
+		return name;
+	}
+}
+
+#pragma mark - Kernels
+
+void ofxAudioUnitConstantQNode::buildKernels(Float64 sampleRate)
+{
+	_cqt.setup(_settings, sampleRate);
+	_amplitude.assign(_cqt.getNumBins(), 0);
+	_lastAnalyzedFrame = 0;
+	setBufferSize(_cqt.getFftSize());
+}
+
+#pragma mark - Analysis
+
+bool ofxAudioUnitConstantQNode::getAmplitude(std::vector<float> &outAmplitude)
+{
+	const Float64 sampleRate = currentSampleRate();
+	if(sampleRate != _cqt.getSampleRate()) {
+		buildKernels(sampleRate);
+	}
+
+	const UInt64 capturedFrames = getCapturedFrameCount();
+
+	// only transform once per hop, regardless of how often we're polled
+	if(_lastAnalyzedFrame != 0 && capturedFrames - _lastAnalyzedFrame < _settings.hopSize) {
+		outAmplitude = _amplitude;
+		return true;
+	}
+
+	getSamplesFromChannel(_sampleBuffer, 0);
+
+	// return empty if we don't have enough samples yet
+	const unsigned int fftSize = _cqt.getFftSize();
+	if(_sampleBuffer.size() < fftSize) {
+		outAmplitude.clear();
+		return false;
+	}
+
+	_cqt.transform(&_sampleBuffer[_sampleBuffer.size() - fftSize], _amplitude.data());
+
+	const unsigned int binCount = _amplitude.size();
+	if(_settings.scale == OFXAU_SCALE_LOG10) {
+		for(unsigned int k = 0; k < binCount; k++) {
+			_amplitude[k] = log10f(_amplitude[k] + 1);
+		}
+	} else if(_settings.scale == OFXAU_SCALE_DECIBEL) {
+		float ref = 1.0;
+		float floor = 1e-9;
+		float ceiling = INFINITY;
+		vDSP_vclip(&_amplitude[0], 1, &floor, &ceiling, &_amplitude[0], 1, binCount);
+		vDSP_vdbcon(&_amplitude[0], 1, &ref, &_amplitude[0], 1, binCount, 1);
+	}
+
+	_lastAnalyzedFrame = capturedFrames;
+	outAmplitude = _amplitude;
+	return true;
+}
+
+#endif // !TARGET_OS_IPHONE
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ofxAudioUnitConstantQ.h"
+#include "ofxAudioUnitFftNode.h"
+
+// ofxAudioUnitConstantQNode performs a constant-Q transform on the audio
+// passing through it. Unlike ofxAudioUnitFftNode's linearly spaced bins,
+// the bins here are spaced logarithmically (e.g. one per semitone), and
+// each bin's bandwidth is proportional to its center frequency.
+
+// The transform itself is ofxAudioUnitConstantQ, which uses Brown &
+// Puckette's sparse spectral kernels. The kernels are built once whenever
+// the configuration or sample rate changes. After that, each hop costs one
+// real FFT plus a sparse multiply, instead of one long correlation per bin.
+
+// The longest kernel (i.e. the lowest bin) decides the FFT size, so low
+// minimum frequencies cost both latency and memory. All kernels are aligned
+// to the most recent end of the analysis window.
+
+class ofxAudioUnitConstantQNode : public ofxAudioUnitDSPNode
+{
+public:
+	// the transform's settings, plus how often to run it and how to scale it
+	struct Settings : ofxAudioUnitConstantQ::Settings {
+		unsigned int hopSize;
+		ofxAudioUnitScaleType scale;
+
+		Settings()
+		: hopSize(512)
+		, scale(OFXAU_SCALE_LINEAR)
+		{ }
+	};
+
+	ofxAudioUnitConstantQNode(Settings settings = Settings());
+	ofxAudioUnitConstantQNode(const ofxAudioUnitConstantQNode &orig);
+	ofxAudioUnitConstantQNode& operator=(const ofxAudioUnitConstantQNode &orig);
+	virtual ~ofxAudioUnitConstantQNode();
+
+	// Fills outAmplitude with one value per bin (lowest frequency first).
+	// With OFXAU_SCALE_LINEAR, a full-scale sine wave centered on a bin reads
+	// as roughly 1. Returns false if there aren't enough samples yet. A new
+	// transform is only computed once per hop; in between, the previous
+	// result is returned
+	bool getAmplitude(std::vector<float> &outAmplitude);
+
+	void setSettings(const Settings &settings);
+	const Settings& getSettings() const {return _settings;}
+
+	// the sample rate is read from the source unit where possible. Set it
+	// here if the node is being fed from a callback or another DSP node
+	void setSampleRate(Float64 sampleRate);
+
+	unsigned int getNumBins() const;
+	float getBinFrequency(unsigned int bin) const;
+	std::vector<float> getBinFrequencies() const;
+
+	// the number of samples in each analysis window
+	unsigned int getFftSize() const {return _cqt.getFftSize();}
+
+	virtual std::string getName();
+
+private:
+	ofxAudioUnitConstantQ _cqt;
+	Settings _settings;
+	Float64 _sampleRate;
+	UInt64 _lastAnalyzedFrame;
+
+	std::vector<Float32> _sampleBuffer;
+	std::vector<float> _amplitude;
+
+	Float64 currentSampleRate() const;
+	void buildKernels(Float64 sampleRate);
+};
@@ -0,0 +1,289 @@
+#include "ofxAudioUnitConvolution.h"
+#include "ofxAudioUnitFftCache.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// Everything needed to run one impulse response at one block size. Engines
+// are built off the render thread and never resized once built
+struct ofxAudioUnitConvolution::Engine
+{
+	struct Channel
+	{
+		std::vector<float> input;  // previous block followed by the block being filled
+		std::vector<float> output; // wet output for the block being filled
+		std::vector<float> fdlReal;
+		std::vector<float> fdlImag;
+	};
+
+	unsigned int blockSize;
+	unsigned int log2FftSize;
+	unsigned int partitions;
+	unsigned int irChannels;
+	FFTSetupRef fftSetup;
+
+	// transformed IR partitions, laid out as [irChannel][partition][bin]
+	std::vector<float> irReal;
+	std::vector<float> irImag;
+
+	std::vector<Channel> channels;
+	std::vector<float> accReal;
+	std::vector<float> accImag;
+	std::vector<float> scratch;
+
+	unsigned int fdlHead;
+	unsigned int position;
+
+	Engine(const std::vector<std::vector<float> > &ir, unsigned int blockSize, unsigned int channelCount);
+	void processBlock();
+};
+
+static unsigned int RoundUpToPowerOfTwo(unsigned int n)
+{
+	return 1 << (unsigned int) ceilf(log2f(std::max(n, 2u)));
+}
+
+#pragma mark - Engine
+
+ofxAudioUnitConvolution::Engine::Engine(const std::vector<std::vector<float> > &ir, unsigned int blockSize, unsigned int channelCount)
+: blockSize(blockSize)
+, log2FftSize(log2f(blockSize) + 1)
+, partitions(1)
+, irChannels(std::max<size_t>(1, ir.size()))
+, fdlHead(0)
+, position(0)
+{
+	size_t irLength = 0;
+	for(size_t c = 0; c < ir.size(); c++) {
+		irLength = std::max(irLength, ir[c].size());
+	}
+
+	const unsigned int B = blockSize;
+	partitions = std::max<size_t>(1, (irLength + B - 1) / B);
+	fftSetup = ofxAudioUnitFftCache::getSetup(log2FftSize);
+
+	irReal.assign(irChannels * partitions * B, 0);
+	irImag.assign(irChannels * partitions * B, 0);
+	scratch.assign(2 * B, 0);
+
+	// vDSP's forward real FFT scales by 2 (so the product of two spectra is
+	// scaled by 4), and its inverse by the FFT size (2B). Folding the
+	// correction into the IR spectra saves a multiply per block
+	const float scale = 1.0 / (8.0 * B);
+
+	for(unsigned int c = 0; c < irChannels && c < ir.size(); c++) {
+		for(unsigned int p = 0; p < partitions; p++) {
+			std::fill(scratch.begin(), scratch.end(), 0);
+			const size_t start = p * B;
+			const size_t end = std::min(ir[c].size(), start + B);
+			if(start < end) {
+				std::copy(ir[c].begin() + start, ir[c].begin() + end, scratch.begin());
+			}
+
+			const size_t offset = (c * partitions + p) * B;
+			COMPLEX_SPLIT partition = {&irReal[offset], &irImag[offset]};
+			vDSP_ctoz((COMPLEX *)&scratch[0], 2, &partition, 1, B);
+			vDSP_fft_zrip(fftSetup.get(), &partition, 1, log2FftSize, kFFTDirection_Forward);
+			vDSP_vsmul(partition.realp, 1, &scale, partition.realp, 1, B);
+			vDSP_vsmul(partition.imagp, 1, &scale, partition.imagp, 1, B);
+		}
+	}
+
+	channels.resize(channelCount);
+	for(size_t c = 0; c < channels.size(); c++) {
+		channels[c].input.assign(2 * B, 0);
+		channels[c].output.assign(B, 0);
+		channels[c].fdlReal.assign(partitions * B, 0);
+		channels[c].fdlImag.assign(partitions * B, 0);
+	}
+
+	accReal.assign(B, 0);
+	accImag.assign(B, 0);
+}
+
+void ofxAudioUnitConvolution::Engine::processBlock()
+{
+	const unsigned int B = blockSize;
+
+	for(size_t c = 0; c < channels.size(); c++) {
+		Channel &ch = channels[c];
+		const unsigned int irChannel = std::min<unsigned int>(c, irChannels - 1);
+
+		// transform the newest 2B input samples into the head of the delay line
+		COMPLEX_SPLIT head = {&ch.fdlReal[fdlHead * B], &ch.fdlImag[fdlHead * B]};
+		vDSP_ctoz((COMPLEX *)&ch.input[0], 2, &head, 1, B);
+		vDSP_fft_zrip(fftSetup.get(), &head, 1, log2FftSize, kFFTDirection_Forward);
+
+		// multiply-accumulate each delay line slot with its IR partition. Bin 0
+		// packs the (real) DC and Nyquist values, so it's handled separately
+		vDSP_vclr(&accReal[0], 1, B);
+		vDSP_vclr(&accImag[0], 1, B);
+		float dc = 0;
+		float nyquist = 0;
+
+		COMPLEX_SPLIT acc = {&accReal[1], &accImag[1]};
+
+		for(unsigned int p = 0; p < partitions; p++) {
+			const unsigned int slot = (fdlHead + partitions - p) % partitions;
+			const size_t irOffset = (irChannel * partitions + p) * B;
+
+			const float * xr = &ch.fdlReal[slot * B];
+			const float * xi = &ch.fdlImag[slot * B];
+			const float * hr = &irReal[irOffset];
+			const float * hi = &irImag[irOffset];
+
+			dc += xr[0] * hr[0];
+			nyquist += xi[0] * hi[0];
+
+			COMPLEX_SPLIT x = {(float *)xr + 1, (float *)xi + 1};
+			COMPLEX_SPLIT h = {(float *)hr + 1, (float *)hi + 1};
+			vDSP_zvma(&x, 1, &h, 1, &acc, 1, &acc, 1, B - 1);
+		}
+
+		accReal[0] = dc;
+		accImag[0] = nyquist;
+
+		COMPLEX_SPLIT result = {&accReal[0], &accImag[0]};
+		vDSP_fft_zrip(fftSetup.get(), &result, 1, log2FftSize, kFFTDirection_Inverse);
+		vDSP_ztoc(&result, 1, (COMPLEX *)&scratch[0], 2, B);
+
+		// overlap-save: only the second half of the circular convolution is valid
+		std::copy(scratch.begin() + B, scratch.end(), ch.output.begin());
+		std::copy(ch.input.begin() + B, ch.input.end(), ch.input.begin());
+	}
+
+	fdlHead = (fdlHead + 1) % partitions;
+}
+
+#pragma mark - ofxAudioUnitConvolution
+
+// ----------------------------------------------------------
+ofxAudioUnitConvolution::ofxAudioUnitConvolution(unsigned int blockSize)
+: _outputChannels(2)
+, _blockSize(RoundUpToPowerOfTwo(blockSize))
+, _wetLevel(1)
+, _dryLevel(0)
+// ----------------------------------------------------------
+{
+	
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitConvolution::~ofxAudioUnitConvolution()
+// ----------------------------------------------------------
+{
+	
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolution::rebuildEngine()
+// ----------------------------------------------------------
+{
+	std::unique_ptr<Engine> engine;
+
+	if(!_impulseResponse.empty()) {
+		const unsigned int channels = std::max<size_t>(_impulseResponse.size(), _outputChannels);
+		engine.reset(new Engine(_impulseResponse, _blockSize, channels));
+	}
+
+	// swapping under the lock means the render thread is never mid-block
+	// when the old engine goes away. The old engine is freed here, on
+	// this thread, once the lock has been released
+	_engineMutex.lock();
+	_engine.swap(engine);
+	_engineMutex.unlock();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolution::setImpulseResponse(const std::vector<std::vector<float> > &channels, unsigned int outputChannels)
+// ----------------------------------------------------------
+{
+	_impulseResponse = channels;
+	_outputChannels = outputChannels;
+	rebuildEngine();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolution::clearImpulseResponse()
+// ----------------------------------------------------------
+{
+	_impulseResponse.clear();
+	rebuildEngine();
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitConvolution::getImpulseResponseLength() const
+// ----------------------------------------------------------
+{
+	size_t length = 0;
+	for(size_t c = 0; c < _impulseResponse.size(); c++) {
+		length = std::max(length, _impulseResponse[c].size());
+	}
+	return length;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolution::setBlockSize(unsigned int blockSize)
+// ----------------------------------------------------------
+{
+	blockSize = RoundUpToPowerOfTwo(blockSize);
+	if(blockSize != _blockSize) {
+		_blockSize = blockSize;
+		rebuildEngine();
+	}
+}
+
+#pragma mark - Rendering
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolution::process(AudioBufferList * ioData, UInt32 inNumberFrames)
+// ----------------------------------------------------------
+{
+	const float wet = _wetLevel.load(std::memory_order_relaxed);
+	const float dry = _dryLevel.load(std::memory_order_relaxed);
+
+	// if the engine is being swapped out, this cycle only has the dry signal
+	if(!_engineMutex.try_lock()) {
+		for(UInt32 c = 0; c < ioData->mNumberBuffers; c++) {
+			Float32 * io = (Float32 *)ioData->mBuffers[c].mData;
+			for(UInt32 i = 0; i < inNumberFrames; i++) {
+				io[i] *= dry;
+			}
+		}
+		return;
+	}
+
+	Engine * engine = _engine.get();
+
+	if(engine) {
+		const unsigned int B = engine->blockSize;
+		const size_t channels = std::min<size_t>(ioData->mNumberBuffers, engine->channels.size());
+
+		UInt32 done = 0;
+		while(done < inNumberFrames) {
+			const UInt32 frames = std::min(inNumberFrames - done, B - engine->position);
+
+			for(size_t c = 0; c < channels; c++) {
+				Engine::Channel &ch = engine->channels[c];
+				Float32 * io = (Float32 *)ioData->mBuffers[c].mData + done;
+				float * input = &ch.input[B + engine->position];
+				const float * output = &ch.output[engine->position];
+
+				memcpy(input, io, frames * sizeof(Float32));
+				for(UInt32 i = 0; i < frames; i++) {
+					io[i] = dry * input[i] + wet * output[i];
+				}
+			}
+
+			engine->position += frames;
+			done += frames;
+
+			if(engine->position == B) {
+				engine->processBlock();
+				engine->position = 0;
+			}
+		}
+	}
+
+	_engineMutex.unlock();
+}
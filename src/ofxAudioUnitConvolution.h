@@ -0,0 +1,65 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// ofxAudioUnitConvolution convolves audio with an impulse response, in
+// place. It's the engine behind ofxAudioUnitConvolutionNode (see there for
+// the method and how channels are mapped).
+
+// setImpulseResponse(), clearImpulseResponse() and setBlockSize() build a
+// new set of partitions and delay lines off the render thread and swap them
+// in between render cycles. A cycle that finds a swap under way can't
+// convolve, so it only has the dry signal: it's scaled by the dry level,
+// which is silence at the default levels. With no impulse response at all,
+// audio passes through untouched.
+
+// process() is for the render thread and never blocks or allocates.
+
+class ofxAudioUnitConvolution
+{
+public:
+	// the block size should be a power of 2 (256, 512, 1024, etc), and will be rounded up otherwise
+	explicit ofxAudioUnitConvolution(unsigned int blockSize = 512);
+	~ofxAudioUnitConvolution();
+
+	// One vector of samples per channel. Enough delay lines are made for
+	// outputChannels channels of audio, or the IR's channel count if that's
+	// higher
+	void setImpulseResponse(const std::vector<std::vector<float> > &channels, unsigned int outputChannels = 2);
+	void clearImpulseResponse();
+	const std::vector<std::vector<float> >& getImpulseResponse() const {return _impulseResponse;}
+
+	// length of the current impulse response, in samples
+	size_t getImpulseResponseLength() const;
+
+	// re-partitions the current impulse response if there is one
+	void setBlockSize(unsigned int blockSize);
+	unsigned int getBlockSize() const {return _blockSize;}
+
+	void setWetLevel(float wetLevel) {_wetLevel.store(wetLevel);}
+	void setDryLevel(float dryLevel) {_dryLevel.store(dryLevel);}
+	float getWetLevel() const {return _wetLevel.load();}
+	float getDryLevel() const {return _dryLevel.load();}
+
+	void process(AudioBufferList * ioData, UInt32 frames);
+
+private:
+	struct Engine;
+
+	std::mutex _engineMutex;
+	std::unique_ptr<Engine> _engine;
+	std::vector<std::vector<float> > _impulseResponse;
+	unsigned int _outputChannels;
+	unsigned int _blockSize;
+	std::atomic<float> _wetLevel;
+	std::atomic<float> _dryLevel;
+
+	ofxAudioUnitConvolution(const ofxAudioUnitConvolution &);
+	ofxAudioUnitConvolution& operator=(const ofxAudioUnitConvolution &);
+
+	void rebuildEngine();
+};
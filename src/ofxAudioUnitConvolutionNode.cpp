@@ -0,0 +1,210 @@
+#include "TargetConditionals.h"
+#if !TARGET_OS_IPHONE
+
+#include "ofxAudioUnitConvolutionNode.h"
+#include "ofxAudioUnitUtils.h"
+
+// convolves the audio passing through the node, in place
+static OSStatus Convolve(void * inRefCon,
+						 AudioUnitRenderActionFlags * ioActionFlags,
+						 const AudioTimeStamp * inTimeStamp,
+						 UInt32 inBusNumber,
+						 UInt32 inNumberFrames,
+						 AudioBufferList * ioData);
+
+#pragma mark - ofxAudioUnitConvolutionNode
+
+// ----------------------------------------------------------
+ofxAudioUnitConvolutionNode::ofxAudioUnitConvolutionNode(unsigned int blockSize)
+: _conv(new ofxAudioUnitConvolution(blockSize))
+, _sampleRate(0)
+// ----------------------------------------------------------
+{
+	setProcessCallback((AURenderCallbackStruct){Convolve, _conv.get()});
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitConvolutionNode::~ofxAudioUnitConvolutionNode()
+// ----------------------------------------------------------
+{
+	setProcessCallback((AURenderCallbackStruct){0});
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitConvolutionNode::loadImpulseResponse(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	CFURLRef fileURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+															   (const UInt8 *)filePath.c_str(),
+															   filePath.length(),
+															   false);
+	ExtAudioFileRef file;
+	OSStatus s = ExtAudioFileOpenURL(fileURL, &file);
+	CFRelease(fileURL);
+
+	if(s != noErr) {
+		std::cout << "Error " << s << " while opening impulse response at " << filePath << std::endl;
+		return false;
+	}
+
+	AudioStreamBasicDescription fileASBD = {0};
+	UInt32 dataSize = sizeof(fileASBD);
+	ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileDataFormat, &dataSize, &fileASBD);
+
+	Float64 sampleRate = _sampleRate > 0 ? _sampleRate : getSourceASBD().mSampleRate;
+	if(sampleRate <= 0) sampleRate = fileASBD.mSampleRate;
+
+	// ask for non-interleaved floats at the rate we're running at
+	AudioStreamBasicDescription clientASBD = {0};
+	clientASBD.mSampleRate       = sampleRate;
+	clientASBD.mFormatID         = kAudioFormatLinearPCM;
+	clientASBD.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+	clientASBD.mBytesPerPacket   = sizeof(Float32);
+	clientASBD.mFramesPerPacket  = 1;
+	clientASBD.mBytesPerFrame    = sizeof(Float32);
+	clientASBD.mChannelsPerFrame = fileASBD.mChannelsPerFrame;
+	clientASBD.mBitsPerChannel   = 32;
+
+	s = ExtAudioFileSetProperty(file, kExtAudioFileProperty_ClientDataFormat, sizeof(clientASBD), &clientASBD);
+
+	if(s != noErr || clientASBD.mChannelsPerFrame == 0) {
+		std::cout << "Error " << s << " while setting impulse response client format" << std::endl;
+		ExtAudioFileDispose(file);
+		return false;
+	}
+
+	const UInt32 framesPerRead = 8192;
+	AudioBufferList * bufferList = AudioBufferListAlloc(clientASBD.mChannelsPerFrame, framesPerRead);
+	std::vector<std::vector<float> > channels(clientASBD.mChannelsPerFrame);
+
+	while(true) {
+		UInt32 frames = framesPerRead;
+		for(UInt32 c = 0; c < bufferList->mNumberBuffers; c++) {
+			bufferList->mBuffers[c].mDataByteSize = framesPerRead * sizeof(Float32);
+		}
+
+		s = ExtAudioFileRead(file, &frames, bufferList);
+		if(s != noErr || frames == 0) break;
+
+		for(UInt32 c = 0; c < channels.size(); c++) {
+			Float32 * data = (Float32 *)bufferList->mBuffers[c].mData;
+			channels[c].insert(channels[c].end(), data, data + frames);
+		}
+	}
+
+	AudioBufferListRelease(bufferList);
+	ExtAudioFileDispose(file);
+
+	if(s != noErr) {
+		std::cout << "Error " << s << " while reading impulse response at " << filePath << std::endl;
+		return false;
+	}
+
+	setImpulseResponse(channels);
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolutionNode::setImpulseResponse(const std::vector<std::vector<float> > &channels)
+// ----------------------------------------------------------
+{
+	_conv->setImpulseResponse(channels, std::max(_impl->channelsToBuffer, 2u));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolutionNode::clearImpulseResponse()
+// ----------------------------------------------------------
+{
+	_conv->clearImpulseResponse();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolutionNode::setBlockSize(unsigned int blockSize)
+// ----------------------------------------------------------
+{
+	_conv->setBlockSize(blockSize);
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitConvolutionNode::getBlockSize() const
+// ----------------------------------------------------------
+{
+	return _conv->getBlockSize();
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitConvolutionNode::getLatency() const
+// ----------------------------------------------------------
+{
+	return _conv->getBlockSize();
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitConvolutionNode::getImpulseResponseLength() const
+// ----------------------------------------------------------
+{
+	return _conv->getImpulseResponseLength();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolutionNode::setWetLevel(float wetLevel)
+// ----------------------------------------------------------
+{
+	_conv->setWetLevel(wetLevel);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolutionNode::setDryLevel(float dryLevel)
+// ----------------------------------------------------------
+{
+	_conv->setDryLevel(dryLevel);
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitConvolutionNode::getWetLevel() const
+// ----------------------------------------------------------
+{
+	return _conv->getWetLevel();
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitConvolutionNode::getDryLevel() const
+// ----------------------------------------------------------
+{
+	return _conv->getDryLevel();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitConvolutionNode::setSampleRate(Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	_sampleRate = sampleRate;
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitConvolutionNode::getName()
+// ----------------------------------------------------------
+{
+	if(name.empty()) {
+		return "ofxAudioUnitConvolutionNode";
+	} else {
+		return name;
+	}
+}
+
+#pragma mark - Render callbacks
+
+// ----------------------------------------------------------
+OSStatus Convolve(void * inRefCon,
+				  AudioUnitRenderActionFlags * ioActionFlags,
+				  const AudioTimeStamp * inTimeStamp,
+				  UInt32 inBusNumber,
+				  UInt32 inNumberFrames,
+				  AudioBufferList * ioData)
+// ----------------------------------------------------------
+{
+	static_cast<ofxAudioUnitConvolution *>(inRefCon)->process(ioData, inNumberFrames);
+	return noErr;
+}
+
+#endif // !TARGET_OS_IPHONE
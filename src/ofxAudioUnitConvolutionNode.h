@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ofxAudioUnitConvolution.h"
+#include "ofxAudioUnitDSPNode.h"
+
+// ofxAudioUnitConvolutionNode convolves the audio passing through it with an
+// impulse response (e.g. a reverb tail or a cabinet / room measurement).
+
+// It uses uniformly partitioned overlap-save convolution: the impulse
+// response is split into blocks of blockSize samples, each block is
+// transformed once when the IR is loaded, and every block of input is
+// transformed once and kept in a frequency-domain delay line. The cost per
+// block is then one forward FFT, one inverse FFT and one complex
+// multiply-add per IR partition, which makes multi-second IRs practical.
+
+// The wet signal is delayed by exactly blockSize samples. Smaller blocks mean
+// lower latency but more CPU per sample.
+
+// Everything the render thread touches is allocated when the IR is loaded.
+// Loading an IR while audio is running swaps it in between render cycles
+// (the cycle in which the swap happens only gets the dry signal, at the dry
+// level). The engine doing all this is ofxAudioUnitConvolution.
+
+// IR channels are mapped onto the audio channels in order. A mono IR is
+// applied to every channel. Channels beyond the IR's channel count reuse its
+// last channel.
+
+class ofxAudioUnitConvolutionNode : public ofxAudioUnitDSPNode
+{
+public:
+	// the block size should be a power of 2 (256, 512, 1024, etc), and will be rounded up otherwise
+	ofxAudioUnitConvolutionNode(unsigned int blockSize = 512);
+	virtual ~ofxAudioUnitConvolutionNode();
+
+	// Loads an impulse response from any file Core Audio can read. It is
+	// converted to the sample rate of the node's source (or the rate passed
+	// to setSampleRate())
+	bool loadImpulseResponse(const std::string &filePath);
+
+	// one vector of samples per channel
+	void setImpulseResponse(const std::vector<std::vector<float> > &channels);
+	void clearImpulseResponse();
+
+	// re-partitions the current impulse response if there is one
+	void setBlockSize(unsigned int blockSize);
+	unsigned int getBlockSize() const;
+
+	// in samples. This is the same as the block size
+	unsigned int getLatency() const;
+
+	// length of the current impulse response, in samples
+	size_t getImpulseResponseLength() const;
+
+	void setWetLevel(float wetLevel);
+	void setDryLevel(float dryLevel);
+	float getWetLevel() const;
+	float getDryLevel() const;
+
+	void setSampleRate(Float64 sampleRate);
+
+	virtual std::string getName();
+
+private:
+	std::shared_ptr<ofxAudioUnitConvolution> _conv;
+	Float64 _sampleRate;
+
+	// a copy would share the DSP context, and tear down its process callback
+	// when destroyed
+	ofxAudioUnitConvolutionNode(const ofxAudioUnitConvolutionNode &);
+	ofxAudioUnitConvolutionNode& operator=(const ofxAudioUnitConvolutionNode &);
+};
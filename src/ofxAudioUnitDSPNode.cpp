@@ -26,23 +26,16 @@ static OSStatus SilentRenderCallback(void * inRefCon,
 	, sourceCallback((AURenderCallbackStruct){0})
 	, processCallback((AURenderCallbackStruct){0})
 	, sourceUnit(NULL)
-	, _bufferSize(0)
+	, capturedFrames(0)
+	, capturedSampleTime(0)
+	, captureTimeOffset(0)
 	{ }
 	
-	void ofxAudioUnitDSPNode::DSPNodeContext::setCircularBufferSize(UInt32 bufferCount, unsigned int samplesToBuffer) {
-		if(bufferCount != circularBuffers.size() || samplesToBuffer != _bufferSize) {
+	void ofxAudioUnitDSPNode::DSPNodeContext::setCaptureBufferSize(UInt32 channels, unsigned int samplesToBuffer) {
+		if(channels != captureBuffer.channels() || samplesToBuffer != captureBuffer.capacity()) {
 			bufferMutex.lock();
 			{
-				for(int i = 0; i < circularBuffers.size(); i++) {
-					TPCircularBufferCleanup(&circularBuffers[i]);
-				}
-				
-				circularBuffers.resize(bufferCount);
-				
-				for(int i = 0; i < circularBuffers.size(); i++) {
-					TPCircularBufferInit(&circularBuffers[i], samplesToBuffer * sizeof(Float32));
-				}
-				_bufferSize = samplesToBuffer;
+				captureBuffer.allocate(channels, samplesToBuffer);
 			}
 			bufferMutex.unlock();
 		}
@@ -61,9 +54,7 @@ ofxAudioUnitDSPNode::ofxAudioUnitDSPNode(unsigned int samplesToBuffer)
 ofxAudioUnitDSPNode::~ofxAudioUnitDSPNode()
 // ----------------------------------------------------------
 {
-	for(int i = 0; i < _impl->ctx.circularBuffers.size(); i++) {
-		TPCircularBufferCleanup(&_impl->ctx.circularBuffers[i]);
-	}
+	
 }
 
 #pragma mark - Connections
@@ -153,7 +144,7 @@ void ofxAudioUnitDSPNode::setBufferSize(unsigned int samplesToBuffer)
 // ----------------------------------------------------------
 {
 	_impl->samplesToBuffer = samplesToBuffer;
-	_impl->ctx.setCircularBufferSize(_impl->channelsToBuffer, _impl->samplesToBuffer);
+	_impl->ctx.setCaptureBufferSize(_impl->channelsToBuffer, _impl->samplesToBuffer);
 }
 
 // ----------------------------------------------------------
@@ -166,13 +157,24 @@ unsigned int ofxAudioUnitDSPNode::getBufferSize() const
 #pragma mark - Getting Samples
 
 
-void ofxAudioUnitDSPNode::getSamplesFromChannel(std::vector<Float32> &samples, unsigned int channel) const
+UInt64 ofxAudioUnitDSPNode::getSamplesFromChannel(std::vector<Float32> &samples, unsigned int channel) const
 {
-	if(_impl->ctx.circularBuffers.size() > channel) {
-		ExtractSamplesFromCircularBuffer(samples, &_impl->ctx.circularBuffers[channel]);
-	} else {
-		samples.clear();
-	}
+	return _impl->ctx.captureBuffer.readLatest(channel, samples);
+}
+
+UInt64 ofxAudioUnitDSPNode::getCapturedFrameCount() const
+{
+	return _impl->ctx.capturedFrames.load(std::memory_order_acquire);
+}
+
+Float64 ofxAudioUnitDSPNode::getCapturedSampleTime() const
+{
+	return _impl->ctx.capturedSampleTime.load(std::memory_order_acquire);
+}
+
+Float64 ofxAudioUnitDSPNode::getCapturedSampleTime(UInt64 sequence) const
+{
+	return sequence + _impl->ctx.captureTimeOffset.load(std::memory_order_relaxed);
 }
 
 void ofxAudioUnitDSPNode::setProcessCallback(AURenderCallbackStruct processCallback)
@@ -253,10 +255,21 @@ OSStatus RenderAndCopy(void * inRefCon,
 	
 	if(ctx->bufferMutex.try_lock()) {
 		if(status == noErr) {
-			const size_t buffersToCopy = std::min<size_t>(ctx->circularBuffers.size(), ioData->mNumberBuffers);
+			const size_t buffersToCopy = std::min<size_t>(ctx->captureBuffer.channels(), ioData->mNumberBuffers);
 			
-			for(int i = 0; i < buffersToCopy; i++) {
-				CopyAudioBufferIntoCircularBuffer(&ctx->circularBuffers[i], ioData->mBuffers[i]);
+			// the buffer's release of the write publishes this too
+			if(inTimeStamp && (inTimeStamp->mFlags & kAudioTimeStampSampleTimeValid)) {
+				const Float64 offset = inTimeStamp->mSampleTime - (Float64)ctx->captureBuffer.getWriteCount();
+				ctx->captureTimeOffset.store(offset, std::memory_order_relaxed);
+			}
+			
+			ctx->captureBuffer.write(ioData, inNumberFrames);
+			
+			if(buffersToCopy > 0) {
+				if(inTimeStamp && (inTimeStamp->mFlags & kAudioTimeStampSampleTimeValid)) {
+					ctx->capturedSampleTime.store(inTimeStamp->mSampleTime + inNumberFrames, std::memory_order_relaxed);
+				}
+				ctx->capturedFrames.fetch_add(inNumberFrames, std::memory_order_release);
 			}
 		}
 		ctx->bufferMutex.unlock();
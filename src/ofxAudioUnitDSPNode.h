@@ -3,7 +3,8 @@
 #include <AudioToolbox/AudioToolbox.h>
 #include <vector>
 #include <mutex>
-#include "TPCircularBuffer.h"
+#include <atomic>
+#include "ofxAudioUnitCaptureBuffer.h"
 #include "ofMain.h"
 class ofxAudioUnit;
 
@@ -48,14 +49,20 @@ public:
 		UInt32 sourceBus;
 		AURenderCallbackStruct sourceCallback;
 		AURenderCallbackStruct processCallback;
-		std::vector<TPCircularBuffer> circularBuffers;
+		ofxAudioUnitCaptureBuffer captureBuffer;
 		std::mutex bufferMutex;
 		
-		DSPNodeContext();
-		void setCircularBufferSize(UInt32 bufferCount, unsigned int samplesToBuffer);
+		// running count of frames copied into the capture buffer, and the
+		// sample time just past the most recently copied frame
+		std::atomic<UInt64> capturedFrames;
+		std::atomic<Float64> capturedSampleTime;
+		
+		// sample time minus capture buffer sequence number, set before each
+		// write so a reader that sees the write sees it too
+		std::atomic<Float64> captureTimeOffset;
 		
-	private:
-		unsigned int _bufferSize;
+		DSPNodeContext();
+		void setCaptureBufferSize(UInt32 channels, unsigned int samplesToBuffer);
 	};
 	struct NodeImpl
 	{
@@ -72,11 +79,22 @@ public:
 protected:
 	std::shared_ptr<NodeImpl> _impl;
 
-	void getSamplesFromChannel(std::vector<Float32> &samples, unsigned int channel) const;
+	// returns the capture sequence number just past the last sample copied
+	UInt64 getSamplesFromChannel(std::vector<Float32> &samples, unsigned int channel) const;
+	
+	// total number of frames that have passed through the node, and the
+	// sample time of the end of the most recently buffered render cycle
+	UInt64 getCapturedFrameCount() const;
+	Float64 getCapturedSampleTime() const;
+	
+	// the sample time of a capture sequence number, e.g. the one returned by
+	// getSamplesFromChannel(). Exact as long as the source's sample times
+	// run on from one render cycle to the next
+	Float64 getCapturedSampleTime(UInt64 sequence) const;
 	
 	
 	
-	// sets the internal circular buffer size
+	// sets the internal capture buffer size
 	void setBufferSize(unsigned int samplesToBuffer);
 	unsigned int getBufferSize() const;
 	
@@ -0,0 +1,409 @@
+#include "ofxAudioUnitDiskPlayer.h"
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static const std::chrono::milliseconds kPollInterval(5);
+static const size_t kAlignment = 4096;
+
+static SInt64 Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDiskPlayer::ofxAudioUnitDiskPlayer()
+: _fd(-1)
+, _frameBytes(0)
+, _playing(false)
+, _position(0)
+, _seekRequested(0)
+, _seekFrame(0)
+, _seekRequestedAt(0)
+, _segmentSerial(0)
+, _segmentStart(0)
+, _segmentFrame(0)
+, _endCount(UINT64_MAX)
+, _seenSerial(0)
+, _cursor(0)
+, _cursorStart(0)
+, _cursorFrame(0)
+, _readCount(0)
+, _running(false)
+, _readBuffer(NULL)
+, _readBytes(0)
+, _carryBytes(0)
+, _chunkFrames(0)
+, _ioSerial(0)
+, _published(false)
+, _pendingStart(0)
+, _pendingFrame(0)
+, _fileFrame(0)
+, _readOffset(0)
+, _skip(0)
+, _carry(0)
+, _underruns(0)
+, _underrunFrames(0)
+, _reads(0)
+, _bytesRead(0)
+, _readSeconds(0)
+, _maxReadSeconds(0)
+, _lastSeekSeconds(0)
+, _failed(false)
+// ----------------------------------------------------------
+{
+	memset(&_info, 0, sizeof(_info));
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDiskPlayer::~ofxAudioUnitDiskPlayer()
+// ----------------------------------------------------------
+{
+	close();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDiskPlayer::open(const std::string &filePath, double readAheadSeconds, size_t readBytes)
+// ----------------------------------------------------------
+{
+	close();
+
+	ofxAudioUnitWavReader::Info info;
+	if(!ofxAudioUnitWavReader::readInfo(filePath, info)) return false;
+
+	const int fd = ::open(filePath.c_str(), O_RDONLY);
+	if(fd < 0) {
+		std::cout << "Couldn't open audio file: " << filePath << " (" << strerror(errno) << ")" << std::endl;
+		return false;
+	}
+#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	const size_t frameBytes = ofxAudioUnitSampleConverter::bytesPerSample(info.format) * info.channels;
+	readBytes = std::max<size_t>((readBytes + kAlignment - 1) / kAlignment * kAlignment, kAlignment);
+	const size_t carryBytes = (frameBytes + kAlignment - 1) / kAlignment * kAlignment;
+
+	unsigned char * readBuffer = NULL;
+	if(posix_memalign((void **)&readBuffer, kAlignment, carryBytes + readBytes) != 0) {
+		std::cout << "Couldn't allocate a read buffer for " << filePath << std::endl;
+		::close(fd);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(_fileMutex);
+	_filePath = filePath;
+	_info = info;
+	_fd = fd;
+	_frameBytes = frameBytes;
+	_readBuffer = readBuffer;
+	_readBytes = readBytes;
+	_carryBytes = carryBytes;
+
+	// Everything either thread touches is allocated here. The ring has room
+	// for at least two reads, so the I/O thread always has somewhere to put
+	// the next one while the render thread plays the last
+	_chunkFrames = (carryBytes + readBytes) / frameBytes + 1;
+	const size_t capacity = std::max<size_t>(readAheadSeconds * info.sampleRate, _chunkFrames * 2);
+	_ring.allocate(info.channels, capacity);
+
+	_scratch.resize(_chunkFrames * info.channels);
+	_scratchPlanes.resize(info.channels);
+	_scratchListStorage.resize(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * info.channels);
+	scratchList()->mNumberBuffers = info.channels;
+	for(unsigned int c = 0; c < info.channels; c++) {
+		_scratchPlanes[c] = &_scratch[c * _chunkFrames];
+		scratchList()->mBuffers[c].mNumberChannels = 1;
+		scratchList()->mBuffers[c].mDataByteSize = _chunkFrames * sizeof(Float32);
+		scratchList()->mBuffers[c].mData = _scratchPlanes[c];
+	}
+
+	// the ring starts over at 0, so the render thread has to pick up the
+	// first segment afresh
+	_playing.store(false);
+	_segmentSerial.store(_seekRequested.load());
+	_ioSerial = _seekRequested.load();
+	_seenSerial = UINT64_MAX;
+	_cursor = 0;
+	_readCount.store(0);
+	_endCount.store(UINT64_MAX);
+
+	_underruns.store(0);
+	_underrunFrames.store(0);
+	_reads.store(0);
+	_bytesRead.store(0);
+	_readSeconds.store(0);
+	_maxReadSeconds.store(0);
+	_lastSeekSeconds.store(0);
+	_failed.store(false);
+
+	setPosition(0);
+	_running.store(true);
+	_thread = std::thread(&ofxAudioUnitDiskPlayer::run, this);
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskPlayer::close()
+// ----------------------------------------------------------
+{
+	if(_thread.joinable()) {
+		_running.store(false);
+		_thread.join();
+	}
+
+	std::lock_guard<std::mutex> lock(_fileMutex);
+	if(_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+	free(_readBuffer);
+	_readBuffer = NULL;
+	_playing.store(false);
+}
+
+#pragma mark - Transport
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskPlayer::play()
+// ----------------------------------------------------------
+{
+	if(_fd < 0) return;
+	if(getPosition() >= _info.frames) setPosition(0);
+	_playing.store(true, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskPlayer::stop()
+// ----------------------------------------------------------
+{
+	_playing.store(false, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskPlayer::setPosition(UInt64 frame)
+// ----------------------------------------------------------
+{
+	_seekFrame.store(std::min(frame, _info.frames), std::memory_order_relaxed);
+	_seekRequestedAt.store(Now(), std::memory_order_relaxed);
+	_seekRequested.fetch_add(1, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitDiskPlayer::getPosition() const
+// ----------------------------------------------------------
+{
+	if(!isReady()) return _seekFrame.load(std::memory_order_relaxed);
+	return _position.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDiskPlayer::isReady() const
+// ----------------------------------------------------------
+{
+	return _segmentSerial.load(std::memory_order_acquire) == _seekRequested.load(std::memory_order_acquire);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDiskPlayer::Stats ofxAudioUnitDiskPlayer::getStats() const
+// ----------------------------------------------------------
+{
+	Stats stats;
+	stats.underruns = _underruns;
+	stats.underrunFrames = _underrunFrames;
+	stats.reads = _reads;
+	stats.bytesRead = _bytesRead;
+	stats.meanReadMs = stats.reads > 0 ? _readSeconds.load() / stats.reads * 1000 : 0;
+	stats.maxReadMs = _maxReadSeconds.load() * 1000;
+	stats.lastSeekMs = _lastSeekSeconds.load() * 1000;
+	stats.failed = _failed;
+
+	const UInt64 written = _ring.getWriteCount();
+	const UInt64 read = std::max(_readCount.load(), _segmentStart.load());
+	stats.bufferedFrames = isReady() && written > read ? written - read : 0;
+	return stats;
+}
+
+#pragma mark - Render thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskPlayer::render(UInt32 frames, AudioBufferList * bufferList)
+// ----------------------------------------------------------
+{
+	UInt32 done = 0;
+
+	// if the file's being swapped, this cycle is silent
+	std::unique_lock<std::mutex> lock(_fileMutex, std::try_to_lock);
+	if(lock.owns_lock() && _fd >= 0 && _playing.load(std::memory_order_relaxed)) {
+
+		// the segment the I/O thread is reading, as long as it's the one the
+		// last seek asked for (otherwise it's silence until it is)
+		const UInt64 requested = _seekRequested.load(std::memory_order_acquire);
+		const UInt64 serial = _segmentSerial.load(std::memory_order_acquire);
+		const UInt64 segmentStart = _segmentStart.load(std::memory_order_relaxed);
+		const UInt64 segmentFrame = _segmentFrame.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if(serial == requested && _segmentSerial.load(std::memory_order_relaxed) == serial) {
+			if(serial != _seenSerial) {
+				_seenSerial = serial;
+				_cursor = _cursorStart = segmentStart;
+				_cursorFrame = segmentFrame;
+			}
+
+			const UInt64 end = _endCount.load(std::memory_order_acquire);
+			UInt64 available = _ring.getWriteCount() - _cursor;
+			if(end != UINT64_MAX) available = end > _cursor ? std::min(available, end - _cursor) : 0;
+
+			UInt32 count = std::min<UInt64>(frames, available);
+			bool copied = true;
+			for(UInt32 b = 0; b < bufferList->mNumberBuffers; b++) {
+				Float32 * out = (Float32 *)bufferList->mBuffers[b].mData;
+				copied = _ring.read(b % _ring.channels(), _cursor, out, count) && copied;
+			}
+			if(!copied) count = 0;
+
+			_cursor += count;
+			done = count;
+			_readCount.store(_cursor, std::memory_order_release);
+			_position.store(_cursorFrame + (_cursor - _cursorStart), std::memory_order_relaxed);
+
+			if(done < frames) {
+				if(end != UINT64_MAX && _cursor >= end) {
+					_playing.store(false, std::memory_order_relaxed);
+				} else {
+					_underruns++;
+					_underrunFrames.fetch_add(frames - done, std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+
+	for(UInt32 b = 0; b < bufferList->mNumberBuffers; b++) {
+		Float32 * out = (Float32 *)bufferList->mBuffers[b].mData;
+		std::fill(out + done, out + frames, 0);
+	}
+}
+
+#pragma mark - I/O thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskPlayer::run()
+// ----------------------------------------------------------
+{
+	while(_running.load(std::memory_order_acquire)) {
+		const UInt64 requested = _seekRequested.load(std::memory_order_acquire);
+		if(requested != _ioSerial) {
+			_ioSerial = requested;
+			beginSegment(_seekFrame.load(std::memory_order_relaxed));
+		}
+
+		if(!fill()) {
+			std::this_thread::sleep_for(kPollInterval);
+		}
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskPlayer::beginSegment(UInt64 frame)
+// ----------------------------------------------------------
+{
+	// everything read ahead so far is thrown away; the new segment starts
+	// wherever the ring's got to
+	_pendingStart = _ring.getWriteCount();
+	_pendingFrame = frame;
+	_published = false;
+	_endCount.store(UINT64_MAX, std::memory_order_relaxed);
+
+	const UInt64 byte = _info.dataOffset + frame * _frameBytes;
+	_readOffset = byte / kAlignment * kAlignment;
+	_skip = byte - _readOffset;
+	_carry = 0;
+	_fileFrame = frame;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskPlayer::publish()
+// ----------------------------------------------------------
+{
+	// a sequence lock: the render thread ignores the segment while the serial
+	// is UINT64_MAX, or if it changes while it's reading it
+	_segmentSerial.store(UINT64_MAX, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	_segmentStart.store(_pendingStart, std::memory_order_relaxed);
+	_segmentFrame.store(_pendingFrame, std::memory_order_relaxed);
+	_position.store(_pendingFrame, std::memory_order_relaxed);
+	_segmentSerial.store(_ioSerial, std::memory_order_release);
+	_published = true;
+
+	_lastSeekSeconds.store((Now() - _seekRequestedAt.load(std::memory_order_relaxed)) * 1e-9, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDiskPlayer::fill()
+// ----------------------------------------------------------
+{
+	if(_fileFrame >= _info.frames || _failed.load(std::memory_order_relaxed)) {
+		if(_endCount.load(std::memory_order_relaxed) == UINT64_MAX) {
+			_endCount.store(_ring.getWriteCount(), std::memory_order_release);
+		}
+		if(!_published) publish();
+		return false;
+	}
+
+	// room for another read? Everything before the segment started is free,
+	// whether the render thread has got to it or not
+	const UInt64 written = _ring.getWriteCount();
+	const UInt64 read = std::max(_readCount.load(std::memory_order_acquire), _pendingStart);
+	if(written - read + _chunkFrames > _ring.capacity()) return false;
+
+	// the read goes in after the room for a partial frame, which the last
+	// read's leftover bytes sit at the end of
+	const Clock::time_point start = Clock::now();
+	unsigned char * const readTo = _readBuffer + _carryBytes;
+	size_t got = 0;
+	while(got < _readBytes) {
+		const ssize_t n = pread(_fd, readTo + got, _readBytes - got, _readOffset + got);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		got += n;
+	}
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	_reads++;
+	_bytesRead.fetch_add(got, std::memory_order_relaxed);
+	_readSeconds.store(_readSeconds.load(std::memory_order_relaxed) + seconds, std::memory_order_relaxed);
+	if(seconds > _maxReadSeconds.load(std::memory_order_relaxed)) _maxReadSeconds.store(seconds, std::memory_order_relaxed);
+
+	const unsigned char * data = readTo - _carry + _skip;
+	const size_t bytes = _carry + got > _skip ? _carry + got - _skip : 0;
+	const size_t frames = std::min<UInt64>(bytes / _frameBytes, _info.frames - _fileFrame);
+
+	if(frames == 0) {
+		std::cout << "Error reading " << _filePath << " at byte " << _readOffset << std::endl;
+		_failed.store(true, std::memory_order_relaxed);
+		return true;
+	}
+
+	ofxAudioUnitSampleConverter::deinterleave(data, _info.format, _info.channels, frames, &_scratchPlanes[0]);
+	_ring.write(scratchList(), frames);
+
+	// keep any partial frame for the next read
+	const size_t leftover = bytes - frames * _frameBytes;
+	_carry = leftover < _frameBytes ? leftover : 0;
+	memmove(readTo - _carry, data + frames * _frameBytes, _carry);
+
+	_readOffset += got;
+	_skip = 0;
+	_fileFrame += frames;
+
+	if(!_published) publish();
+	return true;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include "ofxAudioUnitWavReader.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ofxAudioUnitDiskPlayer streams a WAV or RF64 file from disk to a render
+// thread, for files too long to keep in memory and disks too slow to touch
+// from the render thread (hours of audio on a spinning disk, say). It's the
+// playback counterpart of ofxAudioUnitDiskRecorder.
+
+// An I/O thread of its own reads the file in large reads (1 MB by default)
+// at offsets aligned to 4 KB, converts them to floats, and keeps a ring (an
+// ofxAudioUnitCaptureBuffer) filled up to a read-ahead window ahead of the
+// play head. The render thread only copies out of the ring, so it never
+// blocks, allocates or waits for the disk. If the disk falls behind and the
+// ring runs dry, the rest of the cycle is silence and the underrun is
+// counted; playback carries on from where it was when the audio arrives.
+
+// Seeking doesn't wait for anything either. setPosition() just posts the new
+// position; the render thread plays silence from then on until the I/O
+// thread has thrown away what it had read ahead and read the first block at
+// the new position, then carries on from there. How long that took is in
+// the stats, along with how long reads take.
+
+// open() and close() are for the main thread; swapping files while the
+// render thread is running costs at most a silent cycle.
+
+class ofxAudioUnitDiskPlayer
+{
+public:
+	struct Stats {
+		UInt64 underruns;      // render cycles that ran out of audio before the end of the file
+		UInt64 underrunFrames;
+		UInt64 bufferedFrames; // read ahead of the play head right now
+		UInt64 reads;
+		UInt64 bytesRead;
+		double meanReadMs;
+		double maxReadMs;
+		double lastSeekMs;     // from setPosition() to audio at the new position being ready
+		bool failed;           // a read failed; playback stops where it did
+	};
+
+	ofxAudioUnitDiskPlayer();
+	~ofxAudioUnitDiskPlayer();
+
+	// readAheadSeconds is how far ahead of the play head the I/O thread
+	// reads, and so the longest disk stall playback rides out. readBytes is
+	// the size of each read (rounded up to 4 KB). Returns straight away; the
+	// first block is read in the background
+	bool open(const std::string &filePath, double readAheadSeconds = 4, size_t readBytes = 1 << 20);
+	void close();
+
+	bool isOpen() const {return _fd >= 0;}
+	const std::string& getFilePath() const {return _filePath;}
+	const ofxAudioUnitWavReader::Info& getInfo() const {return _info;}
+
+	// plays from the current position, or from the top if it's at the end
+	void play();
+	void stop();
+	bool isPlaying() const {return _playing.load(std::memory_order_relaxed);}
+
+	// drops what's been read ahead and starts reading at `frame`. Never blocks
+	void setPosition(UInt64 frame);
+	UInt64 getPosition() const;
+
+	// true once there's audio at the current position ready to play
+	bool isReady() const;
+
+	// Render thread: the file's channel c % (file channels) into buffer c,
+	// silence past the end, while stopped or seeking, or on an underrun
+	void render(UInt32 frames, AudioBufferList * bufferList);
+
+	Stats getStats() const;
+
+private:
+	std::mutex _fileMutex; // held by open() and close(); render() only tries it
+	std::string _filePath;
+	ofxAudioUnitWavReader::Info _info;
+	int _fd;
+	size_t _frameBytes;
+	ofxAudioUnitCaptureBuffer _ring;
+
+	std::atomic<bool> _playing;
+	std::atomic<UInt64> _position;
+
+	// Seeks: setPosition() bumps _seekRequested. The I/O thread answers by
+	// publishing where in the ring the new position starts, under the same
+	// serial number
+	std::atomic<UInt64> _seekRequested;
+	std::atomic<UInt64> _seekFrame;
+	std::atomic<SInt64> _seekRequestedAt; // steady clock nanoseconds
+	std::atomic<UInt64> _segmentSerial;
+	std::atomic<UInt64> _segmentStart; // the ring frame the position starts at
+	std::atomic<UInt64> _segmentFrame; // the file frame it is
+	std::atomic<UInt64> _endCount;     // the ring frame the file ends at, once it's been read to the end
+
+	// render thread
+	UInt64 _seenSerial;
+	UInt64 _cursor;
+	UInt64 _cursorStart; // _segmentStart and _segmentFrame of the segment being played
+	UInt64 _cursorFrame;
+	std::atomic<UInt64> _readCount; // _cursor, for the I/O thread
+
+	// I/O thread
+	std::thread _thread;
+	std::atomic<bool> _running;
+	unsigned char * _readBuffer;
+	size_t _readBytes;
+	size_t _carryBytes; // room in front of the read buffer for a partial frame left from the last read
+	size_t _chunkFrames;
+	UInt64 _ioSerial;
+	bool _published;
+	UInt64 _pendingStart; // the ring frame and file frame the segment being read starts at
+	UInt64 _pendingFrame;
+	UInt64 _fileFrame;  // the next frame to go into the ring
+	UInt64 _readOffset; // the next (aligned) byte to read
+	size_t _skip;       // bytes to skip at the start of the next read
+	size_t _carry;      // bytes of a partial frame left over from the last read
+	std::vector<Float32> _scratch;
+	std::vector<Float32 *> _scratchPlanes;
+	std::vector<char> _scratchListStorage;
+
+	std::atomic<UInt64> _underruns;
+	std::atomic<UInt64> _underrunFrames;
+	std::atomic<UInt64> _reads;
+	std::atomic<UInt64> _bytesRead;
+	std::atomic<double> _readSeconds;
+	std::atomic<double> _maxReadSeconds;
+	std::atomic<double> _lastSeekSeconds;
+	std::atomic<bool> _failed;
+
+	ofxAudioUnitDiskPlayer(const ofxAudioUnitDiskPlayer &);
+	ofxAudioUnitDiskPlayer& operator=(const ofxAudioUnitDiskPlayer &);
+
+	AudioBufferList * scratchList() {return (AudioBufferList *)&_scratchListStorage[0];}
+	void run();
+	void beginSegment(UInt64 frame);
+	bool fill();
+	void publish();
+};
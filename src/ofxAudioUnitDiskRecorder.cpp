@@ -0,0 +1,543 @@
+#include "ofxAudioUnitDiskRecorder.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// how often the writer thread checks the ring when there isn't much in it
+static const std::chrono::milliseconds kPollInterval(10);
+
+// Batches are big enough that the file sees a few large writes a second
+// rather than one per render cycle, and small enough that stopping doesn't
+// take long
+static const double kMinBatchSeconds = 0.1;
+static const size_t kMaxBatchFrames = 32768;
+
+// the WAV writer's header, which counts towards a segment's size
+static const UInt64 kWavHeaderBytes = 4096;
+
+// ----------------------------------------------------------
+ofxAudioUnitDiskRecorder::ofxAudioUnitDiskRecorder()
+: _running(false)
+, _stopAt(0)
+, _sampleRate(0)
+, _dither(OFXAU_DITHER_NONE)
+, _armed(false)
+, _armedAt(0)
+, _preRollFrames(0)
+, _anchorSequence(0)
+, _anchorFrame(0)
+, _anchorSampleTime(NAN)
+, _anchorHostTime(NAN)
+, _rotateSeconds(0)
+, _rotateBytes(0)
+, _format(OFXAU_WAV_INT24)
+, _segmentFrames(0)
+, _startCursor(0)
+, _readCursor(0)
+, _recordedFrames(0)
+, _bytesBefore(0)
+, _pendingSilence(0)
+, _minBatchFrames(0)
+, _maxBatchFrames(0)
+, _cursor(0)
+, _framesWritten(0)
+, _bytesWritten(0)
+, _droppedFrames(0)
+, _maxBacklog(0)
+, _preRolled(0)
+, _segmentNumber(0)
+, _failed(false)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDiskRecorder::~ofxAudioUnitDiskRecorder()
+// ----------------------------------------------------------
+{
+	stop();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDiskRecorder::start(const std::string &filePath, unsigned int channels, Float64 sampleRate, ofxAudioUnitWavFormat format, double ringSeconds)
+// ----------------------------------------------------------
+{
+	stop();
+
+	// the render thread is still writing to an armed ring, so it stays as is
+	if(_armed && (channels != _ring.channels() || sampleRate != _sampleRate)) {
+		std::cout << "Can't record " << channels << " channels at " << sampleRate << " Hz with a recorder armed for ";
+		std::cout << _ring.channels() << " channels at " << _sampleRate << " Hz" << std::endl;
+		return false;
+	}
+
+	// a segment's length, if it's limited by size and/or duration
+	_segmentFrames = 0;
+	if(_rotateSeconds > 0 || _rotateBytes > 0) {
+		_segmentFrames = UINT64_MAX;
+		if(_rotateSeconds > 0) {
+			_segmentFrames = std::max<UInt64>(_rotateSeconds * sampleRate, 1);
+		}
+		if(_rotateBytes > 0) {
+			const UInt64 frameBytes = ofxAudioUnitWavWriter::bytesPerSample(format) * channels;
+			const UInt64 dataBytes = _rotateBytes > kWavHeaderBytes ? _rotateBytes - kWavHeaderBytes : 0;
+			_segmentFrames = std::min<UInt64>(_segmentFrames, std::max<UInt64>(dataBytes / frameBytes, 1));
+		}
+	}
+
+	_filePath = filePath;
+	_format = format;
+	_file.reset(new ofxAudioUnitWavWriter);
+	_file->setDither(_dither);
+	if(!_file->open(_segmentFrames ? segmentPath(filePath, 1) : filePath, channels, sampleRate, format)) {
+		_file.reset();
+		return false;
+	}
+
+	if(!_armed) {
+		allocateRing(channels, sampleRate, ringSeconds);
+	}
+
+	const size_t capacity = _ring.capacity();
+	_maxBatchFrames = std::min(kMaxBatchFrames, capacity / 2);
+	_minBatchFrames = std::min<size_t>(sampleRate * kMinBatchSeconds, _maxBatchFrames);
+
+	_scratch.assign(channels * _maxBatchFrames, 0);
+	_scratchPlanes.resize(channels);
+	_writePlanes.resize(channels);
+	_scratchListStorage.assign(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channels, 0);
+	scratchList()->mNumberBuffers = channels;
+	for(unsigned int c = 0; c < channels; c++) {
+		_scratchPlanes[c] = &_scratch[c * _maxBatchFrames];
+		scratchList()->mBuffers[c].mNumberChannels = 1;
+		scratchList()->mBuffers[c].mDataByteSize = _maxBatchFrames * sizeof(Float32);
+		scratchList()->mBuffers[c].mData = _scratchPlanes[c];
+	}
+
+	// Recording starts from whatever the render thread writes next, or as much
+	// of the pre-roll as there is. Everything after this one read of the write
+	// count is the writer thread's business
+	const UInt64 end = _ring.getWriteCount();
+	const UInt64 available = _armed ? std::min<UInt64>(end - _armedAt, _preRollFrames) : 0;
+	_readCursor = end - available;
+	_startCursor = _readCursor;
+	_preRolled.store(available);
+	_pendingSilence = 0;
+	_recordedFrames = 0;
+	_bytesBefore = 0;
+	_cursor.store(_readCursor);
+	_framesWritten.store(0);
+	_bytesWritten.store(0);
+	_droppedFrames.store(0);
+	_maxBacklog.store(0);
+	_failed.store(false);
+
+	beginSegment(1, 0);
+	if(_segmentFrames) {
+		_nextFile = openInBackground(2, std::unique_ptr<ofxAudioUnitWavWriter>(), _segment);
+	}
+
+	_running.store(true);
+	_thread = std::thread(&ofxAudioUnitDiskRecorder::run, this);
+
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDiskRecorder::stop()
+// ----------------------------------------------------------
+{
+	if(!_thread.joinable()) return false;
+
+	// an armed ring is still being written to, so pick a place to end
+	_stopAt.store(_ring.getWriteCount(), std::memory_order_relaxed);
+	_running.store(false, std::memory_order_release);
+	_thread.join();
+
+	// waiting on the next segment's file also waits for the one before to be
+	// finished. It was opened for nothing, so it goes
+	if(_nextFile.valid()) {
+		std::unique_ptr<ofxAudioUnitWavWriter> unused = _nextFile.get();
+		if(unused && unused->isOpen()) {
+			const std::string unusedPath = unused->getFilePath();
+			unused->close();
+			remove(unusedPath.c_str());
+		}
+	}
+
+	if(_file) {
+		finishSegment(*_file, _segment);
+		_file.reset();
+	}
+
+	return !_failed.load();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::write(const AudioBufferList * bufferList, UInt32 frames, Float64 sampleTime, Float64 hostTime)
+// ----------------------------------------------------------
+{
+	if(sampleTime == sampleTime || hostTime == hostTime) {
+		const UInt32 sequence = _anchorSequence.load(std::memory_order_relaxed);
+		_anchorSequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		_anchorFrame.store(_ring.getWriteCount(), std::memory_order_relaxed);
+		_anchorSampleTime.store(sampleTime, std::memory_order_relaxed);
+		_anchorHostTime.store(hostTime, std::memory_order_relaxed);
+		_anchorSequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	_ring.write(bufferList, frames);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::setRotation(double maxSeconds, UInt64 maxBytes)
+// ----------------------------------------------------------
+{
+	_rotateSeconds = std::max(maxSeconds, 0.);
+	_rotateBytes = maxBytes;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDiskRecorder::Stats ofxAudioUnitDiskRecorder::getStats() const
+// ----------------------------------------------------------
+{
+	Stats stats;
+	const UInt64 cursor = _cursor.load(std::memory_order_acquire);
+	const UInt64 end = _ring.getWriteCount();
+	stats.framesWritten = _framesWritten.load(std::memory_order_relaxed);
+	stats.bytesWritten = _bytesWritten.load(std::memory_order_relaxed);
+	stats.droppedFrames = _droppedFrames.load(std::memory_order_relaxed);
+	stats.backlog = end > cursor ? end - cursor : 0;
+	stats.maxBacklog = _maxBacklog.load(std::memory_order_relaxed);
+	stats.preRollFrames = _preRolled.load(std::memory_order_relaxed);
+	stats.segment = _segmentNumber.load(std::memory_order_relaxed);
+	stats.failed = _failed.load(std::memory_order_relaxed);
+	return stats;
+}
+
+#pragma mark - Pre-roll
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDiskRecorder::arm(unsigned int channels, Float64 sampleRate, double preRollSeconds, double ringSeconds)
+// ----------------------------------------------------------
+{
+	stop();
+
+	if(channels == 0 || sampleRate <= 0 || preRollSeconds <= 0) {
+		disarm();
+		return false;
+	}
+
+	// room for the pre-roll, plus the usual margin for the writer thread to
+	// work through it while the render thread carries on
+	allocateRing(channels, sampleRate, preRollSeconds + ringSeconds);
+	_preRollFrames = sampleRate * preRollSeconds;
+	_armedAt = _ring.getWriteCount();
+	_armed = true;
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::rearm()
+// ----------------------------------------------------------
+{
+	_armedAt = _ring.getWriteCount();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::disarm()
+// ----------------------------------------------------------
+{
+	_armed = false;
+	_preRollFrames = 0;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::allocateRing(unsigned int channels, Float64 sampleRate, double seconds)
+// ----------------------------------------------------------
+{
+	// Everything the render thread touches is allocated here. The ring keeps
+	// its allocation across recordings of the same shape, in case a render
+	// cycle that started before the last stop() is still finishing
+	const size_t capacity = std::max<size_t>(sampleRate * seconds, 4096);
+	if(_ring.channels() != channels || _ring.capacity() != capacity) {
+		_ring.allocate(channels, capacity);
+	}
+	_sampleRate = sampleRate;
+}
+
+#pragma mark - Writer thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::run()
+// ----------------------------------------------------------
+{
+	while(_running.load(std::memory_order_acquire)) {
+		if(!drain(_minBatchFrames, UINT64_MAX)) {
+			std::this_thread::sleep_for(kPollInterval);
+		}
+	}
+
+	// write out the rest, up to where stop() was called
+	drain(1, _stopAt.load(std::memory_order_relaxed));
+	writeSilence();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDiskRecorder::drain(size_t minFrames, UInt64 limit)
+// ----------------------------------------------------------
+{
+	bool wrote = false;
+
+	while(true) {
+		const UInt64 end = _ring.getWriteCount();
+		const UInt64 backlog = std::min(end, std::max(limit, _readCursor)) - _readCursor;
+
+		if(backlog > _maxBacklog.load(std::memory_order_relaxed)) {
+			_maxBacklog.store(backlog, std::memory_order_relaxed);
+		}
+
+		if(backlog > _ring.capacity()) {
+			skipAhead(end);
+			continue;
+		}
+
+		if(backlog == 0 || backlog < minFrames) break;
+
+		writeSilence();
+
+		const size_t frames = std::min<UInt64>(backlog, _maxBatchFrames);
+		if(!_ring.read(_readCursor, frames, scratchList())) {
+			// lapped while copying
+			skipAhead(_ring.getWriteCount());
+			continue;
+		}
+
+		writeFile(frames);
+		_readCursor += frames;
+		_cursor.store(_readCursor, std::memory_order_release);
+		wrote = true;
+	}
+
+	return wrote;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::skipAhead(UInt64 end)
+// ----------------------------------------------------------
+{
+	// resume a quarter of the ring behind the writer, so there's room to
+	// catch up before it laps us again
+	const size_t capacity = _ring.capacity();
+	const UInt64 resume = end - (capacity - capacity / 4);
+	if(resume <= _readCursor) return;
+
+	_droppedFrames.fetch_add(resume - _readCursor, std::memory_order_relaxed);
+	_pendingSilence += resume - _readCursor;
+	_readCursor = resume;
+	_cursor.store(_readCursor, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::writeSilence()
+// ----------------------------------------------------------
+{
+	while(_pendingSilence > 0) {
+		const size_t frames = std::min<UInt64>(_pendingSilence, _maxBatchFrames);
+		std::fill(_scratch.begin(), _scratch.end(), 0);
+		writeFile(frames);
+		_pendingSilence -= frames;
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::writeFile(size_t frames)
+// ----------------------------------------------------------
+{
+	size_t done = 0;
+
+	// after a write error there's nowhere for the audio to go, but the ring
+	// keeps being drained so it isn't all reported as dropped
+	while(done < frames && !_failed.load(std::memory_order_relaxed)) {
+		if(_segmentFrames && _segment.frames >= _segmentFrames && !rotate()) {
+			_failed.store(true, std::memory_order_relaxed);
+			break;
+		}
+
+		size_t count = frames - done;
+		if(_segmentFrames) {
+			count = std::min<UInt64>(count, _segmentFrames - _segment.frames);
+		}
+
+		if(_segment.frames == 0) {
+			findSegmentTimes();
+		}
+
+		for(size_t c = 0; c < _writePlanes.size(); c++) {
+			_writePlanes[c] = _scratchPlanes[c] + done;
+		}
+
+		if(!_file->write(&_writePlanes[0], count)) {
+			_failed.store(true, std::memory_order_relaxed);
+			break;
+		}
+
+		_segment.frames += count;
+		_recordedFrames += count;
+		done += count;
+	}
+
+	_framesWritten.store(_recordedFrames, std::memory_order_relaxed);
+	_bytesWritten.store(_bytesBefore + (_file ? _file->getBytesWritten() : 0), std::memory_order_relaxed);
+}
+
+#pragma mark - Rotation
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitDiskRecorder::segmentPath(const std::string &filePath, unsigned int segment)
+// ----------------------------------------------------------
+{
+	std::ostringstream suffix;
+	suffix << "-" << std::setw(4) << std::setfill('0') << segment;
+
+	const size_t slash = filePath.find_last_of('/');
+	const size_t dot = filePath.find_last_of('.');
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return filePath + suffix.str();
+	}
+	return filePath.substr(0, dot) + suffix.str() + filePath.substr(dot);
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitDiskRecorder::indexPath(const std::string &segmentPath)
+// ----------------------------------------------------------
+{
+	const size_t slash = segmentPath.find_last_of('/');
+	const size_t dot = segmentPath.find_last_of('.');
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return segmentPath + ".json";
+	}
+	return segmentPath.substr(0, dot) + ".json";
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitDiskRecorder::rotate()
+// ----------------------------------------------------------
+{
+	// opened in the background while the last segment was being written, so
+	// normally this doesn't wait
+	std::unique_ptr<ofxAudioUnitWavWriter> next = _nextFile.valid() ? _nextFile.get() : std::unique_ptr<ofxAudioUnitWavWriter>();
+	if(!next || !next->isOpen()) {
+		std::cout << "Couldn't open the next segment of " << _filePath << std::endl;
+		return false;
+	}
+
+	std::unique_ptr<ofxAudioUnitWavWriter> finished = std::move(_file);
+	const Segment finishedSegment = _segment;
+	_bytesBefore += finished->getBytesWritten();
+
+	_file = std::move(next);
+	beginSegment(finishedSegment.number + 1, finishedSegment.startFrame + finishedSegment.frames);
+	_nextFile = openInBackground(_segment.number + 1, std::move(finished), finishedSegment);
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::beginSegment(unsigned int number, UInt64 startFrame)
+// ----------------------------------------------------------
+{
+	_segment.path = _file->getFilePath();
+	_segment.number = number;
+	_segment.startFrame = startFrame;
+	_segment.frames = 0;
+	_segment.startSampleTime = NAN;
+	_segment.startHostTime = NAN;
+	_segmentNumber.store(number, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::findSegmentTimes()
+// ----------------------------------------------------------
+{
+	// the render thread may be mid-update, in which case the next try will do
+	for(int tries = 0; tries < 16; tries++) {
+		const UInt32 before = _anchorSequence.load(std::memory_order_acquire);
+		if(before & 1) continue;
+
+		const UInt64 frame = _anchorFrame.load(std::memory_order_relaxed);
+		const Float64 sampleTime = _anchorSampleTime.load(std::memory_order_relaxed);
+		const Float64 hostTime = _anchorHostTime.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if(_anchorSequence.load(std::memory_order_relaxed) == before) {
+			if(before == 0) return; // no timestamps yet
+
+			// the segment's first frame is somewhere before the latest block
+			const Float64 offset = (Float64)(_startCursor + _segment.startFrame) - (Float64)frame;
+			_segment.startSampleTime = sampleTime + offset;
+			_segment.startHostTime = hostTime + offset / _sampleRate;
+			return;
+		}
+	}
+}
+
+// ----------------------------------------------------------
+std::future<std::unique_ptr<ofxAudioUnitWavWriter> > ofxAudioUnitDiskRecorder::openInBackground(unsigned int number, std::unique_ptr<ofxAudioUnitWavWriter> finished, const Segment &segment)
+// ----------------------------------------------------------
+{
+	const std::string path = segmentPath(_filePath, number);
+	const unsigned int channels = _ring.channels();
+	const Float64 sampleRate = _sampleRate;
+	const ofxAudioUnitWavFormat format = _format;
+	const ofxAudioUnitDither dither = _file->getDither();
+	std::shared_ptr<ofxAudioUnitWavWriter> previous(finished.release());
+
+	return std::async(std::launch::async, [this, path, channels, sampleRate, format, dither, previous, segment] {
+		if(previous) {
+			finishSegment(*previous, segment);
+		}
+		std::unique_ptr<ofxAudioUnitWavWriter> next(new ofxAudioUnitWavWriter);
+		next->setDither(dither);
+		next->open(path, channels, sampleRate, format);
+		return next;
+	});
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitDiskRecorder::finishSegment(ofxAudioUnitWavWriter &file, const Segment &segment)
+// ----------------------------------------------------------
+{
+	if(!file.close()) {
+		_failed.store(true);
+	}
+
+	if(!_segmentFrames) return;
+
+	std::ofstream index(indexPath(segment.path).c_str());
+	index << std::setprecision(15);
+	index << "{\n";
+	index << "\t\"file\": \"" << segment.path.substr(segment.path.find_last_of('/') + 1) << "\",\n";
+	index << "\t\"segment\": " << segment.number << ",\n";
+	index << "\t\"sampleRate\": " << _sampleRate << ",\n";
+	index << "\t\"channels\": " << _ring.channels() << ",\n";
+	index << "\t\"startFrame\": " << segment.startFrame << ",\n";
+	index << "\t\"frames\": " << segment.frames << ",\n";
+	index << "\t\"startSampleTime\": ";
+	if(segment.startSampleTime == segment.startSampleTime) index << segment.startSampleTime; else index << "null";
+	index << ",\n";
+	index << "\t\"startHostTime\": ";
+	if(segment.startHostTime == segment.startHostTime) index << segment.startHostTime; else index << "null";
+	index << "\n}\n";
+
+	if(!index) {
+		std::cout << "Couldn't write the index for " << segment.path << std::endl;
+	}
+}
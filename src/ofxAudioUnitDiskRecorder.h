@@ -0,0 +1,175 @@
+#pragma once
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include "ofxAudioUnitWavWriter.h"
+#include <atomic>
+#include <future>
+#include <math.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ofxAudioUnitDiskRecorder streams audio from a render thread to a WAV file.
+// The render thread only copies each block into a preallocated ring (an
+// ofxAudioUnitCaptureBuffer) and returns. A writer thread of its own drains
+// the ring in large batches and hands them to an ofxAudioUnitWavWriter, so
+// nothing on the render thread allocates, locks or waits for the disk.
+
+// If the disk stalls for longer than the ring holds, the oldest unwritten
+// audio is overwritten and counted as dropped, and the file gets silence in
+// its place so everything after it stays in time. A slow disk costs a gap in
+// the recording rather than a glitch in the output.
+
+// arm() keeps the ring running with no file open, holding the last few
+// seconds of audio. start() on an armed recorder begins its file with that
+// pre-roll, picked with a single read of the ring's write count, and carries
+// on from there without a gap. It only has to open the file and start the
+// writer thread, so it takes the same time however long the pre-roll is;
+// the writer thread catches up on the pre-roll in the background.
+
+// With rotation turned on, a recording is split into segments of a set
+// length or size ("show.wav" -> "show-0001.wav", "show-0002.wav", ...), each
+// picking up on the frame after the last one ended. The next segment's file
+// is opened ahead of time, and the finished one closed, on a background
+// task, so the writer thread never waits on either. Every segment gets a
+// sidecar index ("show-0001.json") saying where in the recording it starts,
+// in frames, sample time and host time.
+
+// write() can carry on while an armed recorder starts and stops. Otherwise,
+// make sure the render thread has stopped calling write() before calling
+// start(), stop(), arm() or disarm().
+
+class ofxAudioUnitDiskRecorder
+{
+public:
+	struct Stats {
+		UInt64 framesWritten; // handed to the file
+		UInt64 bytesWritten;
+		UInt64 droppedFrames; // overwritten in the ring before the writer got to them
+		UInt64 backlog;       // frames waiting in the ring right now
+		UInt64 maxBacklog;
+		UInt64 preRollFrames; // how far before start() the file begins
+		unsigned int segment; // the file being written, counting from 1
+		bool failed;          // the file couldn't be written to
+	};
+
+	ofxAudioUnitDiskRecorder();
+	~ofxAudioUnitDiskRecorder();
+
+	// ringSeconds is how long a disk stall can get before audio is dropped.
+	// An armed recorder's channels and sample rate have to match
+	bool start(const std::string &filePath, unsigned int channels, Float64 sampleRate, ofxAudioUnitWavFormat format, double ringSeconds = 4);
+
+	// waits for the writer thread to write out everything up to now, then
+	// finishes the file. Returns false if anything went wrong writing it
+	bool stop();
+
+	bool isRecording() const {return _thread.joinable();}
+
+	// Keeps the last preRollSeconds of audio around for the next start(). Stops
+	// any recording in progress
+	bool arm(unsigned int channels, Float64 sampleRate, double preRollSeconds, double ringSeconds = 4);
+	void disarm();
+	bool isArmed() const {return _armed;}
+
+	// Forgets the pre-roll gathered so far, for when write() stopped being
+	// called for a while and the ring holds audio from before the gap
+	void rearm();
+
+	// Starts a new file every maxSeconds and/or maxBytes (0 for no limit),
+	// from the next start() on. 0, 0 turns rotation off
+	void setRotation(double maxSeconds, UInt64 maxBytes = 0);
+
+	// for 16 and 24 bit files, from the next start() on. Off by default
+	void setDither(ofxAudioUnitDither dither) {_dither = dither;}
+	ofxAudioUnitDither getDither() const {return _dither;}
+
+	// Render thread: copies frames into the ring. Never blocks or allocates.
+	// The block's sample time and host time (in seconds) only go in the
+	// rotation indexes, and can be NaN if they aren't known
+	void write(const AudioBufferList * bufferList, UInt32 frames, Float64 sampleTime = NAN, Float64 hostTime = NAN);
+
+	Stats getStats() const;
+
+	// "show.wav", 3 -> "show-0003.wav", and its index "show-0003.json"
+	static std::string segmentPath(const std::string &filePath, unsigned int segment);
+	static std::string indexPath(const std::string &segmentPath);
+
+private:
+	ofxAudioUnitCaptureBuffer _ring;
+	std::unique_ptr<ofxAudioUnitWavWriter> _file;
+	std::thread _thread;
+	std::atomic<bool> _running;
+	std::atomic<UInt64> _stopAt; // where the writer thread finishes once it's not running
+	Float64 _sampleRate;
+	ofxAudioUnitDither _dither;
+
+	bool _armed;
+	UInt64 _armedAt; // the ring's write count when it was armed
+	size_t _preRollFrames;
+
+	// Where the render thread's latest block started, as a ring frame and in
+	// sample and host time, under a sequence lock. The writer thread maps
+	// other frames from it
+	std::atomic<UInt32> _anchorSequence;
+	std::atomic<UInt64> _anchorFrame;
+	std::atomic<Float64> _anchorSampleTime;
+	std::atomic<Float64> _anchorHostTime;
+
+	// rotation
+	double _rotateSeconds;
+	UInt64 _rotateBytes;
+	std::string _filePath;
+	ofxAudioUnitWavFormat _format;
+	UInt64 _segmentFrames; // 0 when not rotating
+
+	struct Segment {
+		std::string path;
+		unsigned int number;
+		UInt64 startFrame;      // since the start of the recording
+		UInt64 frames;
+		Float64 startSampleTime;
+		Float64 startHostTime;
+	};
+	Segment _segment;
+	std::future<std::unique_ptr<ofxAudioUnitWavWriter> > _nextFile;
+
+	// writer thread
+	UInt64 _startCursor; // the ring frame the recording starts at
+	UInt64 _readCursor;
+	UInt64 _recordedFrames; // into every segment so far
+	UInt64 _bytesBefore;    // in the segments before this one
+	UInt64 _pendingSilence; // dropped frames the file still has to account for
+	size_t _minBatchFrames;
+	size_t _maxBatchFrames;
+	std::vector<Float32> _scratch;
+	std::vector<Float32 *> _scratchPlanes;
+	std::vector<const Float32 *> _writePlanes;
+	std::vector<char> _scratchListStorage;
+
+	std::atomic<UInt64> _cursor; // _readCursor, for stats
+	std::atomic<UInt64> _framesWritten;
+	std::atomic<UInt64> _bytesWritten;
+	std::atomic<UInt64> _droppedFrames;
+	std::atomic<UInt64> _maxBacklog;
+	std::atomic<UInt64> _preRolled;
+	std::atomic<unsigned int> _segmentNumber;
+	std::atomic<bool> _failed;
+
+	ofxAudioUnitDiskRecorder(const ofxAudioUnitDiskRecorder &);
+	ofxAudioUnitDiskRecorder& operator=(const ofxAudioUnitDiskRecorder &);
+
+	AudioBufferList * scratchList() {return (AudioBufferList *)&_scratchListStorage[0];}
+	void run();
+	bool drain(size_t minFrames, UInt64 limit);
+	void allocateRing(unsigned int channels, Float64 sampleRate, double seconds);
+	void writeSilence();
+	void writeFile(size_t frames);
+	void skipAhead(UInt64 end);
+	bool rotate();
+	void beginSegment(unsigned int number, UInt64 startFrame);
+	void findSegmentTimes();
+	void finishSegment(ofxAudioUnitWavWriter &file, const Segment &segment);
+	std::future<std::unique_ptr<ofxAudioUnitWavWriter> > openInBackground(unsigned int number, std::unique_ptr<ofxAudioUnitWavWriter> finished, const Segment &segment);
+};
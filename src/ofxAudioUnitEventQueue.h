@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+// ofxAudioUnitEventQueue passes small fixed-size events (triggers, stops,
+// parameter changes) to the render thread without locks or allocation. It's
+// a bounded ring for one producer and one consumer: push() from one thread
+// at a time (callers with several producers serialize them with a mutex of
+// their own, which is fine off the render thread), pop() from the render
+// thread. A full queue refuses the event rather than blocking.
+
+template<typename T>
+class ofxAudioUnitEventQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit ofxAudioUnitEventQueue(size_t capacity = 256)
+	: _head(0)
+	, _tail(0)
+	{
+		size_t size = 2;
+		while(size < capacity) size <<= 1;
+		_events.resize(size);
+		_mask = size - 1;
+	}
+
+	// Producer: false if the queue is full
+	bool push(const T &event)
+	{
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		if(tail - _head.load(std::memory_order_acquire) > _mask) return false;
+		_events[tail & _mask] = event;
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer: false if there's nothing to pop
+	bool pop(T &event)
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		if(head == _tail.load(std::memory_order_acquire)) return false;
+		event = _events[head & _mask];
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t capacity() const {return _mask + 1;}
+
+private:
+	std::vector<T> _events;
+	size_t _mask;
+	std::atomic<size_t> _head; // next to pop
+	std::atomic<size_t> _tail; // next to push
+
+	ofxAudioUnitEventQueue(const ofxAudioUnitEventQueue &);
+	ofxAudioUnitEventQueue& operator=(const ofxAudioUnitEventQueue &);
+};
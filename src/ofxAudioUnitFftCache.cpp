@@ -0,0 +1,94 @@
+#include "ofxAudioUnitFftCache.h"
+#include <map>
+#include <mutex>
+
+namespace {
+	std::mutex cacheMutex;
+	std::map<unsigned int, std::weak_ptr<OpaqueFFTSetup> > setups;
+	std::map<std::pair<int, size_t>, std::weak_ptr<const std::vector<float> > > windows;
+
+	template<typename Map>
+	size_t PruneExpired(Map &map)
+	{
+		for(typename Map::iterator it = map.begin(); it != map.end();) {
+			if(it->second.expired()) {
+				map.erase(it++);
+			} else {
+				++it;
+			}
+		}
+		return map.size();
+	}
+}
+
+// ----------------------------------------------------------
+void generateWindow(ofxAudioUnitWindowType windowType, float * window, size_t size)
+// ----------------------------------------------------------
+{
+	switch (windowType) {
+		case OFXAU_WINDOW_HAMMING:
+			vDSP_hamm_window(window, size, 0);
+			break;
+		case OFXAU_WINDOW_HANNING:
+			vDSP_hann_window(window, size, 0);
+			break;
+		case OFXAU_WINDOW_BLACKMAN:
+			vDSP_blkman_window(window, size, 0);
+			break;
+	}
+}
+
+// ----------------------------------------------------------
+FFTSetupRef ofxAudioUnitFftCache::getSetup(unsigned int log2N)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	FFTSetupRef setup = setups[log2N].lock();
+
+	if(!setup) {
+		PruneExpired(setups);
+		setup = FFTSetupRef(vDSP_create_fftsetup(log2N, kFFTRadix2), vDSP_destroy_fftsetup);
+		setups[log2N] = setup;
+	}
+
+	return setup;
+}
+
+// ----------------------------------------------------------
+FFTWindowRef ofxAudioUnitFftCache::getWindow(ofxAudioUnitWindowType windowType, size_t size)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	const std::pair<int, size_t> key((int)windowType, size);
+	FFTWindowRef window = windows[key].lock();
+
+	if(!window) {
+		PruneExpired(windows);
+		std::shared_ptr<std::vector<float> > table = std::make_shared<std::vector<float> >(size);
+		if(size > 0) {
+			generateWindow(windowType, &(*table)[0], size);
+		}
+		window = table;
+		windows[key] = window;
+	}
+
+	return window;
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitFftCache::getSetupCount()
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	return PruneExpired(setups);
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitFftCache::getWindowCount()
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	return PruneExpired(windows);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Accelerate/Accelerate.h>
+#include <memory>
+#include <vector>
+
+typedef enum {
+	OFXAU_WINDOW_HAMMING,
+	OFXAU_WINDOW_HANNING,
+	OFXAU_WINDOW_BLACKMAN
+}
+ofxAudioUnitWindowType;
+
+// fills the first "size" values of window with the requested window function
+void generateWindow(ofxAudioUnitWindowType windowType, float * window, size_t size);
+
+typedef std::shared_ptr<struct OpaqueFFTSetup> FFTSetupRef;
+typedef std::shared_ptr<const std::vector<float> > FFTWindowRef;
+
+// ofxAudioUnitFftCache hands out FFT setups and window tables that are
+// shared by every analysis node in the process. Identical requests get the
+// same object back, so 40 nodes at the same size cost one vDSP setup and
+// one window table instead of 40 of each.
+
+// Entries are reference counted: they're freed when the last node using
+// them lets go, and rebuilt the next time they're asked for. Both kinds of
+// table are immutable once built, so they can be read from any thread
+// (vDSP allows a setup to be shared by concurrent transforms). Looking
+// them up takes a lock, so do that off the render thread.
+
+class ofxAudioUnitFftCache
+{
+public:
+	// returns a setup able to perform FFTs of up to 2^log2N points
+	static FFTSetupRef getSetup(unsigned int log2N);
+	
+	static FFTWindowRef getWindow(ofxAudioUnitWindowType windowType, size_t size);
+	
+	// the number of setups / windows currently alive
+	static size_t getSetupCount();
+	static size_t getWindowCount();
+};
@@ -13,9 +13,7 @@ const float DB_CORRECTION_BLACKMAN = 2.37;
 ofxAudioUnitFftNode::ofxAudioUnitFftNode(unsigned int fftBufferSize, Settings settings)
 : _currentMaxLog2N(0)
 , _outputSettings(settings)
-, _fftSetup(NULL)
 , _fftData((COMPLEX_SPLIT){NULL, NULL})
-, _window(NULL)
 {
 	setFftBufferSize(fftBufferSize);
 }
@@ -23,9 +21,7 @@ ofxAudioUnitFftNode::ofxAudioUnitFftNode(unsigned int fftBufferSize, Settings se
 ofxAudioUnitFftNode::ofxAudioUnitFftNode(const ofxAudioUnitFftNode &orig)
 : _currentMaxLog2N(0)
 , _outputSettings(orig._outputSettings)
-, _fftSetup(NULL)
 , _fftData((COMPLEX_SPLIT){NULL, NULL})
-, _window(NULL)
 {
 	setFftBufferSize(orig._N);
 }
@@ -44,25 +40,9 @@ ofxAudioUnitFftNode::~ofxAudioUnitFftNode()
 
 void ofxAudioUnitFftNode::freeBuffers()
 {
-	if(_fftSetup)      vDSP_destroy_fftsetup(_fftSetup);
 	if(_fftData.realp) free(_fftData.realp);
 	if(_fftData.imagp) free(_fftData.imagp);
-	if(_window)        free(_window);
-}
-
-void generateWindow(ofxAudioUnitWindowType windowType, float * window, size_t size)
-{
-	switch (windowType) {
-		case OFXAU_WINDOW_HAMMING:
-			vDSP_hamm_window(window, size, 0);
-			break;
-		case OFXAU_WINDOW_HANNING:
-			vDSP_hann_window(window, size, 0);
-			break;
-		case OFXAU_WINDOW_BLACKMAN:
-			vDSP_blkman_window(window, size, 0);
-			break;
-	}
+	_fftData = (COMPLEX_SPLIT){NULL, NULL};
 }
 
 void ofxAudioUnitFftNode::setFftBufferSize(unsigned int bufferSize)
@@ -71,24 +51,24 @@ void ofxAudioUnitFftNode::setFftBufferSize(unsigned int bufferSize)
 	_N = 1 << _log2N;
 	
 	// if the new buffer size is bigger than what we've allocated for,
-	// free everything and allocate anew (otherwise re-use)
+	// free everything and allocate anew (otherwise re-use). The FFT setup
+	// and window are shared with every other node of the same size
 	if(_log2N > _currentMaxLog2N) {
 		freeBuffers();
 		_fftData.realp = (float *)calloc(_N / 2, sizeof(float));
 		_fftData.imagp = (float *)calloc(_N / 2, sizeof(float));
-		_window = (float *)calloc(_N, sizeof(float));
-		_fftSetup = vDSP_create_fftsetup(_log2N, kFFTRadix2);
 		_currentMaxLog2N = _log2N;
 	}
 
-	generateWindow(_outputSettings.window, _window, _N);
+	_fftSetup = ofxAudioUnitFftCache::getSetup(_log2N);
+	_window = ofxAudioUnitFftCache::getWindow(_outputSettings.window, _N);
 	setBufferSize(_N);
 }
 
 void ofxAudioUnitFftNode::setWindowType(ofxAudioUnitWindowType windowType)
 {
 	_outputSettings.window = windowType;
-	generateWindow(_outputSettings.window, _window, _N);
+	_window = ofxAudioUnitFftCache::getWindow(_outputSettings.window, _N);
 }
 
 void ofxAudioUnitFftNode::setScale(ofxAudioUnitScaleType scaleType)
@@ -114,10 +94,10 @@ void ofxAudioUnitFftNode::setClampMinToZero(bool clampToZero)
 void ofxAudioUnitFftNode::setSettings(const ofxAudioUnitFftNode::Settings &settings)
 {
 	_outputSettings = settings;
-	generateWindow(_outputSettings.window, _window, _N);
+	_window = ofxAudioUnitFftCache::getWindow(_outputSettings.window, _N);
 }
 
-static void PerformFFT(float * input, float * window, COMPLEX_SPLIT &fftData, FFTSetup &setup, size_t N)
+static void PerformFFT(float * input, const float * window, COMPLEX_SPLIT &fftData, FFTSetup setup, size_t N)
 {	
 	// windowing
 	vDSP_vmul(input, 1, window, 1, input, 1, N);
@@ -147,7 +127,7 @@ bool ofxAudioUnitFftNode::getAmplitude(std::vector<float> &outAmplitude)
 		vDSP_vsdiv(&_sampleBuffer[0], 1, &timeDomainMax, &_sampleBuffer[0], 1, _N);
 	}
 	
-	PerformFFT(&_sampleBuffer[0], _window, _fftData, _fftSetup, _N);
+	PerformFFT(&_sampleBuffer[0], &(*_window)[0], _fftData, _fftSetup.get(), _N);
 	
 	// get amplitude
 	vDSP_zvmags(&_fftData, 1, _fftData.realp, 1, _N/2);
@@ -210,7 +190,7 @@ bool ofxAudioUnitFftNode::getPhase(std::vector<float> &outPhase)
 		return false;
 	}
 	
-	PerformFFT(&_sampleBuffer[0], _window, _fftData, _fftSetup, _N);
+	PerformFFT(&_sampleBuffer[0], &(*_window)[0], _fftData, _fftSetup.get(), _N);
 	
 	vDSP_zvphas(&_fftData, 1, &_sampleBuffer[0], 1, _N / 2);
 	
@@ -1,15 +1,9 @@
 #pragma once
 
 #include "ofxAudioUnitDSPNode.h"
+#include "ofxAudioUnitFftCache.h"
 #include <Accelerate/Accelerate.h>
 
-typedef enum {
-	OFXAU_WINDOW_HAMMING,
-	OFXAU_WINDOW_HANNING,
-	OFXAU_WINDOW_BLACKMAN
-}
-ofxAudioUnitWindowType;
-
 typedef enum {
 	OFXAU_SCALE_LINEAR,
 	OFXAU_SCALE_DECIBEL,
@@ -58,9 +52,9 @@ private:
 	unsigned int _N;
 	unsigned int _log2N;
 	unsigned int _currentMaxLog2N;
-	FFTSetup _fftSetup;
+	FFTSetupRef _fftSetup;
+	FFTWindowRef _window;
 	COMPLEX_SPLIT _fftData;
-	float * _window;
 	std::vector<Float32> _sampleBuffer;
 	void freeBuffers();
 };
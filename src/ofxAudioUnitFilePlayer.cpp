@@ -17,6 +17,7 @@ ofxAudioUnitFilePlayer::ofxAudioUnitFilePlayer()
 , _pauseTimeAccumulator(0)
 , _seekSampleTime(0)
 , _primed(false)
+, _overview(new ofxAudioUnitWaveformOverview)
 {
 	_fileID[0] = NULL;
 	_desc = filePlayerDesc;
@@ -49,8 +50,16 @@ bool ofxAudioUnitFilePlayer::setFile(const std::string &filePath) {
 	
 	if(s != noErr) {
 		std::cout << "Error " << s << " while opening file at " << filePath << std::endl;
+		_filePath.clear();
+		_overview->clear();
 		return false;
 	} else {
+		// an overview that's been asked for follows the file
+		_filePath = filePath;
+		if(!_overview->getFilePath().empty()) {
+			_overview->load(_filePath, _overviewDirectory);
+		}
+		
 		// setting the file ID now since it seems to have some overhead.
 		// Doing it now ensures you'll get sound pretty much instantly after
 		// calling play() (subsequent calls don't have the overhead)
@@ -87,6 +96,17 @@ AudioTimeStamp ofxAudioUnitFilePlayer::getCurrentTimestamp() const {
 	return timeStamp;
 }
 
+const ofxAudioUnitWaveformOverview& ofxAudioUnitFilePlayer::getOverview() {
+	if(!_filePath.empty() && _overview->getFilePath() != _filePath) {
+		_overview->load(_filePath, _overviewDirectory);
+	}
+	return *_overview;
+}
+
+void ofxAudioUnitFilePlayer::setOverviewDirectory(const std::string &directory) {
+	_overviewDirectory = directory;
+}
+
 #pragma mark - Playback
 
 void ofxAudioUnitFilePlayer::prime() {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ofxAudioUnitBase.h"
+#include "ofxAudioUnitWaveformOverview.h"
+#include <memory>
 
 // ofxAudioUnitFilePlayer wraps the AUAudioFilePlayer unit.
 // This audio unit allows you to play any file that
@@ -54,6 +56,14 @@ public:
 	
 	AudioTimeStamp getCurrentTimestamp() const;
 	
+	// An overview of the file, for drawing its waveform. It's made on a
+	// thread of its own the first time it's asked for (and again after each
+	// setFile() from then on), and kept in a sidecar file so later runs load
+	// it straight away; see ofxAudioUnitWaveformOverview. Sidecars go next to
+	// the file unless setOverviewDirectory() says otherwise
+	const ofxAudioUnitWaveformOverview& getOverview();
+	void setOverviewDirectory(const std::string &directory);
+	
 private:
 	AudioFileID _fileID[1];
 	ScheduledAudioFileRegion _region;
@@ -62,4 +72,7 @@ private:
 	SInt64 _seekSampleTime;
 	unsigned int _loopCount;
 	bool _primed;
+	std::string _filePath;
+	std::string _overviewDirectory;
+	std::shared_ptr<ofxAudioUnitWaveformOverview> _overview;
 };
@@ -0,0 +1,310 @@
+#include "ofxAudioUnitFlacRecorder.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+
+// how often an encoder checks the ring when there isn't much in it
+static const std::chrono::milliseconds kPollInterval(10);
+
+// Batches are a few FLAC blocks long, so the encoders wake up a few times a
+// second rather than once per render cycle
+static const double kMinBatchSeconds = 0.1;
+static const size_t kMaxBatchFrames = 32768;
+
+// ----------------------------------------------------------
+ofxAudioUnitFlacRecorder::Group::Group(unsigned int firstChannel, unsigned int channels)
+: firstChannel(firstChannel)
+, channels(channels)
+, readCursor(0)
+, pendingSilence(0)
+, cursor(0)
+, framesWritten(0)
+, bytesWritten(0)
+, droppedFrames(0)
+, maxBacklog(0)
+, busyNanoseconds(0)
+, failed(false)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFlacRecorder::ofxAudioUnitFlacRecorder()
+: _dither(OFXAU_DITHER_NONE)
+, _running(false)
+, _stopAt(0)
+, _minBatchFrames(0)
+, _maxBatchFrames(0)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFlacRecorder::~ofxAudioUnitFlacRecorder()
+// ----------------------------------------------------------
+{
+	stop();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacRecorder::start(const std::string &filePath, unsigned int channels, Float64 sampleRate, unsigned int bitsPerSample, unsigned int channelsPerGroup, double ringSeconds)
+// ----------------------------------------------------------
+{
+	stop();
+
+	if(channels == 0 || channelsPerGroup == 0 || channelsPerGroup > ofxAudioUnitFlacWriter::kMaxChannels) {
+		std::cout << "Can't record " << channels << " channels to FLAC files of " << channelsPerGroup << " channels" << std::endl;
+		return false;
+	}
+
+	for(unsigned int first = 0; first < channels; first += channelsPerGroup) {
+		Group * group = new Group(first, std::min(channelsPerGroup, channels - first));
+		_groups.push_back(std::unique_ptr<Group>(group));
+
+		const std::string path = channels <= channelsPerGroup ? filePath : groupPath(filePath, first, group->channels);
+		group->file.setDither(_dither);
+		if(!group->file.open(path, group->channels, sampleRate, bitsPerSample)) {
+			// don't leave the other groups' empty files behind
+			for(size_t i = 0; i < _groups.size(); i++) {
+				if(_groups[i]->file.isOpen()) {
+					const std::string openedPath = _groups[i]->file.getFilePath();
+					_groups[i]->file.close();
+					remove(openedPath.c_str());
+				}
+			}
+			_groups.clear();
+			return false;
+		}
+	}
+
+	// Everything the render thread touches is allocated here. The ring keeps
+	// its allocation across recordings of the same shape, in case a render
+	// cycle that started before the last stop() is still finishing
+	const size_t capacity = std::max<size_t>(sampleRate * ringSeconds, 4096);
+	if(_ring.channels() != channels || _ring.capacity() != capacity) {
+		_ring.allocate(channels, capacity);
+	}
+
+	_maxBatchFrames = std::min(kMaxBatchFrames, capacity / 2);
+	_minBatchFrames = std::min<size_t>(sampleRate * kMinBatchSeconds, _maxBatchFrames);
+
+	// recording starts from whatever the render thread writes next
+	const UInt64 end = _ring.getWriteCount();
+	for(size_t i = 0; i < _groups.size(); i++) {
+		Group &group = *_groups[i];
+		group.readCursor = end;
+		group.cursor.store(end);
+		group.scratch.assign(group.channels * _maxBatchFrames, 0);
+		group.planes.resize(group.channels);
+		for(unsigned int c = 0; c < group.channels; c++) {
+			group.planes[c] = &group.scratch[c * _maxBatchFrames];
+		}
+	}
+
+	_running.store(true);
+	for(size_t i = 0; i < _groups.size(); i++) {
+		_groups[i]->thread = std::thread(&ofxAudioUnitFlacRecorder::run, this, std::ref(*_groups[i]));
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacRecorder::stop()
+// ----------------------------------------------------------
+{
+	if(_groups.empty()) return false;
+
+	_stopAt.store(_ring.getWriteCount(), std::memory_order_relaxed);
+	_running.store(false, std::memory_order_release);
+
+	bool ok = true;
+	for(size_t i = 0; i < _groups.size(); i++) {
+		Group &group = *_groups[i];
+		if(group.thread.joinable()) {
+			group.thread.join();
+		}
+		ok = group.file.close() && !group.failed.load() && ok;
+	}
+
+	_groups.clear();
+	return ok;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFlacRecorder::write(const AudioBufferList * bufferList, UInt32 frames)
+// ----------------------------------------------------------
+{
+	_ring.write(bufferList, frames);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFlacRecorder::Stats ofxAudioUnitFlacRecorder::getStats() const
+// ----------------------------------------------------------
+{
+	Stats stats = {};
+	for(size_t i = 0; i < _groups.size(); i++) {
+		const Stats group = getGroupStats(i);
+		stats.framesWritten = i == 0 ? group.framesWritten : std::min(stats.framesWritten, group.framesWritten);
+		stats.bytesWritten += group.bytesWritten;
+		stats.droppedFrames = std::max(stats.droppedFrames, group.droppedFrames);
+		stats.backlog = std::max(stats.backlog, group.backlog);
+		stats.maxBacklog = std::max(stats.maxBacklog, group.maxBacklog);
+		stats.encodeSeconds += group.encodeSeconds;
+		stats.failed = stats.failed || group.failed;
+	}
+	stats.groups = _groups.size();
+	return stats;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFlacRecorder::Stats ofxAudioUnitFlacRecorder::getGroupStats(size_t index) const
+// ----------------------------------------------------------
+{
+	Stats stats = {};
+	if(index >= _groups.size()) return stats;
+
+	const Group &group = *_groups[index];
+	const UInt64 cursor = group.cursor.load(std::memory_order_acquire);
+	const UInt64 end = _ring.getWriteCount();
+	stats.framesWritten = group.framesWritten.load(std::memory_order_relaxed);
+	stats.bytesWritten = group.bytesWritten.load(std::memory_order_relaxed);
+	stats.droppedFrames = group.droppedFrames.load(std::memory_order_relaxed);
+	stats.backlog = end > cursor ? end - cursor : 0;
+	stats.maxBacklog = group.maxBacklog.load(std::memory_order_relaxed);
+	stats.encodeSeconds = group.busyNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+	stats.groups = 1;
+	stats.failed = group.failed.load(std::memory_order_relaxed);
+	return stats;
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitFlacRecorder::groupPath(const std::string &filePath, unsigned int firstChannel, unsigned int channels)
+// ----------------------------------------------------------
+{
+	std::ostringstream suffix;
+	suffix << "-ch" << std::setw(2) << std::setfill('0') << firstChannel + 1;
+	if(channels > 1) {
+		suffix << "-" << std::setw(2) << std::setfill('0') << firstChannel + channels;
+	}
+
+	const size_t slash = filePath.find_last_of('/');
+	const size_t dot = filePath.find_last_of('.');
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return filePath + suffix.str();
+	}
+	return filePath.substr(0, dot) + suffix.str() + filePath.substr(dot);
+}
+
+#pragma mark - Encoder threads
+
+// ----------------------------------------------------------
+void ofxAudioUnitFlacRecorder::run(Group &group)
+// ----------------------------------------------------------
+{
+	while(_running.load(std::memory_order_acquire)) {
+		if(!drain(group, _minBatchFrames, UINT64_MAX)) {
+			std::this_thread::sleep_for(kPollInterval);
+		}
+	}
+
+	// encode the rest, up to where stop() was called
+	drain(group, 1, _stopAt.load(std::memory_order_relaxed));
+	writeSilence(group);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacRecorder::drain(Group &group, size_t minFrames, UInt64 limit)
+// ----------------------------------------------------------
+{
+	bool wrote = false;
+
+	while(true) {
+		const UInt64 end = _ring.getWriteCount();
+		const UInt64 backlog = std::min(end, std::max(limit, group.readCursor)) - group.readCursor;
+
+		if(backlog > group.maxBacklog.load(std::memory_order_relaxed)) {
+			group.maxBacklog.store(backlog, std::memory_order_relaxed);
+		}
+
+		if(backlog > _ring.capacity()) {
+			skipAhead(group, end);
+			continue;
+		}
+
+		if(backlog == 0 || backlog < minFrames) break;
+
+		writeSilence(group);
+
+		// each channel is checked for being lapped separately, which is
+		// fine: any of them failing throws the whole batch away
+		const size_t frames = std::min<UInt64>(backlog, _maxBatchFrames);
+		bool lapped = false;
+		for(unsigned int c = 0; c < group.channels && !lapped; c++) {
+			lapped = !_ring.read(group.firstChannel + c, group.readCursor, &group.scratch[c * _maxBatchFrames], frames);
+		}
+		if(lapped) {
+			skipAhead(group, _ring.getWriteCount());
+			continue;
+		}
+
+		encode(group, frames);
+		group.readCursor += frames;
+		group.cursor.store(group.readCursor, std::memory_order_release);
+		wrote = true;
+	}
+
+	return wrote;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFlacRecorder::skipAhead(Group &group, UInt64 end)
+// ----------------------------------------------------------
+{
+	// resume a quarter of the ring behind the writer, so there's room to
+	// catch up before it laps us again
+	const size_t capacity = _ring.capacity();
+	const UInt64 resume = end - (capacity - capacity / 4);
+	if(resume <= group.readCursor) return;
+
+	group.droppedFrames.fetch_add(resume - group.readCursor, std::memory_order_relaxed);
+	group.pendingSilence += resume - group.readCursor;
+	group.readCursor = resume;
+	group.cursor.store(group.readCursor, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFlacRecorder::writeSilence(Group &group)
+// ----------------------------------------------------------
+{
+	while(group.pendingSilence > 0) {
+		const size_t frames = std::min<UInt64>(group.pendingSilence, _maxBatchFrames);
+		std::fill(group.scratch.begin(), group.scratch.end(), 0);
+		encode(group, frames);
+		group.pendingSilence -= frames;
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFlacRecorder::encode(Group &group, size_t frames)
+// ----------------------------------------------------------
+{
+	// after a write error there's nowhere for the audio to go, but the ring
+	// keeps being drained so it isn't all reported as dropped
+	if(group.failed.load(std::memory_order_relaxed)) return;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if(!group.file.write(&group.planes[0], frames)) {
+		group.failed.store(true, std::memory_order_relaxed);
+	}
+	const std::chrono::nanoseconds busy = std::chrono::steady_clock::now() - start;
+
+	group.busyNanoseconds.fetch_add(busy.count(), std::memory_order_relaxed);
+	group.framesWritten.store(group.file.getFramesWritten(), std::memory_order_relaxed);
+	group.bytesWritten.store(group.file.getBytesWritten(), std::memory_order_relaxed);
+}
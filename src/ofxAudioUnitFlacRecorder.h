@@ -0,0 +1,116 @@
+#pragma once
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include "ofxAudioUnitFlacWriter.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ofxAudioUnitFlacRecorder streams audio from a render thread to FLAC files.
+// The render thread's side is the same as ofxAudioUnitDiskRecorder's, one
+// copy into a preallocated ring, so recording losslessly costs it no more
+// than recording raw.
+
+// The channels are split into groups of up to 8 (the most a FLAC file can
+// hold), and each group gets a file and an encoder thread of its own, which
+// reads its channels straight out of the shared ring. Recording 32 channels
+// keeps four cores busy rather than one. A recording that fits in one group
+// goes to the path it was given; otherwise each group's file is named after
+// its channels ("show.flac" -> "show-ch01-08.flac", "show-ch09-16.flac", ...)
+
+// The ring is the only buffering, so it bounds the backlog. An encoder that
+// falls further behind than the ring holds has its oldest audio overwritten,
+// counted as dropped and replaced with silence, as with the disk recorder.
+// getStats() reports how far behind the encoders are and how busy they've
+// been, so a setup that can't keep up shows it before anything is dropped.
+
+// Make sure the render thread has stopped calling write() before calling
+// start() or stop().
+
+class ofxAudioUnitFlacRecorder
+{
+public:
+	struct Stats {
+		UInt64 framesWritten; // by the slowest encoder
+		UInt64 bytesWritten;  // across every file
+		UInt64 droppedFrames; // the most any one file lost to an overwritten ring
+		UInt64 backlog;       // frames the slowest encoder has yet to get to
+		UInt64 maxBacklog;
+		double encodeSeconds; // spent converting, encoding and writing, across every encoder
+		unsigned int groups;
+		bool failed;
+	};
+
+	ofxAudioUnitFlacRecorder();
+	~ofxAudioUnitFlacRecorder();
+
+	// 16 or 24 bit. ringSeconds is how far an encoder can fall behind before
+	// audio is dropped
+	bool start(const std::string &filePath, unsigned int channels, Float64 sampleRate, unsigned int bitsPerSample,
+			   unsigned int channelsPerGroup = ofxAudioUnitFlacWriter::kMaxChannels, double ringSeconds = 4);
+
+	// waits for the encoders to get through everything up to now, then
+	// finishes the files. Returns false if anything went wrong writing them
+	bool stop();
+
+	bool isRecording() const {return !_groups.empty();}
+
+	// from the next start() on. Off by default
+	void setDither(ofxAudioUnitDither dither) {_dither = dither;}
+	ofxAudioUnitDither getDither() const {return _dither;}
+
+	// Render thread: copies frames into the ring. Never blocks or allocates
+	void write(const AudioBufferList * bufferList, UInt32 frames);
+
+	Stats getStats() const;
+
+	// the same, for one group's encoder and file
+	Stats getGroupStats(size_t group) const;
+	size_t getNumGroups() const {return _groups.size();}
+
+	// "show.flac", channels 9 to 16 -> "show-ch09-16.flac"
+	static std::string groupPath(const std::string &filePath, unsigned int firstChannel, unsigned int channels);
+
+private:
+	struct Group {
+		unsigned int firstChannel;
+		unsigned int channels;
+		ofxAudioUnitFlacWriter file;
+		std::thread thread;
+
+		// encoder thread
+		UInt64 readCursor;
+		UInt64 pendingSilence; // dropped frames the file still has to account for
+		std::vector<Float32> scratch;
+		std::vector<const Float32 *> planes;
+
+		std::atomic<UInt64> cursor; // readCursor, for stats
+		std::atomic<UInt64> framesWritten;
+		std::atomic<UInt64> bytesWritten;
+		std::atomic<UInt64> droppedFrames;
+		std::atomic<UInt64> maxBacklog;
+		std::atomic<UInt64> busyNanoseconds;
+		std::atomic<bool> failed;
+
+		Group(unsigned int firstChannel, unsigned int channels);
+	};
+
+	ofxAudioUnitCaptureBuffer _ring;
+	std::vector<std::unique_ptr<Group> > _groups;
+	ofxAudioUnitDither _dither;
+	std::atomic<bool> _running;
+	std::atomic<UInt64> _stopAt; // where the encoders finish once they're not running
+	size_t _minBatchFrames;
+	size_t _maxBatchFrames;
+
+	ofxAudioUnitFlacRecorder(const ofxAudioUnitFlacRecorder &);
+	ofxAudioUnitFlacRecorder& operator=(const ofxAudioUnitFlacRecorder &);
+
+	void run(Group &group);
+	bool drain(Group &group, size_t minFrames, UInt64 limit);
+	void skipAhead(Group &group, UInt64 end);
+	void writeSilence(Group &group);
+	void encode(Group &group, size_t frames);
+};
@@ -0,0 +1,725 @@
+#include "ofxAudioUnitFlacWriter.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const size_t kBlockSize = 4096;
+static const unsigned int kMaxFixedOrder = 4;
+static const unsigned int kMaxLpcOrder = 8;
+static const unsigned int kMaxPartitionOrder = 6;
+static const unsigned int kMaxRiceParameter = 14;  // with 4 bit parameters; 15 is the escape code
+static const unsigned int kMaxRice2Parameter = 30; // with 5 bit ones
+static const size_t kHeaderBytes = 4 + 4 + 34;     // "fLaC" and STREAMINFO
+static const size_t kBufferBytes = 1 << 20;
+
+enum {
+	kSubframeConstant,
+	kSubframeVerbatim,
+	kSubframeFixed,
+	kSubframeLpc
+};
+
+// channel assignments besides "independent"
+enum {
+	kLeftSide = 8,
+	kSideRight = 9,
+	kMidSide = 10
+};
+
+typedef ofxAudioUnitFlacWriter::Subframe Subframe;
+
+#pragma mark - Bits
+
+// FLAC is big endian, and packed to the bit
+class BitWriter
+{
+public:
+	BitWriter(unsigned char * out) : _start(out), _p(out), _acc(0), _bits(0) {}
+
+	// the low `count` bits of value, count <= 32
+	inline void put(UInt32 value, unsigned int count) {
+		const UInt64 mask = (1ull << count) - 1;
+		_acc = (_acc << count) | (value & mask);
+		_bits += count;
+		while(_bits >= 8) {
+			_bits -= 8;
+			*_p++ = (unsigned char)(_acc >> _bits);
+		}
+	}
+
+	// q zeros and a one, then the low k bits
+	inline void putRice(UInt32 value, unsigned int k) {
+		UInt32 q = value >> k;
+		if(q + 1 + k <= 32) {
+			put((1u << k) | (value & ((1u << k) - 1)), q + 1 + k);
+			return;
+		}
+		for(; q >= 32; q -= 32) put(0, 32);
+		put(1, q + 1);
+		put(value, k);
+	}
+
+	void align() {if(_bits) put(0, 8 - _bits);}
+	size_t bytes() const {return _p - _start;}
+	const unsigned char * start() const {return _start;}
+
+private:
+	unsigned char * _start;
+	unsigned char * _p;
+	UInt64 _acc;
+	unsigned int _bits;
+};
+
+static UInt8 Crc8Table[256];
+static UInt16 Crc16Table[256];
+
+static const bool CrcTablesReady = [] {
+	for(unsigned int i = 0; i < 256; i++) {
+		UInt8 c8 = i;
+		UInt16 c16 = i << 8;
+		for(int b = 0; b < 8; b++) {
+			c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+			c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+		}
+		Crc8Table[i] = c8;
+		Crc16Table[i] = c16;
+	}
+	return true;
+}();
+
+static UInt8 Crc8(const unsigned char * bytes, size_t count)
+{
+	UInt8 crc = 0;
+	for(size_t i = 0; i < count; i++) crc = Crc8Table[crc ^ bytes[i]];
+	return crc;
+}
+
+static UInt16 Crc16(const unsigned char * bytes, size_t count)
+{
+	UInt16 crc = 0;
+	for(size_t i = 0; i < count; i++) crc = (crc << 8) ^ Crc16Table[(crc >> 8) ^ bytes[i]];
+	return crc;
+}
+
+static inline UInt32 ZigZag(SInt32 residual)
+{
+	return ((UInt32)residual << 1) ^ (UInt32)(residual >> 31);
+}
+
+#pragma mark - Residual coding
+
+// The cheapest Rice parameter for a partition, and what it costs. Counting
+// sum >> k rather than the sum of each value >> k slightly overestimates, so
+// the real thing is never bigger
+static UInt64 RiceCost(UInt64 sum, size_t count, unsigned int maxParameter, unsigned int &parameter)
+{
+	unsigned int k = 0;
+	while(k < maxParameter && ((UInt64)count << (k + 1)) <= sum) k++;
+
+	UInt64 best = UINT64_MAX;
+	for(unsigned int t = k > 0 ? k - 1 : 0; t <= std::min(k + 1, maxParameter); t++) {
+		const UInt64 cost = (UInt64)count * (t + 1) + (sum >> t);
+		if(cost < best) {
+			best = cost;
+			parameter = t;
+		}
+	}
+	return best;
+}
+
+// Splits a subframe's residual into the partitioning that codes smallest,
+// and adds what it costs to the subframe's
+static void PlanResidual(Subframe &s, size_t frames)
+{
+	// the finest partitioning the block allows: every partition the same
+	// size, the first one big enough to hold the warm-up samples as well
+	unsigned int finest = 0;
+	while(finest < kMaxPartitionOrder && (frames & ((2u << finest) - 1)) == 0 && (frames >> (finest + 1)) > s.order) {
+		finest++;
+	}
+
+	UInt64 sums[1 << kMaxPartitionOrder];
+	const UInt32 * u = &s.residual[0];
+	const size_t size = frames >> finest;
+	size_t i = 0;
+	for(size_t p = 0; p < (1u << finest); p++) {
+		const size_t end = (p + 1) * size - s.order;
+		UInt64 sum = 0;
+		for(; i < end; i++) sum += u[i];
+		sums[p] = sum;
+	}
+
+	UInt64 bestCost = UINT64_MAX;
+	for(int order = finest; order >= 0; order--) {
+		const size_t partitions = (size_t)1 << order;
+		unsigned int parameters[1 << kMaxPartitionOrder];
+		UInt64 cost = 0;
+		bool rice2 = false;
+		for(size_t p = 0; p < partitions; p++) {
+			const size_t count = (frames >> order) - (p == 0 ? s.order : 0);
+			cost += RiceCost(sums[p], count, kMaxRice2Parameter, parameters[p]);
+			rice2 = rice2 || parameters[p] > kMaxRiceParameter;
+		}
+		cost += partitions * (rice2 ? 5 : 4);
+
+		if(cost < bestCost) {
+			bestCost = cost;
+			s.partitionOrder = order;
+			s.riceBits = rice2 ? 5 : 4;
+			std::copy(parameters, parameters + partitions, s.parameters);
+		}
+
+		for(size_t p = 0; p < partitions / 2; p++) {
+			sums[p] = sums[2 * p] + sums[2 * p + 1];
+		}
+	}
+
+	s.cost += 2 + 4 + bestCost;
+}
+
+static void WriteResidual(BitWriter &out, const Subframe &s, size_t frames)
+{
+	out.put(s.riceBits == 5 ? 1 : 0, 2);
+	out.put(s.partitionOrder, 4);
+
+	const UInt32 * u = &s.residual[0];
+	for(size_t p = 0; p < ((size_t)1 << s.partitionOrder); p++) {
+		const size_t count = (frames >> s.partitionOrder) - (p == 0 ? s.order : 0);
+		const unsigned int k = s.parameters[p];
+		out.put(k, s.riceBits);
+		for(size_t i = 0; i < count; i++) out.putRice(u[i], k);
+		u += count;
+	}
+}
+
+static void WriteSubframe(BitWriter &out, const Subframe &s, const SInt32 * samples, size_t frames)
+{
+	// a zero bit, the type, and no wasted bits
+	switch(s.type) {
+		case kSubframeConstant:
+			out.put(0x00, 8);
+			out.put(samples[0], s.bits);
+			break;
+
+		case kSubframeVerbatim:
+			out.put(0x01 << 1, 8);
+			for(size_t i = 0; i < frames; i++) out.put(samples[i], s.bits);
+			break;
+
+		case kSubframeFixed:
+			out.put((0x08 | s.order) << 1, 8);
+			for(unsigned int i = 0; i < s.order; i++) out.put(samples[i], s.bits);
+			WriteResidual(out, s, frames);
+			break;
+
+		case kSubframeLpc:
+			out.put((0x20 | (s.order - 1)) << 1, 8);
+			for(unsigned int i = 0; i < s.order; i++) out.put(samples[i], s.bits);
+			out.put(s.precision - 1, 4);
+			out.put(s.shift, 5);
+			for(unsigned int i = 0; i < s.order; i++) out.put(s.coefficients[i], s.precision);
+			WriteResidual(out, s, frames);
+			break;
+	}
+}
+
+#pragma mark - Prediction
+
+static unsigned int PickFixedOrder(const SInt32 * x, size_t frames)
+{
+	if(frames <= kMaxFixedOrder) return 0;
+
+	// whichever order leaves the smallest residual, by absolute sum
+	UInt64 totals[kMaxFixedOrder + 1] = {0};
+	for(size_t i = kMaxFixedOrder; i < frames; i++) {
+		const SInt64 e0 = x[i];
+		const SInt64 e1 = e0 - x[i - 1];
+		const SInt64 e2 = e1 - ((SInt64)x[i - 1] - x[i - 2]);
+		const SInt64 e3 = e2 - ((SInt64)x[i - 1] - 2 * (SInt64)x[i - 2] + x[i - 3]);
+		const SInt64 e4 = e3 - ((SInt64)x[i - 1] - 3 * (SInt64)x[i - 2] + 3 * (SInt64)x[i - 3] - x[i - 4]);
+		totals[0] += llabs(e0);
+		totals[1] += llabs(e1);
+		totals[2] += llabs(e2);
+		totals[3] += llabs(e3);
+		totals[4] += llabs(e4);
+	}
+	return std::min_element(totals, totals + kMaxFixedOrder + 1) - totals;
+}
+
+static void FixedResidual(const SInt32 * x, size_t frames, unsigned int order, UInt32 * u)
+{
+	for(size_t i = order; i < frames; i++) {
+		SInt64 e;
+		switch(order) {
+			case 0:  e = x[i]; break;
+			case 1:  e = (SInt64)x[i] - x[i - 1]; break;
+			case 2:  e = (SInt64)x[i] - 2 * (SInt64)x[i - 1] + x[i - 2]; break;
+			case 3:  e = (SInt64)x[i] - 3 * (SInt64)x[i - 1] + 3 * (SInt64)x[i - 2] - x[i - 3]; break;
+			default: e = (SInt64)x[i] - 4 * (SInt64)x[i - 1] + 6 * (SInt64)x[i - 2] - 4 * (SInt64)x[i - 3] + x[i - 4]; break;
+		}
+		*u++ = ZigZag((SInt32)e);
+	}
+}
+
+// Rounds LPC coefficients to `precision` bit integers and a shift, carrying
+// each one's rounding error into the next
+static bool QuantizeCoefficients(const double * lp, unsigned int order, unsigned int precision, SInt32 * q, int &shift)
+{
+	double largest = 0;
+	for(unsigned int i = 0; i < order; i++) largest = std::max(largest, fabs(lp[i]));
+	if(largest <= 0) return false;
+
+	int log2Largest;
+	frexp(largest, &log2Largest);
+	log2Largest--;
+
+	const int magnitudeBits = precision - 1; // and a sign bit
+	shift = std::min(magnitudeBits - log2Largest - 1, 15);
+	if(shift < 0) return false; // negative shifts aren't allowed
+
+	const SInt32 qMax = (1 << magnitudeBits) - 1;
+	const SInt32 qMin = -qMax - 1;
+	double error = 0;
+	for(unsigned int i = 0; i < order; i++) {
+		error += lp[i] * (1 << shift);
+		const SInt32 rounded = std::min(std::max((SInt32)lrint(error), qMin), qMax);
+		error -= rounded;
+		q[i] = rounded;
+	}
+	return true;
+}
+
+static bool LpcResidual(const SInt32 * x, size_t frames, const Subframe &s, UInt32 * u)
+{
+	const unsigned int order = s.order;
+	const SInt32 * q = s.coefficients;
+
+	for(size_t i = order; i < frames; i++) {
+		SInt64 sum = 0;
+		for(unsigned int j = 0; j < order; j++) sum += (SInt64)q[j] * x[i - 1 - j];
+		const SInt64 e = x[i] - (sum >> s.shift);
+		if(e > INT32_MAX || e < -INT32_MAX) return false;
+		*u++ = ZigZag((SInt32)e);
+	}
+	return true;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFlacWriter::ofxAudioUnitFlacWriter()
+: _fd(-1)
+, _channels(0)
+, _sampleRate(0)
+, _bits(24)
+, _frames(0)
+, _bytes(0)
+, _frameNumber(0)
+, _minFrameBytes(0)
+, _maxFrameBytes(0)
+, _failed(false)
+, _blockUsed(0)
+, _bufferUsed(0)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitFlacWriter::~ofxAudioUnitFlacWriter()
+// ----------------------------------------------------------
+{
+	close();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacWriter::open(const std::string &filePath, unsigned int channels, Float64 sampleRate, unsigned int bitsPerSample)
+// ----------------------------------------------------------
+{
+	close();
+
+	if(channels == 0 || channels > kMaxChannels || sampleRate < 1 || sampleRate >= (1 << 20) || (bitsPerSample != 16 && bitsPerSample != 24)) {
+		std::cout << "Can't write a FLAC file with " << channels << " channels of " << bitsPerSample << " bit audio at " << sampleRate << " Hz" << std::endl;
+		return false;
+	}
+
+	_fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(_fd < 0) {
+		std::cout << "Couldn't create audio file: " << filePath << " (" << strerror(errno) << ")" << std::endl;
+		return false;
+	}
+
+	_filePath = filePath;
+	_channels = channels;
+	_sampleRate = sampleRate;
+	_bits = bitsPerSample;
+	_frames = 0;
+	_bytes = 0;
+	_frameNumber = 0;
+	_minFrameBytes = 0;
+	_maxFrameBytes = 0;
+	_failed = false;
+
+	_block.resize(channels * kBlockSize);
+	_blockUsed = 0;
+	_stereo.resize(2 * kBlockSize);
+	_subframes.resize(std::max(channels, 4u));
+	for(size_t i = 0; i < _subframes.size(); i++) {
+		_subframes[i].residual.resize(kBlockSize);
+	}
+	_candidate.residual.resize(kBlockSize);
+	_windowed.resize(kBlockSize);
+	_buffer.resize(kBufferBytes);
+	_bufferUsed = 0;
+	_converter.reset();
+
+	// a placeholder until close() knows the length
+	if(!writeStreamInfo()) {
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFlacWriter::setDither(ofxAudioUnitDither dither)
+// ----------------------------------------------------------
+{
+	_converter.setDither(dither);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacWriter::write(const Float32 * const * channels, size_t frames)
+// ----------------------------------------------------------
+{
+	if(_fd < 0 || _failed) return false;
+
+	size_t done = 0;
+
+	while(done < frames) {
+		const size_t count = std::min(kBlockSize - _blockUsed, frames - done);
+		for(unsigned int c = 0; c < _channels; c++) {
+			_converter.quantize(channels[c] + done, count, _bits, &_block[c * kBlockSize + _blockUsed], c);
+		}
+		_blockUsed += count;
+		_frames += count;
+		done += count;
+
+		if(_blockUsed == kBlockSize && !encodeBlock()) return false;
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacWriter::close()
+// ----------------------------------------------------------
+{
+	if(_fd < 0) return false;
+
+	bool ok = (_blockUsed == 0 || encodeBlock()) && flush();
+	ok = ok && writeStreamInfo();
+
+	if(::close(_fd) != 0) {
+		std::cout << "Error closing " << _filePath << ": " << strerror(errno) << std::endl;
+		ok = false;
+	}
+	_fd = -1;
+
+	return ok && !_failed;
+}
+
+#pragma mark - Encoding
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacWriter::encodeBlock()
+// ----------------------------------------------------------
+{
+	const size_t frames = _blockUsed;
+	_blockUsed = 0;
+	if(frames == 0) return true;
+
+	const SInt32 * planes[kMaxChannels];
+	for(unsigned int c = 0; c < _channels; c++) {
+		planes[c] = &_block[c * kBlockSize];
+		analyze(planes[c], frames, _bits, _subframes[c]);
+	}
+
+	// each subframe to write, as (subframe, samples)
+	const Subframe * chosen[kMaxChannels];
+	for(unsigned int c = 0; c < _channels; c++) chosen[c] = &_subframes[c];
+	unsigned int assignment = _channels - 1;
+
+	if(_channels == 2) {
+		SInt32 * mid = &_stereo[0];
+		SInt32 * side = &_stereo[kBlockSize];
+		for(size_t i = 0; i < frames; i++) {
+			mid[i] = (planes[0][i] + planes[1][i]) >> 1;
+			side[i] = planes[0][i] - planes[1][i];
+		}
+		analyze(mid, frames, _bits, _subframes[2]);
+		analyze(side, frames, _bits + 1, _subframes[3]);
+
+		const UInt64 left = _subframes[0].cost;
+		const UInt64 right = _subframes[1].cost;
+		const UInt64 midCost = _subframes[2].cost;
+		const UInt64 sideCost = _subframes[3].cost;
+		const UInt64 best = std::min(std::min(left + right, left + sideCost), std::min(sideCost + right, midCost + sideCost));
+
+		if(best == midCost + sideCost && best < left + right) {
+			assignment = kMidSide;
+			chosen[0] = &_subframes[2];
+			chosen[1] = &_subframes[3];
+			planes[0] = mid;
+			planes[1] = side;
+		} else if(best == left + sideCost && best < left + right) {
+			assignment = kLeftSide;
+			chosen[1] = &_subframes[3];
+			planes[1] = side;
+		} else if(best == sideCost + right && best < left + right) {
+			assignment = kSideRight;
+			chosen[0] = &_subframes[3];
+			planes[0] = side;
+		}
+	}
+
+	// even a verbatim frame fits
+	const size_t worstBytes = 32 + _channels * ((_bits + 1) * frames / 8 + 8);
+	if(_bufferUsed + worstBytes > _buffer.size() && !flush()) return false;
+
+	BitWriter out(&_buffer[_bufferUsed]);
+
+	// sync code, fixed block size strategy
+	out.put(0x3FFE, 14);
+	out.put(0, 1);
+	out.put(0, 1);
+
+	// block size: 4096, or the 16 bit value at the end of the header
+	out.put(frames == kBlockSize ? 12 : 7, 4);
+
+	unsigned int rateCode = 0; // from STREAMINFO
+	switch((UInt32)lrint(_sampleRate)) {
+		case 88200:  rateCode = 1; break;
+		case 176400: rateCode = 2; break;
+		case 192000: rateCode = 3; break;
+		case 8000:   rateCode = 4; break;
+		case 16000:  rateCode = 5; break;
+		case 22050:  rateCode = 6; break;
+		case 24000:  rateCode = 7; break;
+		case 32000:  rateCode = 8; break;
+		case 44100:  rateCode = 9; break;
+		case 48000:  rateCode = 10; break;
+		case 96000:  rateCode = 11; break;
+	}
+	out.put(rateCode, 4);
+	out.put(assignment, 4);
+	out.put(_bits == 16 ? 4 : 6, 3);
+	out.put(0, 1);
+
+	// the frame number, coded like UTF-8
+	const UInt32 number = _frameNumber++;
+	if(number < 0x80) {
+		out.put(number, 8);
+	} else {
+		unsigned int continuation = 1;
+		while(continuation < 6 && number >= (1u << (5 * continuation + 6))) continuation++;
+		out.put((0xFF00 >> (continuation + 1)) | (number >> (6 * continuation)), 8);
+		for(int i = continuation - 1; i >= 0; i--) out.put(0x80 | ((number >> (6 * i)) & 0x3F), 8);
+	}
+
+	if(frames != kBlockSize) out.put(frames - 1, 16);
+	out.put(Crc8(out.start(), out.bytes()), 8);
+
+	for(unsigned int c = 0; c < _channels; c++) {
+		WriteSubframe(out, *chosen[c], planes[c], frames);
+	}
+
+	out.align();
+	out.put(Crc16(out.start(), out.bytes()), 16);
+
+	const UInt32 frameBytes = out.bytes();
+	_minFrameBytes = _frameNumber == 1 ? frameBytes : std::min(_minFrameBytes, frameBytes);
+	_maxFrameBytes = std::max(_maxFrameBytes, frameBytes);
+	_bufferUsed += frameBytes;
+	_bytes += frameBytes;
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitFlacWriter::analyze(const SInt32 * x, size_t frames, unsigned int bits, Subframe &best)
+// ----------------------------------------------------------
+{
+	best.bits = bits;
+	best.order = 0;
+
+	bool constant = true;
+	for(size_t i = 1; i < frames && constant; i++) constant = x[i] == x[0];
+	if(constant) {
+		best.type = kSubframeConstant;
+		best.cost = 8 + bits;
+		return;
+	}
+
+	best.type = kSubframeVerbatim;
+	best.cost = 8 + (UInt64)frames * bits;
+
+	Subframe &fixed = _candidate;
+	fixed.type = kSubframeFixed;
+	fixed.bits = bits;
+	fixed.order = PickFixedOrder(x, frames);
+	fixed.cost = 8 + fixed.order * bits;
+	FixedResidual(x, frames, fixed.order, &fixed.residual[0]);
+	PlanResidual(fixed, frames);
+	if(fixed.cost < best.cost) {
+		std::swap(best, fixed);
+	}
+
+	tryLpc(x, frames, bits, best);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacWriter::tryLpc(const SInt32 * x, size_t frames, unsigned int bits, Subframe &best)
+// ----------------------------------------------------------
+{
+	if(frames < 4 * kMaxLpcOrder) return false;
+
+	// a Tukey window, so the block's edges don't smear the spectrum
+	if(_window.size() != frames) {
+		_window.resize(frames);
+		const double taper = 0.25 * frames;
+		for(size_t i = 0; i < frames; i++) {
+			const double edge = std::min<double>(i, frames - 1 - i);
+			_window[i] = edge < taper ? 0.5 - 0.5 * cos(M_PI * edge / taper) : 1;
+		}
+	}
+
+	double * w = &_windowed[0];
+	for(size_t i = 0; i < frames; i++) w[i] = x[i] * _window[i];
+
+	double autocorrelation[kMaxLpcOrder + 1];
+	for(unsigned int lag = 0; lag <= kMaxLpcOrder; lag++) {
+		double sum = 0;
+		for(size_t i = lag; i < frames; i++) sum += w[i] * w[i - lag];
+		autocorrelation[lag] = sum;
+	}
+	if(autocorrelation[0] <= 0) return false;
+
+	// Levinson-Durbin, keeping every order's coefficients and error
+	double coefficients[kMaxLpcOrder][kMaxLpcOrder];
+	double errors[kMaxLpcOrder];
+	double lp[kMaxLpcOrder] = {0};
+	double error = autocorrelation[0];
+	unsigned int orders = 0;
+	for(unsigned int i = 0; i < kMaxLpcOrder; i++) {
+		double acc = autocorrelation[i + 1];
+		for(unsigned int j = 0; j < i; j++) acc -= lp[j] * autocorrelation[i - j];
+		const double k = acc / error;
+
+		double next[kMaxLpcOrder];
+		for(unsigned int j = 0; j < i; j++) next[j] = lp[j] - k * lp[i - 1 - j];
+		next[i] = k;
+		std::copy(next, next + i + 1, lp);
+
+		error *= 1 - k * k;
+		std::copy(lp, lp + i + 1, coefficients[i]);
+		errors[i] = error;
+		orders = i + 1;
+		if(error <= 0) break;
+	}
+
+	// the order that should code smallest, going by the prediction error
+	const unsigned int precision = bits <= 16 ? 12 : 15;
+	unsigned int order = 0;
+	double bestEstimate = HUGE_VAL;
+	for(unsigned int i = 0; i < orders; i++) {
+		const double perSample = errors[i] > 0 ? std::max(0., 0.5 * log2(0.5 * errors[i] / frames)) : 0;
+		const double estimate = perSample * (frames - i - 1) + (i + 1) * (bits + precision);
+		if(estimate < bestEstimate) {
+			bestEstimate = estimate;
+			order = i + 1;
+		}
+	}
+
+	Subframe &lpc = _candidate;
+	lpc.type = kSubframeLpc;
+	lpc.bits = bits;
+	lpc.order = order;
+	lpc.precision = precision;
+	if(!QuantizeCoefficients(coefficients[order - 1], order, precision, lpc.coefficients, lpc.shift)) return false;
+	if(!LpcResidual(x, frames, lpc, &lpc.residual[0])) return false;
+
+	lpc.cost = 8 + order * bits + 4 + 5 + order * precision;
+	PlanResidual(lpc, frames);
+	if(lpc.cost >= best.cost) return false;
+
+	std::swap(best, lpc);
+	return true;
+}
+
+#pragma mark - File
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacWriter::writeStreamInfo()
+// ----------------------------------------------------------
+{
+	unsigned char header[kHeaderBytes];
+	memset(header, 0, sizeof(header));
+	memcpy(header, "fLaC", 4);
+
+	BitWriter out(header + 4);
+	out.put(1, 1); // the last metadata block
+	out.put(0, 7); // STREAMINFO
+	out.put(34, 24);
+	out.put(kBlockSize, 16); // minimum block size, bar the last block
+	out.put(kBlockSize, 16);
+	out.put(_minFrameBytes, 24);
+	out.put(_maxFrameBytes, 24);
+	out.put((UInt32)lrint(_sampleRate), 20);
+	out.put(_channels - 1, 3);
+	out.put(_bits - 1, 5);
+	out.put((UInt32)(_frames >> 32) & 0xF, 4);
+	out.put((UInt32)_frames, 32);
+	// and the MD5, all zeros
+
+	return writeAll(header, sizeof(header), 0);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacWriter::flush()
+// ----------------------------------------------------------
+{
+	if(_failed) return false;
+	if(_bufferUsed == 0) return true;
+
+	const UInt64 flushed = _bytes - _bufferUsed;
+	if(!writeAll(&_buffer[0], _bufferUsed, kHeaderBytes + flushed)) return false;
+
+	_bufferUsed = 0;
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitFlacWriter::writeAll(const void * bytes, size_t count, off_t offset)
+// ----------------------------------------------------------
+{
+	const char * p = (const char *)bytes;
+	while(count > 0) {
+		const ssize_t written = pwrite(_fd, p, count, offset);
+		if(written < 0) {
+			if(errno == EINTR) continue;
+			std::cout << "Error writing " << _filePath << ": " << strerror(errno) << std::endl;
+			_failed = true;
+			return false;
+		}
+		p += written;
+		count -= written;
+		offset += written;
+	}
+	return true;
+}
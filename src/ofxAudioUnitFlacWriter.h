@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ofxAudioUnitSampleConverter.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// ofxAudioUnitFlacWriter encodes FLAC files itself, without Core Audio or
+// libFLAC, so like ofxAudioUnitWavWriter it can run on any thread and builds
+// on any platform.
+
+// Each block of 4096 frames becomes one FLAC frame. Every channel of it is
+// tried with the best of the fixed polynomial predictors and an LPC predictor
+// (up to order 8, picked from the Levinson-Durbin error estimate), and the
+// residual is Rice coded in as many partitions as pay for themselves. Stereo
+// files also try left/side, side/right and mid/side. Roughly what `flac -5`
+// does, at a similar speed.
+
+// close() fills in the STREAMINFO block's length and frame sizes. The MD5 of
+// the audio is left unset (all zeros), which decoders take to mean "not
+// computed".
+
+// Not thread safe; open(), write() and close() should all be called from the
+// same thread (typically one of a recorder's encoder threads).
+
+class ofxAudioUnitFlacWriter
+{
+public:
+	ofxAudioUnitFlacWriter();
+	~ofxAudioUnitFlacWriter();
+
+	// 1 to kMaxChannels channels of 16 or 24 bit samples
+	bool open(const std::string &filePath, unsigned int channels, Float64 sampleRate, unsigned int bitsPerSample);
+
+	// converts and appends frames from one buffer per channel
+	bool write(const Float32 * const * channels, size_t frames);
+
+	// encodes whatever's left of the last block and fills in the header
+	bool close();
+
+	// off by default; stays set across files
+	void setDither(ofxAudioUnitDither dither);
+	ofxAudioUnitDither getDither() const {return _converter.getDither();}
+
+	bool isOpen() const {return _fd >= 0;}
+	const std::string& getFilePath() const {return _filePath;}
+	unsigned int getNumChannels() const {return _channels;}
+	unsigned int getBitsPerSample() const {return _bits;}
+	UInt64 getFramesWritten() const {return _frames;}
+	UInt64 getBytesWritten() const {return _bytes;}
+
+	static const unsigned int kMaxChannels = 8;
+
+	// One subframe's worth of encoding decisions, and its residual. Only
+	// public so the encoder's helpers in the .cpp can see it
+	struct Subframe {
+		unsigned int type;    // constant, verbatim, fixed or LPC
+		unsigned int bits;    // per sample; side channels get one more
+		unsigned int order;
+		unsigned int precision;
+		int shift;
+		SInt32 coefficients[32];
+		unsigned int partitionOrder;
+		unsigned int riceBits; // 4 or 5 bit parameters
+		unsigned int parameters[256];
+		UInt64 cost; // in bits
+		std::vector<UInt32> residual; // zigzagged
+	};
+
+private:
+	int _fd;
+	std::string _filePath;
+	unsigned int _channels;
+	Float64 _sampleRate;
+	unsigned int _bits;
+	UInt64 _frames;
+	UInt64 _bytes;     // encoded frames, not counting the header
+	UInt32 _frameNumber;
+	UInt32 _minFrameBytes;
+	UInt32 _maxFrameBytes;
+	bool _failed;
+
+	ofxAudioUnitSampleConverter _converter;
+	std::vector<SInt32> _block; // one plane per channel, kBlockSize long
+	size_t _blockUsed;
+	std::vector<SInt32> _stereo; // mid and side
+	std::vector<Subframe> _subframes;
+	Subframe _candidate;
+	std::vector<double> _window;
+	std::vector<double> _windowed;
+
+	std::vector<unsigned char> _buffer; // encoded frames on their way to the disk
+	size_t _bufferUsed;
+
+	ofxAudioUnitFlacWriter(const ofxAudioUnitFlacWriter &);
+	ofxAudioUnitFlacWriter& operator=(const ofxAudioUnitFlacWriter &);
+
+	bool encodeBlock();
+	void analyze(const SInt32 * samples, size_t frames, unsigned int bits, Subframe &best);
+	bool tryLpc(const SInt32 * samples, size_t frames, unsigned int bits, Subframe &best);
+	bool writeStreamInfo();
+	bool flush();
+	bool writeAll(const void * bytes, size_t count, off_t offset);
+};
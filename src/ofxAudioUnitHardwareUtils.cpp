@@ -157,4 +157,36 @@ std::string AudioDeviceManufacturer(AudioDeviceID deviceID)
 	return StringForPropertyOnDevice(deviceManuProp, deviceID);
 }
 
+Float64 AudioDeviceSampleRate(AudioDeviceID deviceID)
+{
+	AudioObjectPropertyAddress sampleRateProp = {
+		.mSelector = kAudioDevicePropertyNominalSampleRate,
+		.mScope    = kAudioObjectPropertyScopeGlobal,
+		.mElement  = kAudioObjectPropertyElementMaster
+	};
+	
+	Float64 sampleRate = 0;
+	UInt32 dataSize = sizeof(sampleRate);
+	OFXAU_PRINT(AudioObjectGetPropertyData(deviceID, &sampleRateProp, 0, NULL, &dataSize, &sampleRate),
+				"getting device sample rate");
+	
+	return sampleRate;
+}
+
+UInt32 AudioDeviceMaximumBufferFrameSize(AudioDeviceID deviceID)
+{
+	AudioObjectPropertyAddress bufferSizeRangeProp = {
+		.mSelector = kAudioDevicePropertyBufferFrameSizeRange,
+		.mScope    = kAudioObjectPropertyScopeGlobal,
+		.mElement  = kAudioObjectPropertyElementMaster
+	};
+	
+	AudioValueRange range = {0, 0};
+	UInt32 dataSize = sizeof(range);
+	OFXAU_PRINT(AudioObjectGetPropertyData(deviceID, &bufferSizeRangeProp, 0, NULL, &dataSize, &range),
+				"getting device buffer size range");
+	
+	return range.mMaximum;
+}
+
 #endif
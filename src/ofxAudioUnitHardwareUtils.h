@@ -18,4 +18,9 @@ AudioDeviceID DefaultAudioOutputDevice();
 std::string AudioDeviceName(AudioDeviceID deviceID);
 std::string AudioDeviceManufacturer(AudioDeviceID deviceID);
 
+Float64 AudioDeviceSampleRate(AudioDeviceID deviceID);
+
+// the largest I/O buffer the device can be set to, in frames
+UInt32 AudioDeviceMaximumBufferFrameSize(AudioDeviceID deviceID);
+
 #endif // !TARGET_OS_IPHONE
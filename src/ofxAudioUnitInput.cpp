@@ -1,7 +1,7 @@
 #include "ofxAudioUnit.h"
 #include "ofxAudioUnitUtils.h"
 #include "ofxAudioUnitHardwareUtils.h"
-#include "TPCircularBuffer.h"
+#include "ofxAudioUnitInputCapture.h"
 
 AudioComponentDescription inputDesc = {
 	kAudioUnitType_Output,
@@ -13,35 +13,26 @@ AudioComponentDescription inputDesc = {
 	kAudioUnitManufacturer_Apple
 };
 
-// Handles rendering audio from input unit to internal buffer
-OSStatus RenderCallback(void *inRefCon,
-						AudioUnitRenderActionFlags *ioActionFlags,
-						const AudioTimeStamp *inTimeStamp,
-						UInt32 inBusNumber,
-						UInt32 inNumberFrames,
-						AudioBufferList *ioData);
-
-// Handles pulling audio from internal buffer to a downstream audio unit
-OSStatus PullCallback(void *inRefCon,
-					  AudioUnitRenderActionFlags *ioActionFlags,
-					  const AudioTimeStamp *inTimeStamp,
-					  UInt32 inBusNumber,
-					  UInt32 inNumberFrames,
-					  AudioBufferList *ioData);
-
-typedef std::shared_ptr<AudioBufferList> AudioBufferListRef;
-
-struct InputContext
-{
-	std::vector<TPCircularBuffer> circularBuffers;
-	AudioUnitRef inputUnit;
-	AudioBufferListRef bufferList;
-};
+// Renders audio from the input unit, for InputCaptureCallback to capture
+static OSStatus RenderInputUnit(void *inRefCon,
+								AudioUnitRenderActionFlags *ioActionFlags,
+								const AudioTimeStamp *inTimeStamp,
+								UInt32 inBusNumber,
+								UInt32 inNumberFrames,
+								AudioBufferList *ioData);
 
 struct ofxAudioUnitInput::InputImpl
 {
 	InputContext ctx;
+	InputConsumer * renderConsumer;
 	bool isReady;
+	bool isRunning;
+	unsigned int samplesToBuffer;
+	UInt32 targetLatency;
+	
+	// the rate the input unit hands audio to its consumers at. 0 means
+	// the device's own rate, so no conversion happens on the way in
+	Float64 sampleRate;
 
 #if !TARGET_OS_IPHONE
 	AudioDeviceID inputDeviceID;
@@ -69,18 +60,34 @@ ofxAudioUnitInput::ofxAudioUnitInput(unsigned int samplesToBuffer)
 									 &ASBD_size),
 				"getting input ASBD");
 	
-	_impl->ctx.inputUnit  = _unit;
-	_impl->ctx.bufferList = AudioBufferListRef(AudioBufferListAlloc(ASBD.mChannelsPerFrame, 1024), AudioBufferListRelease);
-	_impl->ctx.circularBuffers.resize(ASBD.mChannelsPerFrame);
+	UInt32 maxFrames = 4096;
+	UInt32 maxFramesSize = sizeof(maxFrames);
+	OFXAU_PRINT(AudioUnitGetProperty(*_unit,
+									 kAudioUnitProperty_MaximumFramesPerSlice,
+									 kAudioUnitScope_Global,
+									 0,
+									 &maxFrames,
+									 &maxFramesSize),
+				"getting input's maximum frames per slice");
+	
+	// resized to suit the device in configureInputDevice()
+	AURenderCallbackStruct source = {RenderInputUnit, _unit.get()};
+	_impl->ctx.source     = source;
+	_impl->ctx.maxFrames  = 0;
+	_impl->ctx.sampleRate = 0;
+	_impl->ctx.compensateDrift = true;
+	_impl->ctx.counters.reset();
+	AllocateInputBuffers(_impl->ctx, ASBD.mChannelsPerFrame, maxFrames, samplesToBuffer, ASBD.mSampleRate);
+	_impl->renderConsumer = ConsumerFor(_impl->ctx, NULL, 0, 0);
+	_impl->targetLatency = 0;
 	_impl->isReady = false;
+	_impl->isRunning = false;
+	_impl->samplesToBuffer = samplesToBuffer;
+	_impl->sampleRate = 0;
 	
 #if !TARGET_OS_IPHONE
 	_impl->inputDeviceID = DefaultAudioInputDevice();
 #endif
-	
-	for(int i = 0; i < ASBD.mChannelsPerFrame; i++) {
-		TPCircularBufferInit(&_impl->ctx.circularBuffers[i], samplesToBuffer * sizeof(Float32));
-	}
 }
 
 // ----------------------------------------------------------
@@ -88,10 +95,6 @@ ofxAudioUnitInput::~ofxAudioUnitInput()
 // ----------------------------------------------------------
 {
 	stop();
-	
-	for(int i = 0; i < _impl->ctx.circularBuffers.size(); i++) {
-		TPCircularBufferCleanup(&_impl->ctx.circularBuffers[i]);
-	}
 }
 
 #pragma mark - Connections
@@ -111,6 +114,60 @@ ofxAudioUnit& ofxAudioUnitInput::connectTo(ofxAudioUnit &otherUnit, int destinat
 									 &ASBDSize),
 				"getting hardware input destination's format");
 	
+	// The first destination decides the input's format, and any after that
+	// are asked to take the same one, since they all share the capture buffer
+	bool fedAlready = false;
+	for(size_t i = 0; i < _impl->ctx.consumers.size(); i++) {
+		AudioUnit destination = _impl->ctx.consumers[i]->destination;
+		if(destination && !(destination == otherUnit.getUnit() && _impl->ctx.consumers[i]->destinationBus == destinationBus)) {
+			fedAlready = true;
+		}
+	}
+	
+	if(fedAlready) {
+		AudioStreamBasicDescription inputASBD;
+		UInt32 inputASBDSize = sizeof(inputASBD);
+		OFXAU_PRINT(AudioUnitGetProperty(*_unit,
+										 kAudioUnitProperty_StreamFormat,
+										 kAudioUnitScope_Output,
+										 1,
+										 &inputASBD,
+										 &inputASBDSize),
+					"getting hardware input's output format");
+		
+		OFXAU_PRINT(AudioUnitSetProperty(otherUnit,
+										 kAudioUnitProperty_StreamFormat,
+										 kAudioUnitScope_Input,
+										 destinationBus,
+										 &inputASBD,
+										 sizeof(inputASBD)),
+					"setting hardware input destination's format to match other destinations");
+		
+		return connectConsumer(otherUnit, destinationBus);
+	}
+	
+#if !TARGET_OS_IPHONE
+	// Stay at the device's rate if the destination can take it, and only
+	// convert on the way in if it can't
+	const Float64 deviceRate = AudioDeviceSampleRate(_impl->inputDeviceID);
+	
+	if(deviceRate > 0 && ASBD.mSampleRate != deviceRate) {
+		AudioStreamBasicDescription deviceRateASBD = ASBD;
+		deviceRateASBD.mSampleRate = deviceRate;
+		OSStatus s = AudioUnitSetProperty(otherUnit,
+										  kAudioUnitProperty_StreamFormat,
+										  kAudioUnitScope_Input,
+										  destinationBus,
+										  &deviceRateASBD,
+										  sizeof(deviceRateASBD));
+		if(s == noErr) {
+			ASBD = deviceRateASBD;
+		}
+	}
+	
+	_impl->sampleRate = (ASBD.mSampleRate == deviceRate) ? 0 : ASBD.mSampleRate;
+#endif
+	
 	OFXAU_PRINT(AudioUnitSetProperty(*_unit,
 									 kAudioUnitProperty_StreamFormat,
 									 kAudioUnitScope_Output,
@@ -119,16 +176,150 @@ ofxAudioUnit& ofxAudioUnitInput::connectTo(ofxAudioUnit &otherUnit, int destinat
 									 sizeof(ASBD)),
 				"setting hardware input's output format");
 	
-	AURenderCallbackStruct callback = {PullCallback, &_impl->ctx};
+#if !TARGET_OS_IPHONE
+	// the buffers may need to grow if the rate changed
+	if(_impl->isReady) configureStreamFormat();
+#endif
+	
+	return connectConsumer(otherUnit, destinationBus);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnit& ofxAudioUnitInput::connectConsumer(ofxAudioUnit &otherUnit, int destinationBus)
+// ----------------------------------------------------------
+{
+	InputConsumer * consumer = ConsumerFor(_impl->ctx, otherUnit.getUnit(), destinationBus, _impl->targetLatency);
+	AURenderCallbackStruct callback = {InputPullCallback, consumer};
 	otherUnit.setRenderCallback(callback, destinationBus);
 	return otherUnit;
 }
 
+// ----------------------------------------------------------
+size_t ofxAudioUnitInput::getNumConsumers() const
+// ----------------------------------------------------------
+{
+	// not counting the one render() reads through, or destinations that have
+	// since been connected elsewhere
+	size_t count = 0;
+	for(size_t i = 1; i < _impl->ctx.consumers.size(); i++) {
+		if(!IsStale(_impl->ctx, *_impl->ctx.consumers[i])) count++;
+	}
+	return count;
+}
+
 // ----------------------------------------------------------
 UInt32 ofxAudioUnitInput::getNumOutputChannels() const
 // ----------------------------------------------------------
 {
-	return _impl->ctx.circularBuffers.size();
+	return _impl->ctx.captureBuffer.channels();
+}
+
+#pragma mark - Stats
+
+static ofxAudioUnitInput::Stats StatsFromCounters(const InputCounters &counters)
+{
+	ofxAudioUnitInput::Stats stats;
+	stats.underruns        = counters.underruns.load(std::memory_order_relaxed);
+	stats.overruns         = counters.overruns.load(std::memory_order_relaxed);
+	stats.droppedFrames    = counters.droppedFrames.load(std::memory_order_relaxed);
+	stats.zeroFilledFrames = counters.zeroFilledFrames.load(std::memory_order_relaxed);
+	stats.latency          = counters.latency.load(std::memory_order_relaxed);
+	stats.averageLatency   = counters.averageLatency.load(std::memory_order_relaxed);
+	stats.maxLatency       = counters.maxLatency.load(std::memory_order_relaxed);
+	return stats;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitInput::Stats ofxAudioUnitInput::getStats() const
+// ----------------------------------------------------------
+{
+	// frames lost on the way in count against everyone
+	Stats stats = StatsFromCounters(_impl->ctx.counters);
+	
+	for(size_t i = 0; i < _impl->ctx.consumers.size(); i++) {
+		// leave out destinations that have since been connected elsewhere
+		if(IsStale(_impl->ctx, *_impl->ctx.consumers[i])) continue;
+		
+		const Stats consumerStats = StatsFromCounters(_impl->ctx.consumers[i]->counters);
+		stats.underruns        += consumerStats.underruns;
+		stats.overruns         += consumerStats.overruns;
+		stats.droppedFrames    += consumerStats.droppedFrames;
+		stats.zeroFilledFrames += consumerStats.zeroFilledFrames;
+		stats.latency           = std::max(stats.latency, consumerStats.latency);
+		stats.averageLatency    = std::max(stats.averageLatency, consumerStats.averageLatency);
+		stats.maxLatency        = std::max(stats.maxLatency, consumerStats.maxLatency);
+	}
+	
+	return stats;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitInput::Stats ofxAudioUnitInput::getStats(ofxAudioUnit &destination, int destinationBus) const
+// ----------------------------------------------------------
+{
+	const InputConsumer * consumer = FindConsumer(_impl->ctx, destination.getUnit(), destinationBus);
+	if(consumer) {
+		return StatsFromCounters(consumer->counters);
+	} else {
+		Stats empty = {};
+		return empty;
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitInput::resetStats()
+// ----------------------------------------------------------
+{
+	_impl->ctx.counters.reset();
+	for(size_t i = 0; i < _impl->ctx.consumers.size(); i++) {
+		_impl->ctx.consumers[i]->counters.reset();
+	}
+}
+
+#pragma mark - Drift Compensation
+
+// ----------------------------------------------------------
+void ofxAudioUnitInput::setDriftCompensation(bool enabled)
+// ----------------------------------------------------------
+{
+	_impl->ctx.compensateDrift = enabled;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitInput::setTargetLatency(UInt32 frames)
+// ----------------------------------------------------------
+{
+	_impl->targetLatency = frames;
+	for(size_t i = 0; i < _impl->ctx.consumers.size(); i++) {
+		_impl->ctx.consumers[i]->jitterBuffer.setTargetLatency(frames);
+	}
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitJitterBuffer::Stats ofxAudioUnitInput::getDriftStats() const
+// ----------------------------------------------------------
+{
+	// the first destination connected to that's still pulling, or render() if
+	// there isn't one
+	for(size_t i = 1; i < _impl->ctx.consumers.size(); i++) {
+		if(!IsStale(_impl->ctx, *_impl->ctx.consumers[i])) {
+			return _impl->ctx.consumers[i]->jitterBuffer.getStats();
+		}
+	}
+	return _impl->renderConsumer->jitterBuffer.getStats();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitJitterBuffer::Stats ofxAudioUnitInput::getDriftStats(ofxAudioUnit &destination, int destinationBus) const
+// ----------------------------------------------------------
+{
+	const InputConsumer * consumer = FindConsumer(_impl->ctx, destination.getUnit(), destinationBus);
+	if(consumer) {
+		return consumer->jitterBuffer.getStats();
+	} else {
+		ofxAudioUnitJitterBuffer::Stats empty = {1, 1, 0, 0, 0};
+		return empty;
+	}
 }
 
 #pragma mark - Start / Stop
@@ -140,6 +331,7 @@ bool ofxAudioUnitInput::start()
 	if(!_impl->isReady) _impl->isReady = configureInputDevice();
 	if(!_impl->isReady) return false;
 	
+	_impl->isRunning = true;
 	OFXAU_RET_BOOL(AudioOutputUnitStart(*_unit), "starting hardware input unit");
 }
 
@@ -148,6 +340,7 @@ bool ofxAudioUnitInput::stop()
 // ----------------------------------------------------------
 {
 	if(_unit) {
+		_impl->isRunning = false;
 		OFXAU_RET_BOOL(AudioOutputUnitStop(*_unit), "stopping hardware input unit");
 	}
 	
@@ -167,15 +360,26 @@ bool ofxAudioUnitInput::setDevice(AudioDeviceID deviceID)
 	// Only actively set the device if it's already been configured. If it's not
 	// yet configured, it'll be handled when configureInputDevice() is called.
 	if(_impl->isReady) {
+		// the new device may run at a different rate or buffer size, so the
+		// unit's formats and our buffers have to be set up again
+		const bool wasRunning = _impl->isRunning;
+		if(wasRunning) stop();
+		
+		OFXAU_PRINT(AudioUnitUninitialize(*_unit), "uninitializing input unit to change devices");
+		
 		UInt32 deviceIDSize = sizeof(deviceID);
-		OFXAU_RET_BOOL(AudioUnitSetProperty(*_unit,
-											kAudioOutputUnitProperty_CurrentDevice,
-											kAudioUnitScope_Global,
-											0,
-											&deviceID,
-											deviceIDSize),
-					   "setting input unit's device ID");
-        return true;
+		OFXAU_RET_FALSE(AudioUnitSetProperty(*_unit,
+											 kAudioOutputUnitProperty_CurrentDevice,
+											 kAudioUnitScope_Global,
+											 0,
+											 &deviceID,
+											 deviceIDSize),
+						"setting input unit's device ID");
+		
+		_impl->isReady = configureStreamFormat() && AudioUnitInitialize(*_unit) == noErr;
+		
+		if(_impl->isReady && wasRunning) start();
+		return _impl->isReady;
 	}
     return false;
 }
@@ -247,38 +451,82 @@ bool ofxAudioUnitInput::configureInputDevice()
 										 deviceIDSize), 
 					"setting HAL unit's device ID");
 	
+	if(!configureStreamFormat()) return false;
+	
+	AURenderCallbackStruct inputCallback = {InputCaptureCallback, &_impl->ctx};
+	
+	OFXAU_RET_FALSE(AudioUnitSetProperty(*_unit,
+										 kAudioOutputUnitProperty_SetInputCallback,
+										 kAudioUnitScope_Global,
+										 0,
+										 &inputCallback,
+										 sizeof(inputCallback)),
+					"setting hardware input callback");
+	
+	OFXAU_RET_BOOL(AudioUnitInitialize(*_unit), 
+				   "initializing hardware input unit after setting it to input mode");
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitInput::configureStreamFormat()
+// ----------------------------------------------------------
+{
 	AudioStreamBasicDescription deviceASBD = {0};
 	UInt32 ASBDSize = sizeof(deviceASBD);
 	OFXAU_RET_FALSE(AudioUnitGetProperty(*_unit,
 										 kAudioUnitProperty_StreamFormat,
-										 kAudioUnitScope_Output,
+										 kAudioUnitScope_Input,
 										 1,
 										 &deviceASBD,
 										 &ASBDSize),
 					"getting hardware stream format");
 	
-	deviceASBD.mSampleRate = 44100;
+	AudioStreamBasicDescription clientASBD = {0};
+	ASBDSize = sizeof(clientASBD);
+	OFXAU_RET_FALSE(AudioUnitGetProperty(*_unit,
+										 kAudioUnitProperty_StreamFormat,
+										 kAudioUnitScope_Output,
+										 1,
+										 &clientASBD,
+										 &ASBDSize),
+					"getting input's client stream format");
+	
+	// run at the device's rate unless something downstream asked otherwise
+	clientASBD.mSampleRate = _impl->sampleRate > 0 ? _impl->sampleRate : deviceASBD.mSampleRate;
 	
 	OFXAU_RET_FALSE(AudioUnitSetProperty(*_unit,
 										 kAudioUnitProperty_StreamFormat,
 										 kAudioUnitScope_Output,
 										 1,
-										 &deviceASBD,
-										 sizeof(deviceASBD)),
-					"setting input sample rate to 44100");
+										 &clientASBD,
+										 sizeof(clientASBD)),
+					"setting input's client sample rate");
 	
-	AURenderCallbackStruct inputCallback = {RenderCallback, &_impl->ctx};
+	UInt32 maxFrames = 0;
+	UInt32 maxFramesSize = sizeof(maxFrames);
+	OFXAU_PRINT(AudioUnitGetProperty(*_unit,
+									 kAudioUnitProperty_MaximumFramesPerSlice,
+									 kAudioUnitScope_Global,
+									 0,
+									 &maxFrames,
+									 &maxFramesSize),
+				"getting input's maximum frames per slice");
 	
-	OFXAU_RET_FALSE(AudioUnitSetProperty(*_unit,
-										 kAudioOutputUnitProperty_SetInputCallback,
-										 kAudioUnitScope_Global,
-										 0,
-										 &inputCallback,
-										 sizeof(inputCallback)),
-					"setting hardware input callback");
+	// The input callback is driven by the device's I/O cycle, which can be
+	// bigger than the unit's slice size. When converting, a cycle's worth of
+	// device frames turns into proportionally more (or fewer) client frames
+	UInt32 deviceFrames = AudioDeviceMaximumBufferFrameSize(_impl->inputDeviceID);
+	if(deviceASBD.mSampleRate > 0 && clientASBD.mSampleRate != deviceASBD.mSampleRate) {
+		deviceFrames = deviceFrames * clientASBD.mSampleRate / deviceASBD.mSampleRate + 2;
+	}
 	
-	OFXAU_RET_BOOL(AudioUnitInitialize(*_unit), 
-				   "initializing hardware input unit after setting it to input mode");
+	AllocateInputBuffers(_impl->ctx,
+						 clientASBD.mChannelsPerFrame,
+						 std::max(maxFrames, deviceFrames),
+						 _impl->samplesToBuffer,
+						 clientASBD.mSampleRate);
+	
+	return true;
 }
 
 #else
@@ -305,75 +553,27 @@ OSStatus ofxAudioUnitInput::render(AudioUnitRenderActionFlags *flags,
 								   AudioBufferList *data)
 // ----------------------------------------------------------
 {
-	return PullCallback(&_impl->ctx, flags, timestamp, bus, frames, data);
+	return InputPullCallback(_impl->renderConsumer, flags, timestamp, bus, frames, data);
 }
 
 // ----------------------------------------------------------
-OSStatus RenderCallback(void *inRefCon,
-						AudioUnitRenderActionFlags *ioActionFlags,
-						const AudioTimeStamp *inTimeStamp,
-						UInt32 inBusNumber,
-						UInt32 inNumberFrames,
-						AudioBufferList *ioData)
+OSStatus RenderInputUnit(void *inRefCon,
+						 AudioUnitRenderActionFlags *ioActionFlags,
+						 const AudioTimeStamp *inTimeStamp,
+						 UInt32 inBusNumber,
+						 UInt32 inNumberFrames,
+						 AudioBufferList *ioData)
 // ----------------------------------------------------------
 {
-	InputContext * ctx = static_cast<InputContext *>(inRefCon);
+	AudioUnit * inputUnit = static_cast<AudioUnit *>(inRefCon);
 	
-	OSStatus s = AudioUnitRender(*(ctx->inputUnit),
+	OSStatus s = AudioUnitRender(*inputUnit,
 								 ioActionFlags,
 								 inTimeStamp,
 								 inBusNumber,
 								 inNumberFrames,
-								 ctx->bufferList.get());
+								 ioData);
 	
 	OFXAU_PRINT(s, "rendering audio input");
-	
-	if(s == noErr) {
-		size_t buffersToCopy = std::min<size_t>(ctx->bufferList->mNumberBuffers, ctx->circularBuffers.size());
-		
-		for(int i = 0; i < buffersToCopy; i++) {
-			TPCircularBuffer * circBuffer = &ctx->circularBuffers[i];
-			if(circBuffer) {
-				TPCircularBufferProduceBytes(circBuffer,
-											 ctx->bufferList->mBuffers[i].mData,
-											 inNumberFrames * sizeof(Float32));
-			}
-		}
-	}
-	
 	return s;
 }
-
-// ----------------------------------------------------------
-OSStatus PullCallback(void *inRefCon,
-					  AudioUnitRenderActionFlags *ioActionFlags,
-					  const AudioTimeStamp *inTimeStamp,
-					  UInt32 inBusNumber,
-					  UInt32 inNumberFrames,
-					  AudioBufferList *ioData)
-// ----------------------------------------------------------
-{
-	InputContext * ctx = static_cast<InputContext *>(inRefCon);
-	
-	size_t buffersToCopy = std::min<size_t>(ioData->mNumberBuffers, ctx->circularBuffers.size());
-	
-	for(int i = 0; i < buffersToCopy; i++) {
-		int32_t circBufferSize;
-		Float32 * circBufferTail = (Float32 *) TPCircularBufferTail(&ctx->circularBuffers[i], &circBufferSize);
-		bool circBufferHasEnoughSamples = circBufferSize / sizeof(Float32) >= inNumberFrames ? true : false;
-		
-		if(!circBufferHasEnoughSamples) {
-			// clear buffer, so bytes that don't get written are silence instead of noise
-			memset(ioData->mBuffers[i].mData, 0, ioData->mBuffers[i].mDataByteSize);
-		}
-		
-		size_t bytesToConsume = std::min(ioData->mBuffers[i].mDataByteSize, (UInt32)circBufferSize);
-		
-		if(bytesToConsume > 0) {
-			memcpy(ioData->mBuffers[i].mData, circBufferTail, bytesToConsume);
-			TPCircularBufferConsume(&ctx->circularBuffers[i], bytesToConsume);
-		}
-	}
-	
-	return noErr;
-}
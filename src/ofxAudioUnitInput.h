@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ofxAudioUnitBase.h"
+#include "ofxAudioUnitJitterBuffer.h"
 
 class ofxAudioUnitInput : public ofxAudioUnit
 {
@@ -8,9 +9,14 @@ public:
 	ofxAudioUnitInput(unsigned int samplesToBuffer = 2048);
 	~ofxAudioUnitInput();
 	
+	// The input can feed any number of destinations. Each one reads the same
+	// captured audio at its own pace, without taking frames from the others
 	ofxAudioUnit& connectTo(ofxAudioUnit &otherUnit, int destinationBus = 0, int sourceBus = 0);
 	using ofxAudioUnit::connectTo; // for connectTo(ofxAudioUnitTap&)
 	
+	// destinations that are still pulling (or were only just connected)
+	size_t getNumConsumers() const;
+	
 	OSStatus render(AudioUnitRenderActionFlags *ioActionFlags,
 					const AudioTimeStamp *inTimeStamp,
 					UInt32 inOutputBusNumber,
@@ -19,6 +25,39 @@ public:
 	
 	UInt32 getNumOutputChannels() const;
 	
+	// Accounting for the capture path, cheap enough to poll every frame. All
+	// channels share one capture cursor, so these apply to each of them alike.
+	// getStats() sums the counters over every destination still pulling and
+	// reports the latency of the one furthest behind; getStats(destination)
+	// reports just that destination's share, and its latency is how far it
+	// lags the input
+	struct Stats {
+		UInt64 underruns;        // pulls that ran out of input
+		UInt64 overruns;         // times unread input was overwritten before being pulled
+		UInt64 droppedFrames;    // input frames that never made it to a pull
+		UInt64 zeroFilledFrames; // frames of silence pulled in place of input
+		UInt32 latency;          // frames between capture and pull, as of the latest pull
+		double averageLatency;   // the same, smoothed over about a second
+		UInt32 maxLatency;       // the highest latency since the stats were reset
+	};
+	
+	Stats getStats() const;
+	Stats getStats(ofxAudioUnit &destination, int destinationBus = 0) const;
+	void resetStats();
+	
+	// The input and output devices rarely share a clock, so by default the
+	// input is resampled very slightly on its way out to keep its latency
+	// steady, instead of clicking whenever the buffer drifts empty or full
+	void setDriftCompensation(bool enabled);
+	
+	// 0 (the default) picks a latency from the callback sizes on either side
+	void setTargetLatency(UInt32 frames);
+	
+	// for the first destination connected to that's still pulling, or a
+	// particular one
+	ofxAudioUnitJitterBuffer::Stats getDriftStats() const;
+	ofxAudioUnitJitterBuffer::Stats getDriftStats(ofxAudioUnit &destination, int destinationBus = 0) const;
+	
 	bool start();
 	bool stop();
 	
@@ -33,4 +72,8 @@ private:
 	struct InputImpl;
 	std::shared_ptr<InputImpl> _impl;
 	bool configureInputDevice();
+	ofxAudioUnit& connectConsumer(ofxAudioUnit &otherUnit, int destinationBus);
+#if !TARGET_OS_IPHONE
+	bool configureStreamFormat();
+#endif
 };
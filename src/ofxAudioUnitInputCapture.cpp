@@ -0,0 +1,248 @@
+#include "ofxAudioUnitInputCapture.h"
+#include <chrono>
+#include <stddef.h>
+#include <string.h>
+
+// seconds on a monotonic clock, for timestamping the callbacks
+static double CallbackTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#pragma mark - Buffers
+
+// ----------------------------------------------------------
+void AllocateInputBuffers(InputContext &ctx, UInt32 channels, UInt32 maxFrames, unsigned int samplesToBuffer, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	const size_t capacity = std::max<size_t>(samplesToBuffer, maxFrames * 2);
+	
+	std::lock_guard<BufferGuard> lock(ctx.guard);
+	
+	if(!ctx.bufferListStorage.empty() && ctx.bufferList()->mNumberBuffers == channels && ctx.maxFrames >= maxFrames &&
+	   ctx.captureBuffer.channels() == channels && ctx.captureBuffer.capacity() >= capacity &&
+	   ctx.sampleRate == sampleRate) {
+		return;
+	}
+	
+	ctx.bufferData.assign(channels * maxFrames, 0);
+	ctx.bufferListStorage.assign(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * std::max(channels, 1u), 0);
+	ctx.bufferList()->mNumberBuffers = channels;
+	for(UInt32 i = 0; i < channels; i++) {
+		ctx.bufferList()->mBuffers[i].mNumberChannels = 1;
+		ctx.bufferList()->mBuffers[i].mDataByteSize   = maxFrames * sizeof(Float32);
+		ctx.bufferList()->mBuffers[i].mData           = &ctx.bufferData[i * maxFrames];
+	}
+	ctx.maxFrames  = maxFrames;
+	ctx.captureBuffer.allocate(channels, capacity);
+	ctx.sampleRate = sampleRate;
+	
+	for(size_t i = 0; i < ctx.consumers.size(); i++) {
+		ctx.consumers[i]->readCursor = 0;
+		ctx.consumers[i]->jitterBuffer.allocate(channels, sampleRate);
+	}
+}
+
+// ----------------------------------------------------------
+InputConsumer * ConsumerFor(InputContext &ctx, AudioUnit destination, int destinationBus, UInt32 targetLatency)
+// ----------------------------------------------------------
+{
+	for(size_t i = 0; i < ctx.consumers.size(); i++) {
+		if(ctx.consumers[i]->destination == destination && ctx.consumers[i]->destinationBus == destinationBus) {
+			ctx.consumers[i]->connectedAt = CallbackTime();
+			return ctx.consumers[i].get();
+		}
+	}
+	
+	std::shared_ptr<InputConsumer> consumer(new InputConsumer);
+	consumer->ctx = &ctx;
+	consumer->destination = destination;
+	consumer->destinationBus = destinationBus;
+	consumer->readCursor = 0;
+	consumer->lastPull = 0;
+	consumer->connectedAt = CallbackTime();
+	consumer->jitterBuffer.setTargetLatency(targetLatency);
+	consumer->counters.reset();
+	
+	std::lock_guard<BufferGuard> lock(ctx.guard);
+	consumer->jitterBuffer.allocate(ctx.captureBuffer.channels(), ctx.sampleRate);
+	ctx.consumers.push_back(consumer);
+	return consumer.get();
+}
+
+// ----------------------------------------------------------
+const InputConsumer * FindConsumer(const InputContext &ctx, AudioUnit destination, int destinationBus)
+// ----------------------------------------------------------
+{
+	for(size_t i = 0; i < ctx.consumers.size(); i++) {
+		if(ctx.consumers[i]->destination == destination && ctx.consumers[i]->destinationBus == destinationBus) {
+			return ctx.consumers[i].get();
+		}
+	}
+	return NULL;
+}
+
+// ----------------------------------------------------------
+bool IsStale(const InputContext &ctx, const InputConsumer &consumer)
+// ----------------------------------------------------------
+{
+	double latest = 0;
+	for(size_t i = 0; i < ctx.consumers.size(); i++) {
+		latest = std::max(latest, ctx.consumers[i]->lastPull.load(std::memory_order_relaxed));
+	}
+	const double active = std::max(consumer.lastPull.load(std::memory_order_relaxed),
+								   consumer.connectedAt.load(std::memory_order_relaxed));
+	return active < latest - kStaleConsumerTime;
+}
+
+#pragma mark - Callbacks
+
+// ----------------------------------------------------------
+OSStatus InputCaptureCallback(void *inRefCon,
+							  AudioUnitRenderActionFlags *ioActionFlags,
+							  const AudioTimeStamp *inTimeStamp,
+							  UInt32 inBusNumber,
+							  UInt32 inNumberFrames,
+							  AudioBufferList * /*ioData*/)
+// ----------------------------------------------------------
+{
+	InputContext * ctx = static_cast<InputContext *>(inRefCon);
+	
+	// the buffers are being resized; drop this slice rather than wait
+	BufferGuardScope scope(ctx->guard);
+	if(!scope.entered) {
+		ctx->counters.add(ctx->counters.droppedFrames, inNumberFrames);
+		return noErr;
+	}
+	
+	if(inNumberFrames > ctx->maxFrames) {
+		ctx->counters.add(ctx->counters.droppedFrames, inNumberFrames);
+		return kAudioUnitErr_TooManyFramesToProcess;
+	}
+	
+	// AudioUnitRender shrinks these to what it rendered last time
+	AudioBufferList * bufferList = ctx->bufferList();
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; i++) {
+		bufferList->mBuffers[i].mDataByteSize = inNumberFrames * sizeof(Float32);
+	}
+	
+	OSStatus s = ctx->source.inputProc(ctx->source.inputProcRefCon,
+									   ioActionFlags,
+									   inTimeStamp,
+									   inBusNumber,
+									   inNumberFrames,
+									   bufferList);
+	
+	if(s == noErr) {
+		ctx->captureBuffer.write(bufferList, inNumberFrames);
+		const UInt64 writeCount = ctx->captureBuffer.getWriteCount();
+		const double now = CallbackTime();
+		for(size_t i = 0; i < ctx->consumers.size(); i++) {
+			ctx->consumers[i]->jitterBuffer.timestampWrite(writeCount, now);
+		}
+	} else {
+		ctx->counters.add(ctx->counters.droppedFrames, inNumberFrames);
+	}
+	
+	return s;
+}
+
+// ----------------------------------------------------------
+OSStatus InputPullCallback(void *inRefCon,
+						   AudioUnitRenderActionFlags * /*ioActionFlags*/,
+						   const AudioTimeStamp * /*inTimeStamp*/,
+						   UInt32 /*inBusNumber*/,
+						   UInt32 inNumberFrames,
+						   AudioBufferList *ioData)
+// ----------------------------------------------------------
+{
+	InputConsumer * consumer = static_cast<InputConsumer *>(inRefCon);
+	InputContext * ctx = consumer->ctx;
+	InputCounters &counters = consumer->counters;
+	UInt64 &readCursor = consumer->readCursor;
+	const double now = CallbackTime();
+	const double lastPull = consumer->lastPull.exchange(now, std::memory_order_relaxed);
+	
+	BufferGuardScope scope(ctx->guard);
+	if(!scope.entered) {
+		for(UInt32 i = 0; i < ioData->mNumberBuffers; i++) {
+			memset(ioData->mBuffers[i].mData, 0, ioData->mBuffers[i].mDataByteSize);
+		}
+		counters.underruns.fetch_add(1, std::memory_order_relaxed);
+		counters.add(counters.zeroFilledFrames, inNumberFrames);
+		return noErr;
+	}
+	
+	const UInt64 framesWritten = ctx->captureBuffer.getWriteCount();
+	UInt32 silentFrames = 0;
+	
+	// first pull, or the destination was disconnected for a while: what it
+	// missed wasn't lost, so start from the newest frames rather than count
+	// the lag as an overrun
+	if(now - lastPull > kStaleConsumerTime) {
+		const UInt64 backlog = std::min<UInt64>(std::min<UInt64>(inNumberFrames, ctx->captureBuffer.capacity()), framesWritten);
+		readCursor = framesWritten - backlog;
+		consumer->jitterBuffer.reset();
+	}
+	
+	if(ctx->compensateDrift.load(std::memory_order_relaxed)) {
+		const ofxAudioUnitJitterBuffer::ReadResult result =
+			consumer->jitterBuffer.read(ctx->captureBuffer, readCursor, ioData, inNumberFrames, now);
+		
+		if(result.underrun) counters.underruns.fetch_add(1, std::memory_order_relaxed);
+		if(result.overrun)  counters.overruns.fetch_add(1, std::memory_order_relaxed);
+		counters.add(counters.droppedFrames, result.skippedFrames);
+		silentFrames = result.silentFrames;
+	} else {
+		// without drift compensation, just hand over whatever's there
+		consumer->jitterBuffer.reset();
+		
+		const size_t capacity = ctx->captureBuffer.capacity();
+		
+		// if we've fallen more than a buffer behind, skip ahead to the oldest
+		// frames that are still there
+		if(framesWritten - readCursor > capacity) {
+			counters.overruns.fetch_add(1, std::memory_order_relaxed);
+			counters.add(counters.droppedFrames, framesWritten - capacity - readCursor);
+			readCursor = framesWritten - capacity;
+		}
+		
+		const size_t framesToCopy = std::min<UInt64>(framesWritten - readCursor, inNumberFrames);
+		
+		if(framesToCopy < inNumberFrames) {
+			// clear buffers, so frames that don't get written are silence instead of noise
+			for(UInt32 i = 0; i < ioData->mNumberBuffers; i++) {
+				memset(ioData->mBuffers[i].mData, 0, ioData->mBuffers[i].mDataByteSize);
+			}
+			counters.underruns.fetch_add(1, std::memory_order_relaxed);
+			silentFrames = inNumberFrames - framesToCopy;
+		}
+		
+		if(framesToCopy > 0) {
+			if(ctx->captureBuffer.read(readCursor, framesToCopy, ioData)) {
+				readCursor += framesToCopy;
+			} else {
+				// the input overwrote these frames while we were copying them
+				for(UInt32 i = 0; i < ioData->mNumberBuffers; i++) {
+					memset(ioData->mBuffers[i].mData, 0, ioData->mBuffers[i].mDataByteSize);
+				}
+				const UInt64 resumeAt = ctx->captureBuffer.getWriteCount();
+				counters.overruns.fetch_add(1, std::memory_order_relaxed);
+				counters.add(counters.droppedFrames, resumeAt - readCursor);
+				readCursor = resumeAt;
+				silentFrames = inNumberFrames;
+			}
+		}
+	}
+	
+	counters.add(counters.zeroFilledFrames, silentFrames);
+	
+	// how long the first frame handed over had been waiting since capture
+	if(silentFrames < inNumberFrames && framesWritten >= readCursor) {
+		counters.recordLatency(framesWritten - readCursor + (inNumberFrames - silentFrames),
+							   inNumberFrames,
+							   ctx->sampleRate);
+	}
+	
+	return noErr;
+}
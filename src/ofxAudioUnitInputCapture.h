@@ -0,0 +1,186 @@
+#pragma once
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include "ofxAudioUnitJitterBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The capture side of ofxAudioUnitInput: the buffer the input device's render
+// thread writes into, and the consumers (one per destination) that pull from
+// it on their own render threads, each at its own pace.
+
+// InputCaptureCallback() is the input unit's input callback. It renders a
+// slice through ctx.source (AudioUnitRender on the input unit, in the addon)
+// and writes it to the capture buffer. InputPullCallback() is a destination's
+// render callback, with its InputConsumer as the refcon.
+
+// AllocateInputBuffers() and ConsumerFor() belong to the main thread. They
+// take the BufferGuard, which waits for callbacks already inside to leave and
+// turns away the ones arriving meanwhile (the input drops its slice, a
+// consumer outputs silence), so neither side ever blocks.
+
+// Updated from both render threads without locking, read from anywhere
+struct InputCounters
+{
+	std::atomic<UInt64> underruns;
+	std::atomic<UInt64> overruns;
+	std::atomic<UInt64> droppedFrames;
+	std::atomic<UInt64> zeroFilledFrames;
+	std::atomic<UInt32> latency;
+	std::atomic<double> averageLatency;
+	std::atomic<UInt32> maxLatency;
+
+	void reset()
+	{
+		underruns = 0;
+		overruns = 0;
+		droppedFrames = 0;
+		zeroFilledFrames = 0;
+		latency = 0;
+		averageLatency = 0;
+		maxLatency = 0;
+	}
+
+	void add(std::atomic<UInt64> &counter, UInt64 amount)
+	{
+		if(amount > 0) counter.fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	// only called from InputPullCallback, so plain loads and stores are enough
+	void recordLatency(UInt64 frames, UInt32 pulledFrames, Float64 sampleRate)
+	{
+		const UInt32 clamped = std::min<UInt64>(frames, UINT32_MAX);
+		const double average = averageLatency.load(std::memory_order_relaxed);
+		const double smoothing = sampleRate > 0 ? std::min(1., pulledFrames / sampleRate) : 1;
+
+		latency.store(clamped, std::memory_order_relaxed);
+		averageLatency.store(average + (clamped - average) * smoothing, std::memory_order_relaxed);
+		if(clamped > maxLatency.load(std::memory_order_relaxed)) {
+			maxLatency.store(clamped, std::memory_order_relaxed);
+		}
+	}
+};
+
+// Lets any number of render threads use the buffers at once without locking
+// each other out. The main thread locks it to reallocate, waiting for the
+// callbacks already inside to leave; callbacks arriving meanwhile back off
+struct BufferGuard
+{
+	std::atomic<int> users;
+	std::atomic<bool> locked;
+	std::mutex lockers;
+
+	BufferGuard() : users(0), locked(false) { }
+
+	bool enter()
+	{
+		users.fetch_add(1);
+		if(locked.load()) {
+			users.fetch_sub(1);
+			return false;
+		}
+		return true;
+	}
+
+	void leave() {users.fetch_sub(1);}
+
+	void lock()
+	{
+		lockers.lock();
+		locked.store(true);
+		while(users.load() > 0) {
+			std::this_thread::yield();
+		}
+	}
+
+	void unlock()
+	{
+		locked.store(false);
+		lockers.unlock();
+	}
+};
+
+// holds a BufferGuard for the length of a callback, if it could get in
+struct BufferGuardScope
+{
+	BufferGuard &guard;
+	const bool entered;
+
+	BufferGuardScope(BufferGuard &guard) : guard(guard), entered(guard.enter()) { }
+	~BufferGuardScope() {if(entered) guard.leave();}
+};
+
+struct InputConsumer;
+
+struct InputContext
+{
+	ofxAudioUnitCaptureBuffer captureBuffer;
+	AURenderCallbackStruct source; // renders a slice of input into bufferList()
+	std::vector<Float32> bufferData;
+	std::vector<char> bufferListStorage;
+	UInt32 maxFrames; // the most frames bufferList() can hold
+	Float64 sampleRate;
+	BufferGuard guard; // locked while the buffers or the consumer list change
+	std::atomic<bool> compensateDrift;
+
+	InputCounters counters; // frames lost on the way in, before any consumer
+	std::vector<std::shared_ptr<InputConsumer> > consumers;
+
+	AudioBufferList * bufferList() {return (AudioBufferList *)&bufferListStorage[0];}
+};
+
+// Every destination pulling from the input gets its own read position in the
+// shared capture buffer, so they don't steal frames from each other
+struct InputConsumer
+{
+	InputContext * ctx;
+	AudioUnit destination; // NULL for audio pulled through render()
+	int destinationBus;
+	UInt64 readCursor; // only touched by this consumer's InputPullCallback
+	std::atomic<double> lastPull; // when InputPullCallback last ran for it, 0 before that
+	std::atomic<double> connectedAt; // when ConsumerFor() last handed it out
+	ofxAudioUnitJitterBuffer jitterBuffer;
+	InputCounters counters;
+};
+
+// How long a consumer can go without pulling while others carry on before
+// it's taken to be disconnected. One that starts pulling again after that
+// picks up at the newest frames, without counting what it missed
+static const double kStaleConsumerTime = 0.5;
+
+// Sizes the render buffer to the largest callback the unit can make and the
+// capture buffer to hold at least a couple of them. Does nothing if they're
+// already big enough, so the render thread isn't interrupted needlessly
+void AllocateInputBuffers(InputContext &ctx, UInt32 channels, UInt32 maxFrames, unsigned int samplesToBuffer, Float64 sampleRate);
+
+// Finds the consumer feeding a destination, or sets up a new one
+InputConsumer * ConsumerFor(InputContext &ctx, AudioUnit destination, int destinationBus, UInt32 targetLatency);
+const InputConsumer * FindConsumer(const InputContext &ctx, AudioUnit destination, int destinationBus);
+
+// Whether a consumer has stopped pulling while the others haven't, say because
+// its destination was connected to something else. Its counters are left as
+// they were then, so they shouldn't count towards the input's stats. One that
+// was just handed out by ConsumerFor() isn't stale until it's had a chance to
+// pull. Stale consumers stay in the list, since their destination may still
+// hold on to them and start pulling again
+bool IsStale(const InputContext &ctx, const InputConsumer &consumer);
+
+// Renders audio from the input into the capture buffer
+OSStatus InputCaptureCallback(void *inRefCon,
+							  AudioUnitRenderActionFlags *ioActionFlags,
+							  const AudioTimeStamp *inTimeStamp,
+							  UInt32 inBusNumber,
+							  UInt32 inNumberFrames,
+							  AudioBufferList *ioData);
+
+// Pulls audio from the capture buffer for one consumer
+OSStatus InputPullCallback(void *inRefCon,
+						   AudioUnitRenderActionFlags *ioActionFlags,
+						   const AudioTimeStamp *inTimeStamp,
+						   UInt32 inBusNumber,
+						   UInt32 inNumberFrames,
+						   AudioBufferList *ioData);
@@ -0,0 +1,425 @@
+#include "ofxAudioUnitJitterBuffer.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// interpolation kernel length, and how finely the space between two input
+// frames is divided up (kernels for in-between positions are interpolated)
+static const int kHalfTaps = 32;
+static const int kTaps = kHalfTaps * 2;
+static const int kPhases = 256;
+
+// passband edge, as a fraction of the input rate, and the Kaiser window's
+// shape (about 80 dB of stopband rejection)
+static const double kCutoff = 0.46;
+static const double kKaiserBeta = 7.86;
+
+// output is rendered in chunks of at most this many frames, so the scratch
+// buffer doesn't depend on the consumer's slice size
+static const UInt32 kMaxChunk = 512;
+
+// how far the controller is allowed to bend the read rate (1%, far beyond
+// any real clock drift, but quick to recover from a resync)
+static const double kMaxDeviation = 0.01;
+
+// the controller's natural period and the time constant of the latency
+// smoothing, in seconds. The smoothing has to be long enough to average out
+// the sawtooth of block-sized writes and reads
+static const double kLoopPeriod = 20;
+static const double kSmoothingTime = 0.5;
+
+// the writer's timestamps are smoothed over this long, in seconds, and the
+// smoothing starts over after a jump of more than kEpochResetTime
+static const double kEpochSmoothingTime = 2;
+static const double kEpochResetTime = 0.1;
+
+// headroom on top of a block's worth of latency, in seconds, for callbacks
+// running late and for the smoothed epoch lagging behind a drifting writer
+// (by kEpochSmoothingTime times the drift, 1ms at 500ppm)
+static const double kHeadroomTime = 0.002;
+
+// Callbacks don't run exactly on time, so the epoch of a clock (when it
+// would have been at frame 0 at its nominal rate) is smoothed. It drifts with
+// the clock, which the smoothing turns into a small constant offset that the
+// controller absorbs
+static void SmoothEpoch(double &smoothed, double epoch, double frames, Float64 sampleRate)
+{
+	if(isnan(smoothed) || fabs(epoch - smoothed) > kEpochResetTime) {
+		smoothed = epoch;
+	} else {
+		smoothed += std::min(1., frames / (kEpochSmoothingTime * sampleRate)) * (epoch - smoothed);
+	}
+}
+
+// zeroth order modified Bessel function of the first kind
+static double BesselI0(double x)
+{
+	double sum = 1;
+	double term = 1;
+	for(int k = 1; k < 50 && term > sum * 1e-12; k++) {
+		const double t = x / (2 * k);
+		term *= t * t;
+		sum += term;
+	}
+	return sum;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitJitterBuffer::ofxAudioUnitJitterBuffer()
+: _channels(0)
+, _sampleRate(0)
+, _scratchFrames(0)
+, _primed(false)
+, _fraction(0)
+, _step(1)
+, _integral(0)
+, _latency(0)
+, _kp(0)
+, _ki(0)
+, _smoothingFrames(1)
+, _maxWriteDelta(0)
+, _maxReadFrames(0)
+, _readCount(0)
+, _readerEpoch(NAN)
+, _timestampedCount(0)
+, _smoothedEpoch(NAN)
+, _writerEpoch(NAN)
+, _writerBlock(0)
+, _requestedLatency(0)
+, _statRatio(1)
+, _statEstimate(1)
+, _statLatency(0)
+, _statTarget(0)
+, _resyncs(0)
+// ----------------------------------------------------------
+{
+	// Each kernel is a windowed sinc centered on its fractional position,
+	// normalized so that it passes DC at unity gain
+	_kernels.resize((kPhases + 1) * kTaps);
+	const double windowScale = 1. / BesselI0(kKaiserBeta);
+
+	for(int p = 0; p <= kPhases; p++) {
+		const double fraction = p / double(kPhases);
+		Float32 * kernel = &_kernels[p * kTaps];
+		double sum = 0;
+
+		for(int k = 0; k < kTaps; k++) {
+			const double t = (k - (kHalfTaps - 1)) - fraction;
+			const double x = t / kHalfTaps;
+			const double window = fabs(x) < 1 ? BesselI0(kKaiserBeta * sqrt(1 - x * x)) * windowScale : 0;
+			const double arg = M_PI * 2 * kCutoff * t;
+			const double sinc = fabs(arg) < 1e-9 ? 1 : sin(arg) / arg;
+			kernel[k] = sinc * window;
+			sum += kernel[k];
+		}
+
+		for(int k = 0; k < kTaps; k++) {
+			kernel[k] /= sum;
+		}
+	}
+
+	_coefficients.resize(kTaps);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitJitterBuffer::allocate(unsigned int channels, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	_channels = channels;
+	_sampleRate = sampleRate;
+
+	_scratchFrames = kMaxChunk * (1 + kMaxDeviation) + kTaps + 2;
+	_scratch.assign(_scratchFrames * std::max(channels, 1u), 0);
+	_scratchListStorage.assign(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * std::max(channels, 1u), 0);
+
+	AudioBufferList * list = scratchList();
+	list->mNumberBuffers = channels;
+	for(unsigned int c = 0; c < channels; c++) {
+		list->mBuffers[c].mNumberChannels = 1;
+		list->mBuffers[c].mDataByteSize = _scratchFrames * sizeof(Float32);
+		list->mBuffers[c].mData = &_scratch[c * _scratchFrames];
+	}
+
+	// critically damped, with the gains expressed per frame
+	const double omega = 2 * M_PI / (kLoopPeriod * std::max(sampleRate, 1.));
+	_ki = omega * omega;
+	_kp = 2 * omega;
+	_smoothingFrames = kSmoothingTime * std::max(sampleRate, 1.);
+
+	_step = 1;
+	_integral = 0;
+	_maxWriteDelta = 0;
+	_maxReadFrames = 0;
+	_readCount = 0;
+	_readerEpoch = NAN;
+	_timestampedCount = 0;
+	_smoothedEpoch = NAN;
+	_writerEpoch.store(NAN);
+	_writerBlock.store(0);
+	reset();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitJitterBuffer::setTargetLatency(UInt32 frames)
+// ----------------------------------------------------------
+{
+	_requestedLatency.store(frames, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitJitterBuffer::getTargetLatency() const
+// ----------------------------------------------------------
+{
+	return _requestedLatency.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitJitterBuffer::reset()
+// ----------------------------------------------------------
+{
+	_primed = false;
+	_fraction = 0;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitJitterBuffer::Stats ofxAudioUnitJitterBuffer::getStats() const
+// ----------------------------------------------------------
+{
+	Stats stats;
+	stats.ratio          = _statRatio.load(std::memory_order_relaxed);
+	stats.estimatedRatio = _statEstimate.load(std::memory_order_relaxed);
+	stats.latency        = _statLatency.load(std::memory_order_relaxed);
+	stats.targetLatency  = _statTarget.load(std::memory_order_relaxed);
+	stats.resyncs        = _resyncs.load(std::memory_order_relaxed);
+	return stats;
+}
+
+#pragma mark - Writing
+
+// ----------------------------------------------------------
+void ofxAudioUnitJitterBuffer::timestampWrite(UInt64 writeCount, double seconds)
+// ----------------------------------------------------------
+{
+	const double epoch = seconds - writeCount / _sampleRate;
+	const double frames = writeCount - _timestampedCount;
+	_timestampedCount = writeCount;
+
+	// The block size is measured here rather than between reads: two blocks
+	// landing between a pair of reads is just the two clocks passing each
+	// other. The first write is skipped, as it may include however long the
+	// writer ran before this buffer was allocated
+	if(!isnan(_smoothedEpoch) && frames > _writerBlock.load(std::memory_order_relaxed)) {
+		_writerBlock.store(std::min<double>(frames, UINT32_MAX), std::memory_order_relaxed);
+	}
+
+	SmoothEpoch(_smoothedEpoch, epoch, frames, _sampleRate);
+	_writerEpoch.store(_smoothedEpoch, std::memory_order_relaxed);
+}
+
+#pragma mark - Reading
+
+// ----------------------------------------------------------
+double ofxAudioUnitJitterBuffer::writerPosition(UInt64 written, double seconds) const
+// ----------------------------------------------------------
+{
+	// how far the writer has got into its next block, judging by the time
+	// since its last write. Kept within a block (and the headroom, which the
+	// smoothed epoch's lag eats into) of the write count, in case the writer
+	// stalled. Clamping any tighter bends the estimate every time the two
+	// clocks' callbacks pass each other
+	const double epoch = _writerEpoch.load(std::memory_order_relaxed);
+	if(isnan(epoch)) {
+		return written;
+	}
+
+	const double slack = _maxWriteDelta + kHeadroomTime * _sampleRate;
+	const double position = (seconds - epoch) * _sampleRate;
+	return std::max<double>(double(written) - slack, std::min<double>(position, double(written) + slack));
+}
+
+// A read needs its whole span plus half a kernel of lookahead to be there
+// already
+// ----------------------------------------------------------
+double ofxAudioUnitJitterBuffer::minimumLatency() const
+// ----------------------------------------------------------
+{
+	return _maxReadFrames * (1 + kMaxDeviation) + kHalfTaps + 2;
+}
+
+// ----------------------------------------------------------
+double ofxAudioUnitJitterBuffer::targetLatency(size_t capacity) const
+// ----------------------------------------------------------
+{
+	// The latency is measured from where the writer would be by now, but
+	// the writer adds a block at a time, so sitting a block (plus some
+	// headroom) above the minimum keeps us clear of it just before a write
+	const double minimum = minimumLatency();
+	const UInt32 requested = _requestedLatency.load(std::memory_order_relaxed);
+	const double target = requested > 0 ? requested : minimum + _maxWriteDelta + kHeadroomTime * _sampleRate;
+
+	// leave room for the kernel's history and a write's worth of headroom
+	const double maximum = double(capacity) - _maxWriteDelta - kTaps;
+	return std::max(minimum, std::min(target, maximum));
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitJitterBuffer::resync(const ofxAudioUnitCaptureBuffer &source, UInt64 &cursor, double position, double target)
+// ----------------------------------------------------------
+{
+	// Starts over target frames behind where the writer would be by now,
+	// which is where the controller measures from. Lining up with the write
+	// count instead would leave it measuring up to a block too much latency,
+	// and speeding up straight into the next underrun
+	const UInt64 written = source.getWriteCount();
+	const double start = std::min(position - target, double(written) - minimumLatency());
+	if(start < 0 || target + kTaps > source.capacity()) {
+		_primed = false;
+		return false;
+	}
+
+	cursor = UInt64(start);
+	_fraction = 0;
+	_latency = position - cursor;
+	_primed = true;
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitJitterBuffer::updateController(double latency, double target, UInt32 frames)
+// ----------------------------------------------------------
+{
+	_latency += (1 - exp(-(frames / _smoothingFrames))) * (latency - _latency);
+
+	// too far behind the writer means reading faster than 1:1, and vice versa
+	const double error = _latency - target;
+	const double integralLimit = kMaxDeviation / _ki;
+	_integral = std::max(-integralLimit, std::min(_integral + error * frames, integralLimit));
+
+	const double step = 1 + _kp * error + _ki * _integral;
+	_step = std::max(1 - kMaxDeviation, std::min(step, 1 + kMaxDeviation));
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitJitterBuffer::ReadResult ofxAudioUnitJitterBuffer::read(const ofxAudioUnitCaptureBuffer &source, UInt64 &cursor, AudioBufferList * outBufferList, UInt32 frames, double seconds)
+// ----------------------------------------------------------
+{
+	ReadResult result = {0, 0, false, false};
+
+	const UInt64 written = source.getWriteCount();
+	const size_t capacity = source.capacity();
+
+	_maxWriteDelta = std::min<size_t>(_writerBlock.load(std::memory_order_relaxed), capacity / 2);
+	_maxReadFrames = std::max<UInt32>(_maxReadFrames, std::min<size_t>(frames, capacity / 2));
+
+	// the writer's position is judged at the reader's smoothed time, so the
+	// reader's own scheduling jitter doesn't end up in the read rate
+	SmoothEpoch(_readerEpoch, seconds - _readCount / _sampleRate, frames, _sampleRate);
+	const double now = _readerEpoch + _readCount / _sampleRate;
+	_readCount += frames;
+
+	const double target = targetLatency(capacity);
+	const double position = writerPosition(written, now);
+	bool ok = _channels > 0 && _channels == source.channels();
+
+	// wait until a whole write has been seen, so the target has settled
+	if(ok && !_primed) {
+		ok = _maxWriteDelta > 0 && resync(source, cursor, position, target);
+	}
+
+	if(ok) {
+		const double latency = double(written - cursor) - _fraction;
+		const bool underrun = latency < frames * (1 + kMaxDeviation) + kHalfTaps + 1;
+		const bool overrun = cursor + capacity < written + _maxWriteDelta + kHalfTaps;
+
+		if(underrun || overrun) {
+			_resyncs.fetch_add(1, std::memory_order_relaxed);
+			result.underrun = underrun;
+			result.overrun = overrun;
+			const UInt64 previous = cursor;
+			ok = resync(source, cursor, position, target);
+			if(ok && cursor > previous) result.skippedFrames = cursor - previous;
+		}
+	}
+
+	UInt32 done = 0;
+
+	if(ok) {
+		updateController(position - cursor - _fraction, target, frames);
+
+		while(done < frames) {
+			const UInt32 chunk = std::min(kMaxChunk, frames - done);
+
+			// the input frames under the kernel for every output frame in the chunk
+			const UInt64 first = cursor - (kHalfTaps - 1);
+			const size_t count = size_t(_fraction + (chunk - 1) * _step) + kTaps;
+
+			if(!source.read(first, count, scratchList())) {
+				// the writer lapped us mid-read. The rest of this read is
+				// silence, and the next one picks up at the target again
+				_resyncs.fetch_add(1, std::memory_order_relaxed);
+				result.overrun = true;
+				const UInt64 previous = cursor;
+				if(resync(source, cursor, position, target) && cursor > previous) {
+					result.skippedFrames = cursor - previous;
+				}
+				ok = false;
+				break;
+			}
+
+			interpolate(outBufferList, done, chunk);
+
+			const double end = _fraction + chunk * _step;
+			cursor += UInt64(end);
+			_fraction = end - floor(end);
+			done += chunk;
+		}
+	}
+
+	for(UInt32 i = 0; i < outBufferList->mNumberBuffers; i++) {
+		const UInt32 silentFrom = i < _channels ? done : 0;
+		if(silentFrom < frames) {
+			memset((Float32 *)outBufferList->mBuffers[i].mData + silentFrom, 0, (frames - silentFrom) * sizeof(Float32));
+		}
+	}
+
+	_statRatio.store(_step, std::memory_order_relaxed);
+	_statEstimate.store(1 + _ki * _integral, std::memory_order_relaxed);
+	_statLatency.store(_latency, std::memory_order_relaxed);
+	_statTarget.store(target, std::memory_order_relaxed);
+
+	result.silentFrames = frames - done;
+	return result;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitJitterBuffer::interpolate(AudioBufferList * outBufferList, UInt32 offset, UInt32 frames)
+// ----------------------------------------------------------
+{
+	const unsigned int channels = std::min<unsigned int>(_channels, outBufferList->mNumberBuffers);
+	const AudioBufferList * scratch = scratchList();
+	Float32 * coefficients = &_coefficients[0];
+
+	for(UInt32 i = 0; i < frames; i++) {
+		const double position = _fraction + i * _step;
+		const size_t index = size_t(position);
+		const double phase = (position - index) * kPhases;
+		const size_t p = std::min<size_t>(phase, kPhases - 1);
+		const Float32 mix = phase - p;
+
+		// one kernel per output frame, shared by every channel
+		const Float32 * k0 = &_kernels[p * kTaps];
+		const Float32 * k1 = k0 + kTaps;
+		for(int k = 0; k < kTaps; k++) {
+			coefficients[k] = k0[k] + (k1[k] - k0[k]) * mix;
+		}
+
+		for(unsigned int c = 0; c < channels; c++) {
+			const Float32 * in = (const Float32 *)scratch->mBuffers[c].mData + index;
+			Float32 sum = 0;
+			for(int k = 0; k < kTaps; k++) {
+				sum += in[k] * coefficients[k];
+			}
+			((Float32 *)outBufferList->mBuffers[c].mData)[offset + i] = sum;
+		}
+	}
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include <atomic>
+#include <vector>
+
+// ofxAudioUnitJitterBuffer reads audio out of a capture buffer that's being
+// filled on one clock (an input device) for a consumer running on another
+// (an output device). Two devices' clocks never quite agree, so reading one
+// frame per frame either drains the buffer or lets it overflow, with a click
+// every time that happens.
+
+// Instead, the read position moves through the input at a slightly variable
+// rate. A PI controller watches how far behind the writer the read position
+// is, and steers the rate so that the distance settles on a target latency.
+// Once it has settled, the controller's integral term is an estimate of the
+// ratio between the two clocks. Fractional read positions are interpolated
+// with a Kaiser-windowed sinc kernel, so the resampling is transparent below
+// ~20 kHz at 44.1 / 48 kHz.
+
+// Writes arrive a block at a time, so sampling the distance at each read
+// would only see it change when a whole block slips past a read, which can
+// take minutes. The writer timestamps each write instead, and the distance
+// is measured from where the writer would be by the time of the read.
+
+// allocate() isn't thread safe. timestampWrite() belongs to the writer's
+// render thread, getStats() and setTargetLatency() can be called from
+// anywhere, and everything else belongs to the consumer's render thread.
+
+class ofxAudioUnitJitterBuffer
+{
+public:
+	struct Stats {
+		double ratio;          // input frames consumed per output frame, right now
+		double estimatedRatio; // the controller's long term estimate of the clock ratio
+		double latency;        // smoothed distance behind the writer, in input frames
+		double targetLatency;  // where the controller is steering the latency to
+		UInt64 resyncs;        // times the read position had to jump to recover
+	};
+
+	ofxAudioUnitJitterBuffer();
+
+	void allocate(unsigned int channels, Float64 sampleRate);
+	unsigned int channels() const {return _channels;}
+	Float64 sampleRate() const {return _sampleRate;}
+
+	// 0 (the default) picks a target from the block sizes seen on either side
+	void setTargetLatency(UInt32 frames);
+	UInt32 getTargetLatency() const;
+
+	// forgets the read position, so the next read starts over at the target
+	// latency. The clock ratio estimate is kept
+	void reset();
+
+	// Writer: call after every write to the source, with its new write count
+	// and the time (in seconds, on the same clock the reader uses)
+	void timestampWrite(UInt64 writeCount, double seconds);
+
+	// what a read had to do to keep going, for the caller's bookkeeping
+	struct ReadResult {
+		UInt32 silentFrames;  // output frames filled with silence
+		UInt64 skippedFrames; // input frames jumped over to catch up with the writer
+		bool underrun;        // ran out of input after it had started reading
+		bool overrun;         // fell far enough behind for unread input to be overwritten
+	};
+
+	// Fills frames of every buffer in outBufferList, reading from source at
+	// cursor onwards and advancing cursor past what was consumed. Outputs
+	// silence while it's waiting for enough audio to reach the target
+	ReadResult read(const ofxAudioUnitCaptureBuffer &source, UInt64 &cursor, AudioBufferList * outBufferList, UInt32 frames, double seconds);
+
+	Stats getStats() const;
+
+private:
+	unsigned int _channels;
+	Float64 _sampleRate;
+
+	// interpolation kernels for kPhases + 1 fractional positions, kTaps each
+	std::vector<Float32> _kernels;
+	std::vector<Float32> _coefficients;
+
+	// the stretch of input a chunk of output is interpolated from
+	std::vector<Float32> _scratch;
+	std::vector<char> _scratchListStorage;
+	size_t _scratchFrames;
+
+	// controller state
+	bool _primed;
+	double _fraction;   // read position past cursor, in [0, 1)
+	double _step;       // input frames per output frame
+	double _integral;
+	double _latency;    // smoothed
+	double _kp, _ki;
+	double _smoothingFrames;
+	UInt32 _maxWriteDelta; // the writer's largest block, as of the latest read
+	UInt32 _maxReadFrames;
+
+	// the reader's own clock, smoothed the same way as the writer's below
+	UInt64 _readCount;
+	double _readerEpoch;
+
+	// when the writer would have written frame 0 at its nominal rate, as of
+	// its latest write. NaN until the first timestamp. The plain members are
+	// only touched by the writer
+	UInt64 _timestampedCount;
+	double _smoothedEpoch;
+	std::atomic<double> _writerEpoch;
+	std::atomic<UInt32> _writerBlock; // the most frames timestamped at once
+
+	std::atomic<UInt32> _requestedLatency;
+	std::atomic<double> _statRatio;
+	std::atomic<double> _statEstimate;
+	std::atomic<double> _statLatency;
+	std::atomic<double> _statTarget;
+	std::atomic<UInt64> _resyncs;
+
+	ofxAudioUnitJitterBuffer(const ofxAudioUnitJitterBuffer &);
+	ofxAudioUnitJitterBuffer& operator=(const ofxAudioUnitJitterBuffer &);
+
+	AudioBufferList * scratchList() {return (AudioBufferList *)&_scratchListStorage[0];}
+	double minimumLatency() const;
+	double targetLatency(size_t capacity) const;
+	double writerPosition(UInt64 written, double seconds) const;
+	bool resync(const ofxAudioUnitCaptureBuffer &source, UInt64 &cursor, double position, double target);
+	void updateController(double latency, double target, UInt32 frames);
+	void interpolate(AudioBufferList * outBufferList, UInt32 offset, UInt32 frames);
+};
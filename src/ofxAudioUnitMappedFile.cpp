@@ -0,0 +1,340 @@
+#include "ofxAudioUnitMappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const std::chrono::milliseconds kPollInterval(10);
+static const UInt32 kScratchFrames = 1024;
+
+// ----------------------------------------------------------
+ofxAudioUnitMappedFile::ofxAudioUnitMappedFile()
+: _fd(-1)
+, _map(NULL)
+, _mapBytes(0)
+, _frameBytes(0)
+, _pageBytes(sysconf(_SC_PAGESIZE))
+, _prefetchFrames(0)
+, _playing(false)
+, _looping(false)
+, _seekTo(-1)
+, _position(0)
+, _cursor(0)
+, _running(false)
+, _readyFrom(0)
+, _readyTo(0)
+, _readyHead(0)
+, _framesRendered(0)
+, _prefetchedBytes(0)
+, _prefetchMisses(0)
+// ----------------------------------------------------------
+{
+	memset(&_info, 0, sizeof(_info));
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMappedFile::~ofxAudioUnitMappedFile()
+// ----------------------------------------------------------
+{
+	close();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFile::open(const std::string &filePath, double prefetchSeconds)
+// ----------------------------------------------------------
+{
+	close();
+
+	ofxAudioUnitWavReader::Info info;
+	if(!ofxAudioUnitWavReader::readInfo(filePath, info)) return false;
+
+	const int fd = ::open(filePath.c_str(), O_RDONLY);
+	if(fd < 0) {
+		std::cout << "Couldn't open audio file: " << filePath << " (" << strerror(errno) << ")" << std::endl;
+		return false;
+	}
+
+	const size_t frameBytes = ofxAudioUnitSampleConverter::bytesPerSample(info.format) * info.channels;
+	const size_t mapBytes = info.dataOffset + info.frames * frameBytes;
+	void * map = mapBytes > 0 ? mmap(NULL, mapBytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if(map == MAP_FAILED) {
+		std::cout << "Couldn't map " << filePath << " (" << strerror(errno) << ")" << std::endl;
+		::close(fd);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(_fileMutex);
+	_filePath = filePath;
+	_info = info;
+	_fd = fd;
+	_map = (unsigned char *)map;
+	_mapBytes = mapBytes;
+	_frameBytes = frameBytes;
+	_prefetchFrames = prefetchSeconds > 0 ? std::max<UInt64>(prefetchSeconds * info.sampleRate, kScratchFrames) : 0;
+
+	_cursor = 0;
+	_position.store(0);
+	_seekTo.store(-1);
+	_playing.store(false);
+	_scratch.resize(kScratchFrames * info.channels);
+	_planes.resize(info.channels);
+
+	_readyFrom.store(0);
+	_readyTo.store(0);
+	_readyHead.store(0);
+	if(_prefetchFrames > 0) {
+		advise(0, _prefetchFrames);
+		_running.store(true);
+		_prefetcher = std::thread(&ofxAudioUnitMappedFile::runPrefetcher, this);
+	}
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::close()
+// ----------------------------------------------------------
+{
+	if(_prefetcher.joinable()) {
+		_running.store(false);
+		_prefetcher.join();
+	}
+
+	std::lock_guard<std::mutex> lock(_fileMutex);
+	if(_map) {
+		munmap(_map, _mapBytes);
+		_map = NULL;
+		_mapBytes = 0;
+	}
+	if(_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+	_playing.store(false);
+}
+
+#pragma mark - Transport
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::play()
+// ----------------------------------------------------------
+{
+	if(!_map) return;
+	if(_seekTo.load() < 0 && _position.load() >= _info.frames) setPosition(0);
+	_playing.store(true, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::stop()
+// ----------------------------------------------------------
+{
+	_playing.store(false, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::setPosition(UInt64 frame)
+// ----------------------------------------------------------
+{
+	if(!_map) return;
+	frame = std::min(frame, _info.frames);
+	if(_prefetchFrames > 0) advise(frame, frame + _prefetchFrames);
+	_seekTo.store(frame, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::preload(UInt64 frame)
+// ----------------------------------------------------------
+{
+	if(!_map) return;
+	advise(frame, frame + std::max<UInt64>(_prefetchFrames, kScratchFrames));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::cue(UInt64 frame)
+// ----------------------------------------------------------
+{
+	_seekTo.store(frame, std::memory_order_release);
+	_playing.store(true, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitMappedFile::getPosition() const
+// ----------------------------------------------------------
+{
+	const SInt64 seekTo = _seekTo.load(std::memory_order_acquire);
+	return seekTo >= 0 ? seekTo : _position.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMappedFile::Stats ofxAudioUnitMappedFile::getStats() const
+// ----------------------------------------------------------
+{
+	Stats stats;
+	stats.framesRendered = _framesRendered;
+	stats.prefetchedBytes = _prefetchedBytes;
+	stats.prefetchMisses = _prefetchMisses;
+
+	const UInt64 position = _position.load();
+	const UInt64 readyTo = _readyTo.load();
+	stats.readyFrames = readyTo > position && _readyFrom.load() <= position ? readyTo - position : 0;
+	return stats;
+}
+
+#pragma mark - Render thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::render(UInt32 frames, AudioBufferList * bufferList)
+// ----------------------------------------------------------
+{
+	UInt32 done = 0;
+
+	// if the file's being swapped, this cycle is silent
+	std::unique_lock<std::mutex> lock(_fileMutex, std::try_to_lock);
+	if(lock.owns_lock() && _map) {
+		const SInt64 seekTo = _seekTo.exchange(-1, std::memory_order_acquire);
+		if(seekTo >= 0) _cursor = std::min<UInt64>(seekTo, _info.frames);
+
+		while(done < frames && _playing.load(std::memory_order_relaxed)) {
+			if(_cursor >= _info.frames) {
+				if(_looping.load(std::memory_order_relaxed) && _info.frames > 0) {
+					_cursor = 0;
+				} else {
+					_playing.store(false, std::memory_order_relaxed);
+					break;
+				}
+			}
+
+			const UInt32 count = std::min<UInt64>(frames - done, _info.frames - _cursor);
+			if(!isReady(_cursor, _cursor + count)) _prefetchMisses++;
+			copyFrames(_cursor, count, bufferList, done);
+			_cursor += count;
+			done += count;
+		}
+
+		_position.store(_cursor, std::memory_order_relaxed);
+		_framesRendered.fetch_add(done, std::memory_order_relaxed);
+	}
+
+	for(UInt32 b = 0; b < bufferList->mNumberBuffers; b++) {
+		Float32 * out = (Float32 *)bufferList->mBuffers[b].mData;
+		std::fill(out + done, out + frames, 0);
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFile::isReady(UInt64 start, UInt64 end) const
+// ----------------------------------------------------------
+{
+	if(end <= _readyHead.load(std::memory_order_relaxed)) return true;
+	return start >= _readyFrom.load(std::memory_order_relaxed) && end <= _readyTo.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::copyFrames(UInt64 start, UInt32 frames, AudioBufferList * bufferList, UInt32 offset)
+// ----------------------------------------------------------
+{
+	const unsigned char * in = _map + _info.dataOffset + start * _frameBytes;
+	const unsigned int channels = _info.channels;
+
+	// straight from the mapping into the output when the channels line up
+	if(bufferList->mNumberBuffers == channels) {
+		for(unsigned int c = 0; c < channels; c++) {
+			_planes[c] = (Float32 *)bufferList->mBuffers[c].mData + offset;
+		}
+		ofxAudioUnitSampleConverter::deinterleave(in, _info.format, channels, frames, &_planes[0]);
+		return;
+	}
+
+	for(UInt32 done = 0; done < frames;) {
+		const UInt32 count = std::min(frames - done, kScratchFrames);
+		for(unsigned int c = 0; c < channels; c++) {
+			_planes[c] = &_scratch[c * kScratchFrames];
+		}
+		ofxAudioUnitSampleConverter::deinterleave(in + done * _frameBytes, _info.format, channels, count, &_planes[0]);
+
+		for(UInt32 b = 0; b < bufferList->mNumberBuffers; b++) {
+			const Float32 * from = _planes[b % channels];
+			std::copy(from, from + count, (Float32 *)bufferList->mBuffers[b].mData + offset + done);
+		}
+		done += count;
+	}
+}
+
+#pragma mark - Prefetch thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::runPrefetcher()
+// ----------------------------------------------------------
+{
+	while(_running.load(std::memory_order_acquire)) {
+		prefetch();
+		std::this_thread::sleep_for(kPollInterval);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::prefetch()
+// ----------------------------------------------------------
+{
+	const UInt64 total = _info.frames;
+	const SInt64 seekTo = _seekTo.load(std::memory_order_acquire);
+	const UInt64 position = seekTo >= 0 ? seekTo : _position.load(std::memory_order_relaxed);
+
+	// after a seek, start over from the new position
+	UInt64 readyTo = _readyTo.load(std::memory_order_relaxed);
+	if(position < _readyFrom.load(std::memory_order_relaxed) || position > readyTo) {
+		readyTo = position;
+		_readyTo.store(readyTo, std::memory_order_relaxed);
+	}
+	_readyFrom.store(position, std::memory_order_relaxed);
+
+	const UInt64 target = std::min(position + _prefetchFrames, total);
+	if(target > readyTo) {
+		touch(readyTo, target);
+		_readyTo.store(target, std::memory_order_relaxed);
+	}
+
+	// the top of the file, for when it wraps around
+	const UInt64 readyHead = _readyHead.load(std::memory_order_relaxed);
+	if(_looping.load(std::memory_order_relaxed) && position + _prefetchFrames > total) {
+		const UInt64 headTarget = std::min(position + _prefetchFrames - total, total);
+		if(headTarget > readyHead) {
+			touch(readyHead, headTarget);
+			_readyHead.store(headTarget, std::memory_order_relaxed);
+		}
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::advise(UInt64 fromFrame, UInt64 toFrame)
+// ----------------------------------------------------------
+{
+	toFrame = std::min(toFrame, _info.frames);
+	if(fromFrame >= toFrame) return;
+
+	const size_t begin = (_info.dataOffset + fromFrame * _frameBytes) / _pageBytes * _pageBytes;
+	const size_t end = std::min<size_t>(_info.dataOffset + toFrame * _frameBytes, _mapBytes);
+	madvise(_map + begin, end - begin, MADV_WILLNEED);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFile::touch(UInt64 fromFrame, UInt64 toFrame)
+// ----------------------------------------------------------
+{
+	toFrame = std::min(toFrame, _info.frames);
+	if(fromFrame >= toFrame) return;
+
+	// ask for the whole range first, so the reads go out together, then
+	// wait for each page here rather than on the render thread
+	advise(fromFrame, toFrame);
+
+	const size_t begin = (_info.dataOffset + fromFrame * _frameBytes) / _pageBytes * _pageBytes;
+	const size_t end = std::min<size_t>(_info.dataOffset + toFrame * _frameBytes, _mapBytes);
+	for(size_t page = begin; page < end; page += _pageBytes) {
+		(void)*(volatile const unsigned char *)(_map + page);
+	}
+	_prefetchedBytes.fetch_add(end - begin, std::memory_order_relaxed);
+}
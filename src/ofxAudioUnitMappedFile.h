@@ -0,0 +1,121 @@
+#pragma once
+
+#include "ofxAudioUnitWavReader.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ofxAudioUnitMappedFile plays a WAV or RF64 file straight out of a memory
+// mapping of it, for stems too long to be worth decoding into memory. There's
+// no decode buffer and no reader thread: the render thread converts samples
+// from the mapped pages directly into its output buffers. Float files only
+// need deinterleaving on the way; integer files go through the vectorized
+// conversion in ofxAudioUnitSampleConverter.
+
+// Reading a page that isn't in memory yet would stall the render thread on
+// the disk, so a prefetch thread keeps the next few seconds ahead of the play
+// head resident: it asks for them with madvise(MADV_WILLNEED) and then
+// touches every page, taking any page faults itself. When looping, it also
+// keeps the start of the file ready for the wrap. A render cycle that gets
+// ahead of it (after a seek, or with a disk that can't keep up) is counted
+// as a prefetch miss.
+
+// open(), close() and setPosition() are for the main thread. Swapping files
+// while the render thread is running is fine; it plays silence for any cycle
+// that lands in the middle of it.
+
+class ofxAudioUnitMappedFile
+{
+public:
+	struct Stats {
+		UInt64 framesRendered;
+		UInt64 prefetchedBytes;
+		UInt64 prefetchMisses; // render cycles that read frames the prefetch thread hadn't got to
+		UInt64 readyFrames;    // how far ahead of the play head the prefetch thread is
+	};
+
+	ofxAudioUnitMappedFile();
+	~ofxAudioUnitMappedFile();
+
+	// prefetchSeconds is how much to keep ready ahead of the play head. 0
+	// turns the prefetch thread off, leaving it to the kernel's readahead
+	bool open(const std::string &filePath, double prefetchSeconds = 2);
+	void close();
+
+	bool isOpen() const {return _map != NULL;}
+	const std::string& getFilePath() const {return _filePath;}
+	const ofxAudioUnitWavReader::Info& getInfo() const {return _info;}
+
+	// plays from the current position, or from the top if it's at the end
+	void play();
+	void stop();
+	bool isPlaying() const {return _playing.load(std::memory_order_relaxed);}
+
+	void setLooping(bool looping) {_looping.store(looping, std::memory_order_relaxed);}
+	bool isLooping() const {return _looping.load(std::memory_order_relaxed);}
+
+	// Takes effect on the next render cycle. The new position is prefetched
+	// (asynchronously) straight away, so a seek a little ahead of playing it
+	// doesn't miss
+	void setPosition(UInt64 frame);
+	UInt64 getPosition() const;
+
+	// For schedulers: preload() asks for the audio at `frame` to be read in,
+	// ahead of a cue() there. cue() is for the render thread, between calls
+	// to render(); it plays from `frame` from the next one on, and leaves
+	// prefetching it to the prefetch thread
+	void preload(UInt64 frame);
+	void cue(UInt64 frame);
+
+	// Render thread: the file's channel c % (file channels) into buffer c,
+	// silence past the end (unless looping) or while stopped
+	void render(UInt32 frames, AudioBufferList * bufferList);
+
+	Stats getStats() const;
+
+private:
+	std::mutex _fileMutex; // held by open() and close(); render() only tries it
+	std::string _filePath;
+	ofxAudioUnitWavReader::Info _info;
+	int _fd;
+	unsigned char * _map;
+	size_t _mapBytes;
+	size_t _frameBytes;
+	size_t _pageBytes;
+	UInt64 _prefetchFrames;
+
+	std::atomic<bool> _playing;
+	std::atomic<bool> _looping;
+	std::atomic<SInt64> _seekTo; // -1 for none
+	std::atomic<UInt64> _position;
+
+	// render thread
+	UInt64 _cursor;
+	std::vector<Float32> _scratch;
+	std::vector<Float32 *> _planes;
+
+	// prefetch thread: frames [_readyFrom, _readyTo) and [0, _readyHead) have
+	// been touched
+	std::thread _prefetcher;
+	std::atomic<bool> _running;
+	std::atomic<UInt64> _readyFrom;
+	std::atomic<UInt64> _readyTo;
+	std::atomic<UInt64> _readyHead;
+
+	std::atomic<UInt64> _framesRendered;
+	std::atomic<UInt64> _prefetchedBytes;
+	std::atomic<UInt64> _prefetchMisses;
+
+	ofxAudioUnitMappedFile(const ofxAudioUnitMappedFile &);
+	ofxAudioUnitMappedFile& operator=(const ofxAudioUnitMappedFile &);
+
+	void runPrefetcher();
+	void prefetch();
+	void touch(UInt64 fromFrame, UInt64 toFrame);
+	void advise(UInt64 fromFrame, UInt64 toFrame);
+	void copyFrames(UInt64 start, UInt32 frames, AudioBufferList * bufferList, UInt32 offset);
+	bool isReady(UInt64 start, UInt64 end) const;
+};
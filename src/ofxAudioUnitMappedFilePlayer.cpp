@@ -0,0 +1,196 @@
+#include "ofxAudioUnitMappedFilePlayer.h"
+
+// a render callback which plays the mapped file (through its timeline
+// track) into the buffers it's given
+static OSStatus RenderMapped(void * inRefCon,
+							 AudioUnitRenderActionFlags *	ioActionFlags,
+							 const AudioTimeStamp *	inTimeStamp,
+							 UInt32 inBusNumber,
+							 UInt32	inNumberFrames,
+							 AudioBufferList * ioData);
+
+// the mapped file, as something a timeline track can start and stop
+class MappedFileTarget : public ofxAudioUnitTimelineTrack::Target
+{
+public:
+	explicit MappedFileTarget(ofxAudioUnitMappedFile &file) : _file(file) {}
+
+	void prepare(UInt64 frame) {_file.preload(frame);}
+	void start(UInt64 frame) {_file.cue(frame);}
+	void stop() {_file.stop();}
+	void setLooping(bool looping) {_file.setLooping(looping);}
+	void render(UInt32 frames, AudioBufferList * bufferList) {_file.render(frames, bufferList);}
+
+private:
+	ofxAudioUnitMappedFile &_file;
+};
+
+// ----------------------------------------------------------
+ofxAudioUnitMappedFilePlayer::ofxAudioUnitMappedFilePlayer(unsigned int channels)
+: _file(new ofxAudioUnitMappedFile)
+, _target(new MappedFileTarget(*_file))
+, _track(new ofxAudioUnitTimelineTrack(*_target))
+// ----------------------------------------------------------
+{
+	setSource((AURenderCallbackStruct){RenderMapped, _track.get()}, channels);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMappedFilePlayer::~ofxAudioUnitMappedFilePlayer()
+// ----------------------------------------------------------
+{
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFilePlayer::setFile(const std::string &filePath, double prefetchSeconds)
+// ----------------------------------------------------------
+{
+	return _file->open(filePath, prefetchSeconds);
+}
+
+// ----------------------------------------------------------
+const ofxAudioUnitWavReader::Info& ofxAudioUnitMappedFilePlayer::getFileInfo() const
+// ----------------------------------------------------------
+{
+	return _file->getInfo();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFilePlayer::play()
+// ----------------------------------------------------------
+{
+	_file->play();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFilePlayer::stop()
+// ----------------------------------------------------------
+{
+	_file->stop();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFilePlayer::isPlaying() const
+// ----------------------------------------------------------
+{
+	return _file->isPlaying();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFilePlayer::setLooping(bool looping)
+// ----------------------------------------------------------
+{
+	_file->setLooping(looping);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFilePlayer::isLooping() const
+// ----------------------------------------------------------
+{
+	return _file->isLooping();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFilePlayer::setPosition(UInt64 frame)
+// ----------------------------------------------------------
+{
+	_file->setPosition(frame);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitMappedFilePlayer::getPosition() const
+// ----------------------------------------------------------
+{
+	return _file->getPosition();
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitMappedFilePlayer::getLength() const
+// ----------------------------------------------------------
+{
+	return _file->isOpen() ? _file->getInfo().frames : 0;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitMappedFile::Stats ofxAudioUnitMappedFilePlayer::getStats() const
+// ----------------------------------------------------------
+{
+	return _file->getStats();
+}
+
+#pragma mark - Timeline
+
+// ----------------------------------------------------------
+void ofxAudioUnitMappedFilePlayer::setTimeline(const std::shared_ptr<ofxAudioUnitTimeline> &timeline)
+// ----------------------------------------------------------
+{
+	_track->setTimeline(timeline);
+}
+
+// ----------------------------------------------------------
+std::shared_ptr<ofxAudioUnitTimeline> ofxAudioUnitMappedFilePlayer::getTimeline() const
+// ----------------------------------------------------------
+{
+	return _track->getTimeline();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFilePlayer::startAt(UInt64 time, UInt64 frame)
+// ----------------------------------------------------------
+{
+	return _track->startAt(time, frame);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFilePlayer::stopAt(UInt64 time)
+// ----------------------------------------------------------
+{
+	return _track->stopAt(time);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFilePlayer::setLoopingAt(UInt64 time, bool looping)
+// ----------------------------------------------------------
+{
+	return _track->setLoopingAt(time, looping);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitMappedFilePlayer::clearScheduled()
+// ----------------------------------------------------------
+{
+	return _track->clear();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimelineTrack::Stats ofxAudioUnitMappedFilePlayer::getTimelineStats() const
+// ----------------------------------------------------------
+{
+	return _track->getStats();
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitMappedFilePlayer::getName()
+// ----------------------------------------------------------
+{
+	if(name.empty()) {
+		return "ofxAudioUnitMappedFilePlayer";
+	} else {
+		return name;
+	}
+}
+
+#pragma mark - Render Callback
+
+// ----------------------------------------------------------
+OSStatus RenderMapped(void * inRefCon,
+					  AudioUnitRenderActionFlags * ioActionFlags,
+					  const AudioTimeStamp * inTimeStamp,
+					  UInt32 inBusNumber,
+					  UInt32 inNumberFrames,
+					  AudioBufferList * ioData)
+// ----------------------------------------------------------
+{
+	((ofxAudioUnitTimelineTrack *)inRefCon)->render(inTimeStamp, inNumberFrames, ioData);
+	return noErr;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ofxAudioUnitDSPNode.h"
+#include "ofxAudioUnitMappedFile.h"
+#include "ofxAudioUnitTimeline.h"
+
+// ofxAudioUnitMappedFilePlayer plays long WAV or RF64 files (multi-gigabyte
+// stems, say) from a memory mapping instead of decoding them into memory or
+// streaming them through AUAudioFilePlayer. See ofxAudioUnitMappedFile for
+// how the render thread is kept from waiting on the disk.
+
+// It's a source, so connect it to a mixer or output like a file player. The
+// file is played at its own sample rate.
+
+// Players given the same ofxAudioUnitTimeline can be started, stopped and
+// looped on it to the sample with startAt(), stopAt() and setLoopingAt(),
+// which take timeline sample times. play() and the rest still work, but a
+// player on a timeline is only heard while the timeline's running.
+
+class ofxAudioUnitMappedFilePlayer : public ofxAudioUnitDSPNode
+{
+public:
+	explicit ofxAudioUnitMappedFilePlayer(unsigned int channels = 2);
+	virtual ~ofxAudioUnitMappedFilePlayer();
+
+	// prefetchSeconds is how far ahead of the play head to keep in memory
+	bool setFile(const std::string &filePath, double prefetchSeconds = 2);
+	const ofxAudioUnitWavReader::Info& getFileInfo() const;
+
+	void play();
+	void stop();
+	bool isPlaying() const;
+
+	void setLooping(bool looping);
+	bool isLooping() const;
+
+	void setPosition(UInt64 frame);
+	UInt64 getPosition() const;
+	UInt64 getLength() const;
+
+	ofxAudioUnitMappedFile::Stats getStats() const;
+
+	void setTimeline(const std::shared_ptr<ofxAudioUnitTimeline> &timeline);
+	std::shared_ptr<ofxAudioUnitTimeline> getTimeline() const;
+
+	// false if the event couldn't be queued
+	bool startAt(UInt64 time, UInt64 frame = 0);
+	bool stopAt(UInt64 time);
+	bool setLoopingAt(UInt64 time, bool looping);
+	bool clearScheduled();
+
+	ofxAudioUnitTimelineTrack::Stats getTimelineStats() const;
+
+	virtual std::string getName();
+
+private:
+	std::shared_ptr<ofxAudioUnitMappedFile> _file;
+	std::shared_ptr<ofxAudioUnitTimelineTrack::Target> _target;
+	std::shared_ptr<ofxAudioUnitTimelineTrack> _track;
+};
@@ -0,0 +1,183 @@
+#include "ofxAudioUnitPitchDetector.h"
+#include <algorithm>
+#include <math.h>
+
+// ----------------------------------------------------------
+ofxAudioUnitPitchDetector::ofxAudioUnitPitchDetector(unsigned int windowSize, const Settings &settings)
+: _settings(settings)
+, _N(0)
+, _log2FftSize(0)
+// ----------------------------------------------------------
+{
+	_fftData.realp = NULL;
+	_fftData.imagp = NULL;
+	setWindowSize(windowSize);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitPitchDetector::~ofxAudioUnitPitchDetector()
+// ----------------------------------------------------------
+{
+	freeBuffers();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitPitchDetector::freeBuffers()
+// ----------------------------------------------------------
+{
+	if(_fftData.realp) free(_fftData.realp);
+	if(_fftData.imagp) free(_fftData.imagp);
+	_fftData.realp = NULL;
+	_fftData.imagp = NULL;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitPitchDetector::setWindowSize(unsigned int windowSize)
+// ----------------------------------------------------------
+{
+	const unsigned int log2N = (unsigned int) ceilf(log2f(std::max(windowSize, 2u)));
+
+	if(_N == (1u << log2N)) return;
+
+	_N = 1 << log2N;
+
+	// the autocorrelation is computed with a zero-padded FFT of twice
+	// the window size, so that it doesn't wrap around onto itself
+	_log2FftSize = log2N + 1;
+	const unsigned int fftSize = 1 << _log2FftSize;
+
+	freeBuffers();
+	_fftData.realp = (float *)calloc(fftSize / 2, sizeof(float));
+	_fftData.imagp = (float *)calloc(fftSize / 2, sizeof(float));
+	_fftSetup = ofxAudioUnitFftCache::getSetup(_log2FftSize);
+	_acf.assign(fftSize, 0);
+	_nsdf.assign(_N, 0);
+}
+
+#pragma mark - Analysis
+
+// ----------------------------------------------------------
+ofxAudioUnitPitchDetector::Estimate ofxAudioUnitPitchDetector::analyze(const Float32 * x, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	Estimate estimate;
+	estimate.frequency = 0;
+	estimate.confidence = 0;
+
+	const unsigned int fftSize = 1 << _log2FftSize;
+
+	float energy;
+	vDSP_svesq(x, 1, &energy, _N);
+
+	if(sqrtf(energy / _N) < _settings.silenceRMS) {
+		return estimate;
+	}
+
+	// autocorrelation r(tau) via the power spectrum of the zero-padded window
+	std::copy(x, x + _N, _acf.begin());
+	std::fill(_acf.begin() + _N, _acf.end(), 0);
+
+	vDSP_ctoz((COMPLEX *)&_acf[0], 2, &_fftData, 1, fftSize / 2);
+	vDSP_fft_zrip(_fftSetup.get(), &_fftData, 1, _log2FftSize, kFFTDirection_Forward);
+
+	// vDSP packs the (purely real) Nyquist bin into imagp[0]
+	const float dcPower = _fftData.realp[0] * _fftData.realp[0];
+	const float nyquistPower = _fftData.imagp[0] * _fftData.imagp[0];
+	vDSP_zvmags(&_fftData, 1, _fftData.realp, 1, fftSize / 2);
+	vDSP_vclr(_fftData.imagp, 1, fftSize / 2);
+	_fftData.realp[0] = dcPower;
+	_fftData.imagp[0] = nyquistPower;
+
+	vDSP_fft_zrip(_fftSetup.get(), &_fftData, 1, _log2FftSize, kFFTDirection_Inverse);
+	vDSP_ztoc(&_fftData, 1, (COMPLEX *)&_acf[0], 2, fftSize / 2);
+
+	if(_acf[0] <= 0) {
+		return estimate;
+	}
+
+	// r(0) is the window's energy, which gives us the scale of vDSP's
+	// un-normalized transforms without having to track it by hand
+	const float acfScale = energy / _acf[0];
+
+	// the NSDF is 2r(tau) / m(tau), where m(tau) is the summed energy of the
+	// overlapping parts of the window. 1 - NSDF is YIN's difference function
+	// normalized by m(tau)
+	const unsigned int minTau = std::max<unsigned int>(2, floor(sampleRate / _settings.maxFrequency));
+	const unsigned int maxTau = std::min<unsigned int>(_N / 2, ceil(sampleRate / _settings.minFrequency));
+
+	if(minTau + 2 >= maxTau) {
+		return estimate;
+	}
+
+	double m = 2.0 * energy;
+	_nsdf[0] = 1;
+	for(unsigned int tau = 1; tau <= maxTau + 1; tau++) {
+		m -= x[tau - 1] * x[tau - 1] + x[_N - tau] * x[_N - tau];
+		_nsdf[tau] = m > 0 ? 2.0 * _acf[tau] * acfScale / m : 0;
+	}
+
+	// MPM peak picking: find the highest point ("key maximum") of each
+	// positive lobe of the NSDF, then take the first one that's within
+	// the threshold of the tallest
+	unsigned int keyMaxima[64];
+	unsigned int keyMaximaCount = 0;
+	float highestPeak = 0;
+
+	unsigned int tau = 1;
+
+	// skip the lobe around tau = 0
+	while(tau < maxTau && _nsdf[tau] > 0) tau++;
+
+	while(tau < maxTau && keyMaximaCount < 64) {
+		// wait for a positive-going zero crossing
+		while(tau < maxTau && _nsdf[tau] <= 0) tau++;
+
+		unsigned int peakTau = 0;
+		while(tau < maxTau && _nsdf[tau] > 0) {
+			if(tau >= minTau && (peakTau == 0 || _nsdf[tau] > _nsdf[peakTau])) {
+				peakTau = tau;
+			}
+			tau++;
+		}
+
+		if(peakTau > 0) {
+			keyMaxima[keyMaximaCount++] = peakTau;
+			highestPeak = std::max(highestPeak, _nsdf[peakTau]);
+		}
+	}
+
+	if(keyMaximaCount == 0) {
+		return estimate;
+	}
+
+	const float cutoff = _settings.threshold * highestPeak;
+	unsigned int chosenTau = keyMaxima[0];
+	for(unsigned int i = 0; i < keyMaximaCount; i++) {
+		if(_nsdf[keyMaxima[i]] >= cutoff) {
+			chosenTau = keyMaxima[i];
+			break;
+		}
+	}
+
+	// parabolic interpolation around the chosen peak
+	const float a = _nsdf[chosenTau - 1];
+	const float b = _nsdf[chosenTau];
+	const float c = _nsdf[chosenTau + 1];
+	const float denominator = a - 2 * b + c;
+	float delta = 0;
+	float peak = b;
+
+	if(denominator != 0) {
+		delta = 0.5 * (a - c) / denominator;
+		peak = b - 0.25 * (a - c) * delta;
+	}
+
+	const float confidence = std::min(1.f, std::max(0.f, peak));
+
+	estimate.confidence = confidence;
+	if(confidence >= _settings.minConfidence) {
+		estimate.frequency = sampleRate / (chosenTau + delta);
+	}
+
+	return estimate;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ofxAudioUnitFftCache.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <vector>
+
+// ofxAudioUnitPitchDetector estimates the fundamental frequency of a window
+// of samples, using the McLeod Pitch Method (MPM). It's the analysis behind
+// ofxAudioUnitPitchNode.
+
+// The autocorrelation that the method is built on is computed with an FFT,
+// so each analysis costs O(N log N) in the window size rather than the
+// O(N^2) of a direct autocorrelation.
+
+class ofxAudioUnitPitchDetector
+{
+public:
+	struct Settings {
+		float minFrequency;  // lowest f0 to search for (Hz)
+		float maxFrequency;  // highest f0 to search for (Hz)
+		float threshold;     // fraction of the highest peak a candidate must reach (MPM's "k")
+		float minConfidence; // estimates below this clarity are reported as unpitched
+		float silenceRMS;    // windows quieter than this are reported as unpitched
+
+		Settings()
+		: minFrequency(60)
+		, maxFrequency(1500)
+		, threshold(0.9)
+		, minConfidence(0.5)
+		, silenceRMS(0.001)
+		{ }
+	};
+
+	struct Estimate {
+		float frequency;  // in Hz, or 0 if the window was unpitched
+		float confidence; // normalized clarity of the chosen peak (0 - 1)
+	};
+
+	// the window size should be a power of 2 (1024, 2048, etc), and will be rounded up otherwise
+	explicit ofxAudioUnitPitchDetector(unsigned int windowSize = 2048, const Settings &settings = Settings());
+	~ofxAudioUnitPitchDetector();
+
+	void setWindowSize(unsigned int windowSize);
+	unsigned int getWindowSize() const {return _N;}
+
+	void setSettings(const Settings &settings) {_settings = settings;}
+	const Settings& getSettings() const {return _settings;}
+
+	// analyzes getWindowSize() samples
+	Estimate analyze(const Float32 * window, Float64 sampleRate);
+
+private:
+	Settings _settings;
+	unsigned int _N;
+	unsigned int _log2FftSize;
+	FFTSetupRef _fftSetup;
+	COMPLEX_SPLIT _fftData;
+	std::vector<Float32> _acf;
+	std::vector<Float32> _nsdf;
+
+	ofxAudioUnitPitchDetector(const ofxAudioUnitPitchDetector &);
+	ofxAudioUnitPitchDetector& operator=(const ofxAudioUnitPitchDetector &);
+
+	void freeBuffers();
+};
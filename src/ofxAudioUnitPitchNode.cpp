@@ -0,0 +1,118 @@
+#include "TargetConditionals.h"
+#if !TARGET_OS_IPHONE
+
+#include "ofxAudioUnitPitchNode.h"
+
+ofxAudioUnitPitchNode::ofxAudioUnitPitchNode(unsigned int windowSize, Settings settings)
+: _detector(windowSize, settings)
+, _settings(settings)
+, _sampleRate(0)
+, _lastAnalyzedFrame(0)
+{
+	setBufferSize(_detector.getWindowSize());
+}
+
+ofxAudioUnitPitchNode::ofxAudioUnitPitchNode(const ofxAudioUnitPitchNode &orig)
+: _detector(orig.getWindowSize(), orig._settings)
+, _settings(orig._settings)
+, _sampleRate(orig._sampleRate)
+, _lastAnalyzedFrame(0)
+{
+	setBufferSize(_detector.getWindowSize());
+}
+
+ofxAudioUnitPitchNode& ofxAudioUnitPitchNode::operator=(const ofxAudioUnitPitchNode &orig)
+{
+	if(this == &orig) return *this;
+
+	_sampleRate = orig._sampleRate;
+	setSettings(orig._settings);
+	setWindowSize(orig.getWindowSize());
+	return *this;
+}
+
+ofxAudioUnitPitchNode::~ofxAudioUnitPitchNode()
+{
+}
+
+#pragma mark - Settings
+
+void ofxAudioUnitPitchNode::setWindowSize(unsigned int windowSize)
+{
+	_detector.setWindowSize(windowSize);
+	_lastAnalyzedFrame = 0;
+	setBufferSize(_detector.getWindowSize());
+}
+
+void ofxAudioUnitPitchNode::setSettings(const Settings &settings)
+{
+	_settings = settings;
+	_detector.setSettings(settings);
+	_lastAnalyzedFrame = 0;
+}
+
+void ofxAudioUnitPitchNode::setSampleRate(Float64 sampleRate)
+{
+	_sampleRate = sampleRate;
+}
+
+Float64 ofxAudioUnitPitchNode::currentSampleRate() const
+{
+	if(_sampleRate > 0) {
+		return _sampleRate;
+	}
+
+	const Float64 sourceRate = getSourceASBD().mSampleRate;
+	return sourceRate > 0 ? sourceRate : 44100;
+}
+
+std::string ofxAudioUnitPitchNode::getName()
+{
+	if(name.empty()) {
+		return "ofxAudioUnitPitchNode";
+	} else {
+		return name;
+	}
+}
+
+#pragma mark - Analysis
+
+bool ofxAudioUnitPitchNode::getPitch(Pitch &outPitch)
+{
+	const UInt64 capturedFrames = getCapturedFrameCount();
+
+	// only analyze once per hop, regardless of how often we're polled
+	if(_lastAnalyzedFrame != 0 && capturedFrames - _lastAnalyzedFrame < _settings.hopSize) {
+		outPitch = _lastPitch;
+		return false;
+	}
+
+	// the window's sample time comes from the same read as its samples, so
+	// a render cycle landing in between can't put them a block apart
+	const UInt64 end = getSamplesFromChannel(_sampleBuffer, 0);
+	const unsigned int N = _detector.getWindowSize();
+
+	// return the previous estimate if we don't have enough samples yet
+	if(_sampleBuffer.size() < N) {
+		outPitch = _lastPitch;
+		return false;
+	}
+
+	const ofxAudioUnitPitchDetector::Estimate estimate = _detector.analyze(&_sampleBuffer[_sampleBuffer.size() - N], currentSampleRate());
+	_lastPitch.frequency = estimate.frequency;
+	_lastPitch.confidence = estimate.confidence;
+	_lastPitch.sampleTime = getCapturedSampleTime(end);
+	_lastAnalyzedFrame = capturedFrames;
+
+	outPitch = _lastPitch;
+	return true;
+}
+
+ofxAudioUnitPitchNode::Pitch ofxAudioUnitPitchNode::getPitch()
+{
+	Pitch pitch;
+	getPitch(pitch);
+	return pitch;
+}
+
+#endif // !TARGET_OS_IPHONE
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ofxAudioUnitDSPNode.h"
+#include "ofxAudioUnitPitchDetector.h"
+
+// ofxAudioUnitPitchNode estimates the fundamental frequency of the
+// audio passing through it, using the McLeod Pitch Method (MPM) (see
+// ofxAudioUnitPitchDetector). At most one window is analyzed per call to
+// getPitch(), and only once a full hop's worth of new samples has arrived,
+// so the CPU cost per frame of your app is bounded no matter how often you
+// poll it.
+
+// Pitch analysis happens on the calling thread (not the render thread).
+
+class ofxAudioUnitPitchNode : public ofxAudioUnitDSPNode
+{
+public:
+	// the detector's settings, plus how often to analyze
+	struct Settings : ofxAudioUnitPitchDetector::Settings {
+		unsigned int hopSize;
+
+		Settings()
+		: hopSize(512)
+		{ }
+	};
+
+	struct Pitch {
+		float frequency;    // in Hz, or 0 if the window was unpitched
+		float confidence;   // normalized clarity of the chosen peak (0 - 1)
+		Float64 sampleTime; // sample time of the end of the analyzed window
+
+		Pitch() : frequency(0), confidence(0), sampleTime(0) { }
+	};
+
+	// the window size should be a power of 2 (1024, 2048, etc), and will be rounded up otherwise
+	ofxAudioUnitPitchNode(unsigned int windowSize = 2048, Settings settings = Settings());
+	ofxAudioUnitPitchNode(const ofxAudioUnitPitchNode &orig);
+	ofxAudioUnitPitchNode& operator=(const ofxAudioUnitPitchNode &orig);
+	virtual ~ofxAudioUnitPitchNode();
+
+	// returns true if a new hop was analyzed. outPitch is always filled
+	// with the most recent estimate
+	bool getPitch(Pitch &outPitch);
+	Pitch getPitch();
+
+	void setWindowSize(unsigned int windowSize);
+	unsigned int getWindowSize() const {return _detector.getWindowSize();}
+
+	void setSettings(const Settings &settings);
+	const Settings& getSettings() const {return _settings;}
+
+	// the sample rate is read from the source unit where possible. Set it
+	// here if the node is being fed from a callback or another DSP node
+	void setSampleRate(Float64 sampleRate);
+
+	virtual std::string getName();
+
+private:
+	ofxAudioUnitPitchDetector _detector;
+	Settings _settings;
+	Pitch _lastPitch;
+	Float64 _sampleRate;
+	UInt64 _lastAnalyzedFrame;
+	std::vector<Float32> _sampleBuffer;
+
+	Float64 currentSampleRate() const;
+};
@@ -1,5 +1,6 @@
 #include "ofxAudioUnitRecorder.h"
 #include "ofxAudioUnitUtils.h"
+#include <mach/mach_time.h>
 
 // a render callback records audio passing through it
 static OSStatus Record(void * inRefCon,
@@ -9,24 +10,48 @@ static OSStatus Record(void * inRefCon,
 					   UInt32	inNumberFrames,
 					   AudioBufferList * ioData);
 
+// a render callback which hands audio passing through it to a writer thread
+static OSStatus StreamRecord(void * inRefCon,
+							 AudioUnitRenderActionFlags *	ioActionFlags,
+							 const AudioTimeStamp *	inTimeStamp,
+							 UInt32 inBusNumber,
+							 UInt32	inNumberFrames,
+							 AudioBufferList * ioData);
+
+// a render callback which hands audio passing through it to the FLAC encoders
+static OSStatus FlacRecord(void * inRefCon,
+						   AudioUnitRenderActionFlags *	ioActionFlags,
+						   const AudioTimeStamp *	inTimeStamp,
+						   UInt32 inBusNumber,
+						   UInt32	inNumberFrames,
+						   AudioBufferList * ioData);
+
+// host time ticks to seconds, for the rotation indexes
+static Float64 HostTimeToSeconds(UInt64 hostTime) {
+	static const Float64 secondsPerTick = [] {
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		return (Float64)timebase.numer / timebase.denom * 1e-9;
+	}();
+	return hostTime * secondsPerTick;
+}
 
 ofxAudioUnitRecorder::ofxAudioUnitRecorder()
-: _recordFile(NULL) {
-	
+: _recordFile(NULL)
+, _diskRecorder(new ofxAudioUnitDiskRecorder)
+, _flacRecorder(new ofxAudioUnitFlacRecorder)
+, _preRoll(0) {
+	HostTimeToSeconds(0); // so the render thread doesn't have to set it up
 }
 
 ofxAudioUnitRecorder::~ofxAudioUnitRecorder() {
-	if(_recordFile) {
-		ExtAudioFileDispose(_recordFile);
-		_recordFile = NULL;
-	}
+	stopRecording();
+	setProcessCallback((AURenderCallbackStruct){0});
 }
 
 bool ofxAudioUnitRecorder::startRecording(const std::string &filePath) {
 	
-	if(_recordFile) {
-		stopRecording();
-	}
+	stopRecording();
 	
 	AudioStreamBasicDescription inASBD = getSourceASBD();
 	
@@ -36,62 +61,35 @@ bool ofxAudioUnitRecorder::startRecording(const std::string &filePath) {
 		return false;
 	}
 	
+	//detect file format from fileName
+	std::string ext = "";
+	if(filePath.find_last_of(".") != std::string::npos){
+		ext = filePath.substr(filePath.find_last_of(".")+1);
+	}
+	
+	// converted (and dithered) on the writer thread rather than by ExtAudioFile
+	if(ext == "wav") {
+		return startRecording(filePath, OFXAU_WAV_INT16);
+	}
+	
 	CFURLRef fileURL = CFURLCreateFromFileSystemRepresentation(NULL,
 															   (const UInt8*)filePath.c_str(),
 															   filePath.length(),
 															   false);
-    
-    //default m4a setting
-    AudioStreamBasicDescription outASBD = {
+	
+	AudioStreamBasicDescription outASBD = {
 		.mChannelsPerFrame = inASBD.mChannelsPerFrame,
 		.mSampleRate = inASBD.mSampleRate,
 		.mFormatID = kAudioFormatMPEG4AAC
 	};
-    
-	
-    //detect file format from fileName
-    std::string ext = "";
-     if(filePath.find_last_of(".") != std::string::npos){
-        ext = filePath.substr(filePath.find_last_of(".")+1);
-    }
-    
-    OSStatus s;
-    //http://kaniini.dereferenced.org/2014/08/31/CoreAudio-sucks.html
-    //you can expand wav formats as you like
-    if(ext == "wav"){
-        outASBD = {
-                .mChannelsPerFrame = inASBD.mChannelsPerFrame,
-                .mSampleRate = inASBD.mSampleRate,
-                .mFormatID = kAudioFormatLinearPCM,
-                .mFramesPerPacket = 1, //For uncompressed audio, the value is 1. For variable bit-rate formats, the value is a larger fixed number, such as 1024 for AAC
-                //S16_BE
-                //.mFormatFlags = kAudioFormatFlagIsBigEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked,
-                //S16_LE...better for Ableton
-                .mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked,
-                .mBitsPerChannel = 16,
-                .mBytesPerFrame = inASBD.mChannelsPerFrame * 2,
-                .mBytesPerPacket = inASBD.mChannelsPerFrame * 2
-        };
-        
-        
-        s = ExtAudioFileCreateWithURL(fileURL,
-                kAudioFileWAVEType,
-                &outASBD,
-                NULL,
-                kAudioFileFlags_EraseFile,
-                &_recordFile);
-    }else{
-        //default m4a
-        s = ExtAudioFileCreateWithURL(fileURL,
-                kAudioFileM4AType,
-                &outASBD,
-                NULL,
-                kAudioFileFlags_EraseFile,
-                &_recordFile);
-    
-    }
-    
-
+	
+	OSStatus s = ExtAudioFileCreateWithURL(fileURL,
+										   kAudioFileM4AType,
+										   &outASBD,
+										   NULL,
+										   kAudioFileFlags_EraseFile,
+										   &_recordFile);
+	
 	CFRelease(fileURL);
 	
 	if(s != noErr) {
@@ -115,14 +113,150 @@ bool ofxAudioUnitRecorder::startRecording(const std::string &filePath) {
 	return true;
 }
 
+bool ofxAudioUnitRecorder::startRecording(const std::string &filePath, ofxAudioUnitWavFormat format) {
+	
+	stopRecording();
+	
+	AudioStreamBasicDescription inASBD = getSourceASBD();
+	
+	if(inASBD.mFormatID == 0) {
+		std::cout << "Recorder couldn't determine proper stream format. ";
+		std::cout << "Is the recorder directly after an Audio Unit?" << std::endl;
+		return false;
+	}
+	
+	if(!_diskRecorder->start(filePath, inASBD.mChannelsPerFrame, inASBD.mSampleRate, format)) {
+		return false;
+	}
+	
+	// an armed recorder is already being fed
+	if(!_diskRecorder->isArmed()) {
+		setProcessCallback((AURenderCallbackStruct){StreamRecord, _diskRecorder.get()});
+	}
+	
+	return true;
+}
+
+bool ofxAudioUnitRecorder::startFlacRecording(const std::string &filePath, unsigned int bitsPerSample, unsigned int channelsPerFile) {
+	
+	stopRecording();
+	
+	AudioStreamBasicDescription inASBD = getSourceASBD();
+	
+	if(inASBD.mFormatID == 0) {
+		std::cout << "Recorder couldn't determine proper stream format. ";
+		std::cout << "Is the recorder directly after an Audio Unit?" << std::endl;
+		return false;
+	}
+	
+	if(!_flacRecorder->start(filePath, inASBD.mChannelsPerFrame, inASBD.mSampleRate, bitsPerSample, channelsPerFile)) {
+		return false;
+	}
+	
+	setProcessCallback((AURenderCallbackStruct){FlacRecord, _flacRecorder.get()});
+	
+	return true;
+}
+
 void ofxAudioUnitRecorder::stopRecording() {
 	if(_recordFile) {
 		setProcessCallback((AURenderCallbackStruct){0}); // stop calling Record callback
 		ExtAudioFileDispose(_recordFile);
 		_recordFile = NULL;
+		resumePreRoll();
+	}
+	
+	if(_flacRecorder->isRecording()) {
+		resumePreRoll();
+		
+		const ofxAudioUnitFlacRecorder::Stats stats = _flacRecorder->getStats();
+		if(!_flacRecorder->stop()) {
+			std::cout << "FLAC recording wasn't written completely" << std::endl;
+		} else if(stats.droppedFrames > 0) {
+			std::cout << "Recorder dropped " << stats.droppedFrames << " frames keeping up with the FLAC encoders" << std::endl;
+		}
+	}
+	
+	if(_diskRecorder->isRecording()) {
+		if(!_diskRecorder->isArmed()) {
+			setProcessCallback((AURenderCallbackStruct){0});
+		}
+		
+		const ofxAudioUnitDiskRecorder::Stats stats = _diskRecorder->getStats();
+		if(!_diskRecorder->stop()) {
+			std::cout << "Recording wasn't written completely" << std::endl;
+		} else if(stats.droppedFrames > 0) {
+			std::cout << "Recorder dropped " << stats.droppedFrames << " frames keeping up with the disk" << std::endl;
+		}
+	}
+}
+
+bool ofxAudioUnitRecorder::setPreRoll(float seconds) {
+	
+	stopRecording();
+	
+	// the ring's about to be reallocated, so the render thread has to let go of it
+	setProcessCallback((AURenderCallbackStruct){0});
+	_diskRecorder->disarm();
+	_preRoll = 0;
+	
+	if(seconds <= 0) {
+		return true;
+	}
+	
+	AudioStreamBasicDescription inASBD = getSourceASBD();
+	
+	if(inASBD.mFormatID == 0) {
+		std::cout << "Recorder couldn't determine proper stream format. ";
+		std::cout << "Is the recorder directly after an Audio Unit?" << std::endl;
+		return false;
+	}
+	
+	if(!_diskRecorder->arm(inASBD.mChannelsPerFrame, inASBD.mSampleRate, seconds)) {
+		return false;
+	}
+	
+	_preRoll = seconds;
+	setProcessCallback((AURenderCallbackStruct){StreamRecord, _diskRecorder.get()});
+	
+	return true;
+}
+
+void ofxAudioUnitRecorder::setRotation(double maxSeconds, UInt64 maxBytes) {
+	_diskRecorder->setRotation(maxSeconds, maxBytes);
+}
+
+void ofxAudioUnitRecorder::setDither(ofxAudioUnitDither dither) {
+	_diskRecorder->setDither(dither);
+	_flacRecorder->setDither(dither);
+}
+
+void ofxAudioUnitRecorder::attachToSession(AURenderCallbackStruct callback) {
+	stopRecording();
+	setProcessCallback(callback);
+}
+
+void ofxAudioUnitRecorder::detachFromSession() {
+	resumePreRoll();
+}
+
+void ofxAudioUnitRecorder::resumePreRoll() {
+	if(_diskRecorder->isArmed()) {
+		_diskRecorder->rearm();
+		setProcessCallback((AURenderCallbackStruct){StreamRecord, _diskRecorder.get()});
+	} else {
+		setProcessCallback((AURenderCallbackStruct){0});
 	}
 }
 
+ofxAudioUnitDiskRecorder::Stats ofxAudioUnitRecorder::getRecordingStats() const {
+	return _diskRecorder->getStats();
+}
+
+ofxAudioUnitFlacRecorder::Stats ofxAudioUnitRecorder::getFlacRecordingStats() const {
+	return _flacRecorder->getStats();
+}
+
 OSStatus Record(void * inRefCon,
 				AudioUnitRenderActionFlags * ioActionFlags,
 				const AudioTimeStamp *	inTimeStamp,
@@ -140,3 +274,35 @@ OSStatus Record(void * inRefCon,
 	
 	return noErr;
 }
+
+
+OSStatus StreamRecord(void * inRefCon,
+					  AudioUnitRenderActionFlags * ioActionFlags,
+					  const AudioTimeStamp *	inTimeStamp,
+					  UInt32 inBusNumber,
+					  UInt32	inNumberFrames,
+					  AudioBufferList * ioData)
+{
+	Float64 sampleTime = NAN;
+	Float64 hostTime = NAN;
+	if(inTimeStamp && (inTimeStamp->mFlags & kAudioTimeStampSampleTimeValid)) {
+		sampleTime = inTimeStamp->mSampleTime;
+	}
+	if(inTimeStamp && (inTimeStamp->mFlags & kAudioTimeStampHostTimeValid)) {
+		hostTime = HostTimeToSeconds(inTimeStamp->mHostTime);
+	}
+	
+	static_cast<ofxAudioUnitDiskRecorder *>(inRefCon)->write(ioData, inNumberFrames, sampleTime, hostTime);
+	return noErr;
+}
+
+OSStatus FlacRecord(void * inRefCon,
+					AudioUnitRenderActionFlags * ioActionFlags,
+					const AudioTimeStamp *	inTimeStamp,
+					UInt32 inBusNumber,
+					UInt32	inNumberFrames,
+					AudioBufferList * ioData)
+{
+	static_cast<ofxAudioUnitFlacRecorder *>(inRefCon)->write(ioData, inNumberFrames);
+	return noErr;
+}
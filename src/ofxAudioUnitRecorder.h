@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ofxAudioUnitDSPNode.h"
+#include "ofxAudioUnitDiskRecorder.h"
+#include "ofxAudioUnitFlacRecorder.h"
 #include <AudioToolbox/AudioToolbox.h>
 
 // ofxAudioUnitRecorder can record all audio passing through it
@@ -12,10 +14,63 @@ public:
 	ofxAudioUnitRecorder();
 	~ofxAudioUnitRecorder();
 	
-	// Note: only supported filetype at the moment is .m4a
+	// Records .m4a through Core Audio. A .wav extension streams a 16 bit
+	// file, as startRecording(filePath, OFXAU_WAV_INT16) does
 	bool startRecording(const std::string &filePath);
+	
+	// Streams a .wav file in the given sample format (as RF64 once it grows
+	// past 4 GB). The render thread only copies into a ring; the conversion
+	// and the disk writes happen on a writer thread of the recorder's own
+	bool startRecording(const std::string &filePath, ofxAudioUnitWavFormat format);
+	
+	// Streams lossless 16 or 24 bit FLAC. Like the .wav streaming above, the
+	// render thread only copies into a ring; the channels are encoded in
+	// groups of up to channelsPerFile on a thread per group, and recordings
+	// with more channels than that are split into one file per group
+	// ("show-ch01-08.flac", ...). The pre-roll and rotation below only
+	// apply to .wav streaming
+	bool startFlacRecording(const std::string &filePath, unsigned int bitsPerSample = 24, unsigned int channelsPerFile = 8);
+	
 	void stopRecording();
 	
+	// Keeps the last `seconds` of audio passing through, so the next file
+	// startRecording(filePath, format) writes starts that far back and carries
+	// on seamlessly from there. 0 turns it off
+	bool setPreRoll(float seconds);
+	float getPreRoll() const {return _preRoll;}
+	
+	// Splits streamed recordings into files of at most maxSeconds and/or
+	// maxBytes (0 for no limit) without a gap between them: "show.wav" is
+	// written as "show-0001.wav", "show-0002.wav" and so on, each with a
+	// "show-0001.json" index giving its start frame, sample time and host
+	// time. Takes effect from the next startRecording(filePath, format)
+	void setRotation(double maxSeconds, UInt64 maxBytes = 0);
+	
+	// How 16 and 24 bit recordings, .wav or FLAC, are dithered. Off by
+	// default. Takes effect from the next recording
+	void setDither(ofxAudioUnitDither dither);
+	ofxAudioUnitDither getDither() const {return _diskRecorder->getDither();}
+	
+	// how the streaming writer is keeping up
+	ofxAudioUnitDiskRecorder::Stats getRecordingStats() const;
+	
+	// and how the FLAC encoders are keeping up
+	ofxAudioUnitFlacRecorder::Stats getFlacRecordingStats() const;
+	
 private:
+	friend class ofxAudioUnitStemSession;
+	
+	// hands the render callback over to a session, and takes it back
+	void attachToSession(AURenderCallbackStruct callback);
+	void detachFromSession();
+	
+	// Gives the render callback back to the pre-roll ring, if it's armed.
+	// Whatever it held from before the callback was taken over is forgotten,
+	// so the next recording doesn't splice it on across the gap
+	void resumePreRoll();
+	
 	ExtAudioFileRef _recordFile;
+	std::shared_ptr<ofxAudioUnitDiskRecorder> _diskRecorder;
+	std::shared_ptr<ofxAudioUnitFlacRecorder> _flacRecorder;
+	float _preRoll;
 };
@@ -0,0 +1,325 @@
+#include "ofxAudioUnitSampleCache.h"
+#include "ofxAudioUnitWavReader.h"
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <list>
+#include <math.h>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace {
+	typedef std::tuple<std::string, Float64, unsigned int> Key; // path, sample rate, channels
+
+	struct Entry {
+		std::weak_ptr<const ofxAudioUnitSampleData> sample;
+		std::shared_future<ofxAudioUnitSampleRef> decoding; // valid while someone's decoding it
+		size_t bytes;
+		bool recent; // in the recently used list
+		std::list<std::pair<Key, ofxAudioUnitSampleRef> >::iterator position;
+		Entry() : bytes(0), recent(false) {}
+	};
+
+	std::mutex cacheMutex;
+	std::map<Key, Entry> entries;
+	std::list<std::pair<Key, ofxAudioUnitSampleRef> > recentlyUsed; // most recent first
+	size_t budget = 256 << 20;
+	UInt64 hits = 0;
+	UInt64 decodes = 0;
+	UInt64 failures = 0;
+	UInt64 evictions = 0;
+
+	void Touch(const Key &key, Entry &entry, const ofxAudioUnitSampleRef &sample)
+	{
+		if(entry.recent) {
+			recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, entry.position);
+		} else {
+			recentlyUsed.push_front(std::make_pair(key, sample));
+			entry.position = recentlyUsed.begin();
+			entry.recent = true;
+		}
+	}
+
+	size_t BytesInMemory()
+	{
+		size_t bytes = 0;
+		for(std::map<Key, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+			if(!it->second.sample.expired()) bytes += it->second.bytes;
+		}
+		return bytes;
+	}
+
+	void PruneExpired()
+	{
+		for(std::map<Key, Entry>::iterator it = entries.begin(); it != entries.end();) {
+			if(it->second.sample.expired() && !it->second.decoding.valid()) {
+				entries.erase(it++);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	// Lets go of the least recently used samples that only the cache holds,
+	// until what's in memory fits in `limit`. Everything here is under the
+	// lock, and a sample only the cache holds can only be handed out again by
+	// load() under the same lock, so a use count of 1 can't change under us
+	void Trim(size_t limit)
+	{
+		size_t bytes = BytesInMemory();
+		std::list<std::pair<Key, ofxAudioUnitSampleRef> >::iterator it = recentlyUsed.end();
+		while(bytes > limit && it != recentlyUsed.begin()) {
+			--it;
+			if(it->second.use_count() > 1) continue;
+
+			bytes -= it->second->bytes();
+			entries[it->first].recent = false;
+			it = recentlyUsed.erase(it);
+			evictions++;
+		}
+		PruneExpired();
+	}
+}
+
+#pragma mark - Decoding
+
+// the decoded channels mixed or spread out to `channels`: averaged down to
+// mono, otherwise repeated (mono to both sides of stereo) or dropped
+static void Remix(ofxAudioUnitSampleData &sample, unsigned int channels)
+{
+	if(channels == 0 || channels == sample.channels) return;
+
+	std::vector<Float32> remixed(channels * sample.frames, 0);
+	for(unsigned int c = 0; c < channels; c++) {
+		Float32 * out = &remixed[c * sample.frames];
+		if(channels == 1) {
+			for(unsigned int from = 0; from < sample.channels; from++) {
+				const Float32 * in = sample.channel(from);
+				for(size_t i = 0; i < sample.frames; i++) out[i] += in[i] / sample.channels;
+			}
+		} else {
+			const Float32 * in = sample.channel(c % sample.channels);
+			std::copy(in, in + sample.frames, out);
+		}
+	}
+
+	sample.samples.swap(remixed);
+	sample.channels = channels;
+}
+
+#if defined(__APPLE__)
+
+static bool Decode(ofxAudioUnitSampleData &sample, Float64 sampleRate)
+{
+	CFURLRef fileURL = CFURLCreateFromFileSystemRepresentation(NULL,
+															   (const UInt8*)sample.filePath.c_str(),
+															   sample.filePath.length(),
+															   false);
+	ExtAudioFileRef file = NULL;
+	OSStatus s = ExtAudioFileOpenURL(fileURL, &file);
+	CFRelease(fileURL);
+	if(s != noErr) {
+		std::cout << "Couldn't open audio file: " << sample.filePath << " err code: " << (OSStatus)s << std::endl;
+		return false;
+	}
+
+	AudioStreamBasicDescription fileFormat = {0};
+	SInt64 fileFrames = 0;
+	UInt32 size = sizeof(fileFormat);
+	s = ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileDataFormat, &size, &fileFormat);
+	size = sizeof(fileFrames);
+	if(s == noErr) s = ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileLengthFrames, &size, &fileFrames);
+
+	// floats, one buffer per channel, at the sample rate asked for
+	AudioStreamBasicDescription clientFormat = {0};
+	clientFormat.mSampleRate       = sampleRate > 0 ? sampleRate : fileFormat.mSampleRate;
+	clientFormat.mFormatID         = kAudioFormatLinearPCM;
+	clientFormat.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+	clientFormat.mBytesPerPacket   = sizeof(Float32);
+	clientFormat.mFramesPerPacket  = 1;
+	clientFormat.mBytesPerFrame    = sizeof(Float32);
+	clientFormat.mChannelsPerFrame = fileFormat.mChannelsPerFrame;
+	clientFormat.mBitsPerChannel   = 32;
+	if(s == noErr) s = ExtAudioFileSetProperty(file, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat);
+
+	if(s != noErr || fileFormat.mChannelsPerFrame == 0) {
+		std::cout << "Couldn't decode " << sample.filePath << " err code: " << (OSStatus)s << std::endl;
+		ExtAudioFileDispose(file);
+		return false;
+	}
+
+	sample.sampleRate = clientFormat.mSampleRate;
+	sample.channels = clientFormat.mChannelsPerFrame;
+
+	// the length is in the file's frames; resampling can come out a frame or
+	// two either side of the estimate
+	const size_t capacity = ceil(fileFrames * clientFormat.mSampleRate / fileFormat.mSampleRate) + 16;
+	std::vector<std::vector<Float32> > planes(sample.channels, std::vector<Float32>(capacity));
+	std::vector<char> listStorage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * sample.channels);
+	AudioBufferList * list = (AudioBufferList *)&listStorage[0];
+
+	size_t frames = 0;
+	while(frames < capacity) {
+		UInt32 count = std::min<size_t>(capacity - frames, 32768);
+		list->mNumberBuffers = sample.channels;
+		for(unsigned int c = 0; c < sample.channels; c++) {
+			list->mBuffers[c].mNumberChannels = 1;
+			list->mBuffers[c].mDataByteSize = count * sizeof(Float32);
+			list->mBuffers[c].mData = &planes[c][frames];
+		}
+		s = ExtAudioFileRead(file, &count, list);
+		if(s != noErr || count == 0) break;
+		frames += count;
+	}
+	ExtAudioFileDispose(file);
+
+	if(s != noErr) {
+		std::cout << "Error decoding " << sample.filePath << " err code: " << (OSStatus)s << std::endl;
+		return false;
+	}
+
+	sample.frames = frames;
+	sample.samples.resize(sample.channels * frames);
+	for(unsigned int c = 0; c < sample.channels; c++) {
+		std::copy(planes[c].begin(), planes[c].begin() + frames, sample.samples.begin() + c * frames);
+	}
+	return true;
+}
+
+#else
+
+static bool Decode(ofxAudioUnitSampleData &sample, Float64 sampleRate)
+{
+	ofxAudioUnitWavReader reader;
+	if(!reader.open(sample.filePath)) return false;
+
+	const ofxAudioUnitWavReader::Info &info = reader.getInfo();
+	if(sampleRate > 0 && sampleRate != info.sampleRate) {
+		std::cout << "Can't resample " << sample.filePath << " to " << sampleRate << " Hz without Core Audio" << std::endl;
+		return false;
+	}
+
+	sample.sampleRate = info.sampleRate;
+	sample.channels = info.channels;
+	sample.frames = info.frames;
+	sample.samples.resize(sample.channels * sample.frames);
+
+	std::vector<Float32 *> planes(sample.channels);
+	for(unsigned int c = 0; c < sample.channels; c++) {
+		planes[c] = &sample.samples[c * sample.frames];
+	}
+	if(reader.read(0, sample.frames, &planes[0]) != sample.frames) return false;
+	return true;
+}
+
+#endif
+
+static ofxAudioUnitSampleRef Load(const std::string &filePath, Float64 sampleRate, unsigned int channels)
+{
+	std::shared_ptr<ofxAudioUnitSampleData> sample = std::make_shared<ofxAudioUnitSampleData>();
+	sample->filePath = filePath;
+	if(!Decode(*sample, sampleRate)) return ofxAudioUnitSampleRef();
+	Remix(*sample, channels);
+	return sample;
+}
+
+#pragma mark - Cache
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleRef ofxAudioUnitSampleCache::load(const std::string &filePath, Float64 sampleRate, unsigned int channels)
+// ----------------------------------------------------------
+{
+	const Key key(filePath, sampleRate, channels);
+	std::unique_lock<std::mutex> lock(cacheMutex);
+
+	Entry &entry = entries[key];
+	ofxAudioUnitSampleRef sample = entry.sample.lock();
+	if(sample) {
+		hits++;
+		Touch(key, entry, sample);
+		return sample;
+	}
+
+	// someone else is decoding it already
+	if(entry.decoding.valid()) {
+		std::shared_future<ofxAudioUnitSampleRef> decoding = entry.decoding;
+		hits++;
+		lock.unlock();
+		return decoding.get();
+	}
+
+	std::promise<ofxAudioUnitSampleRef> decoded;
+	entry.decoding = decoded.get_future().share();
+	decodes++;
+	lock.unlock();
+
+	sample = Load(filePath, sampleRate, channels);
+
+	lock.lock();
+	Entry &finished = entries[key]; // entries with a decode under way are never pruned
+	finished.decoding = std::shared_future<ofxAudioUnitSampleRef>();
+	if(sample) {
+		finished.sample = sample;
+		finished.bytes = sample->bytes();
+		Touch(key, finished, sample);
+		Trim(budget);
+	} else {
+		failures++;
+	}
+	lock.unlock();
+
+	decoded.set_value(sample);
+	return sample;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleCache::setMemoryBudget(size_t bytes)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	budget = bytes;
+	Trim(budget);
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitSampleCache::getMemoryBudget()
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	return budget;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleCache::purge()
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	Trim(0);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleCache::Stats ofxAudioUnitSampleCache::getStats()
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	Stats stats = {};
+	stats.hits = hits;
+	stats.decodes = decodes;
+	stats.failures = failures;
+	stats.evictions = evictions;
+	stats.budget = budget;
+
+	for(std::map<Key, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+		const ofxAudioUnitSampleRef sample = it->second.sample.lock();
+		if(!sample) continue;
+		stats.samples++;
+		stats.bytes += it->second.bytes;
+		// one for the list if it's in it, one for `sample` here
+		if(sample.use_count() > (it->second.recent ? 2 : 1)) {
+			stats.bytesInUse += it->second.bytes;
+		}
+	}
+	return stats;
+}
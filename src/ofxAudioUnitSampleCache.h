@@ -0,0 +1,74 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A decoded audio file: floats, one plane per channel. Immutable once the
+// cache hands it out, so any number of players (and render threads) can read
+// it at once.
+
+struct ofxAudioUnitSampleData
+{
+	std::string filePath;
+	Float64 sampleRate;
+	unsigned int channels;
+	size_t frames;
+	std::vector<Float32> samples; // channel after channel, frames long each
+
+	const Float32 * channel(unsigned int c) const {return &samples[c * frames];}
+	size_t bytes() const {return samples.size() * sizeof(Float32);}
+};
+
+typedef std::shared_ptr<const ofxAudioUnitSampleData> ofxAudioUnitSampleRef;
+
+// ofxAudioUnitSampleCache decodes audio files into memory once per process
+// and shares them. Twenty players loading the same one-shot get the same
+// buffer back, and only the first of them pays for the disk and the decode;
+// anyone asking while that's happening waits for it rather than decoding it
+// again.
+
+// Files are keyed by path and the format they were asked for (sample rate
+// and channel count; 0 for either means the file's own). Entries are
+// reference counted, so a sample stays in memory for as long as anything
+// holds it. On top of that the cache keeps the most recently used samples
+// around after their players let go, up to a memory budget, so reloading one
+// is instant. When the total goes over the budget the least recently used
+// samples nobody holds are let go; samples in use are never taken away.
+
+// On Apple platforms files are decoded (and resampled if need be) with
+// ExtAudioFile, so anything Core Audio can read works. Elsewhere, WAV and
+// RF64 files at their own sample rate are read with ofxAudioUnitWavReader.
+// Loading blocks while decoding and takes a lock, so do it off the render
+// thread, ahead of time.
+
+class ofxAudioUnitSampleCache
+{
+public:
+	struct Stats {
+		UInt64 hits;      // loads served from memory (or from another load's decode)
+		UInt64 decodes;
+		UInt64 failures;
+		UInt64 evictions; // unused samples let go to stay within the budget
+		size_t samples;   // in memory, in use or not
+		size_t bytes;
+		size_t bytesInUse; // held by something other than the cache
+		size_t budget;
+	};
+
+	// Returns null if the file couldn't be read. Failures aren't cached, so
+	// the next load tries again
+	static ofxAudioUnitSampleRef load(const std::string &filePath, Float64 sampleRate = 0, unsigned int channels = 0);
+
+	// The most decoded audio to keep, in bytes. Samples in use can take the
+	// total over it; unused ones are let go until it's back under. 256 MB by
+	// default
+	static void setMemoryBudget(size_t bytes);
+	static size_t getMemoryBudget();
+
+	// lets go of every sample nobody's using
+	static void purge();
+
+	static Stats getStats();
+};
@@ -0,0 +1,321 @@
+#include "ofxAudioUnitSampleConverter.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// Interleaving goes a chunk of frames at a time, every channel, so the part
+// of the output being written to stays in cache
+static const size_t kChunkFrames = 256;
+
+// Error feedback filter for noise shaping, from Lipshitz, Vanderkooy and
+// Wannamaker's "Minimally Audible Noise Shaping" (E-weighted, 44.1 kHz). The
+// noise comes out about 16 dB down at low frequencies and up near Nyquist
+static const unsigned int kShapeTaps = 5;
+static const Float32 kShapeFilter[kShapeTaps] = {2.033f, -2.165f, 1.959f, -1.590f, 0.6149f};
+
+// bounds the shaper's memory, so a run of clipped samples can't wind it up
+static const Float32 kMaxShapeError = 4;
+
+#pragma mark - Vectors
+
+// gcc and clang lower these to SSE2 on Intel and NEON on ARM
+typedef float        Float4  __attribute__((vector_size(16)));
+typedef int          Int4    __attribute__((vector_size(16)));
+typedef unsigned int UInt4   __attribute__((vector_size(16)));
+typedef double       Double4 __attribute__((vector_size(32)));
+
+static inline Float4 Splat(float x) {const Float4 v = {x, x, x, x}; return v;}
+static inline Int4 SplatInt(int x) {const Int4 v = {x, x, x, x}; return v;}
+
+static inline Float4 Load(const Float32 * p) {Float4 v; memcpy(&v, p, sizeof(v)); return v;}
+static inline void Store(Float32 * p, Float4 v) {memcpy(p, &v, sizeof(v));}
+static inline void Store(SInt32 * p, Int4 v) {memcpy(p, &v, sizeof(v));}
+
+static inline Float4 Select(Int4 mask, Float4 a, Float4 b) {return (Float4)(((Int4)a & mask) | ((Int4)b & ~mask));}
+
+// x rounded to the nearest integer, halfway cases to even, as lrint() does
+// in the default rounding mode. x has to be in range for an int already
+static inline Int4 Round(Float4 x)
+{
+	const Int4 t = __builtin_convertvector(x, Int4); // toward zero
+	const Float4 r = x - __builtin_convertvector(t, Float4); // exact
+	const Int4 odd = (t & SplatInt(1)) != SplatInt(0);
+	const Int4 up = (r > Splat(0.5f)) | ((r == Splat(0.5f)) & odd);
+	const Int4 down = (r < Splat(-0.5f)) | ((r == Splat(-0.5f)) & odd);
+	return t - up + down; // the masks are -1 where they're true
+}
+
+// Scaled samples clipped to [-scale, scale - 1] and rounded. For 32 bits the
+// top isn't a float, so samples at or beyond 2^31 are sorted out as integers
+static inline Int4 RoundClip(Float4 x, float scale, float hi, int hiInt)
+{
+	const Int4 over = x >= Splat(scale);
+	x = Select(x < Splat(-scale), Splat(-scale), x);
+	x = Select(x > Splat(hi), Splat(hi), x);
+	return (Round(x) & ~over) | (SplatInt(hiInt) & over);
+}
+
+// xorshift32 in each lane, as floats in [0, 1)
+static inline Float4 Uniform(UInt4 &seeds)
+{
+	seeds ^= seeds << 13;
+	seeds ^= seeds >> 17;
+	seeds ^= seeds << 5;
+	return __builtin_convertvector((Int4)(seeds >> 8), Float4) * Splat(1.f / 16777216.f);
+}
+
+static inline Float32 Uniform(UInt32 &seed)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return (seed >> 8) * (1.f / 16777216.f);
+}
+
+#pragma mark - Byte order
+
+static inline void Put16(unsigned char * p, UInt32 v) {p[0] = v; p[1] = v >> 8;}
+static inline void Put24(unsigned char * p, UInt32 v) {p[0] = v; p[1] = v >> 8; p[2] = v >> 16;}
+static inline void Put32(unsigned char * p, UInt32 v) {Put16(p, v); Put16(p + 2, v >> 16);}
+
+static inline SInt32 Get16(const unsigned char * p) {return (SInt16)(p[0] | p[1] << 8);}
+static inline SInt32 Get24(const unsigned char * p) {return (SInt32)((UInt32)p[0] << 8 | (UInt32)p[1] << 16 | (UInt32)p[2] << 24) >> 8;}
+static inline UInt32 Get32(const unsigned char * p) {return (UInt32)p[0] | (UInt32)p[1] << 8 | (UInt32)p[2] << 16 | (UInt32)p[3] << 24;}
+
+static unsigned int IntegerBits(ofxAudioUnitSampleFormat format)
+{
+	switch(format) {
+		case OFXAU_SAMPLE_INT16: return 16;
+		case OFXAU_SAMPLE_INT24: return 24;
+		case OFXAU_SAMPLE_INT32: return 32;
+		default:                 return 0;
+	}
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleConverter::ofxAudioUnitSampleConverter(ofxAudioUnitDither dither)
+: _dither(dither)
+// ----------------------------------------------------------
+{
+	reset();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleConverter::setDither(ofxAudioUnitDither dither)
+// ----------------------------------------------------------
+{
+	_dither = dither;
+	reset();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleConverter::reset()
+// ----------------------------------------------------------
+{
+	static const UInt32 seeds[4] = {0x9E3779B9, 0x7F4A7C15, 0x85EBCA6B, 0xC2B2AE35};
+	memcpy(_seeds, seeds, sizeof(_seeds));
+	std::fill(_shaping.begin(), _shaping.end(), 0);
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitSampleConverter::bytesPerSample(ofxAudioUnitSampleFormat format)
+// ----------------------------------------------------------
+{
+	switch(format) {
+		case OFXAU_SAMPLE_INT16:   return 2;
+		case OFXAU_SAMPLE_INT24:   return 3;
+		case OFXAU_SAMPLE_INT32:   return 4;
+		case OFXAU_SAMPLE_FLOAT32: return 4;
+		case OFXAU_SAMPLE_FLOAT64: return 8;
+	}
+	return 0;
+}
+
+#pragma mark - Float to integer
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleConverter::quantize(const Float32 * samples, size_t count, unsigned int bits, SInt32 * out, unsigned int channel)
+// ----------------------------------------------------------
+{
+	if(bits < 2 || bits > 32) return;
+
+	if(_dither == OFXAU_DITHER_SHAPED && bits <= 24) {
+		quantizeShaped(samples, count, bits, out, channel);
+	} else {
+		quantizeBlock(samples, count, bits, out);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleConverter::quantizeBlock(const Float32 * samples, size_t count, unsigned int bits, SInt32 * out)
+// ----------------------------------------------------------
+{
+	const float scale = (float)(1u << (bits - 1));
+	const float hi = bits == 32 ? 2147483520.f : scale - 1; // the largest float below 2^31
+	const int hiInt = (int)((1u << (bits - 1)) - 1);
+	const Float4 scale4 = Splat(scale);
+
+	// dither much below 24 bits is lost in a float's own rounding
+	const bool dither = _dither != OFXAU_DITHER_NONE && bits <= 24;
+	UInt4 seeds;
+	memcpy(&seeds, _seeds, sizeof(seeds));
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		Float4 x = Load(samples + i) * scale4;
+		if(dither) x += Uniform(seeds) - Uniform(seeds);
+		Store(out + i, RoundClip(x, scale, hi, hiInt));
+	}
+
+	if(i < count) {
+		Float32 tail[4] = {0, 0, 0, 0};
+		SInt32 q[4];
+		std::copy(samples + i, samples + count, tail);
+		Float4 x = Load(tail) * scale4;
+		if(dither) x += Uniform(seeds) - Uniform(seeds);
+		Store(q, RoundClip(x, scale, hi, hiInt));
+		std::copy(q, q + (count - i), out + i);
+	}
+
+	memcpy(_seeds, &seeds, sizeof(seeds));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleConverter::quantizeShaped(const Float32 * samples, size_t count, unsigned int bits, SInt32 * out, unsigned int channel)
+// ----------------------------------------------------------
+{
+	if(_shaping.size() < (channel + 1) * kShapeTaps) {
+		_shaping.resize((channel + 1) * kShapeTaps, 0);
+	}
+
+	const Float32 scale = (Float32)(1u << (bits - 1));
+	const Float32 lo = -scale;
+	const Float32 hi = scale - 1;
+	Float32 * errors = &_shaping[channel * kShapeTaps]; // most recent first
+	UInt32 &seed = _seeds[channel & 3];
+
+	for(size_t i = 0; i < count; i++) {
+		Float32 target = samples[i] * scale;
+		for(unsigned int k = 0; k < kShapeTaps; k++) {
+			target -= kShapeFilter[k] * errors[k];
+		}
+
+		const Float32 x = target + Uniform(seed) - Uniform(seed);
+		const SInt32 q = (SInt32)lrintf(std::min(std::max(x, lo), hi));
+		out[i] = q;
+
+		for(unsigned int k = kShapeTaps - 1; k > 0; k--) {
+			errors[k] = errors[k - 1];
+		}
+		errors[0] = std::min(std::max(q - target, -kMaxShapeError), kMaxShapeError);
+	}
+}
+
+#pragma mark - Interleaving
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleConverter::interleave(const Float32 * const * planes, unsigned int channels, size_t frames, void * out, ofxAudioUnitSampleFormat format, unsigned int channelOffset)
+// ----------------------------------------------------------
+{
+	const unsigned int sampleBytes = bytesPerSample(format);
+	const size_t frameBytes = sampleBytes * channels;
+	const unsigned int bits = IntegerBits(format);
+	SInt32 q[kChunkFrames];
+
+	for(size_t start = 0; start < frames; start += kChunkFrames) {
+		const size_t count = std::min(kChunkFrames, frames - start);
+		unsigned char * chunk = (unsigned char *)out + start * frameBytes;
+
+		for(unsigned int c = 0; c < channels; c++) {
+			const Float32 * in = planes[c] + start;
+			unsigned char * o = chunk + c * sampleBytes;
+
+			if(bits) {
+				quantize(in, count, bits, q, channelOffset + c);
+			}
+
+			switch(format) {
+				case OFXAU_SAMPLE_INT16:
+					for(size_t i = 0; i < count; i++, o += frameBytes) Put16(o, q[i]);
+					break;
+				case OFXAU_SAMPLE_INT24:
+					for(size_t i = 0; i < count; i++, o += frameBytes) Put24(o, q[i]);
+					break;
+				case OFXAU_SAMPLE_INT32:
+					for(size_t i = 0; i < count; i++, o += frameBytes) Put32(o, q[i]);
+					break;
+				case OFXAU_SAMPLE_FLOAT32:
+					for(size_t i = 0; i < count; i++, o += frameBytes) {
+						UInt32 raw;
+						memcpy(&raw, &in[i], sizeof(raw));
+						Put32(o, raw);
+					}
+					break;
+				case OFXAU_SAMPLE_FLOAT64:
+					for(size_t i = 0; i < count; i++, o += frameBytes) {
+						const Float64 x = in[i];
+						UInt64 raw;
+						memcpy(&raw, &x, sizeof(raw));
+						Put32(o, (UInt32)raw);
+						Put32(o + 4, (UInt32)(raw >> 32));
+					}
+					break;
+			}
+		}
+	}
+}
+
+#pragma mark - Deinterleaving
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleConverter::deinterleave(const void * in, ofxAudioUnitSampleFormat format, unsigned int channels, size_t frames, Float32 * const * planes)
+// ----------------------------------------------------------
+{
+	const unsigned int sampleBytes = bytesPerSample(format);
+	const size_t frameBytes = sampleBytes * channels;
+	const unsigned int bits = IntegerBits(format);
+	const Float4 scale = Splat(bits ? 1.f / (Float32)(1u << (bits - 1)) : 1.f);
+
+	for(unsigned int c = 0; c < channels; c++) {
+		const unsigned char * p = (const unsigned char *)in + c * sampleBytes;
+		Float32 * out = planes[c];
+
+		// Gathers four samples into lanes, then converts and scales them
+		// together. The tail goes through the same path with padding
+		for(size_t i = 0; i < frames; i += 4) {
+			const size_t n = std::min<size_t>(4, frames - i);
+			Float4 x;
+
+			if(format == OFXAU_SAMPLE_FLOAT64) {
+				Double4 d = {0, 0, 0, 0};
+				for(size_t k = 0; k < n; k++, p += frameBytes) {
+					const UInt64 raw = Get32(p) | (UInt64)Get32(p + 4) << 32;
+					Float64 v;
+					memcpy(&v, &raw, sizeof(v));
+					d[k] = v;
+				}
+				x = __builtin_convertvector(d, Float4);
+			} else if(format == OFXAU_SAMPLE_FLOAT32) {
+				UInt4 raw = {0, 0, 0, 0};
+				for(size_t k = 0; k < n; k++, p += frameBytes) raw[k] = Get32(p);
+				x = (Float4)raw;
+			} else {
+				Int4 v = {0, 0, 0, 0};
+				switch(format) {
+					case OFXAU_SAMPLE_INT16: for(size_t k = 0; k < n; k++, p += frameBytes) v[k] = Get16(p); break;
+					case OFXAU_SAMPLE_INT24: for(size_t k = 0; k < n; k++, p += frameBytes) v[k] = Get24(p); break;
+					default:                 for(size_t k = 0; k < n; k++, p += frameBytes) v[k] = (SInt32)Get32(p); break;
+				}
+				x = __builtin_convertvector(v, Float4) * scale;
+			}
+
+			if(n == 4) {
+				Store(out + i, x);
+			} else {
+				Float32 tail[4];
+				Store(tail, x);
+				std::copy(tail, tail + n, out + i);
+			}
+		}
+	}
+}
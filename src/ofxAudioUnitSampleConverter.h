@@ -0,0 +1,73 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <vector>
+
+typedef enum {
+	OFXAU_SAMPLE_INT16,
+	OFXAU_SAMPLE_INT24, // packed, 3 bytes a sample
+	OFXAU_SAMPLE_INT32,
+	OFXAU_SAMPLE_FLOAT32,
+	OFXAU_SAMPLE_FLOAT64
+}
+ofxAudioUnitSampleFormat;
+
+typedef enum {
+	OFXAU_DITHER_NONE,
+	OFXAU_DITHER_TPDF,  // triangular noise of +/- 1 LSB, so the quantization error is independent of the signal
+	OFXAU_DITHER_SHAPED // the same, with the noise shaped away from where the ear is most sensitive (for 44.1 / 48 kHz)
+}
+ofxAudioUnitDither;
+
+// ofxAudioUnitSampleConverter converts between the render thread's
+// non-interleaved floats and the sample formats files and encoders want,
+// interleaving or deinterleaving in the same pass.
+
+// Work is done four samples at a time with the compiler's vector extensions,
+// which come out as SSE2 on Intel and NEON on Apple silicon. Without dither,
+// results are bit for bit what the obvious scalar loop gives: samples scaled
+// by 2^(bits - 1), clipped, and rounded to the nearest integer (halfway
+// cases to even, like lrint()). Integers are written little endian, as WAV
+// and most other formats want them.
+
+// Going down to 16 or 24 bits can be dithered. TPDF dither is vectorized
+// too; noise shaping feeds each sample's error back into the next ones, so it
+// runs a sample at a time. Dither and the noise shaper's memory are the only
+// state, so a converter that doesn't dither can be shared freely, and one
+// that does should be used for one stream at a time (and reset() between
+// them). Conversions to float formats are never dithered.
+
+class ofxAudioUnitSampleConverter
+{
+public:
+	ofxAudioUnitSampleConverter(ofxAudioUnitDither dither = OFXAU_DITHER_NONE);
+
+	void setDither(ofxAudioUnitDither dither);
+	ofxAudioUnitDither getDither() const {return _dither;}
+
+	// forgets the noise shaper's history and restarts the dither sequence
+	void reset();
+
+	// frames of every plane, into out as interleaved samples of the format.
+	// channelOffset says which channel the first plane is in the dither's
+	// bookkeeping, for callers that interleave a few channels at a time
+	void interleave(const Float32 * const * planes, unsigned int channels, size_t frames, void * out, ofxAudioUnitSampleFormat format, unsigned int channelOffset = 0);
+
+	// samples, scaled and rounded to `bits` bit integers (2 to 32), for
+	// encoders that want them as plain ints. channel is for the dither
+	void quantize(const Float32 * samples, size_t count, unsigned int bits, SInt32 * out, unsigned int channel = 0);
+
+	// interleaved samples of the format, split out into one float plane per
+	// channel. Stateless
+	static void deinterleave(const void * in, ofxAudioUnitSampleFormat format, unsigned int channels, size_t frames, Float32 * const * planes);
+
+	static unsigned int bytesPerSample(ofxAudioUnitSampleFormat format);
+
+private:
+	ofxAudioUnitDither _dither;
+	UInt32 _seeds[4];               // the dither's random number generators
+	std::vector<Float32> _shaping;  // each channel's last few errors, for noise shaping
+
+	void quantizeBlock(const Float32 * samples, size_t count, unsigned int bits, SInt32 * out);
+	void quantizeShaped(const Float32 * samples, size_t count, unsigned int bits, SInt32 * out, unsigned int channel);
+};
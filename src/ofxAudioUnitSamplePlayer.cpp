@@ -0,0 +1,110 @@
+#include "ofxAudioUnitSamplePlayer.h"
+
+// a render callback which plays the voices into the buffers it's given
+static OSStatus Render(void * inRefCon,
+					   AudioUnitRenderActionFlags *	ioActionFlags,
+					   const AudioTimeStamp *	inTimeStamp,
+					   UInt32 inBusNumber,
+					   UInt32	inNumberFrames,
+					   AudioBufferList * ioData);
+
+// ----------------------------------------------------------
+ofxAudioUnitSamplePlayer::ofxAudioUnitSamplePlayer(unsigned int channels)
+: _voices(new ofxAudioUnitSampleVoices)
+// ----------------------------------------------------------
+{
+	setSource((AURenderCallbackStruct){Render, _voices.get()}, channels);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSamplePlayer::~ofxAudioUnitSamplePlayer()
+// ----------------------------------------------------------
+{
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSamplePlayer::setFile(const std::string &filePath, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	ofxAudioUnitSampleRef sample = ofxAudioUnitSampleCache::load(filePath, sampleRate);
+	if(!sample) {
+		std::cout << getName() << " couldn't load " << filePath << std::endl;
+		return false;
+	}
+	return setSample(sample);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSamplePlayer::setSample(const ofxAudioUnitSampleRef &sample)
+// ----------------------------------------------------------
+{
+	return _voices->setSample(sample);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleRef ofxAudioUnitSamplePlayer::getSample() const
+// ----------------------------------------------------------
+{
+	return _voices->getSample();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSamplePlayer::play(float gain)
+// ----------------------------------------------------------
+{
+	return _voices->play(gain);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSamplePlayer::playAt(Float64 sampleTime, float gain)
+// ----------------------------------------------------------
+{
+	return _voices->playAt(sampleTime, gain);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSamplePlayer::stop()
+// ----------------------------------------------------------
+{
+	return _voices->stop();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSamplePlayer::stopAt(Float64 sampleTime)
+// ----------------------------------------------------------
+{
+	return _voices->stopAt(sampleTime);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleVoices::Stats ofxAudioUnitSamplePlayer::getStats() const
+// ----------------------------------------------------------
+{
+	return _voices->getStats();
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitSamplePlayer::getName()
+// ----------------------------------------------------------
+{
+	if(name.empty()) {
+		return "ofxAudioUnitSamplePlayer";
+	} else {
+		return name;
+	}
+}
+
+#pragma mark - Render Callback
+
+// ----------------------------------------------------------
+OSStatus Render(void * inRefCon,
+				AudioUnitRenderActionFlags * ioActionFlags,
+				const AudioTimeStamp * inTimeStamp,
+				UInt32 inBusNumber,
+				UInt32 inNumberFrames,
+				AudioBufferList * ioData)
+// ----------------------------------------------------------
+{
+	((ofxAudioUnitSampleVoices *)inRefCon)->render(inTimeStamp, inNumberFrames, ioData);
+	return noErr;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ofxAudioUnitDSPNode.h"
+#include "ofxAudioUnitSampleCache.h"
+#include "ofxAudioUnitSampleVoices.h"
+
+// ofxAudioUnitSamplePlayer plays a sound file from memory, for one-shots
+// that need to start right away or on an exact frame. Files are loaded
+// through ofxAudioUnitSampleCache, so twenty players of the same file share
+// one decoded copy, and only the first load touches the disk.
+
+// Unlike ofxAudioUnitFilePlayer there's no file to open or schedule when
+// play() is called: the voice starts at the top of the next render cycle,
+// or with playAt(), on the frame at a given sample time. Up to
+// ofxAudioUnitSampleVoices::kMaxVoices triggers can overlap.
+
+// It's a source, so connect it to a mixer or output like a file player.
+// setFile() blocks while decoding (unless the file's cached already), so
+// load ahead of time rather than right before playing.
+
+class ofxAudioUnitSamplePlayer : public ofxAudioUnitDSPNode
+{
+public:
+	explicit ofxAudioUnitSamplePlayer(unsigned int channels = 2);
+	virtual ~ofxAudioUnitSamplePlayer();
+
+	// sampleRate should be the rate of the graph the player is connected to,
+	// or 0 to play the file at its own rate
+	bool setFile(const std::string &filePath, Float64 sampleRate = 0);
+	bool setSample(const ofxAudioUnitSampleRef &sample);
+	ofxAudioUnitSampleRef getSample() const;
+
+	bool play(float gain = 1);
+	bool playAt(Float64 sampleTime, float gain = 1);
+	bool stop();
+	bool stopAt(Float64 sampleTime);
+
+	ofxAudioUnitSampleVoices::Stats getStats() const;
+
+	virtual std::string getName();
+
+private:
+	std::shared_ptr<ofxAudioUnitSampleVoices> _voices;
+};
@@ -0,0 +1,276 @@
+#include "ofxAudioUnitSampleVoices.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+static const UInt32 kFadeFrames = 64;
+static const size_t kMaxPending = 128; // events queued for later cycles
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleVoices::ofxAudioUnitSampleVoices()
+: _generation(0)
+, _commands(256)
+, _current(NULL)
+, _currentGeneration(0)
+, _serial(0)
+, _clock(0)
+, _inUseFrom(0)
+, _triggers(0)
+, _lateTriggers(0)
+, _maxLateness(0)
+, _stolenVoices(0)
+, _droppedCommands(0)
+, _activeVoices(0)
+// ----------------------------------------------------------
+{
+	memset(_voices, 0, sizeof(_voices));
+	_pending.reserve(kMaxPending);
+	_due.reserve(kMaxPending + _commands.capacity());
+}
+
+#pragma mark - Main thread
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampleVoices::push(const Command &command)
+// ----------------------------------------------------------
+{
+	if(_commands.push(command)) return true;
+	_droppedCommands++;
+	return false;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleVoices::releaseRetired()
+// ----------------------------------------------------------
+{
+	const UInt64 inUseFrom = _inUseFrom.load(std::memory_order_acquire);
+	size_t kept = 0;
+	for(size_t i = 0; i < _retired.size(); i++) {
+		if(_retired[i].first >= inUseFrom) _retired[kept++] = _retired[i];
+	}
+	_retired.resize(kept);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampleVoices::setSample(const ofxAudioUnitSampleRef &sample)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	releaseRetired();
+
+	Command command = {CommandSample, true, 0, 0, sample.get(), _generation + 1, 0};
+	if(!push(command)) return false;
+
+	if(_sample) _retired.push_back(std::make_pair(_generation, _sample));
+	_sample = sample;
+	_generation++;
+	return true;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleRef ofxAudioUnitSampleVoices::getSample() const
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	return _sample;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampleVoices::play(float gain)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	releaseRetired();
+	Command command = {CommandPlay, true, 0, gain, NULL, 0, 0};
+	return push(command);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampleVoices::playAt(Float64 sampleTime, float gain)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	releaseRetired();
+	Command command = {CommandPlay, false, sampleTime, gain, NULL, 0, 0};
+	return push(command);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampleVoices::stop()
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	releaseRetired();
+	Command command = {CommandStop, true, 0, 0, NULL, 0, 0};
+	return push(command);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitSampleVoices::stopAt(Float64 sampleTime)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	releaseRetired();
+	Command command = {CommandStop, false, sampleTime, 0, NULL, 0, 0};
+	return push(command);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleVoices::Stats ofxAudioUnitSampleVoices::getStats() const
+// ----------------------------------------------------------
+{
+	Stats stats;
+	stats.triggers = _triggers;
+	stats.lateTriggers = _lateTriggers;
+	stats.maxLateness = _maxLateness;
+	stats.stolenVoices = _stolenVoices;
+	stats.droppedCommands = _droppedCommands;
+	stats.activeVoices = _activeVoices;
+	return stats;
+}
+
+#pragma mark - Render thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleVoices::render(const AudioTimeStamp * timeStamp, UInt32 frames, AudioBufferList * bufferList)
+// ----------------------------------------------------------
+{
+	for(UInt32 b = 0; b < bufferList->mNumberBuffers; b++) {
+		memset(bufferList->mBuffers[b].mData, 0, bufferList->mBuffers[b].mDataByteSize);
+	}
+
+	const Float64 cycleStart = timeStamp && (timeStamp->mFlags & kAudioTimeStampSampleTimeValid) ? timeStamp->mSampleTime : _clock;
+	_clock = cycleStart + frames;
+
+	Command command;
+	while(_commands.pop(command)) {
+		if(_pending.size() < kMaxPending) {
+			_pending.push_back(command);
+		} else {
+			_droppedCommands++;
+		}
+	}
+
+	// this cycle's events, kept in the order they were sent for ones on the
+	// same frame (a stop and a play at the same time stops the old voices,
+	// then starts a new one)
+	_due.clear();
+	size_t kept = 0;
+	for(size_t i = 0; i < _pending.size(); i++) {
+		Command &event = _pending[i];
+		event.offset = event.immediate ? 0 : (SInt64)floor(event.sampleTime - cycleStart + 0.5);
+		if(event.offset < (SInt64)frames) {
+			_due.push_back(event);
+		} else {
+			_pending[kept++] = event;
+		}
+	}
+	_pending.resize(kept);
+
+	for(size_t i = 1; i < _due.size(); i++) {
+		const Command event = _due[i];
+		size_t j = i;
+		for(; j > 0 && _due[j - 1].offset > event.offset; j--) _due[j] = _due[j - 1];
+		_due[j] = event;
+	}
+
+	UInt32 cursor = 0;
+	for(size_t i = 0; i < _due.size(); i++) {
+		const UInt32 offset = std::max<SInt64>(_due[i].offset, 0);
+		if(offset > cursor) {
+			mix(bufferList, cursor, offset);
+			cursor = offset;
+		}
+		apply(_due[i]);
+	}
+	mix(bufferList, cursor, frames);
+
+	UInt64 inUseFrom = _currentGeneration;
+	unsigned int active = 0;
+	for(unsigned int v = 0; v < kMaxVoices; v++) {
+		if(!_voices[v].active) continue;
+		inUseFrom = std::min(inUseFrom, _voices[v].generation);
+		active++;
+	}
+	_activeVoices.store(active, std::memory_order_relaxed);
+	_inUseFrom.store(inUseFrom, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleVoices::apply(const Command &command)
+// ----------------------------------------------------------
+{
+	if(command.type == CommandSample) {
+		_current = command.sample;
+		_currentGeneration = command.generation;
+	} else if(command.type == CommandStop) {
+		for(unsigned int v = 0; v < kMaxVoices; v++) {
+			if(_voices[v].active && _voices[v].fadeLeft == 0) _voices[v].fadeLeft = kFadeFrames;
+		}
+	} else if(command.type == CommandPlay) {
+		if(!_current || _current->frames == 0) return;
+
+		_triggers++;
+		if(command.offset < 0) {
+			_lateTriggers++;
+			const UInt64 lateness = -command.offset;
+			if(lateness > _maxLateness.load(std::memory_order_relaxed)) _maxLateness.store(lateness, std::memory_order_relaxed);
+		}
+
+		// a free voice, or else the oldest one
+		Voice * voice = NULL;
+		for(unsigned int v = 0; v < kMaxVoices && !voice; v++) {
+			if(!_voices[v].active) voice = &_voices[v];
+		}
+		if(!voice) {
+			voice = &_voices[0];
+			for(unsigned int v = 1; v < kMaxVoices; v++) {
+				if(_voices[v].serial < voice->serial) voice = &_voices[v];
+			}
+			_stolenVoices++;
+		}
+
+		voice->sample = _current;
+		voice->generation = _currentGeneration;
+		voice->serial = _serial++;
+		voice->position = 0;
+		voice->gain = command.gain;
+		voice->fadeLeft = 0;
+		voice->active = true;
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitSampleVoices::mix(AudioBufferList * bufferList, UInt32 from, UInt32 to)
+// ----------------------------------------------------------
+{
+	for(unsigned int v = 0; v < kMaxVoices; v++) {
+		Voice &voice = _voices[v];
+		if(!voice.active) continue;
+
+		const ofxAudioUnitSampleData &sample = *voice.sample;
+		UInt32 count = std::min<size_t>(to - from, sample.frames - voice.position);
+		if(voice.fadeLeft > 0) count = std::min(count, voice.fadeLeft);
+
+		for(UInt32 b = 0; b < bufferList->mNumberBuffers; b++) {
+			Float32 * out = (Float32 *)bufferList->mBuffers[b].mData + from;
+			const Float32 * in = sample.channel(b % sample.channels) + voice.position;
+			const float gain = voice.gain;
+
+			if(voice.fadeLeft == 0) {
+				for(UInt32 i = 0; i < count; i++) out[i] += gain * in[i];
+			} else {
+				const float step = gain / kFadeFrames;
+				const float start = step * voice.fadeLeft;
+				for(UInt32 i = 0; i < count; i++) out[i] += (start - step * i) * in[i];
+			}
+		}
+
+		voice.position += count;
+		if(voice.fadeLeft > 0) {
+			voice.fadeLeft -= count;
+			if(voice.fadeLeft == 0) voice.active = false;
+		}
+		if(voice.position >= sample.frames) voice.active = false;
+	}
+}
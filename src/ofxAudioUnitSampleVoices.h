@@ -0,0 +1,134 @@
+#pragma once
+
+#include "ofxAudioUnitEventQueue.h"
+#include "ofxAudioUnitSampleCache.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// ofxAudioUnitSampleVoices plays a decoded sample (from
+// ofxAudioUnitSampleCache) straight out of memory, as up to kMaxVoices
+// overlapping one-shots. There's no file to open or buffer to prime, so a
+// trigger can land on any frame: playAt() takes a sample time, and the voice
+// starts on exactly that frame of whichever render cycle it falls in. A
+// trigger that arrives too late for its time starts at the top of the next
+// cycle instead, and is counted.
+
+// Triggers and stops are queued to the render thread without locks, and the
+// render thread never allocates. When every voice is busy the oldest is cut
+// off for the new one. stop() and stopAt() fade voices out over a few frames
+// rather than cutting them.
+
+// The sample can be swapped while voices are playing; those voices finish
+// the old one, which is let go (on a later call from the main thread) once
+// the render thread is done with it.
+
+// Output channel c plays the sample's channel c % (sample channels), so a
+// mono sample comes out of both sides of a stereo output.
+
+// Any number of threads can call the trigger functions; render() belongs to
+// one render thread.
+
+class ofxAudioUnitSampleVoices
+{
+public:
+	static const unsigned int kMaxVoices = 16;
+
+	struct Stats {
+		UInt64 triggers;
+		UInt64 lateTriggers;   // started after the frame they were asked for
+		UInt64 maxLateness;    // in frames
+		UInt64 stolenVoices;   // cut off to make room for a new one
+		UInt64 droppedCommands; // the queue (or the render thread's list of future events) was full
+		unsigned int activeVoices;
+	};
+
+	ofxAudioUnitSampleVoices();
+
+	// false if the render thread's queue is full, in which case the sample
+	// isn't changed
+	bool setSample(const ofxAudioUnitSampleRef &sample);
+	ofxAudioUnitSampleRef getSample() const;
+
+	// play() starts a voice at the beginning of the next render cycle,
+	// playAt() on the frame at sampleTime. False if the command couldn't be
+	// queued
+	bool play(float gain = 1);
+	bool playAt(Float64 sampleTime, float gain = 1);
+
+	// fades out every voice playing at the time
+	bool stop();
+	bool stopAt(Float64 sampleTime);
+
+	// Render thread: writes the voices over the (non-interleaved float)
+	// buffers. Sample times come from the timestamp when it has them, and
+	// otherwise count up from 0
+	void render(const AudioTimeStamp * timeStamp, UInt32 frames, AudioBufferList * bufferList);
+
+	Stats getStats() const;
+
+private:
+	enum CommandType {
+		CommandPlay,
+		CommandStop,
+		CommandSample
+	};
+
+	struct Command {
+		CommandType type;
+		bool immediate; // at the top of the next cycle, rather than at sampleTime
+		Float64 sampleTime;
+		float gain;
+		const ofxAudioUnitSampleData * sample;
+		UInt64 generation;
+		SInt64 offset; // frames into the cycle, filled in by the render thread
+	};
+
+	struct Voice {
+		const ofxAudioUnitSampleData * sample;
+		UInt64 generation;
+		UInt64 serial; // trigger order, for stealing the oldest
+		size_t position;
+		float gain;
+		UInt32 fadeLeft; // frames of fade out to go, or 0 if not fading
+		bool active;
+	};
+
+	// main thread
+	mutable std::mutex _producerMutex;
+	ofxAudioUnitSampleRef _sample;
+	UInt64 _generation;
+	std::vector<std::pair<UInt64, ofxAudioUnitSampleRef> > _retired; // generation, sample
+
+	ofxAudioUnitEventQueue<Command> _commands;
+
+	// render thread
+	Voice _voices[kMaxVoices];
+	const ofxAudioUnitSampleData * _current;
+	UInt64 _currentGeneration;
+	UInt64 _serial;
+	Float64 _clock;
+	std::vector<Command> _pending; // waiting for their cycle
+	std::vector<Command> _due;     // this cycle's, in time order
+
+	// the oldest sample generation the render thread might still be reading
+	std::atomic<UInt64> _inUseFrom;
+
+	std::atomic<UInt64> _triggers;
+	std::atomic<UInt64> _lateTriggers;
+	std::atomic<UInt64> _maxLateness;
+	std::atomic<UInt64> _stolenVoices;
+	std::atomic<UInt64> _droppedCommands;
+	std::atomic<unsigned int> _activeVoices;
+
+	ofxAudioUnitSampleVoices(const ofxAudioUnitSampleVoices &);
+	ofxAudioUnitSampleVoices& operator=(const ofxAudioUnitSampleVoices &);
+
+	bool push(const Command &command);
+	void releaseRetired();
+
+	void apply(const Command &command);
+	void mix(AudioBufferList * bufferList, UInt32 from, UInt32 to);
+};
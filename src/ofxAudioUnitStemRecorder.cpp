@@ -0,0 +1,475 @@
+#include "ofxAudioUnitStemRecorder.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <sstream>
+#include <stddef.h>
+#include <stdint.h>
+
+static const std::chrono::milliseconds kPollInterval(10);
+static const double kMinBatchSeconds = 0.1;
+static const size_t kMaxBatchFrames = 32768;
+
+// how long stop() waits for sources to reach the end before padding them
+static const std::chrono::milliseconds kStopTimeout(500);
+
+// gaps in a source's sample times up to this long are filled with silence on
+// the render thread, so the source stays in line with the others
+static const UInt32 kMaxGapFrames = 8192;
+
+static const Float64 kNoTime = std::numeric_limits<Float64>::quiet_NaN();
+
+static inline bool IsTime(Float64 t) {return t == t;}
+
+static void InitBufferList(std::vector<char> &storage, unsigned int channels)
+{
+	storage.assign(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * std::max(channels, 1u), 0);
+	AudioBufferList * list = (AudioBufferList *)&storage[0];
+	list->mNumberBuffers = channels;
+	for(unsigned int c = 0; c < channels; c++) {
+		list->mBuffers[c].mNumberChannels = 1;
+	}
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStemRecorder::Source::Source(unsigned int channels, const std::string &name)
+: name(name)
+, channels(channels)
+, nextSampleTime(kNoTime)
+, leadFrames(0)
+, started(false)
+, endSampleTime(kNoTime)
+, discontinuities(0)
+, firstPlane(0)
+// ----------------------------------------------------------
+{
+	InitBufferList(offsetListStorage, channels);
+	InitBufferList(readListStorage, channels);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStemRecorder::ofxAudioUnitStemRecorder()
+: _layout(OFXAU_STEMS_SEPARATE)
+, _dither(OFXAU_DITHER_NONE)
+, _running(false)
+, _accepting(false)
+, _startSampleTime(kNoTime)
+, _timeOffset(0)
+, _stopFrames(UINT64_MAX)
+, _position(0)
+, _lagLimit(0)
+, _minBatchFrames(0)
+, _maxBatchFrames(0)
+, _framesWritten(0)
+, _bytesWritten(0)
+, _droppedFrames(0)
+, _missingFrames(0)
+, _maxBacklog(0)
+, _failed(false)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStemRecorder::~ofxAudioUnitStemRecorder()
+// ----------------------------------------------------------
+{
+	stop();
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitStemRecorder::addSource(unsigned int channels, const std::string &name)
+// ----------------------------------------------------------
+{
+	_sources.push_back(std::unique_ptr<Source>(new Source(channels, name)));
+	return _sources.size() - 1;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemRecorder::clearSources()
+// ----------------------------------------------------------
+{
+	stop();
+	_sources.clear();
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitStemRecorder::stemPath(const std::string &filePath, const std::string &name)
+// ----------------------------------------------------------
+{
+	const size_t slash = filePath.find_last_of('/');
+	const size_t dot = filePath.find_last_of('.');
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return filePath + "-" + name;
+	}
+	return filePath.substr(0, dot) + "-" + name + filePath.substr(dot);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStemRecorder::start(const std::string &filePath, Float64 sampleRate, ofxAudioUnitWavFormat format, ofxAudioUnitStemLayout layout, double ringSeconds)
+// ----------------------------------------------------------
+{
+	stop();
+
+	if(_sources.empty()) {
+		std::cout << "Stem recorder has no sources to record" << std::endl;
+		return false;
+	}
+
+	unsigned int totalChannels = 0;
+	for(size_t i = 0; i < _sources.size(); i++) {
+		_sources[i]->firstPlane = totalChannels;
+		totalChannels += _sources[i]->channels;
+	}
+
+	_layout = layout;
+	bool opened = true;
+	if(layout == OFXAU_STEMS_INTERLEAVED) {
+		_file.setDither(_dither);
+		opened = _file.open(filePath, totalChannels, sampleRate, format);
+	} else {
+		for(size_t i = 0; i < _sources.size() && opened; i++) {
+			std::ostringstream name;
+			if(_sources[i]->name.empty()) {
+				name << (i + 1);
+			} else {
+				name << _sources[i]->name;
+			}
+			_sources[i]->file.setDither(_dither);
+			opened = _sources[i]->file.open(stemPath(filePath, name.str()), _sources[i]->channels, sampleRate, format);
+		}
+	}
+
+	if(!opened) {
+		closeFiles();
+		return false;
+	}
+
+	// everything the render threads touch is allocated here
+	const size_t capacity = std::max<size_t>(sampleRate * ringSeconds, 4096);
+	for(size_t i = 0; i < _sources.size(); i++) {
+		Source &source = *_sources[i];
+		source.ring.allocate(source.channels, capacity);
+		source.nextSampleTime = kNoTime;
+		source.leadFrames.store(0);
+		source.started.store(false);
+		source.endSampleTime.store(kNoTime);
+		source.discontinuities.store(0);
+	}
+
+	_lagLimit = capacity / 2;
+	_maxBatchFrames = std::min(kMaxBatchFrames, capacity / 4);
+	_minBatchFrames = std::min<size_t>(sampleRate * kMinBatchSeconds, _maxBatchFrames);
+	_scratch.assign(totalChannels * _maxBatchFrames, 0);
+	_planes.resize(totalChannels);
+	for(unsigned int c = 0; c < totalChannels; c++) {
+		_planes[c] = &_scratch[c * _maxBatchFrames];
+	}
+
+	_position = 0;
+	_framesWritten.store(0);
+	_bytesWritten.store(0);
+	_droppedFrames.store(0);
+	_missingFrames.store(0);
+	_maxBacklog.store(0);
+	_failed.store(false);
+	_startSampleTime.store(kNoTime);
+	_timeOffset.store(0);
+	_stopFrames.store(UINT64_MAX);
+
+	_running.store(true);
+	_thread = std::thread(&ofxAudioUnitStemRecorder::run, this);
+	_accepting.store(true, std::memory_order_release);
+
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStemRecorder::stop()
+// ----------------------------------------------------------
+{
+	if(!_thread.joinable()) return false;
+
+	// end where the furthest source has got to
+	const Float64 start = _startSampleTime.load();
+	Float64 end = kNoTime;
+	for(size_t i = 0; i < _sources.size(); i++) {
+		const Float64 sourceEnd = _sources[i]->endSampleTime.load();
+		if(IsTime(sourceEnd) && (!IsTime(end) || sourceEnd > end)) {
+			end = sourceEnd;
+		}
+	}
+
+	_stopFrames.store(IsTime(start) && IsTime(end) && end > start ? (UInt64)llround(end - start) : 0);
+	_running.store(false, std::memory_order_release);
+	_thread.join();
+	_accepting.store(false);
+
+	closeFiles();
+	return !_failed.load();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemRecorder::write(size_t index, Float64 sampleTime, const AudioBufferList * bufferList, UInt32 frames)
+// ----------------------------------------------------------
+{
+	if(index >= _sources.size() || frames == 0 || !_accepting.load(std::memory_order_acquire)) return;
+
+	Source &source = *_sources[index];
+	const Float64 expected = source.nextSampleTime;
+
+	if(IsTime(sampleTime)) {
+		// If the output's sample times start over (it was stopped and
+		// started, or its device changed), the first source to see them go
+		// back moves the offset so the files carry on from where they'd got
+		// to. The other sources rendering that cycle then land there too
+		const Float64 renderTime = sampleTime;
+		Float64 offset = _timeOffset.load(std::memory_order_acquire);
+		sampleTime = renderTime + offset;
+		while(IsTime(expected) && sampleTime + frames < expected) {
+			if(_timeOffset.compare_exchange_weak(offset, expected - renderTime, std::memory_order_acq_rel)) {
+				source.discontinuities.fetch_add(1, std::memory_order_relaxed);
+				sampleTime = expected;
+				break;
+			}
+			sampleTime = renderTime + offset;
+		}
+	} else {
+		sampleTime = expected;
+		if(!IsTime(sampleTime)) return;
+	}
+
+	// the first source to get here picks where every file starts
+	Float64 start = _startSampleTime.load(std::memory_order_acquire);
+	if(!IsTime(start)) {
+		const Float64 next = sampleTime + frames;
+		if(_startSampleTime.compare_exchange_strong(start, next)) {
+			start = next;
+		}
+	}
+
+	source.nextSampleTime = sampleTime + frames;
+	source.endSampleTime.store(sampleTime + frames, std::memory_order_relaxed);
+
+	if(sampleTime + frames <= start) return;
+
+	const UInt32 skip = start > sampleTime ? (UInt32)llround(start - sampleTime) : 0;
+
+	if(!source.started.load(std::memory_order_relaxed)) {
+		// a source that starts late is lined up with silence
+		source.leadFrames.store(skip == 0 ? (UInt64)llround(sampleTime - start) : 0, std::memory_order_relaxed);
+		source.started.store(true, std::memory_order_release);
+	} else if(IsTime(expected) && sampleTime != expected) {
+		source.discontinuities.fetch_add(1, std::memory_order_relaxed);
+		if(sampleTime > expected && sampleTime - expected <= kMaxGapFrames) {
+			// a buffer list with no buffers writes silence
+			AudioBufferList silence = {};
+			source.ring.write(&silence, (size_t)llround(sampleTime - expected));
+		}
+	}
+
+	if(skip == 0) {
+		source.ring.write(bufferList, frames);
+		return;
+	}
+
+	AudioBufferList * offsetList = source.offsetList();
+	offsetList->mNumberBuffers = std::min(source.channels, bufferList->mNumberBuffers);
+	for(UInt32 c = 0; c < offsetList->mNumberBuffers; c++) {
+		offsetList->mBuffers[c] = bufferList->mBuffers[c];
+		offsetList->mBuffers[c].mData = (Float32 *)bufferList->mBuffers[c].mData + skip;
+	}
+	source.ring.write(offsetList, frames - skip);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStemRecorder::Stats ofxAudioUnitStemRecorder::getStats() const
+// ----------------------------------------------------------
+{
+	Stats stats;
+	stats.framesWritten = _framesWritten.load(std::memory_order_relaxed);
+	stats.bytesWritten = _bytesWritten.load(std::memory_order_relaxed);
+	stats.droppedFrames = _droppedFrames.load(std::memory_order_relaxed);
+	stats.missingFrames = _missingFrames.load(std::memory_order_relaxed);
+	stats.discontinuities = 0;
+	for(size_t i = 0; i < _sources.size(); i++) {
+		stats.discontinuities += _sources[i]->discontinuities.load(std::memory_order_relaxed);
+	}
+
+	// worked out here rather than by the writer, which only looks between naps
+	UInt64 furthest = 0;
+	for(size_t i = 0; i < _sources.size(); i++) {
+		const Source &source = *_sources[i];
+		if(source.started.load(std::memory_order_acquire)) {
+			furthest = std::max(furthest, source.leadFrames.load(std::memory_order_relaxed) + source.ring.getWriteCount());
+		}
+	}
+	stats.backlog = furthest > stats.framesWritten ? furthest - stats.framesWritten : 0;
+	stats.maxBacklog = _maxBacklog.load(std::memory_order_relaxed);
+	stats.startSampleTime = _startSampleTime.load(std::memory_order_relaxed);
+	stats.failed = _failed.load(std::memory_order_relaxed);
+	return stats;
+}
+
+#pragma mark - Writer thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemRecorder::run()
+// ----------------------------------------------------------
+{
+	while(_running.load(std::memory_order_acquire)) {
+		if(!process(UINT64_MAX, false)) {
+			std::this_thread::sleep_for(kPollInterval);
+		}
+	}
+
+	// give every source a chance to reach the end before padding it out
+	const UInt64 limit = _stopFrames.load();
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + kStopTimeout;
+	while(_position < limit) {
+		const bool late = std::chrono::steady_clock::now() >= deadline;
+		if(!process(limit, late) && !late) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStemRecorder::process(UInt64 limit, bool padToLimit)
+// ----------------------------------------------------------
+{
+	bool wrote = false;
+
+	while(IsTime(_startSampleTime.load(std::memory_order_acquire))) {
+
+		// how far along the timeline each source has got
+		UInt64 slowest = UINT64_MAX;
+		UInt64 furthest = 0;
+		for(size_t i = 0; i < _sources.size(); i++) {
+			const Source &source = *_sources[i];
+			const UInt64 available = source.started.load(std::memory_order_acquire) ? source.leadFrames.load(std::memory_order_relaxed) + source.ring.getWriteCount() : 0;
+			slowest = std::min(slowest, available);
+			furthest = std::max(furthest, available);
+		}
+
+		// don't let one source that's fallen far behind hold the rest up
+		UInt64 target = slowest;
+		if(furthest > _lagLimit && furthest - _lagLimit > target) {
+			target = furthest - _lagLimit;
+		}
+		if(padToLimit) {
+			target = limit;
+		}
+		target = std::min(target, limit);
+
+		const UInt64 backlog = furthest > _position ? furthest - _position : 0;
+		if(backlog > _maxBacklog.load(std::memory_order_relaxed)) {
+			_maxBacklog.store(backlog, std::memory_order_relaxed);
+		}
+
+		const UInt64 ready = target > _position ? target - _position : 0;
+		if(ready == 0 || (limit == UINT64_MAX && ready < _minBatchFrames)) break;
+
+		const size_t frames = std::min<UInt64>(ready, _maxBatchFrames);
+		for(size_t i = 0; i < _sources.size(); i++) {
+			fill(*_sources[i], _position, frames);
+		}
+
+		if(!_failed.load(std::memory_order_relaxed)) {
+			bool ok = true;
+			UInt64 bytes = 0;
+			if(_layout == OFXAU_STEMS_INTERLEAVED) {
+				ok = _file.write(&_planes[0], frames);
+				bytes = _file.getBytesWritten();
+			} else {
+				for(size_t i = 0; i < _sources.size(); i++) {
+					Source &source = *_sources[i];
+					ok = source.file.write(&_planes[source.firstPlane], frames) && ok;
+					bytes += source.file.getBytesWritten();
+				}
+			}
+			_bytesWritten.store(bytes, std::memory_order_relaxed);
+			if(!ok) {
+				_failed.store(true, std::memory_order_relaxed);
+			}
+		}
+
+		_position += frames;
+		_framesWritten.store(_position, std::memory_order_relaxed);
+		wrote = true;
+	}
+
+	return wrote;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemRecorder::fill(Source &source, UInt64 from, size_t frames)
+// ----------------------------------------------------------
+{
+	Float32 * const * planes = &_planes[source.firstPlane];
+	for(unsigned int c = 0; c < source.channels; c++) {
+		std::fill(planes[c], planes[c] + frames, 0);
+	}
+
+	if(!source.started.load(std::memory_order_acquire)) {
+		_missingFrames.fetch_add(frames, std::memory_order_relaxed);
+		return;
+	}
+
+	// the stretch of the timeline the ring still holds. Before it, the source
+	// either hadn't started (silence) or has been overwritten (dropped); after
+	// it, the source hasn't got there yet (missing)
+	const UInt64 lead = source.leadFrames.load(std::memory_order_relaxed);
+	const UInt64 written = source.ring.getWriteCount();
+	const UInt64 oldest = written > source.ring.capacity() ? written - source.ring.capacity() : 0;
+	const UInt64 to = from + frames;
+	const UInt64 first = std::max(from, lead + oldest);
+	const UInt64 last = std::min(to, lead + written);
+
+	const UInt64 overwrittenFrom = std::max(from, lead);
+	if(std::min(to, lead + oldest) > overwrittenFrom) {
+		_droppedFrames.fetch_add(std::min(to, lead + oldest) - overwrittenFrom, std::memory_order_relaxed);
+	}
+
+	const UInt64 missingFrom = std::max(from, lead + written);
+	if(to > missingFrom) {
+		_missingFrames.fetch_add(to - missingFrom, std::memory_order_relaxed);
+	}
+
+	if(first >= last) return;
+
+	AudioBufferList * list = source.readList();
+	for(unsigned int c = 0; c < source.channels; c++) {
+		list->mBuffers[c].mData = planes[c] + (first - from);
+		list->mBuffers[c].mDataByteSize = (last - first) * sizeof(Float32);
+	}
+
+	if(!source.ring.read(first - lead, last - first, list)) {
+		// lapped while copying
+		for(unsigned int c = 0; c < source.channels; c++) {
+			std::fill(planes[c] + (first - from), planes[c] + (last - from), 0);
+		}
+		_droppedFrames.fetch_add(last - first, std::memory_order_relaxed);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemRecorder::closeFiles()
+// ----------------------------------------------------------
+{
+	bool ok = true;
+	if(_file.isOpen()) {
+		ok = _file.close();
+	}
+	for(size_t i = 0; i < _sources.size(); i++) {
+		if(_sources[i]->file.isOpen()) {
+			ok = _sources[i]->file.close() && ok;
+		}
+	}
+	if(!ok) {
+		_failed.store(true);
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "ofxAudioUnitCaptureBuffer.h"
+#include "ofxAudioUnitWavWriter.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef enum {
+	OFXAU_STEMS_SEPARATE,   // one file per source
+	OFXAU_STEMS_INTERLEAVED // every source's channels side by side in one file
+}
+ofxAudioUnitStemLayout;
+
+// ofxAudioUnitStemRecorder records several sources (branches of the same
+// graph, each fed from its own render callback) so that their files line up
+// to the sample. Each source gets its own ring, and one writer thread turns
+// them into either one multichannel file or a set of stems.
+
+// Alignment comes from the sources' sample times rather than from when they
+// were started. Once start() has been called, the first source to render
+// picks the start time: the end of the block it's rendering, so every source
+// that rendered that cycle before it is still in time for the next one. Each
+// source only writes frames from that sample time on, and a source that
+// starts rendering later is padded with silence up to its first frame. This
+// relies on the sources sharing a sample time line, which every node pulled
+// by the same output unit does. If the output's sample times start over (it
+// was stopped and started, or its device changed), the files carry on from
+// where they were, and the restart counts as one discontinuity.
+
+// The writer thread works through the files' shared timeline, so stems
+// always have the same length. A source that falls a long way behind the
+// others (say it was disconnected) gets silence rather than holding the rest
+// up, and is counted as missing.
+
+// addSource() and clearSources() aren't thread safe, and write() isn't
+// allowed until start() has returned.
+
+class ofxAudioUnitStemRecorder
+{
+public:
+	struct Stats {
+		UInt64 framesWritten;  // per file, i.e. along the timeline
+		UInt64 bytesWritten;   // across every file
+		UInt64 droppedFrames;  // overwritten in a ring before the writer got to them
+		UInt64 missingFrames;  // filled with silence for a source that fell behind
+		UInt64 discontinuities; // blocks that didn't follow on from the last one's sample time
+		UInt64 backlog;        // timeline frames waiting to be written
+		UInt64 maxBacklog;
+		Float64 startSampleTime; // NaN until the first source renders after start()
+		bool failed;
+	};
+
+	ofxAudioUnitStemRecorder();
+	~ofxAudioUnitStemRecorder();
+
+	// returns the index to pass to write(). The name is used for the stem's
+	// file name (see stemPath())
+	size_t addSource(unsigned int channels, const std::string &name = "");
+	void clearSources();
+	size_t getNumSources() const {return _sources.size();}
+
+	// filePath is the interleaved file, or what the stems' file names are
+	// made from
+	bool start(const std::string &filePath, Float64 sampleRate, ofxAudioUnitWavFormat format, ofxAudioUnitStemLayout layout, double ringSeconds = 4);
+
+	// Ends the files at the latest sample time any source has rendered,
+	// waiting (briefly) for the others to catch up with it. Sources can carry
+	// on calling write() until this returns
+	bool stop();
+
+	bool isRecording() const {return _thread.joinable();}
+
+	// for 16 and 24 bit files, from the next start() on. Off by default
+	void setDither(ofxAudioUnitDither dither) {_dither = dither;}
+	ofxAudioUnitDither getDither() const {return _dither;}
+
+	// Render thread: the block starting at sampleTime (NaN if the caller
+	// doesn't know, in which case it's assumed to follow on from the last
+	// one). Different sources can write from different threads
+	void write(size_t source, Float64 sampleTime, const AudioBufferList * bufferList, UInt32 frames);
+
+	Stats getStats() const;
+
+	// "show.wav" + "drums" -> "show-drums.wav"
+	static std::string stemPath(const std::string &filePath, const std::string &name);
+
+private:
+	struct Source {
+		std::string name;
+		unsigned int channels;
+		ofxAudioUnitCaptureBuffer ring;
+		ofxAudioUnitWavWriter file;
+
+		// render thread
+		Float64 nextSampleTime;
+		std::vector<char> offsetListStorage;
+
+		// the timeline frame the ring's frame 0 lands on, published by started
+		std::atomic<UInt64> leadFrames;
+		std::atomic<bool> started;
+		std::atomic<Float64> endSampleTime; // just past the latest block rendered
+		std::atomic<UInt64> discontinuities;
+
+		// writer thread
+		std::vector<char> readListStorage;
+		size_t firstPlane; // index of its channels in _planes
+
+		Source(unsigned int channels, const std::string &name);
+		AudioBufferList * offsetList() {return (AudioBufferList *)&offsetListStorage[0];}
+		AudioBufferList * readList() {return (AudioBufferList *)&readListStorage[0];}
+	};
+
+	std::vector<std::unique_ptr<Source> > _sources;
+	ofxAudioUnitWavWriter _file; // interleaved
+	ofxAudioUnitStemLayout _layout;
+	ofxAudioUnitDither _dither;
+	std::thread _thread;
+	std::atomic<bool> _running;
+	std::atomic<bool> _accepting;
+	std::atomic<Float64> _startSampleTime;
+	std::atomic<Float64> _timeOffset; // added to the sources' sample times once the output's have started over
+	std::atomic<UInt64> _stopFrames;
+
+	// writer thread
+	UInt64 _position; // along the timeline
+	size_t _lagLimit;
+	size_t _minBatchFrames;
+	size_t _maxBatchFrames;
+	std::vector<Float32> _scratch;
+	std::vector<Float32 *> _planes;
+
+	std::atomic<UInt64> _framesWritten;
+	std::atomic<UInt64> _bytesWritten;
+	std::atomic<UInt64> _droppedFrames;
+	std::atomic<UInt64> _missingFrames;
+	std::atomic<UInt64> _maxBacklog;
+	std::atomic<bool> _failed;
+
+	ofxAudioUnitStemRecorder(const ofxAudioUnitStemRecorder &);
+	ofxAudioUnitStemRecorder& operator=(const ofxAudioUnitStemRecorder &);
+
+	void run();
+	bool process(UInt64 limit, bool padToLimit);
+	void fill(Source &source, UInt64 from, size_t frames);
+	void closeFiles();
+};
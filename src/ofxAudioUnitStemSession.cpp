@@ -0,0 +1,168 @@
+#include "ofxAudioUnitStemSession.h"
+#include <limits>
+
+// a render callback which hands a recorder's audio to the session, stamped
+// with its sample time
+static OSStatus StemRecord(void * inRefCon,
+						   AudioUnitRenderActionFlags *	ioActionFlags,
+						   const AudioTimeStamp *	inTimeStamp,
+						   UInt32 inBusNumber,
+						   UInt32	inNumberFrames,
+						   AudioBufferList * ioData);
+
+// ----------------------------------------------------------
+ofxAudioUnitStemSession::ofxAudioUnitStemSession()
+: _stems(new ofxAudioUnitStemRecorder)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStemSession::~ofxAudioUnitStemSession()
+// ----------------------------------------------------------
+{
+	stopRecording();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemSession::addRecorder(ofxAudioUnitRecorder &recorder, const std::string &name)
+// ----------------------------------------------------------
+{
+	stopRecording();
+
+	Member * member = new Member;
+	member->recorder = &recorder;
+	member->name = name;
+	member->stems = _stems.get();
+	member->source = 0;
+	_members.push_back(std::unique_ptr<Member>(member));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemSession::clear()
+// ----------------------------------------------------------
+{
+	stopRecording();
+	_members.clear();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStemSession::startRecording(const std::string &filePath, ofxAudioUnitWavFormat format, ofxAudioUnitStemLayout layout)
+// ----------------------------------------------------------
+{
+	stopRecording();
+	_stems->clearSources();
+
+	if(_members.empty()) {
+		std::cout << "Stem session has no recorders" << std::endl;
+		return false;
+	}
+
+	Float64 sampleRate = 0;
+	for(size_t i = 0; i < _members.size(); i++) {
+		Member &member = *_members[i];
+		AudioStreamBasicDescription inASBD = member.recorder->getSourceASBD();
+
+		if(inASBD.mFormatID == 0) {
+			std::cout << "Stem session couldn't determine the stream format of recorder " << (i + 1) << ". ";
+			std::cout << "Is it directly after an Audio Unit?" << std::endl;
+			return false;
+		}
+
+		if(sampleRate == 0) {
+			sampleRate = inASBD.mSampleRate;
+		} else if(inASBD.mSampleRate != sampleRate) {
+			std::cout << "Stem session's recorders have to run at the same sample rate ("
+					  << sampleRate << " vs. " << inASBD.mSampleRate << ")" << std::endl;
+			return false;
+		}
+
+		const std::string name = member.name.empty() ? member.recorder->name : member.name;
+		member.source = _stems->addSource(inASBD.mChannelsPerFrame, name);
+	}
+
+	if(!_stems->start(filePath, sampleRate, format, layout)) {
+		return false;
+	}
+
+	// The order doesn't matter: the files start at the end of the first block
+	// any of them renders from here on, and a recorder that only starts
+	// rendering after that gets lined up with silence
+	for(size_t i = 0; i < _members.size(); i++) {
+		_members[i]->recorder->attachToSession((AURenderCallbackStruct){StemRecord, _members[i].get()});
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemSession::stopRecording()
+// ----------------------------------------------------------
+{
+	if(!_stems->isRecording()) return;
+
+	// the recorders keep feeding the session until it's found its end point
+	const bool ok = _stems->stop();
+
+	for(size_t i = 0; i < _members.size(); i++) {
+		_members[i]->recorder->detachFromSession();
+	}
+
+	const ofxAudioUnitStemRecorder::Stats stats = _stems->getStats();
+	if(!ok) {
+		std::cout << "Stem session wasn't written completely" << std::endl;
+	}
+	if(stats.droppedFrames > 0 || stats.missingFrames > 0) {
+		std::cout << "Stem session dropped " << stats.droppedFrames << " frames keeping up with the disk, and filled "
+				  << stats.missingFrames << " frames of recorders that fell behind with silence" << std::endl;
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStemSession::isRecording() const
+// ----------------------------------------------------------
+{
+	return _stems->isRecording();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStemSession::setDither(ofxAudioUnitDither dither)
+// ----------------------------------------------------------
+{
+	_stems->setDither(dither);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDither ofxAudioUnitStemSession::getDither() const
+// ----------------------------------------------------------
+{
+	return _stems->getDither();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStemRecorder::Stats ofxAudioUnitStemSession::getStats() const
+// ----------------------------------------------------------
+{
+	return _stems->getStats();
+}
+
+#pragma mark - Render callback
+
+// ----------------------------------------------------------
+OSStatus StemRecord(void * inRefCon,
+					AudioUnitRenderActionFlags * ioActionFlags,
+					const AudioTimeStamp * inTimeStamp,
+					UInt32 inBusNumber,
+					UInt32 inNumberFrames,
+					AudioBufferList * ioData)
+{
+	ofxAudioUnitStemSession::Member * member = static_cast<ofxAudioUnitStemSession::Member *>(inRefCon);
+
+	const Float64 sampleTime = inTimeStamp && (inTimeStamp->mFlags & kAudioTimeStampSampleTimeValid)
+		? inTimeStamp->mSampleTime
+		: std::numeric_limits<Float64>::quiet_NaN();
+
+	member->stems->write(member->source, sampleTime, ioData, inNumberFrames);
+	return noErr;
+}
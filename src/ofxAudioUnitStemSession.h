@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ofxAudioUnitRecorder.h"
+#include "ofxAudioUnitStemRecorder.h"
+#include <memory>
+#include <vector>
+
+// ofxAudioUnitStemSession records several ofxAudioUnitRecorders together
+// (say, one at the end of each branch of a graph), with every file starting
+// on the same sample time. The result is either one interleaved file with
+// every recorder's channels side by side, or one stem per recorder. All of
+// the writing happens on a single writer thread.
+
+// The recorders have to be pulled by the same output, so that their sample
+// times agree. While the session is recording, it takes over the recorders'
+// render callbacks; anything they were recording themselves is stopped, and
+// their pre-roll (if any) picks up again once the session stops. If the
+// output's sample times start over mid-take, the stems carry on together from
+// where they were (see ofxAudioUnitStemRecorder).
+
+class ofxAudioUnitStemSession
+{
+public:
+	ofxAudioUnitStemSession();
+	~ofxAudioUnitStemSession();
+
+	// the name goes in the stem's file name. It defaults to the recorder's
+	// name, or its position in the session if that's empty too
+	void addRecorder(ofxAudioUnitRecorder &recorder, const std::string &name = "");
+	void clear();
+
+	// With OFXAU_STEMS_SEPARATE, "show.wav" becomes "show-drums.wav",
+	// "show-bass.wav" etc.
+	bool startRecording(const std::string &filePath,
+						ofxAudioUnitWavFormat format = OFXAU_WAV_INT24,
+						ofxAudioUnitStemLayout layout = OFXAU_STEMS_SEPARATE);
+	void stopRecording();
+	bool isRecording() const;
+
+	// for 16 and 24 bit files, applied to every stem from the next
+	// startRecording() on. Off by default
+	void setDither(ofxAudioUnitDither dither);
+	ofxAudioUnitDither getDither() const;
+
+	ofxAudioUnitStemRecorder::Stats getStats() const;
+
+	struct Member
+	{
+		ofxAudioUnitRecorder * recorder;
+		std::string name;
+		ofxAudioUnitStemRecorder * stems;
+		size_t source;
+	};
+
+private:
+	std::vector<std::unique_ptr<Member> > _members;
+	std::shared_ptr<ofxAudioUnitStemRecorder> _stems;
+};
@@ -0,0 +1,146 @@
+#include "ofxAudioUnitStreamingFilePlayer.h"
+
+// a render callback which streams the file into the buffers it's given
+static OSStatus RenderStreamed(void * inRefCon,
+							 AudioUnitRenderActionFlags *	ioActionFlags,
+							 const AudioTimeStamp *	inTimeStamp,
+							 UInt32 inBusNumber,
+							 UInt32	inNumberFrames,
+							 AudioBufferList * ioData);
+
+// ----------------------------------------------------------
+ofxAudioUnitStreamingFilePlayer::ofxAudioUnitStreamingFilePlayer(unsigned int channels)
+: _file(new ofxAudioUnitDiskPlayer)
+, _overview(new ofxAudioUnitWaveformOverview)
+// ----------------------------------------------------------
+{
+	setSource((AURenderCallbackStruct){RenderStreamed, _file.get()}, channels);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStreamingFilePlayer::~ofxAudioUnitStreamingFilePlayer()
+// ----------------------------------------------------------
+{
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStreamingFilePlayer::setFile(const std::string &filePath, double readAheadSeconds, size_t readBytes)
+// ----------------------------------------------------------
+{
+	if(!_file->open(filePath, readAheadSeconds, readBytes)) {
+		_overview->clear();
+		return false;
+	}
+
+	// an overview that's been asked for follows the file
+	if(!_overview->getFilePath().empty()) {
+		_overview->load(filePath, _overviewDirectory);
+	}
+	return true;
+}
+
+// ----------------------------------------------------------
+const ofxAudioUnitWavReader::Info& ofxAudioUnitStreamingFilePlayer::getFileInfo() const
+// ----------------------------------------------------------
+{
+	return _file->getInfo();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::play()
+// ----------------------------------------------------------
+{
+	_file->play();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::stop()
+// ----------------------------------------------------------
+{
+	_file->stop();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStreamingFilePlayer::isPlaying() const
+// ----------------------------------------------------------
+{
+	return _file->isPlaying();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::setPosition(UInt64 frame)
+// ----------------------------------------------------------
+{
+	_file->setPosition(frame);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitStreamingFilePlayer::getPosition() const
+// ----------------------------------------------------------
+{
+	return _file->getPosition();
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitStreamingFilePlayer::getLength() const
+// ----------------------------------------------------------
+{
+	return _file->isOpen() ? _file->getInfo().frames : 0;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStreamingFilePlayer::isReady() const
+// ----------------------------------------------------------
+{
+	return _file->isOpen() && _file->isReady();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitDiskPlayer::Stats ofxAudioUnitStreamingFilePlayer::getStats() const
+// ----------------------------------------------------------
+{
+	return _file->getStats();
+}
+
+// ----------------------------------------------------------
+const ofxAudioUnitWaveformOverview& ofxAudioUnitStreamingFilePlayer::getOverview()
+// ----------------------------------------------------------
+{
+	if(_file->isOpen() && _overview->getFilePath() != _file->getFilePath()) {
+		_overview->load(_file->getFilePath(), _overviewDirectory);
+	}
+	return *_overview;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStreamingFilePlayer::setOverviewDirectory(const std::string &directory)
+// ----------------------------------------------------------
+{
+	_overviewDirectory = directory;
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitStreamingFilePlayer::getName()
+// ----------------------------------------------------------
+{
+	if(name.empty()) {
+		return "ofxAudioUnitStreamingFilePlayer";
+	} else {
+		return name;
+	}
+}
+
+#pragma mark - Render Callback
+
+// ----------------------------------------------------------
+OSStatus RenderStreamed(void * inRefCon,
+					  AudioUnitRenderActionFlags * ioActionFlags,
+					  const AudioTimeStamp * inTimeStamp,
+					  UInt32 inBusNumber,
+					  UInt32 inNumberFrames,
+					  AudioBufferList * ioData)
+// ----------------------------------------------------------
+{
+	((ofxAudioUnitDiskPlayer *)inRefCon)->render(inNumberFrames, ioData);
+	return noErr;
+}
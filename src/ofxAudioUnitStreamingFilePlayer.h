@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ofxAudioUnitDSPNode.h"
+#include "ofxAudioUnitDiskPlayer.h"
+#include "ofxAudioUnitWaveformOverview.h"
+
+// ofxAudioUnitStreamingFilePlayer streams WAV or RF64 files from disk with
+// a read-ahead thread of its own, for recordings hours long on disks that
+// can't keep up with the render thread. Unlike ofxAudioUnitFilePlayer,
+// nothing blocks: setFile() and setPosition() return straight away and the
+// audio follows once it's been read (isReady() says when). See
+// ofxAudioUnitDiskPlayer for how it's done.
+
+// It's a source, so connect it to a mixer or output like a file player. The
+// file is played at its own sample rate.
+
+class ofxAudioUnitStreamingFilePlayer : public ofxAudioUnitDSPNode
+{
+public:
+	explicit ofxAudioUnitStreamingFilePlayer(unsigned int channels = 2);
+	virtual ~ofxAudioUnitStreamingFilePlayer();
+
+	// readAheadSeconds is the longest disk stall playback can ride out;
+	// readBytes is the size of each read
+	bool setFile(const std::string &filePath, double readAheadSeconds = 4, size_t readBytes = 1 << 20);
+	const ofxAudioUnitWavReader::Info& getFileInfo() const;
+
+	void play();
+	void stop();
+	bool isPlaying() const;
+
+	void setPosition(UInt64 frame);
+	UInt64 getPosition() const;
+	UInt64 getLength() const;
+	bool isReady() const;
+
+	ofxAudioUnitDiskPlayer::Stats getStats() const;
+
+	// An overview of the file for drawing its waveform, made in the
+	// background the first time it's asked for (and after each setFile()
+	// from then on) and kept in a sidecar; see ofxAudioUnitWaveformOverview
+	const ofxAudioUnitWaveformOverview& getOverview();
+	void setOverviewDirectory(const std::string &directory);
+
+	virtual std::string getName();
+
+private:
+	std::shared_ptr<ofxAudioUnitDiskPlayer> _file;
+	std::string _overviewDirectory;
+	std::shared_ptr<ofxAudioUnitWaveformOverview> _overview;
+};
@@ -0,0 +1,189 @@
+#include "ofxAudioUnitStretchPlayer.h"
+
+// a render callback which plays the stretched sample into the buffers it's given
+static OSStatus RenderStretched(void * inRefCon,
+							  AudioUnitRenderActionFlags *	ioActionFlags,
+							  const AudioTimeStamp *	inTimeStamp,
+							  UInt32 inBusNumber,
+							  UInt32	inNumberFrames,
+							  AudioBufferList * ioData);
+
+// ----------------------------------------------------------
+ofxAudioUnitStretchPlayer::ofxAudioUnitStretchPlayer(unsigned int channels, ofxAudioUnitStretchMode mode)
+: _stretch(new ofxAudioUnitTimeStretch(mode))
+// ----------------------------------------------------------
+{
+	setSource((AURenderCallbackStruct){RenderStretched, _stretch.get()}, channels);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStretchPlayer::~ofxAudioUnitStretchPlayer()
+// ----------------------------------------------------------
+{
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStretchPlayer::setFile(const std::string &filePath, Float64 sampleRate)
+// ----------------------------------------------------------
+{
+	ofxAudioUnitSampleRef sample = ofxAudioUnitSampleCache::load(filePath, sampleRate);
+	if(!sample) {
+		std::cout << getName() << " couldn't load " << filePath << std::endl;
+		return false;
+	}
+	setSample(sample);
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::setSample(const ofxAudioUnitSampleRef &sample)
+// ----------------------------------------------------------
+{
+	_stretch->setSample(sample);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleRef ofxAudioUnitStretchPlayer::getSample() const
+// ----------------------------------------------------------
+{
+	return _stretch->getSample();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::setMode(ofxAudioUnitStretchMode mode)
+// ----------------------------------------------------------
+{
+	_stretch->setMode(mode);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStretchMode ofxAudioUnitStretchPlayer::getMode() const
+// ----------------------------------------------------------
+{
+	return _stretch->getMode();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::setTempo(double tempo)
+// ----------------------------------------------------------
+{
+	_stretch->setTempo(tempo);
+}
+
+// ----------------------------------------------------------
+double ofxAudioUnitStretchPlayer::getTempo() const
+// ----------------------------------------------------------
+{
+	return _stretch->getTempo();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::setPitch(double ratio)
+// ----------------------------------------------------------
+{
+	_stretch->setPitch(ratio);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::setPitchSemitones(double semitones)
+// ----------------------------------------------------------
+{
+	_stretch->setPitchSemitones(semitones);
+}
+
+// ----------------------------------------------------------
+double ofxAudioUnitStretchPlayer::getPitch() const
+// ----------------------------------------------------------
+{
+	return _stretch->getPitch();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::play()
+// ----------------------------------------------------------
+{
+	_stretch->play();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::stop()
+// ----------------------------------------------------------
+{
+	_stretch->stop();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStretchPlayer::isPlaying() const
+// ----------------------------------------------------------
+{
+	return _stretch->isPlaying();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::setLooping(bool looping)
+// ----------------------------------------------------------
+{
+	_stretch->setLooping(looping);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitStretchPlayer::isLooping() const
+// ----------------------------------------------------------
+{
+	return _stretch->isLooping();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitStretchPlayer::setPosition(UInt64 frame)
+// ----------------------------------------------------------
+{
+	_stretch->setPosition(frame);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitStretchPlayer::getPosition() const
+// ----------------------------------------------------------
+{
+	return _stretch->getPosition();
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitStretchPlayer::getLength() const
+// ----------------------------------------------------------
+{
+	ofxAudioUnitSampleRef sample = _stretch->getSample();
+	return sample ? sample->frames : 0;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeStretch::Stats ofxAudioUnitStretchPlayer::getStats() const
+// ----------------------------------------------------------
+{
+	return _stretch->getStats();
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitStretchPlayer::getName()
+// ----------------------------------------------------------
+{
+	if(name.empty()) {
+		return "ofxAudioUnitStretchPlayer";
+	} else {
+		return name;
+	}
+}
+
+#pragma mark - Render Callback
+
+// ----------------------------------------------------------
+OSStatus RenderStretched(void * inRefCon,
+					   AudioUnitRenderActionFlags * ioActionFlags,
+					   const AudioTimeStamp * inTimeStamp,
+					   UInt32 inBusNumber,
+					   UInt32 inNumberFrames,
+					   AudioBufferList * ioData)
+// ----------------------------------------------------------
+{
+	((ofxAudioUnitTimeStretch *)inRefCon)->render(inNumberFrames, ioData);
+	return noErr;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "ofxAudioUnitDSPNode.h"
+#include "ofxAudioUnitTimeStretch.h"
+
+// ofxAudioUnitStretchPlayer plays a sound file from memory with its tempo
+// and pitch set independently: slowed down without dropping in pitch, or
+// transposed without changing length, and both can be changed while it's
+// playing. See ofxAudioUnitTimeStretch for how, and for the two modes
+// (WSOLA for speech, the phase vocoder for music).
+
+// Files are loaded through ofxAudioUnitSampleCache, so players of the same
+// file share one decoded copy. It's a source, so connect it to a mixer or
+// output like a file player. setFile() and setMode() block, so call them
+// ahead of time. getStats() says what the player costs the render thread.
+
+class ofxAudioUnitStretchPlayer : public ofxAudioUnitDSPNode
+{
+public:
+	explicit ofxAudioUnitStretchPlayer(unsigned int channels = 2,
+	                                   ofxAudioUnitStretchMode mode = OFXAU_STRETCH_PHASE_VOCODER);
+	virtual ~ofxAudioUnitStretchPlayer();
+
+	// sampleRate should be the rate of the graph the player is connected to,
+	// or 0 to play the file at its own rate
+	bool setFile(const std::string &filePath, Float64 sampleRate = 0);
+	void setSample(const ofxAudioUnitSampleRef &sample);
+	ofxAudioUnitSampleRef getSample() const;
+
+	void setMode(ofxAudioUnitStretchMode mode);
+	ofxAudioUnitStretchMode getMode() const;
+
+	void setTempo(double tempo);
+	double getTempo() const;
+	void setPitch(double ratio);
+	void setPitchSemitones(double semitones);
+	double getPitch() const;
+
+	void play();
+	void stop();
+	bool isPlaying() const;
+	void setLooping(bool looping);
+	bool isLooping() const;
+
+	// in frames of the sample
+	void setPosition(UInt64 frame);
+	UInt64 getPosition() const;
+	UInt64 getLength() const;
+
+	ofxAudioUnitTimeStretch::Stats getStats() const;
+
+	virtual std::string getName();
+
+private:
+	std::shared_ptr<ofxAudioUnitTimeStretch> _stretch;
+};
@@ -0,0 +1,713 @@
+#include "ofxAudioUnitTimeStretch.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static const double kMinRatio = 0.25;
+static const double kMaxRatio = 4;
+static const unsigned int kMaxChannels = 32;
+
+#pragma mark - Vectors
+
+// gcc and clang lower these to SSE2 on Intel and NEON on ARM
+typedef float Float4 __attribute__((vector_size(16)));
+typedef int   Int4   __attribute__((vector_size(16)));
+
+static inline Float4 Splat(float x) {const Float4 v = {x, x, x, x}; return v;}
+static inline Int4 SplatInt(int x) {const Int4 v = {x, x, x, x}; return v;}
+static inline Float4 Load(const Float32 * p) {Float4 v; memcpy(&v, p, sizeof(v)); return v;}
+static inline void Store(Float32 * p, Float4 v) {memcpy(p, &v, sizeof(v));}
+static inline Float4 Select(Int4 mask, Float4 a, Float4 b) {return (Float4)(((Int4)a & mask) | ((Int4)b & ~mask));}
+static inline Float4 Abs(Float4 x) {return (Float4)((Int4)x & SplatInt(0x7fffffff));}
+
+// x rounded to the nearest integer, for |x| < 2^22
+static inline Float4 RoundFloat(Float4 x)
+{
+	const Float4 magic = Splat(12582912.f); // 1.5 * 2^23
+	return (x + magic) - magic;
+}
+
+// an angle brought into [-pi, pi]
+static inline Float4 Wrap(Float4 x)
+{
+	return x - Splat(2 * M_PI) * RoundFloat(x * Splat(1 / (2 * M_PI)));
+}
+
+// Abramowitz and Stegun 4.4.49 on [0, 1], within 1e-5 radians, and the
+// octants sorted out from there
+static inline Float4 Atan2(Float4 y, Float4 x)
+{
+	const Float4 ax = Abs(x);
+	const Float4 ay = Abs(y);
+	const Int4 swap = ay > ax;
+	const Float4 num = Select(swap, ax, ay);
+	const Float4 den = Select(swap, ay, ax);
+	const Float4 z = num / Select(den == Splat(0), Splat(1), den);
+	const Float4 z2 = z * z;
+
+	Float4 a = z * (Splat(0.9998660f) + z2 * (Splat(-0.3302995f) + z2 * (Splat(0.1801410f) + z2 * (Splat(-0.0851330f) + z2 * Splat(0.0208351f)))));
+	a = Select(swap, Splat(M_PI_2) - a, a);
+	a = Select(x < Splat(0), Splat(M_PI) - a, a);
+	return Select(y < Splat(0), -a, a);
+}
+
+// for |x| <= pi or so: reduced to [-pi/4, pi/4] by quadrant, where the
+// Taylor series to x^9 is good to a few 1e-7
+static inline void SinCos(Float4 x, Float4 &sine, Float4 &cosine)
+{
+	const Float4 q = RoundFloat(x * Splat(M_2_PI));
+	const Float4 r = (x - q * Splat(1.5707963705062866f)) - q * Splat(-4.371139000186241e-08f);
+	const Float4 r2 = r * r;
+	const Float4 s = r + r * r2 * (Splat(-1.f / 6) + r2 * (Splat(1.f / 120) + r2 * (Splat(-1.f / 5040) + r2 * Splat(1.f / 362880))));
+	const Float4 c = Splat(1) + r2 * (Splat(-0.5f) + r2 * (Splat(1.f / 24) + r2 * (Splat(-1.f / 720) + r2 * Splat(1.f / 40320))));
+
+	const Int4 quadrant = __builtin_convertvector(q, Int4);
+	const Int4 odd = (quadrant & SplatInt(1)) != SplatInt(0);
+	sine = Select(odd, c, s);
+	cosine = Select(odd, s, c);
+	sine = Select((quadrant & SplatInt(2)) != SplatInt(0), -sine, sine);
+	cosine = Select(((quadrant + SplatInt(1)) & SplatInt(2)) != SplatInt(0), -cosine, cosine);
+}
+
+static inline float Dot(const Float32 * a, const Float32 * b, size_t n)
+{
+	Float4 s0 = Splat(0);
+	Float4 s1 = Splat(0);
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		s0 += Load(a + i) * Load(b + i);
+		s1 += Load(a + i + 4) * Load(b + i + 4);
+	}
+	s0 += s1;
+	float sum = s0[0] + s0[1] + s0[2] + s0[3];
+	for(; i < n; i++) sum += a[i] * b[i];
+	return sum;
+}
+
+// out[i] = a[i] * b[i]
+static inline void Multiply(Float32 * out, const Float32 * a, const Float32 * b, size_t n)
+{
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) Store(out + i, Load(a + i) * Load(b + i));
+	for(; i < n; i++) out[i] = a[i] * b[i];
+}
+
+// out[i] += a[i] * b[i]
+static inline void MultiplyAdd(Float32 * out, const Float32 * a, const Float32 * b, size_t n)
+{
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) Store(out + i, Load(out + i) + Load(a + i) * Load(b + i));
+	for(; i < n; i++) out[i] += a[i] * b[i];
+}
+
+static inline void Add(Float32 * out, const Float32 * a, size_t n)
+{
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) Store(out + i, Load(out + i) + Load(a + i));
+	for(; i < n; i++) out[i] += a[i];
+}
+
+// 4 point, 3rd order Hermite (Catmull-Rom) between y0 and y1
+static inline Float32 Hermite(Float32 ym1, Float32 y0, Float32 y1, Float32 y2, Float32 t)
+{
+	const Float32 c1 = 0.5f * (y1 - ym1);
+	const Float32 c2 = ym1 - 2.5f * y0 + 2.f * y1 - 0.5f * y2;
+	const Float32 c3 = 0.5f * (y2 - ym1) + 1.5f * (y0 - y1);
+	return ((c3 * t + c2) * t + c1) * t + y0;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeStretch::ofxAudioUnitTimeStretch(ofxAudioUnitStretchMode mode)
+: _mode(mode)
+, _tempo(1)
+, _pitch(1)
+, _playing(false)
+, _looping(false)
+, _seekTo(-1)
+, _position(0)
+, _channels(0)
+, _frameSize(0)
+, _log2FrameSize(0)
+, _hop(0)
+, _search(0)
+, _bins(0)
+, _paddedBins(0)
+, _fifoCapacity(0)
+, _active(0)
+, _reset(true)
+, _first(true)
+, _analysis(0)
+, _previousStart(0)
+, _heard(0)
+, _discard(0)
+, _readPosition(0)
+, _fifoFill(0)
+, _framesRendered(0)
+, _renderSeconds(0)
+, _peakLoad(0)
+, _cycles(0)
+// ----------------------------------------------------------
+{
+	allocate();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeStretch::~ofxAudioUnitTimeStretch()
+// ----------------------------------------------------------
+{
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::setSample(const ofxAudioUnitSampleRef &sample)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_sample = sample;
+	_seekTo.store(-1);
+	_position.store(0);
+	_heard = 0;
+	allocate();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitSampleRef ofxAudioUnitTimeStretch::getSample() const
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _sample;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::setMode(ofxAudioUnitStretchMode mode)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(mode == _mode) return;
+	_mode = mode;
+	allocate();
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitStretchMode ofxAudioUnitTimeStretch::getMode() const
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _mode;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::allocate()
+// ----------------------------------------------------------
+{
+	const ofxAudioUnitSampleData * sample = _sample.get();
+	const double rate = sample ? sample->sampleRate : 44100;
+	_channels = sample ? std::min(sample->channels, kMaxChannels) : 1;
+
+	if(_mode == OFXAU_STRETCH_WSOLA) {
+		_frameSize = std::max<size_t>(llround(rate * 0.02 / 8) * 8, 64);
+		_log2FrameSize = 0; // not a power of 2, and there's no FFT
+		_hop = _frameSize / 2;
+		_search = llround(rate * 0.006);
+	} else {
+		_log2FrameSize = rate < 32000 ? 10 : rate <= 64000 ? 11 : rate <= 128000 ? 12 : 13;
+		_frameSize = (size_t)1 << _log2FrameSize;
+		_hop = _frameSize / 4;
+		_search = 0;
+	}
+	_bins = _frameSize / 2 + 1;
+	_paddedBins = (_bins + 3) / 4 * 4;
+	_fifoCapacity = _hop + 8;
+
+	// Hann (periodic), and the same scaled so the overlapping frames add back
+	// up to 1 (the vocoder windows twice, WSOLA once)
+	_window.resize(_frameSize);
+	for(size_t n = 0; n < _frameSize; n++) {
+		_window[n] = 0.5 - 0.5 * cos(2 * M_PI * n / _frameSize);
+	}
+	double overlap = 0;
+	for(size_t n = 0; n < _frameSize; n += _hop) {
+		overlap += _mode == OFXAU_STRETCH_WSOLA ? _window[n + _hop / 2] : _window[n + _hop / 2] * _window[n + _hop / 2];
+	}
+	_synthesisWindow.resize(_frameSize);
+	for(size_t n = 0; n < _frameSize; n++) {
+		_synthesisWindow[n] = _window[n] / overlap;
+	}
+
+	_accumulator.assign(_channels * _frameSize, 0);
+	_fifo.assign(_channels * _fifoCapacity, 0);
+	_frame.assign(std::max(_frameSize, 2 * _search + _hop), 0);
+	_target.assign(_mode == OFXAU_STRETCH_WSOLA ? _hop : 0, 0);
+	_mix.assign(_mode == OFXAU_STRETCH_WSOLA ? 2 * _search + _hop : 0, 0);
+
+	const size_t bins = _mode == OFXAU_STRETCH_PHASE_VOCODER ? _paddedBins : 0;
+	_fftSetup = _mode == OFXAU_STRETCH_PHASE_VOCODER ? ofxAudioUnitFftCache::getSetup(_log2FrameSize) : FFTSetupRef();
+	_binNumbers.resize(bins);
+	for(size_t k = 0; k < bins; k++) _binNumbers[k] = k;
+	_real.assign(bins, 0);
+	_imag.assign(bins, 0);
+	_magnitude.assign(bins, 0);
+	_phase.assign(bins, 0);
+	_advance.assign(bins, 0);
+	_analysisPhase.assign(_channels * bins, 0);
+	_synthesisPhase.assign(_channels * bins, 0);
+	_peaks.resize(bins);
+
+	_reset = true;
+}
+
+#pragma mark - Transport
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::setTempo(double tempo)
+// ----------------------------------------------------------
+{
+	_tempo.store(std::min(std::max(tempo, kMinRatio), kMaxRatio), std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::setPitch(double ratio)
+// ----------------------------------------------------------
+{
+	_pitch.store(std::min(std::max(ratio, kMinRatio), kMaxRatio), std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::setPitchSemitones(double semitones)
+// ----------------------------------------------------------
+{
+	setPitch(pow(2, semitones / 12));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::play()
+// ----------------------------------------------------------
+{
+	ofxAudioUnitSampleRef sample = getSample();
+	if(!sample) return;
+	if(getPosition() >= sample->frames) setPosition(0);
+	_playing.store(true, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::stop()
+// ----------------------------------------------------------
+{
+	_playing.store(false, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::setPosition(UInt64 frame)
+// ----------------------------------------------------------
+{
+	_seekTo.store(frame, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitTimeStretch::getPosition() const
+// ----------------------------------------------------------
+{
+	const SInt64 seekTo = _seekTo.load(std::memory_order_acquire);
+	return seekTo >= 0 ? seekTo : _position.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeStretch::Stats ofxAudioUnitTimeStretch::getStats() const
+// ----------------------------------------------------------
+{
+	ofxAudioUnitSampleRef sample = getSample();
+	const double rate = sample ? sample->sampleRate : 44100;
+
+	Stats stats;
+	stats.framesRendered = _framesRendered;
+	stats.meanLoad = stats.framesRendered > 0 ? _renderSeconds.load() / (stats.framesRendered / rate) : 0;
+	stats.peakLoad = _peakLoad;
+	stats.meanCycleUs = _cycles > 0 ? _renderSeconds.load() / _cycles * 1e6 : 0;
+	return stats;
+}
+
+#pragma mark - Render thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::render(UInt32 frames, AudioBufferList * bufferList)
+// ----------------------------------------------------------
+{
+	const Clock::time_point start = Clock::now();
+	UInt32 done = 0;
+	double rate = 0;
+
+	// if the sample or mode is being changed, this cycle is silent
+	std::unique_lock<std::mutex> lock(_mutex, std::try_to_lock);
+	const ofxAudioUnitSampleData * sample = lock.owns_lock() ? _sample.get() : NULL;
+	const unsigned int active = std::min<unsigned int>(bufferList->mNumberBuffers, _channels);
+
+	if(sample && sample->frames > 0 && active > 0) {
+		rate = sample->sampleRate;
+		const double tempo = _tempo.load(std::memory_order_relaxed);
+		const double pitch = _pitch.load(std::memory_order_relaxed);
+		const bool looping = _looping.load(std::memory_order_relaxed);
+
+		const SInt64 seekTo = _seekTo.exchange(-1, std::memory_order_acquire);
+		if(seekTo >= 0) {
+			_heard = std::min<UInt64>(seekTo, sample->frames);
+			_reset = true;
+		}
+		if(active != _active) {
+			_active = active;
+			_reset = true;
+		}
+
+		if(_playing.load(std::memory_order_relaxed)) {
+			if(_reset) restart(_heard, pitch / tempo);
+
+			UInt32 count = frames;
+			if(!looping) {
+				const double left = sample->frames > _heard ? ceil((sample->frames - _heard) / tempo) : 0;
+				count = std::min<double>(frames, left);
+			}
+
+			Float32 * out[kMaxChannels];
+			for(unsigned int c = 0; c < active; c++) out[c] = (Float32 *)bufferList->mBuffers[c].mData;
+			done = resample(out, count, pitch, pitch / tempo);
+
+			_heard += tempo * done;
+			if(looping) {
+				_heard = fmod(_heard, (double)sample->frames);
+			} else if(_heard >= sample->frames || done < frames) {
+				_heard = sample->frames;
+				_playing.store(false, std::memory_order_relaxed);
+			}
+			_position.store(_heard, std::memory_order_relaxed);
+		}
+	}
+
+	for(UInt32 b = 0; b < bufferList->mNumberBuffers; b++) {
+		Float32 * out = (Float32 *)bufferList->mBuffers[b].mData;
+		if(b < active) {
+			std::fill(out + done, out + frames, 0);
+		} else if(active > 0) {
+			memcpy(out, bufferList->mBuffers[b % active].mData, frames * sizeof(Float32));
+		} else {
+			std::fill(out, out + frames, 0);
+		}
+	}
+
+	if(rate > 0) {
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		const double load = seconds / (frames / rate);
+		_renderSeconds.store(_renderSeconds.load(std::memory_order_relaxed) + seconds, std::memory_order_relaxed);
+		_framesRendered.fetch_add(frames, std::memory_order_relaxed);
+		_cycles.fetch_add(1, std::memory_order_relaxed);
+		if(load > _peakLoad.load(std::memory_order_relaxed)) _peakLoad.store(load, std::memory_order_relaxed);
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::restart(double frame, double ratio)
+// ----------------------------------------------------------
+{
+	// start far enough back that the frames overlapping the first output
+	// sample are all in, and drop what comes out before it
+	const size_t preroll = _frameSize / _hop - 1;
+	_analysis = frame - preroll * (_hop / ratio);
+	_discard = preroll * _hop;
+	_first = true;
+
+	std::fill(_accumulator.begin(), _accumulator.end(), 0);
+	for(unsigned int c = 0; c < _active; c++) _fifo[c * _fifoCapacity] = 0;
+	_fifoFill = 1; // a frame of silence before the start, for the interpolator
+	_readPosition = 1;
+	_reset = false;
+}
+
+// ----------------------------------------------------------
+UInt32 ofxAudioUnitTimeStretch::resample(Float32 * const * out, UInt32 frames, double pitch, double ratio)
+// ----------------------------------------------------------
+{
+	UInt32 done = 0;
+	while(done < frames) {
+		// how many output samples the fifo has what's needed for (the
+		// interpolator reads one sample back and two ahead)
+		const double limit = (double)_fifoFill - 2;
+		UInt32 count = 0;
+		if(_readPosition < limit) {
+			count = std::min<double>(frames - done, ceil((limit - _readPosition) / pitch));
+			while(count > 0 && _readPosition + (count - 1) * pitch >= limit) count--;
+		}
+		if(count == 0) {
+			produce(ratio);
+			continue;
+		}
+
+		const bool aligned = pitch == 1 && _readPosition == floor(_readPosition);
+		for(unsigned int c = 0; c < _active; c++) {
+			const Float32 * in = &_fifo[c * _fifoCapacity];
+			Float32 * to = out[c] + done;
+			if(aligned) {
+				memcpy(to, in + (size_t)_readPosition, count * sizeof(Float32));
+				continue;
+			}
+			for(UInt32 i = 0; i < count; i++) {
+				const double position = _readPosition + i * pitch;
+				const size_t index = position;
+				to[i] = Hermite(in[index - 1], in[index], in[index + 1], in[index + 2], position - index);
+			}
+		}
+
+		_readPosition += count * pitch;
+		done += count;
+	}
+	return done;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::produce(double ratio)
+// ----------------------------------------------------------
+{
+	// let go of what the interpolator's done with, keeping the sample
+	// before where it's reading
+	const size_t drop = std::min<size_t>(_readPosition >= 1 ? (size_t)_readPosition - 1 : 0, _fifoFill);
+	if(drop > 0) {
+		for(unsigned int c = 0; c < _active; c++) {
+			Float32 * fifo = &_fifo[c * _fifoCapacity];
+			memmove(fifo, fifo + drop, (_fifoFill - drop) * sizeof(Float32));
+		}
+		_fifoFill -= drop;
+		_readPosition -= drop;
+	}
+
+	const double hop = _hop / ratio;
+	do {
+		if(_mode == OFXAU_STRETCH_WSOLA) {
+			wsolaFrame(hop);
+		} else {
+			vocoderFrame(hop);
+		}
+	} while(!emit());
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitTimeStretch::emit()
+// ----------------------------------------------------------
+{
+	// the first hop of the accumulator has had every frame it'll get
+	for(unsigned int c = 0; c < _active; c++) {
+		Float32 * accumulator = &_accumulator[c * _frameSize];
+		if(_discard == 0) memcpy(&_fifo[c * _fifoCapacity + _fifoFill], accumulator, _hop * sizeof(Float32));
+		memmove(accumulator, accumulator + _hop, (_frameSize - _hop) * sizeof(Float32));
+		std::fill(accumulator + _frameSize - _hop, accumulator + _frameSize, 0);
+	}
+
+	if(_discard > 0) {
+		_discard -= _hop;
+		return false;
+	}
+	_fifoFill += _hop;
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::readSample(unsigned int channel, SInt64 start, size_t frames, Float32 * out) const
+// ----------------------------------------------------------
+{
+	// silence before the start, and after the end unless looping
+	const ofxAudioUnitSampleData &sample = *_sample;
+	const Float32 * in = sample.channel(channel);
+	const SInt64 total = sample.frames;
+	const bool looping = _looping.load(std::memory_order_relaxed);
+
+	for(size_t done = 0; done < frames;) {
+		SInt64 at = start + (SInt64)done;
+		size_t count;
+		if(at < 0) {
+			count = std::min<UInt64>(frames - done, -at);
+			std::fill(out + done, out + done + count, 0);
+		} else if(at >= total && !looping) {
+			count = frames - done;
+			std::fill(out + done, out + frames, 0);
+		} else {
+			at %= total;
+			count = std::min<UInt64>(frames - done, total - at);
+			memcpy(out + done, in + at, count * sizeof(Float32));
+		}
+		done += count;
+	}
+}
+
+#pragma mark - WSOLA
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::wsolaFrame(double hop)
+// ----------------------------------------------------------
+{
+	const SInt64 nominal = llround(_analysis);
+	SInt64 start = nominal;
+
+	if(!_first && _search > 0) {
+		// the grain that best carries on from where the last one would have
+		// gone, within the search radius of where this one ought to start
+		const size_t overlap = _hop;
+		const size_t span = 2 * _search + overlap;
+		Float32 * target = &_target[0];
+		Float32 * mix = &_mix[0];
+		for(unsigned int c = 0; c < _active; c++) {
+			readSample(c, _previousStart + _hop, overlap, c == 0 ? target : &_frame[0]);
+			if(c > 0) Add(target, &_frame[0], overlap);
+		}
+		for(unsigned int c = 0; c < _active; c++) {
+			readSample(c, nominal - _search, span, c == 0 ? mix : &_frame[0]);
+			if(c > 0) Add(mix, &_frame[0], span);
+		}
+
+		const double floor = 1e-9 * overlap;
+		double energy = Dot(mix, mix, overlap);
+		double best = -INFINITY;
+		size_t bestAt = _search;
+
+		// where it ought to be wins a tie
+		for(size_t pass = 0; pass < 2; pass++) {
+			double running = energy;
+			for(size_t i = 0; i <= 2 * _search; i++) {
+				if(i > 0) running += (double)mix[i - 1 + overlap] * mix[i - 1 + overlap] - (double)mix[i - 1] * mix[i - 1];
+				if((pass == 0) != (i == _search)) continue;
+				const double score = Dot(target, mix + i, overlap) / sqrt(std::max(running, 0.) + floor);
+				if(score > best) {
+					best = score;
+					bestAt = i;
+				}
+			}
+		}
+		start = nominal + (SInt64)bestAt - (SInt64)_search;
+	}
+
+	for(unsigned int c = 0; c < _active; c++) {
+		readSample(c, start, _frameSize, &_frame[0]);
+		MultiplyAdd(&_accumulator[c * _frameSize], &_frame[0], &_synthesisWindow[0], _frameSize);
+	}
+
+	_previousStart = start;
+	_first = false;
+	_analysis += hop;
+}
+
+#pragma mark - Phase vocoder
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeStretch::vocoderFrame(double hop)
+// ----------------------------------------------------------
+{
+	const SInt64 start = llround(_analysis);
+	const double analysisHop = _first ? hop : std::max<double>(start - _previousStart, 1);
+
+	// per bin number: the phase a bin's centre frequency moves by over the
+	// analysis hop and the synthesis hop, wrapped, and the factor that turns
+	// a deviation from the first into one over the second
+	const Float4 expected = Splat(fmod(2 * M_PI * analysisHop / _frameSize, 2 * M_PI));
+	const Float4 step = Splat(fmod(2 * M_PI * _hop / _frameSize, 2 * M_PI));
+	const Float4 scale = Splat(_hop / analysisHop);
+
+	// vDSP's forward transform comes out at twice the DFT, and its inverse
+	// is unscaled, so a round trip scales by 2N; that comes off the
+	// magnitudes
+	const size_t half = _frameSize / 2;
+	const Float32 norm = 1.f / (2 * _frameSize);
+
+	Float32 * frame = &_frame[0];
+	Float32 * real = &_real[0];
+	Float32 * imag = &_imag[0];
+	Float32 * magnitude = &_magnitude[0];
+	Float32 * phase = &_phase[0];
+	Float32 * advance = &_advance[0];
+
+	for(unsigned int c = 0; c < _active; c++) {
+		readSample(c, start, _frameSize, frame);
+		Multiply(frame, frame, &_window[0], _frameSize);
+
+		// vDSP packs the Nyquist bin's real part in with DC's; it's unpacked
+		// here so every bin is where the loops below expect it
+		DSPSplitComplex spectrum = {real, imag};
+		vDSP_ctoz((const DSPComplex *)frame, 2, &spectrum, 1, half);
+		vDSP_fft_zrip(_fftSetup.get(), &spectrum, 1, _log2FrameSize, kFFTDirection_Forward);
+		real[half] = imag[0];
+		imag[half] = 0;
+		imag[0] = 0;
+
+		for(size_t k = 0; k < _paddedBins; k += 4) {
+			Store(phase + k, Atan2(Load(imag + k), Load(real + k)));
+		}
+		for(size_t k = 0; k < _bins; k++) {
+			magnitude[k] = sqrtf(real[k] * real[k] + imag[k] * imag[k]) * norm;
+		}
+
+		Float32 * previous = &_analysisPhase[c * _paddedBins];
+		Float32 * synthesis = &_synthesisPhase[c * _paddedBins];
+
+		if(_first) {
+			memcpy(synthesis, phase, _paddedBins * sizeof(Float32));
+		} else {
+			// each bin's frequency, from how far its phase moved, as a phase
+			// advance over the synthesis hop
+			for(size_t k = 0; k < _paddedBins; k += 4) {
+				const Float4 bin = Load(&_binNumbers[k]);
+				const Float4 deviation = Wrap(Load(phase + k) - Load(previous + k) - Wrap(bin * expected));
+				Store(advance + k, bin * step + deviation * scale);
+			}
+
+			// Identity phase locking: only the peaks move at their own
+			// frequency. The bins in a peak's region (out to the quietest
+			// bins either side) keep their phase relative to the peak's
+			size_t peaks = 0;
+			for(size_t k = 0; k < _bins; k++) {
+				const bool up = k == 0 || magnitude[k] > magnitude[k - 1];
+				const bool down = k + 1 == _bins || magnitude[k] >= magnitude[k + 1];
+				if(up && down) _peaks[peaks++] = k;
+			}
+
+			if(peaks == 0) {
+				for(size_t k = 0; k < _paddedBins; k += 4) {
+					Store(synthesis + k, Load(synthesis + k) + Load(advance + k));
+				}
+			} else {
+				size_t from = 0;
+				for(size_t p = 0; p < peaks; p++) {
+					const size_t peak = _peaks[p];
+					size_t to = _bins;
+					if(p + 1 < peaks) {
+						to = peak + 1;
+						for(size_t k = peak + 1; k < _peaks[p + 1]; k++) {
+							if(magnitude[k] < magnitude[to]) to = k;
+						}
+					}
+
+					const Float32 peakPhase = synthesis[peak] + advance[peak];
+					const Float32 peakAnalysis = phase[peak];
+					for(size_t k = from; k < to; k++) {
+						synthesis[k] = peakPhase + (phase[k] - peakAnalysis);
+					}
+					from = to;
+				}
+			}
+		}
+		memcpy(previous, phase, _paddedBins * sizeof(Float32));
+
+		for(size_t k = 0; k < _paddedBins; k += 4) {
+			const Float4 wrapped = Wrap(Load(synthesis + k));
+			Float4 sine, cosine;
+			SinCos(wrapped, sine, cosine);
+			Store(synthesis + k, wrapped);
+			Store(real + k, Load(magnitude + k) * cosine);
+			Store(imag + k, Load(magnitude + k) * sine);
+		}
+		imag[0] = real[half];
+
+		vDSP_fft_zrip(_fftSetup.get(), &spectrum, 1, _log2FrameSize, kFFTDirection_Inverse);
+		vDSP_ztoc(&spectrum, 1, (DSPComplex *)frame, 2, half);
+		MultiplyAdd(&_accumulator[c * _frameSize], frame, &_synthesisWindow[0], _frameSize);
+	}
+
+	_previousStart = start;
+	_first = false;
+	_analysis += hop;
+}
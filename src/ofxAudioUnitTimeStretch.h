@@ -0,0 +1,166 @@
+#pragma once
+
+#include "ofxAudioUnitFftCache.h"
+#include "ofxAudioUnitSampleCache.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+typedef enum {
+	OFXAU_STRETCH_WSOLA,         // for speech and other monophonic sources
+	OFXAU_STRETCH_PHASE_VOCODER  // for music
+}
+ofxAudioUnitStretchMode;
+
+// ofxAudioUnitTimeStretch plays a decoded sample (from
+// ofxAudioUnitSampleCache) with its tempo and pitch changed independently,
+// as one voice. It's the engine behind ofxAudioUnitStretchPlayer.
+
+// The sample is time stretched by pitch / tempo, then resampled (4 point
+// Hermite) by the pitch ratio, which puts the pitch back up or down and
+// leaves the duration changed by 1 / tempo. Stretching is done one of two
+// ways:
+
+// - WSOLA overlap-adds 20 ms grains (Hann windowed, half overlapped), each
+//   taken from within 6 ms of where the tempo says it should be, wherever it
+//   best continues the last one (the highest normalized cross-correlation,
+//   on a mix of the channels so they stay aligned). Cheap, and clean on
+//   speech, but it can double or drop beats in polyphonic music.
+// - The phase vocoder analyses 2048 point frames (at 44.1 or 48 kHz) at a
+//   quarter frame apart, advances every bin's phase at its measured
+//   frequency, and keeps the bins around each spectral peak locked to the
+//   peak's phase (Laroche and Dolson's identity phase locking), which keeps
+//   the phasiness down. Channels are processed separately.
+
+// The start of the sample isn't smeared or delayed: each voice pre-rolls the
+// frames overlapping its first output sample and drops what they produce
+// before it. The vocoder's FFTs are vDSP's, on setups shared with the other
+// nodes through ofxAudioUnitFftCache. The other inner loops (windowing,
+// correlation, and the trigonometry for phases) work on four floats at a
+// time with the compiler's vector extensions, which come out as SSE on Intel
+// and NEON on ARM.
+
+// setSample() and setMode() allocate, so they're for the main thread; the
+// rest can be called from anywhere. Tempo and pitch changes take effect on
+// the next render cycle. The render thread never blocks or allocates, and
+// times itself, so getStats() says what each voice costs.
+
+class ofxAudioUnitTimeStretch
+{
+public:
+	struct Stats {
+		UInt64 framesRendered;
+		double meanLoad;    // time spent rendering over the duration of what was rendered; 1 is a whole core
+		double peakLoad;    // the same, for the worst render cycle
+		double meanCycleUs;
+	};
+
+	explicit ofxAudioUnitTimeStretch(ofxAudioUnitStretchMode mode = OFXAU_STRETCH_PHASE_VOCODER);
+	~ofxAudioUnitTimeStretch();
+
+	void setSample(const ofxAudioUnitSampleRef &sample);
+	ofxAudioUnitSampleRef getSample() const;
+
+	void setMode(ofxAudioUnitStretchMode mode);
+	ofxAudioUnitStretchMode getMode() const;
+
+	// 0.5 plays at half speed; the pitch is a ratio, so 2 is an octave up.
+	// Both are clamped to [0.25, 4]
+	void setTempo(double tempo);
+	double getTempo() const {return _tempo.load(std::memory_order_relaxed);}
+	void setPitch(double ratio);
+	void setPitchSemitones(double semitones);
+	double getPitch() const {return _pitch.load(std::memory_order_relaxed);}
+
+	// plays from the current position, or from the top if it's at the end
+	void play();
+	void stop();
+	bool isPlaying() const {return _playing.load(std::memory_order_relaxed);}
+
+	void setLooping(bool looping) {_looping.store(looping, std::memory_order_relaxed);}
+	bool isLooping() const {return _looping.load(std::memory_order_relaxed);}
+
+	// in frames of the sample. Takes effect on the next render cycle
+	void setPosition(UInt64 frame);
+	UInt64 getPosition() const;
+
+	// Render thread: the sample's channel c % (sample channels) into buffer
+	// c, silence past the end (unless looping) or while stopped
+	void render(UInt32 frames, AudioBufferList * bufferList);
+
+	Stats getStats() const;
+
+private:
+	mutable std::mutex _mutex; // held by setSample() and setMode(); render() only tries it
+	ofxAudioUnitSampleRef _sample;
+	ofxAudioUnitStretchMode _mode;
+
+	std::atomic<double> _tempo;
+	std::atomic<double> _pitch;
+	std::atomic<bool> _playing;
+	std::atomic<bool> _looping;
+	std::atomic<SInt64> _seekTo; // -1 for none
+	std::atomic<UInt64> _position;
+
+	// sizes, set when the sample or mode changes
+	unsigned int _channels;
+	size_t _frameSize; // N
+	unsigned int _log2FrameSize;
+	size_t _hop;       // synthesis hop
+	size_t _search;    // WSOLA's search radius
+	size_t _bins;
+	size_t _paddedBins; // to a multiple of 4
+	size_t _fifoCapacity;
+
+	// render thread
+	unsigned int _active; // channels being rendered: as many as there are buffers for
+	bool _reset;
+	bool _first;
+	double _analysis;     // where the next frame is read from, in sample frames
+	SInt64 _previousStart; // where the last one was
+	double _heard;        // the sample frame being played
+	size_t _discard;      // pre-roll output still to drop
+	double _readPosition; // into the fifo, for the resampler
+	size_t _fifoFill;
+
+	std::vector<Float32> _window;
+	std::vector<Float32> _synthesisWindow;
+	std::vector<Float32> _accumulator; // overlap-add, N per channel
+	std::vector<Float32> _fifo;        // stretched audio waiting to be resampled, _fifoCapacity per channel
+	std::vector<Float32> _frame;
+
+	// WSOLA
+	std::vector<Float32> _target;
+	std::vector<Float32> _mix;
+
+	// phase vocoder
+	FFTSetupRef _fftSetup; // shared, from ofxAudioUnitFftCache
+	std::vector<Float32> _binNumbers;
+	std::vector<Float32> _real;
+	std::vector<Float32> _imag;
+	std::vector<Float32> _magnitude;
+	std::vector<Float32> _phase;
+	std::vector<Float32> _advance;
+	std::vector<Float32> _analysisPhase;  // the last frame's, per channel
+	std::vector<Float32> _synthesisPhase; // per channel
+	std::vector<UInt32> _peaks;
+
+	std::atomic<UInt64> _framesRendered;
+	std::atomic<double> _renderSeconds;
+	std::atomic<double> _peakLoad;
+	std::atomic<UInt64> _cycles;
+
+	ofxAudioUnitTimeStretch(const ofxAudioUnitTimeStretch &);
+	ofxAudioUnitTimeStretch& operator=(const ofxAudioUnitTimeStretch &);
+
+	void allocate();
+	void restart(double frame, double ratio);
+	UInt32 resample(Float32 * const * out, UInt32 frames, double pitch, double ratio);
+	void produce(double ratio);
+	void wsolaFrame(double hop);
+	void vocoderFrame(double hop);
+	bool emit();
+	void readSample(unsigned int channel, SInt64 start, size_t frames, Float32 * out) const;
+};
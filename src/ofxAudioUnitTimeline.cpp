@@ -0,0 +1,362 @@
+#include "ofxAudioUnitTimeline.h"
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+static const SInt64 kNoCycle = INT64_MIN;
+static const size_t kMaxPending = 256;     // events waiting for their cycle, per track
+static const UInt32 kMaxPartBuffers = 64; // channels a track can split a cycle for
+static const SInt64 kMaxOvertakenCycles = 2; // how far a track can fall behind before it's a clock reset
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeline::ofxAudioUnitTimeline()
+: _requestedRunning(false)
+, _locateVersion(0)
+, _locatePosition(0)
+, _latestCycle(kNoCycle)
+, _version(0)
+, _stateStart(kNoCycle)
+, _stateFrames(0)
+, _stateRunning(false)
+, _statePosition(0)
+, _stateLocated(0)
+// ----------------------------------------------------------
+{
+}
+
+#pragma mark - Transport
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeline::start()
+// ----------------------------------------------------------
+{
+	_requestedRunning.store(true, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeline::stop()
+// ----------------------------------------------------------
+{
+	_requestedRunning.store(false, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitTimeline::isRunning() const
+// ----------------------------------------------------------
+{
+	return _requestedRunning.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeline::setPosition(UInt64 position)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	const UInt64 version = _locateVersion.load(std::memory_order_relaxed);
+	_locateVersion.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	_locatePosition.store(position, std::memory_order_relaxed);
+	_locateVersion.store(version + 2, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitTimeline::getPosition() const
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	const State state = read();
+	if(state.located != _locateVersion.load(std::memory_order_relaxed)) return _locatePosition.load(std::memory_order_relaxed);
+	return state.running ? state.position + state.frames : state.position;
+}
+
+#pragma mark - Render thread
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeline::State ofxAudioUnitTimeline::read() const
+// ----------------------------------------------------------
+{
+	for(;;) {
+		const UInt64 version = _version.load(std::memory_order_acquire);
+		if(version & 1) continue;
+
+		State state;
+		state.start = _stateStart.load(std::memory_order_relaxed);
+		state.frames = _stateFrames.load(std::memory_order_relaxed);
+		state.running = _stateRunning.load(std::memory_order_relaxed);
+		state.position = _statePosition.load(std::memory_order_relaxed);
+		state.located = _stateLocated.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(_version.load(std::memory_order_relaxed) == version) return state;
+	}
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimeline::write(const State &state)
+// ----------------------------------------------------------
+{
+	const UInt64 version = _version.load(std::memory_order_relaxed);
+	_version.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	_stateStart.store(state.start, std::memory_order_relaxed);
+	_stateFrames.store(state.frames, std::memory_order_relaxed);
+	_stateRunning.store(state.running, std::memory_order_relaxed);
+	_statePosition.store(state.position, std::memory_order_relaxed);
+	_stateLocated.store(state.located, std::memory_order_relaxed);
+
+	_version.store(version + 2, std::memory_order_release);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeline::Cycle ofxAudioUnitTimeline::cycle(SInt64 sampleTime, UInt32 frames)
+// ----------------------------------------------------------
+{
+	for(;;) {
+		// The first track into a new cycle advances the transport for it. A
+		// cycle more than a couple of cycles behind the latest isn't a track
+		// running late but the output's clock starting over (it was stopped
+		// and started, or its device changed), so it's a new cycle too
+		SInt64 latest = _latestCycle.load(std::memory_order_acquire);
+		const bool restarted = latest != kNoCycle && sampleTime < latest - kMaxOvertakenCycles * (SInt64)frames;
+		if(sampleTime > latest || restarted) {
+			if(_latestCycle.compare_exchange_weak(latest, sampleTime, std::memory_order_acq_rel)) {
+				return advance(sampleTime, frames);
+			}
+			continue;
+		}
+
+		// the rest wait for it to have done so (which takes no time at all
+		// unless the tracks render on different threads)
+		const State state = read();
+		if(state.start == sampleTime) {
+			Cycle cycle = {state.running, state.position};
+			return cycle;
+		}
+		if(state.start > sampleTime && latest != sampleTime) {
+			// a cycle that's already been overtaken, counted back from the latest
+			const UInt64 back = state.running ? std::min<UInt64>(state.start - sampleTime, state.position) : 0;
+			Cycle cycle = {state.running, state.position - back};
+			return cycle;
+		}
+	}
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimeline::Cycle ofxAudioUnitTimeline::advance(SInt64 sampleTime, UInt32 frames)
+// ----------------------------------------------------------
+{
+	State state = read();
+	if(state.running && state.start != kNoCycle) {
+		// after the clock starts over, carry on from the end of the last cycle
+		state.position += sampleTime >= state.start ? sampleTime - state.start : state.frames;
+	}
+
+	state.running = _requestedRunning.load(std::memory_order_relaxed);
+
+	// a setPosition() that's half written is picked up next cycle
+	const UInt64 version = _locateVersion.load(std::memory_order_acquire);
+	if(version != state.located && !(version & 1)) {
+		const UInt64 position = _locatePosition.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(_locateVersion.load(std::memory_order_relaxed) == version) {
+			state.position = position;
+			state.located = version;
+		}
+	}
+
+	state.start = sampleTime;
+	state.frames = frames;
+	write(state);
+
+	Cycle cycle = {state.running, state.position};
+	return cycle;
+}
+
+#pragma mark - Tracks
+
+// ----------------------------------------------------------
+ofxAudioUnitTimelineTrack::ofxAudioUnitTimelineTrack(Target &target)
+: _target(target)
+, _events(256)
+, _clock(0)
+, _applied(0)
+, _lateEvents(0)
+, _maxLateness(0)
+, _droppedEvents(0)
+// ----------------------------------------------------------
+{
+	_pending.reserve(kMaxPending);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimelineTrack::setTimeline(const std::shared_ptr<ofxAudioUnitTimeline> &timeline)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_timelineMutex);
+	_timeline = timeline;
+}
+
+// ----------------------------------------------------------
+std::shared_ptr<ofxAudioUnitTimeline> ofxAudioUnitTimelineTrack::getTimeline() const
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_timelineMutex);
+	return _timeline;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitTimelineTrack::push(const Event &event)
+// ----------------------------------------------------------
+{
+	std::lock_guard<std::mutex> lock(_producerMutex);
+	if(_events.push(event)) return true;
+	_droppedEvents++;
+	return false;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitTimelineTrack::startAt(UInt64 time, UInt64 frame)
+// ----------------------------------------------------------
+{
+	_target.prepare(frame);
+	Event event = {EventStart, time, frame, false};
+	return push(event);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitTimelineTrack::stopAt(UInt64 time)
+// ----------------------------------------------------------
+{
+	Event event = {EventStop, time, 0, false};
+	return push(event);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitTimelineTrack::setLoopingAt(UInt64 time, bool looping)
+// ----------------------------------------------------------
+{
+	Event event = {EventLooping, time, 0, looping};
+	return push(event);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitTimelineTrack::clear()
+// ----------------------------------------------------------
+{
+	Event event = {EventClear, 0, 0, false};
+	return push(event);
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitTimelineTrack::Stats ofxAudioUnitTimelineTrack::getStats() const
+// ----------------------------------------------------------
+{
+	Stats stats;
+	stats.events = _applied;
+	stats.lateEvents = _lateEvents;
+	stats.maxLateness = _maxLateness;
+	stats.droppedEvents = _droppedEvents;
+	return stats;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimelineTrack::render(const AudioTimeStamp * timeStamp, UInt32 frames, AudioBufferList * bufferList)
+// ----------------------------------------------------------
+{
+	const SInt64 cycleStart = timeStamp && (timeStamp->mFlags & kAudioTimeStampSampleTimeValid) ? (SInt64)llround(timeStamp->mSampleTime) : _clock;
+	_clock = cycleStart + frames;
+
+	// if the timeline's being swapped, the target plays on its own this cycle
+	std::unique_lock<std::mutex> lock(_timelineMutex, std::try_to_lock);
+	if(!lock.owns_lock() || !_timeline) {
+		_target.render(frames, bufferList);
+		return;
+	}
+
+	// new events go in after any already pending for the same time, so ones
+	// on the same frame happen in the order they were sent
+	Event event;
+	while(_events.pop(event)) {
+		if(event.type == EventClear) {
+			_pending.clear();
+		} else if(_pending.size() < kMaxPending) {
+			std::vector<Event>::iterator at = _pending.end();
+			while(at != _pending.begin() && (at - 1)->time > event.time) --at;
+			_pending.insert(at, event);
+		} else {
+			_droppedEvents++;
+		}
+	}
+
+	const ofxAudioUnitTimeline::Cycle cycle = _timeline->cycle(cycleStart, frames);
+	if(!cycle.running) {
+		for(UInt32 b = 0; b < bufferList->mNumberBuffers; b++) {
+			memset(bufferList->mBuffers[b].mData, 0, bufferList->mBuffers[b].mDataByteSize);
+		}
+		return;
+	}
+
+	size_t due = 0;
+	UInt32 cursor = 0;
+	for(; due < _pending.size() && _pending[due].time < cycle.position + frames; due++) {
+		const Event &event = _pending[due];
+		UInt32 offset = 0;
+		if(event.time >= cycle.position) {
+			offset = event.time - cycle.position;
+		} else {
+			_lateEvents++;
+			const UInt64 lateness = cycle.position - event.time;
+			if(lateness > _maxLateness.load(std::memory_order_relaxed)) _maxLateness.store(lateness, std::memory_order_relaxed);
+		}
+
+		if(offset > cursor) {
+			renderPart(bufferList, cursor, offset, frames);
+			cursor = offset;
+		}
+		apply(event);
+	}
+	_pending.erase(_pending.begin(), _pending.begin() + due);
+
+	renderPart(bufferList, cursor, frames, frames);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimelineTrack::apply(const Event &event)
+// ----------------------------------------------------------
+{
+	if(event.type == EventStart) {
+		_target.start(event.frame);
+	} else if(event.type == EventStop) {
+		_target.stop();
+	} else if(event.type == EventLooping) {
+		_target.setLooping(event.looping);
+	}
+	_applied++;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitTimelineTrack::renderPart(AudioBufferList * bufferList, UInt32 from, UInt32 to, UInt32 frames)
+// ----------------------------------------------------------
+{
+	if(from == 0 && to == frames) {
+		_target.render(frames, bufferList);
+		return;
+	}
+
+	// the same buffers, starting `from` frames in. Past kMaxPartBuffers
+	// channels (which nothing has), the rest are left silent
+	AudioBuffer storage[kMaxPartBuffers + 1];
+	AudioBufferList * part = (AudioBufferList *)storage;
+	part->mNumberBuffers = std::min(bufferList->mNumberBuffers, kMaxPartBuffers);
+	for(UInt32 b = 0; b < part->mNumberBuffers; b++) {
+		part->mBuffers[b].mNumberChannels = bufferList->mBuffers[b].mNumberChannels;
+		part->mBuffers[b].mDataByteSize = (to - from) * sizeof(Float32);
+		part->mBuffers[b].mData = (Float32 *)bufferList->mBuffers[b].mData + from;
+	}
+	for(UInt32 b = part->mNumberBuffers; b < bufferList->mNumberBuffers; b++) {
+		memset((Float32 *)bufferList->mBuffers[b].mData + from, 0, (to - from) * sizeof(Float32));
+	}
+	_target.render(to - from, part);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "ofxAudioUnitEventQueue.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// ofxAudioUnitTimeline is a transport (a sample clock that can be started,
+// stopped and moved) shared by any number of players, so that they start,
+// stop and loop together to the sample rather than each scheduling itself
+// against the host clock.
+
+// Each player renders in a callback of its own, so rather than keeping one
+// queue of events for all of them, the timeline only keeps time; every
+// player has an ofxAudioUnitTimelineTrack holding its own queue of events,
+// at timeline sample times. Every render cycle, the first track to render
+// it advances the transport to the cycle's sample time (from its
+// AudioTimeStamp, which is the same for every player pulled in that cycle)
+// and the rest read where that put it, so they all agree without talking to
+// each other. If the output's sample times start over (it was stopped and
+// started, or its device changed), the transport carries on from where it
+// was.
+
+// start(), stop() and setPosition() are passed to the render thread without
+// locks, and take effect at the start of the next render cycle. While the
+// timeline is stopped its tracks are silent and their players stay where
+// they are.
+
+class ofxAudioUnitTimeline
+{
+public:
+	ofxAudioUnitTimeline();
+
+	void start();
+	void stop();
+	bool isRunning() const;
+
+	// in timeline samples, from 0
+	void setPosition(UInt64 position);
+
+	// where the next render cycle starts on the timeline
+	UInt64 getPosition() const;
+
+	// Render thread (tracks): whether the timeline's running for the cycle
+	// starting at sampleTime, and where it is at its first frame
+	struct Cycle {
+		bool running;
+		UInt64 position;
+	};
+	Cycle cycle(SInt64 sampleTime, UInt32 frames);
+
+private:
+	struct State {
+		SInt64 start; // sample time of the cycle it's for
+		UInt32 frames;
+		bool running;
+		UInt64 position;
+		UInt64 located; // the last setPosition() taken into account
+	};
+
+	// Main thread: only the latest request counts, so there's no queue to
+	// fill up. setPosition() writes under a sequence lock (odd while writing)
+	mutable std::mutex _producerMutex;
+	std::atomic<bool> _requestedRunning;
+	std::atomic<UInt64> _locateVersion;
+	std::atomic<UInt64> _locatePosition;
+
+	// The state for the latest cycle, behind a sequence lock too: written by
+	// that cycle's first track, read by the others and the main thread
+	std::atomic<SInt64> _latestCycle;
+	std::atomic<UInt64> _version;
+	std::atomic<SInt64> _stateStart;
+	std::atomic<UInt32> _stateFrames;
+	std::atomic<bool> _stateRunning;
+	std::atomic<UInt64> _statePosition;
+	std::atomic<UInt64> _stateLocated;
+
+	ofxAudioUnitTimeline(const ofxAudioUnitTimeline &);
+	ofxAudioUnitTimeline& operator=(const ofxAudioUnitTimeline &);
+
+	State read() const;
+	void write(const State &state);
+	Cycle advance(SInt64 sampleTime, UInt32 frames);
+};
+
+// ofxAudioUnitTimelineTrack schedules one player's starts, stops and loop
+// changes on a timeline. Events land on exactly the frame they're scheduled
+// for: the track renders the player up to the event, applies it, and renders
+// the rest of the cycle after it. An event that arrives too late for its
+// time (or that the timeline is moved past) happens at the top of the next
+// cycle the timeline's running in instead, and is counted.
+
+// The player is a Target, which the track calls from the render thread. With
+// no timeline set the track just renders it, so a player works as it did
+// before until it's given one.
+
+class ofxAudioUnitTimelineTrack
+{
+public:
+	class Target
+	{
+	public:
+		virtual ~Target() {}
+
+		// main thread, when a start is scheduled: a chance to get the audio
+		// at `frame` ready ahead of time
+		virtual void prepare(UInt64 /*frame*/) {}
+
+		// render thread, between calls to render()
+		virtual void start(UInt64 frame) = 0;
+		virtual void stop() = 0;
+		virtual void setLooping(bool looping) = 0;
+
+		// render thread: fills (non-interleaved float) buffers of `frames`
+		virtual void render(UInt32 frames, AudioBufferList * bufferList) = 0;
+	};
+
+	struct Stats {
+		UInt64 events;
+		UInt64 lateEvents;    // happened after the sample they were scheduled for
+		UInt64 maxLateness;   // in frames
+		UInt64 droppedEvents; // the queue (or the render thread's list of future events) was full
+	};
+
+	explicit ofxAudioUnitTimelineTrack(Target &target);
+
+	// Main thread. Changing timelines costs at most a cycle of the target
+	// playing on its own
+	void setTimeline(const std::shared_ptr<ofxAudioUnitTimeline> &timeline);
+	std::shared_ptr<ofxAudioUnitTimeline> getTimeline() const;
+
+	// At timeline sample `time`. False if the event couldn't be queued
+	bool startAt(UInt64 time, UInt64 frame = 0);
+	bool stopAt(UInt64 time);
+	bool setLoopingAt(UInt64 time, bool looping);
+
+	// drops every event scheduled so far that hasn't happened yet
+	bool clear();
+
+	// Render thread. Sample times come from the timestamp when it has them,
+	// and otherwise count up from 0
+	void render(const AudioTimeStamp * timeStamp, UInt32 frames, AudioBufferList * bufferList);
+
+	Stats getStats() const;
+
+private:
+	enum EventType {
+		EventStart,
+		EventStop,
+		EventLooping,
+		EventClear
+	};
+
+	struct Event {
+		EventType type;
+		UInt64 time;
+		UInt64 frame;
+		bool looping;
+	};
+
+	Target &_target;
+
+	mutable std::mutex _timelineMutex; // held by setTimeline(); render() only tries it
+	std::shared_ptr<ofxAudioUnitTimeline> _timeline;
+
+	std::mutex _producerMutex;
+	ofxAudioUnitEventQueue<Event> _events;
+
+	// render thread
+	SInt64 _clock;
+	std::vector<Event> _pending; // in time order
+
+	std::atomic<UInt64> _applied;
+	std::atomic<UInt64> _lateEvents;
+	std::atomic<UInt64> _maxLateness;
+	std::atomic<UInt64> _droppedEvents;
+
+	ofxAudioUnitTimelineTrack(const ofxAudioUnitTimelineTrack &);
+	ofxAudioUnitTimelineTrack& operator=(const ofxAudioUnitTimelineTrack &);
+
+	bool push(const Event &event);
+	void apply(const Event &event);
+	void renderPart(AudioBufferList * bufferList, UInt32 from, UInt32 to, UInt32 frames);
+};
@@ -0,0 +1,200 @@
+#include "ofxAudioUnitWavReader.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t kScratchBytes = 1 << 16;
+
+static const UInt16 kFormatPCM = 0x0001;
+static const UInt16 kFormatFloat = 0x0003;
+static const UInt16 kFormatExtensible = 0xFFFE;
+
+#pragma mark - Byte order
+
+static inline UInt16 Get16(const unsigned char * p) {return p[0] | p[1] << 8;}
+static inline UInt32 Get32(const unsigned char * p) {return Get16(p) | (UInt32)Get16(p + 2) << 16;}
+static inline UInt64 Get64(const unsigned char * p) {return Get32(p) | (UInt64)Get32(p + 4) << 32;}
+
+static bool ReadAll(int fd, void * bytes, size_t count, off_t offset)
+{
+	char * p = (char *)bytes;
+	while(count > 0) {
+		const ssize_t got = pread(fd, p, count, offset);
+		if(got < 0 && errno == EINTR) continue;
+		if(got <= 0) return false;
+		p += got;
+		count -= got;
+		offset += got;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitWavReader::ofxAudioUnitWavReader()
+: _fd(-1)
+// ----------------------------------------------------------
+{
+	memset(&_info, 0, sizeof(_info));
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitWavReader::~ofxAudioUnitWavReader()
+// ----------------------------------------------------------
+{
+	close();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavReader::open(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	close();
+
+	_fd = ::open(filePath.c_str(), O_RDONLY);
+	if(_fd < 0) {
+		std::cout << "Couldn't open audio file: " << filePath << " (" << strerror(errno) << ")" << std::endl;
+		return false;
+	}
+
+	if(!parse(_fd, filePath, _info)) {
+		close();
+		return false;
+	}
+
+	_filePath = filePath;
+	_planes.resize(_info.channels);
+	return true;
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWavReader::close()
+// ----------------------------------------------------------
+{
+	if(_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavReader::readInfo(const std::string &filePath, Info &info)
+// ----------------------------------------------------------
+{
+	const int fd = ::open(filePath.c_str(), O_RDONLY);
+	if(fd < 0) {
+		std::cout << "Couldn't open audio file: " << filePath << " (" << strerror(errno) << ")" << std::endl;
+		return false;
+	}
+	const bool ok = parse(fd, filePath, info);
+	::close(fd);
+	return ok;
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitWavReader::read(UInt64 startFrame, size_t frames, Float32 * const * channels)
+// ----------------------------------------------------------
+{
+	if(_fd < 0 || startFrame >= _info.frames) return 0;
+
+	const size_t frameBytes = ofxAudioUnitSampleConverter::bytesPerSample(_info.format) * _info.channels;
+	const size_t chunkFrames = std::max<size_t>(kScratchBytes / frameBytes, 1);
+	_scratch.resize(chunkFrames * frameBytes);
+
+	frames = std::min<UInt64>(frames, _info.frames - startFrame);
+	size_t done = 0;
+
+	while(done < frames) {
+		const size_t count = std::min(chunkFrames, frames - done);
+		if(!ReadAll(_fd, &_scratch[0], count * frameBytes, _info.dataOffset + (startFrame + done) * frameBytes)) {
+			std::cout << "Error reading " << _filePath << std::endl;
+			break;
+		}
+		for(unsigned int c = 0; c < _info.channels; c++) {
+			_planes[c] = channels[c] + done;
+		}
+		ofxAudioUnitSampleConverter::deinterleave(&_scratch[0], _info.format, _info.channels, count, &_planes[0]);
+		done += count;
+	}
+
+	return done;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavReader::parse(int fd, const std::string &filePath, Info &info)
+// ----------------------------------------------------------
+{
+	struct stat st;
+	unsigned char riff[12];
+	if(fstat(fd, &st) != 0 || !ReadAll(fd, riff, sizeof(riff), 0) || memcmp(riff + 8, "WAVE", 4) != 0 ||
+	   (memcmp(riff, "RIFF", 4) != 0 && memcmp(riff, "RF64", 4) != 0)) {
+		std::cout << filePath << " isn't a WAV file" << std::endl;
+		return false;
+	}
+
+	const bool rf64 = memcmp(riff, "RF64", 4) == 0;
+	const UInt64 fileBytes = st.st_size;
+	UInt64 dataBytes64 = 0;
+	UInt16 formatTag = 0;
+	unsigned int channels = 0;
+	unsigned int bits = 0;
+	Float64 sampleRate = 0;
+	bool haveFormat = false;
+
+	UInt64 offset = sizeof(riff);
+	unsigned char chunk[40];
+
+	while(offset + 8 <= fileBytes) {
+		if(!ReadAll(fd, chunk, 8, offset)) break;
+		const UInt64 size = Get32(chunk + 4);
+		const UInt64 body = offset + 8;
+
+		if(memcmp(chunk, "ds64", 4) == 0 && size >= 24 && ReadAll(fd, chunk, 24, body)) {
+			dataBytes64 = Get64(chunk + 8);
+		} else if(memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+			const size_t fmtBytes = std::min<UInt64>(size, sizeof(chunk));
+			if(!ReadAll(fd, chunk, fmtBytes, body)) break;
+			formatTag = Get16(chunk);
+			channels = Get16(chunk + 2);
+			sampleRate = Get32(chunk + 4);
+			bits = Get16(chunk + 14);
+			if(formatTag == kFormatExtensible && fmtBytes >= 26) {
+				formatTag = Get16(chunk + 24); // the first two bytes of the subformat GUID
+			}
+			haveFormat = true;
+		} else if(memcmp(chunk, "data", 4) == 0) {
+			if(!haveFormat) break;
+
+			UInt64 bytes = rf64 && size == 0xFFFFFFFF ? dataBytes64 : size;
+			if(bytes == 0 || body + bytes > fileBytes) {
+				bytes = fileBytes - body; // never finished, or cut short
+			}
+
+			if(formatTag == kFormatPCM && bits == 16)        info.format = OFXAU_SAMPLE_INT16;
+			else if(formatTag == kFormatPCM && bits == 24)   info.format = OFXAU_SAMPLE_INT24;
+			else if(formatTag == kFormatPCM && bits == 32)   info.format = OFXAU_SAMPLE_INT32;
+			else if(formatTag == kFormatFloat && bits == 32) info.format = OFXAU_SAMPLE_FLOAT32;
+			else if(formatTag == kFormatFloat && bits == 64) info.format = OFXAU_SAMPLE_FLOAT64;
+			else {
+				std::cout << "Can't read " << bits << " bit samples (format " << formatTag << ") from " << filePath << std::endl;
+				return false;
+			}
+
+			if(channels == 0 || sampleRate <= 0) break;
+
+			info.channels = channels;
+			info.sampleRate = sampleRate;
+			info.frames = bytes / (ofxAudioUnitSampleConverter::bytesPerSample(info.format) * channels);
+			info.dataOffset = body;
+			return true;
+		}
+
+		offset = body + size + (size & 1); // chunks are padded to an even length
+	}
+
+	std::cout << "Couldn't find the audio in " << filePath << std::endl;
+	return false;
+}
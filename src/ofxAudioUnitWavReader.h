@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ofxAudioUnitSampleConverter.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <string>
+#include <vector>
+
+// ofxAudioUnitWavReader reads WAV and RF64 files (as ofxAudioUnitWavWriter
+// writes them, and most others) without going through Core Audio: 16, 24 and
+// 32 bit integer or 32 and 64 bit float samples, plain or
+// WAVE_FORMAT_EXTENSIBLE. Samples come out as floats, one buffer per channel.
+
+// A file whose header never got its final sizes (a recording that didn't
+// get as far as close()) is read to the end of the file.
+
+// Not thread safe; each thread reading a file should have its own reader.
+
+class ofxAudioUnitWavReader
+{
+public:
+	struct Info {
+		unsigned int channels;
+		Float64 sampleRate;
+		ofxAudioUnitSampleFormat format;
+		UInt64 frames;
+		UInt64 dataOffset; // where the first frame starts in the file
+	};
+
+	ofxAudioUnitWavReader();
+	~ofxAudioUnitWavReader();
+
+	bool open(const std::string &filePath);
+	void close();
+
+	bool isOpen() const {return _fd >= 0;}
+	const std::string& getFilePath() const {return _filePath;}
+	const Info& getInfo() const {return _info;}
+
+	// Frames [startFrame, startFrame + frames) into one buffer per channel.
+	// Returns how many were read, which is short at the end of the file or
+	// if the read fails
+	size_t read(UInt64 startFrame, size_t frames, Float32 * const * channels);
+
+	// just the header, for callers that want to get at the data themselves
+	static bool readInfo(const std::string &filePath, Info &info);
+
+private:
+	int _fd;
+	std::string _filePath;
+	Info _info;
+	std::vector<unsigned char> _scratch;
+	std::vector<Float32 *> _planes;
+
+	ofxAudioUnitWavReader(const ofxAudioUnitWavReader &);
+	ofxAudioUnitWavReader& operator=(const ofxAudioUnitWavReader &);
+
+	static bool parse(int fd, const std::string &filePath, Info &info);
+};
@@ -0,0 +1,296 @@
+#include "ofxAudioUnitWavWriter.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const size_t kPageSize = 4096;
+static const size_t kHeaderBytes = kPageSize;
+static const size_t kBufferBytes = 1 << 20;
+static const unsigned int kMaxChannels = 1024;
+
+static const UInt16 kFormatPCM = 0x0001;
+static const UInt16 kFormatFloat = 0x0003;
+static const UInt16 kFormatExtensible = 0xFFFE;
+
+#pragma mark - Byte order
+
+// WAV is little endian whatever the host is
+static inline void Put16(unsigned char * p, UInt16 v) {p[0] = v; p[1] = v >> 8;}
+static inline void Put24(unsigned char * p, UInt32 v) {p[0] = v; p[1] = v >> 8; p[2] = v >> 16;}
+static inline void Put32(unsigned char * p, UInt32 v) {Put16(p, v); Put16(p + 2, v >> 16);}
+static inline void Put64(unsigned char * p, UInt64 v) {Put32(p, v); Put32(p + 4, v >> 32);}
+static inline void PutTag(unsigned char * p, const char * tag) {memcpy(p, tag, 4);}
+
+static ofxAudioUnitSampleFormat SampleFormat(ofxAudioUnitWavFormat format)
+{
+	switch(format) {
+		case OFXAU_WAV_INT16:   return OFXAU_SAMPLE_INT16;
+		case OFXAU_WAV_INT24:   return OFXAU_SAMPLE_INT24;
+		case OFXAU_WAV_INT32:   return OFXAU_SAMPLE_INT32;
+		case OFXAU_WAV_FLOAT32: return OFXAU_SAMPLE_FLOAT32;
+	}
+	return OFXAU_SAMPLE_FLOAT32;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitWavWriter::ofxAudioUnitWavWriter()
+: _fd(-1)
+, _channels(0)
+, _sampleRate(0)
+, _format(OFXAU_WAV_INT24)
+, _frames(0)
+, _dataBytes(0)
+, _failed(false)
+, _buffer(NULL)
+, _bufferUsed(0)
+// ----------------------------------------------------------
+{
+
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitWavWriter::~ofxAudioUnitWavWriter()
+// ----------------------------------------------------------
+{
+	close();
+	free(_buffer);
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWavWriter::setDither(ofxAudioUnitDither dither)
+// ----------------------------------------------------------
+{
+	_converter.setDither(dither);
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitWavWriter::bytesPerSample(ofxAudioUnitWavFormat format)
+// ----------------------------------------------------------
+{
+	switch(format) {
+		case OFXAU_WAV_INT16:   return 2;
+		case OFXAU_WAV_INT24:   return 3;
+		case OFXAU_WAV_INT32:   return 4;
+		case OFXAU_WAV_FLOAT32: return 4;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavWriter::open(const std::string &filePath, unsigned int channels, Float64 sampleRate, ofxAudioUnitWavFormat format)
+// ----------------------------------------------------------
+{
+	close();
+
+	if(channels == 0 || channels > kMaxChannels || sampleRate <= 0 || bytesPerSample(format) == 0) {
+		std::cout << "Can't write a WAV file with " << channels << " channels at " << sampleRate << " Hz" << std::endl;
+		return false;
+	}
+
+	if(!_buffer && posix_memalign((void **)&_buffer, kPageSize, kBufferBytes) != 0) {
+		_buffer = NULL;
+		std::cout << "Couldn't allocate a write buffer for " << filePath << std::endl;
+		return false;
+	}
+
+	_fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(_fd < 0) {
+		std::cout << "Couldn't create audio file: " << filePath << " (" << strerror(errno) << ")" << std::endl;
+		return false;
+	}
+
+	_filePath = filePath;
+	_channels = channels;
+	_sampleRate = sampleRate;
+	_format = format;
+	_frames = 0;
+	_dataBytes = 0;
+	_bufferUsed = 0;
+	_failed = false;
+	_planes.resize(channels);
+	_converter.reset();
+
+	// a placeholder until close() knows the sizes, so the file is readable
+	// (minus its length) even if we never get that far
+	if(!writeHeader()) {
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavWriter::write(const Float32 * const * channels, size_t frames)
+// ----------------------------------------------------------
+{
+	if(_fd < 0 || _failed) return false;
+
+	const size_t frameBytes = bytesPerSample(_format) * _channels;
+	size_t done = 0;
+
+	while(done < frames) {
+		size_t fit = (kBufferBytes - _bufferUsed) / frameBytes;
+		if(fit == 0) {
+			if(!flush(false)) return false;
+			fit = (kBufferBytes - _bufferUsed) / frameBytes;
+		}
+
+		const size_t count = std::min(fit, frames - done);
+		for(unsigned int c = 0; c < _channels; c++) {
+			_planes[c] = channels[c] + done;
+		}
+		_converter.interleave(&_planes[0], _channels, count, _buffer + _bufferUsed, SampleFormat(_format));
+		_bufferUsed += count * frameBytes;
+		_dataBytes += count * frameBytes;
+		_frames += count;
+		done += count;
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavWriter::close()
+// ----------------------------------------------------------
+{
+	if(_fd < 0) return false;
+
+	bool ok = flush(true);
+
+	// chunks are padded to an even length
+	if(ok && (_dataBytes & 1)) {
+		const unsigned char pad = 0;
+		ok = writeAll(&pad, 1, kHeaderBytes + _dataBytes);
+	}
+
+	ok = ok && writeHeader();
+
+	if(::close(_fd) != 0) {
+		std::cout << "Error closing " << _filePath << ": " << strerror(errno) << std::endl;
+		ok = false;
+	}
+	_fd = -1;
+
+	return ok && !_failed;
+}
+
+#pragma mark - File
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavWriter::writeHeader()
+// ----------------------------------------------------------
+{
+	const unsigned int sampleBytes = bytesPerSample(_format);
+	const bool isFloat = _format == OFXAU_WAV_FLOAT32;
+
+	// the plain 16 byte fmt chunk only covers 16 bit stereo or mono PCM
+	// unambiguously, everything else gets WAVE_FORMAT_EXTENSIBLE
+	const bool extensible = _channels > 2 || sampleBytes > 2 || isFloat;
+	const UInt32 fmtBytes = extensible ? 40 : 16;
+	const UInt32 factBytes = isFloat ? 12 : 0;
+	const UInt32 junkBytes = kHeaderBytes - 12 - 8 - (8 + fmtBytes) - factBytes - 8;
+
+	const UInt64 pad = _dataBytes & 1;
+	const UInt64 riffBytes = kHeaderBytes - 8 + _dataBytes + pad;
+	const bool rf64 = riffBytes > 0xFFFFFFFFull;
+
+	unsigned char header[kHeaderBytes];
+	memset(header, 0, sizeof(header));
+	unsigned char * p = header;
+
+	PutTag(p, rf64 ? "RF64" : "RIFF");
+	Put32(p + 4, rf64 ? 0xFFFFFFFF : (UInt32)riffBytes);
+	PutTag(p + 8, "WAVE");
+	p += 12;
+
+	// Reserved space for a ds64 chunk, which has to come first. Readers that
+	// don't know RF64 skip it as JUNK, and the rest of it pads the header out
+	// to a page
+	PutTag(p, rf64 ? "ds64" : "JUNK");
+	Put32(p + 4, junkBytes);
+	if(rf64) {
+		Put64(p + 8, riffBytes);
+		Put64(p + 16, _dataBytes);
+		Put64(p + 24, _frames);
+		Put32(p + 32, 0); // no table entries
+	}
+	p += 8 + junkBytes;
+
+	PutTag(p, "fmt ");
+	Put32(p + 4, fmtBytes);
+	Put16(p + 8, extensible ? kFormatExtensible : kFormatPCM);
+	Put16(p + 10, _channels);
+	Put32(p + 12, (UInt32)lrint(_sampleRate));
+	Put32(p + 16, (UInt32)lrint(_sampleRate) * _channels * sampleBytes);
+	Put16(p + 20, _channels * sampleBytes);
+	Put16(p + 22, sampleBytes * 8);
+	if(extensible) {
+		Put16(p + 24, 22);
+		Put16(p + 26, sampleBytes * 8);
+		Put32(p + 28, _channels == 1 ? 0x4 : _channels == 2 ? 0x3 : 0); // front centre, front left + right, or unassigned
+
+		// KSDATAFORMAT_SUBTYPE_PCM / _IEEE_FLOAT
+		static const unsigned char guidTail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+		Put16(p + 32, isFloat ? kFormatFloat : kFormatPCM);
+		memcpy(p + 34, guidTail, sizeof(guidTail));
+	}
+	p += 8 + fmtBytes;
+
+	if(factBytes) {
+		PutTag(p, "fact");
+		Put32(p + 4, 4);
+		Put32(p + 8, rf64 || _frames > 0xFFFFFFFFull ? 0xFFFFFFFF : (UInt32)_frames);
+		p += factBytes;
+	}
+
+	PutTag(p, "data");
+	Put32(p + 4, rf64 ? 0xFFFFFFFF : (UInt32)_dataBytes);
+
+	return writeAll(header, sizeof(header), 0);
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavWriter::flush(bool everything)
+// ----------------------------------------------------------
+{
+	if(_failed) return false;
+
+	// Only whole pages go out until the end, so every write lands on a page
+	// boundary. What's left over is less than a page
+	const size_t bytes = everything ? _bufferUsed : _bufferUsed / kPageSize * kPageSize;
+	if(bytes == 0) return true;
+
+	const UInt64 flushed = _dataBytes - _bufferUsed;
+	if(!writeAll(_buffer, bytes, kHeaderBytes + flushed)) return false;
+
+	memmove(_buffer, _buffer + bytes, _bufferUsed - bytes);
+	_bufferUsed -= bytes;
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWavWriter::writeAll(const void * bytes, size_t count, off_t offset)
+// ----------------------------------------------------------
+{
+	const char * p = (const char *)bytes;
+	while(count > 0) {
+		const ssize_t written = pwrite(_fd, p, count, offset);
+		if(written < 0) {
+			if(errno == EINTR) continue;
+			std::cout << "Error writing " << _filePath << ": " << strerror(errno) << std::endl;
+			_failed = true;
+			return false;
+		}
+		p += written;
+		count -= written;
+		offset += written;
+	}
+	return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "ofxAudioUnitSampleConverter.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+typedef enum {
+	OFXAU_WAV_INT16,
+	OFXAU_WAV_INT24,
+	OFXAU_WAV_INT32,
+	OFXAU_WAV_FLOAT32
+}
+ofxAudioUnitWavFormat;
+
+// ofxAudioUnitWavWriter writes WAV files without going through Core Audio,
+// so it can be driven from any thread and builds on any platform.
+
+// The header is padded out to 4 KB with a JUNK chunk, so the audio data
+// starts on a page boundary and every write except the last one is a whole
+// number of pages. If the file ends up bigger than a plain WAV file can
+// describe (4 GB), close() turns it into an RF64 file by rewriting the JUNK
+// chunk as a ds64 chunk holding the 64 bit sizes (EBU Tech 3306).
+
+// Not thread safe; open(), write() and close() should all be called from the
+// same thread (typically a recorder's writer thread).
+
+class ofxAudioUnitWavWriter
+{
+public:
+	ofxAudioUnitWavWriter();
+	~ofxAudioUnitWavWriter();
+
+	bool open(const std::string &filePath, unsigned int channels, Float64 sampleRate, ofxAudioUnitWavFormat format);
+
+	// converts and appends frames from one buffer per channel
+	bool write(const Float32 * const * channels, size_t frames);
+
+	// flushes whatever's buffered and fills in the header
+	bool close();
+
+	// for 16 and 24 bit files. Off by default; stays set across files
+	void setDither(ofxAudioUnitDither dither);
+	ofxAudioUnitDither getDither() const {return _converter.getDither();}
+
+	bool isOpen() const {return _fd >= 0;}
+	const std::string& getFilePath() const {return _filePath;}
+	unsigned int getNumChannels() const {return _channels;}
+	ofxAudioUnitWavFormat getFormat() const {return _format;}
+	UInt64 getFramesWritten() const {return _frames;}
+	UInt64 getBytesWritten() const {return _dataBytes;}
+
+	static unsigned int bytesPerSample(ofxAudioUnitWavFormat format);
+
+private:
+	int _fd;
+	std::string _filePath;
+	unsigned int _channels;
+	Float64 _sampleRate;
+	ofxAudioUnitWavFormat _format;
+	UInt64 _frames;
+	UInt64 _dataBytes;
+	bool _failed;
+
+	unsigned char * _buffer; // page aligned
+	size_t _bufferUsed;
+
+	ofxAudioUnitSampleConverter _converter;
+	std::vector<const Float32 *> _planes; // where write() has got to in each channel
+
+	ofxAudioUnitWavWriter(const ofxAudioUnitWavWriter &);
+	ofxAudioUnitWavWriter& operator=(const ofxAudioUnitWavWriter &);
+
+	bool writeHeader();
+	bool flush(bool everything);
+	bool writeAll(const void * bytes, size_t count, off_t offset);
+};
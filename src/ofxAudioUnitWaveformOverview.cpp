@@ -0,0 +1,609 @@
+#include "ofxAudioUnitWaveformOverview.h"
+#include "ofxAudioUnitWavReader.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const unsigned int kMaxLevels = 20;
+static const unsigned int kMaxChannels = 1024;
+static const size_t kReadFrames = 64 * ofxAudioUnitWaveformOverview::kBaseFrames;
+
+#pragma mark - Sidecar format
+
+// followed by each level's bins, finest first, channel after channel
+struct SidecarHeader {
+	char magic[8];
+	UInt32 version;
+	UInt32 byteOrder;  // kByteOrder as the writer saw it; a file from a machine of the other order is ignored
+	UInt64 fileSize;   // of the audio file, and its modification time in
+	SInt64 modified;   // nanoseconds, when the overview was made
+	Float64 sampleRate;
+	UInt64 frames;
+	UInt32 channels;
+	UInt32 baseFrames;
+	UInt32 levelFactor;
+	UInt32 levels;
+};
+
+static_assert(sizeof(SidecarHeader) == 64, "the sidecar header has no padding");
+
+static const char kMagic[8] = {'o', 'f', 'x', 'A', 'U', 'p', 'k', 's'};
+static const UInt32 kVersion = 1;
+static const UInt32 kByteOrder = 0x01020304;
+
+static bool FileStamp(const std::string &path, UInt64 &size, SInt64 &modified)
+{
+	struct stat st;
+	if(stat(path.c_str(), &st) != 0) return false;
+	size = st.st_size;
+#if defined(__APPLE__)
+	modified = (SInt64)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	modified = (SInt64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+static UInt64 FramesPerBin(unsigned int level)
+{
+	UInt64 frames = ofxAudioUnitWaveformOverview::kBaseFrames;
+	for(unsigned int l = 0; l < level; l++) frames *= ofxAudioUnitWaveformOverview::kLevelFactor;
+	return frames;
+}
+
+static UInt64 BinCount(UInt64 frames, unsigned int level)
+{
+	const UInt64 framesPerBin = FramesPerBin(level);
+	return (frames + framesPerBin - 1) / framesPerBin;
+}
+
+// levels get coarser until the next would have a single bin
+static unsigned int LevelCount(UInt64 frames)
+{
+	unsigned int levels = 1;
+	while(levels < kMaxLevels && BinCount(frames, levels - 1) > ofxAudioUnitWaveformOverview::kLevelFactor) levels++;
+	return levels;
+}
+
+#pragma mark - Vectors
+
+// gcc and clang lower these to SSE2 on Intel and NEON on ARM
+typedef float Float4 __attribute__((vector_size(16)));
+typedef int   Int4   __attribute__((vector_size(16)));
+
+static inline Float4 Load(const Float32 * p) {Float4 v; memcpy(&v, p, sizeof(v)); return v;}
+static inline Float4 Select(Int4 mask, Float4 a, Float4 b) {return (Float4)(((Int4)a & mask) | ((Int4)b & ~mask));}
+
+#pragma mark - Accumulating bins
+
+namespace {
+
+	struct Accumulator {
+		float min;
+		float max;
+		double squares;
+		UInt64 frames;
+
+		Accumulator() {reset();}
+		void reset() {min = INFINITY; max = -INFINITY; squares = 0; frames = 0;}
+
+		void add(const Float32 * in, size_t n)
+		{
+			size_t i = 0;
+			if(n >= 4) {
+				Float4 lo = Load(in);
+				Float4 hi = lo;
+				Float4 squares4 = lo * lo;
+				for(i = 4; i + 4 <= n; i += 4) {
+					const Float4 x = Load(in + i);
+					lo = Select(x < lo, x, lo);
+					hi = Select(x > hi, x, hi);
+					squares4 += x * x;
+				}
+				for(int k = 0; k < 4; k++) {
+					min = std::min(min, lo[k]);
+					max = std::max(max, hi[k]);
+				}
+				squares += squares4[0] + squares4[1] + squares4[2] + squares4[3];
+			}
+			for(; i < n; i++) {
+				min = std::min(min, in[i]);
+				max = std::max(max, in[i]);
+				squares += in[i] * in[i];
+			}
+			frames += n;
+		}
+
+		void add(const Accumulator &finer)
+		{
+			min = std::min(min, finer.min);
+			max = std::max(max, finer.max);
+			squares += finer.squares;
+			frames += finer.frames;
+		}
+	};
+
+#if defined(__APPLE__)
+
+	// anything Core Audio can read, a block at a time as floats, one buffer
+	// per channel
+	class Source
+	{
+	public:
+		Source() : _file(NULL) {}
+		~Source() {if(_file) ExtAudioFileDispose(_file);}
+
+		bool open(const std::string &filePath, unsigned int &channels, Float64 &sampleRate, UInt64 &frames)
+		{
+			CFURLRef fileURL = CFURLCreateFromFileSystemRepresentation(NULL,
+																	   (const UInt8*)filePath.c_str(),
+																	   filePath.length(),
+																	   false);
+			OSStatus s = ExtAudioFileOpenURL(fileURL, &_file);
+			CFRelease(fileURL);
+			if(s != noErr) {
+				_file = NULL;
+				return false;
+			}
+
+			AudioStreamBasicDescription fileFormat = {0};
+			SInt64 fileFrames = 0;
+			UInt32 size = sizeof(fileFormat);
+			s = ExtAudioFileGetProperty(_file, kExtAudioFileProperty_FileDataFormat, &size, &fileFormat);
+			size = sizeof(fileFrames);
+			if(s == noErr) s = ExtAudioFileGetProperty(_file, kExtAudioFileProperty_FileLengthFrames, &size, &fileFrames);
+
+			AudioStreamBasicDescription clientFormat = {0};
+			clientFormat.mSampleRate       = fileFormat.mSampleRate;
+			clientFormat.mFormatID         = kAudioFormatLinearPCM;
+			clientFormat.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+			clientFormat.mBytesPerPacket   = sizeof(Float32);
+			clientFormat.mFramesPerPacket  = 1;
+			clientFormat.mBytesPerFrame    = sizeof(Float32);
+			clientFormat.mChannelsPerFrame = fileFormat.mChannelsPerFrame;
+			clientFormat.mBitsPerChannel   = 32;
+			if(s == noErr) s = ExtAudioFileSetProperty(_file, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat);
+			if(s != noErr || fileFormat.mChannelsPerFrame == 0) return false;
+
+			channels = fileFormat.mChannelsPerFrame;
+			sampleRate = fileFormat.mSampleRate;
+			frames = fileFrames;
+			_listStorage.resize(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channels);
+			return true;
+		}
+
+		size_t read(Float32 * const * planes, size_t frames)
+		{
+			AudioBufferList * list = (AudioBufferList *)&_listStorage[0];
+			const unsigned int channels = (_listStorage.size() - offsetof(AudioBufferList, mBuffers)) / sizeof(AudioBuffer);
+			list->mNumberBuffers = channels;
+			for(unsigned int c = 0; c < channels; c++) {
+				list->mBuffers[c].mNumberChannels = 1;
+				list->mBuffers[c].mDataByteSize = frames * sizeof(Float32);
+				list->mBuffers[c].mData = planes[c];
+			}
+			UInt32 count = frames;
+			return ExtAudioFileRead(_file, &count, list) == noErr ? count : 0;
+		}
+
+	private:
+		ExtAudioFileRef _file;
+		std::vector<char> _listStorage;
+	};
+
+#else
+
+	// WAV and RF64, a block at a time as floats, one buffer per channel
+	class Source
+	{
+	public:
+		Source() : _position(0) {}
+
+		bool open(const std::string &filePath, unsigned int &channels, Float64 &sampleRate, UInt64 &frames)
+		{
+			if(!_reader.open(filePath)) return false;
+			channels = _reader.getInfo().channels;
+			sampleRate = _reader.getInfo().sampleRate;
+			frames = _reader.getInfo().frames;
+			return channels > 0;
+		}
+
+		size_t read(Float32 * const * planes, size_t frames)
+		{
+			const size_t count = _reader.read(_position, frames, planes);
+			_position += count;
+			return count;
+		}
+
+	private:
+		ofxAudioUnitWavReader _reader;
+		UInt64 _position;
+	};
+
+#endif
+
+}
+
+// to a bin's 16 bit values, rounded outwards so the drawn envelope never
+// comes up short of a peak
+static void Quantize(const Accumulator &accumulator, SInt16 &min, SInt16 &max, UInt16 &rms)
+{
+	min = std::max(floor(accumulator.min * 32767.), -32767.);
+	max = std::min(ceil(accumulator.max * 32767.), 32767.);
+	rms = std::min(sqrt(accumulator.squares / accumulator.frames), 1.) * 65535 + 0.5;
+}
+
+static ofxAudioUnitWaveformOverview::Peak MakePeak(SInt16 min, SInt16 max, UInt16 rms)
+{
+	ofxAudioUnitWaveformOverview::Peak peak = {min / 32767.f, max / 32767.f, rms / 65535.f};
+	return peak;
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitWaveformOverview::ofxAudioUnitWaveformOverview()
+: _state(StateEmpty)
+, _cancel(false)
+, _scanned(0)
+, _expected(0)
+, _cached(false)
+, _channels(0)
+, _sampleRate(0)
+, _frames(0)
+// ----------------------------------------------------------
+{
+}
+
+// ----------------------------------------------------------
+ofxAudioUnitWaveformOverview::~ofxAudioUnitWaveformOverview()
+// ----------------------------------------------------------
+{
+	clear();
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::load(const std::string &filePath, const std::string &cacheDirectory)
+// ----------------------------------------------------------
+{
+	clear();
+	_filePath = filePath;
+	_state.store(StateLoading, std::memory_order_release);
+	_thread = std::thread(&ofxAudioUnitWaveformOverview::run, this, filePath, getSidecarPath(filePath, cacheDirectory));
+}
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::clear()
+// ----------------------------------------------------------
+{
+	_cancel.store(true);
+	if(_thread.joinable()) _thread.join();
+	_cancel.store(false);
+
+	_state.store(StateEmpty, std::memory_order_release);
+	_filePath.clear();
+	_scanned.store(0);
+	_expected.store(0);
+	_cached.store(false);
+	_channels = 0;
+	_sampleRate = 0;
+	_frames = 0;
+	_levels.clear();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::wait()
+// ----------------------------------------------------------
+{
+	if(_thread.joinable()) _thread.join();
+	return isReady();
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::isReady() const
+// ----------------------------------------------------------
+{
+	return _state.load(std::memory_order_acquire) == StateReady;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::hasFailed() const
+// ----------------------------------------------------------
+{
+	return _state.load(std::memory_order_acquire) == StateFailed;
+}
+
+// ----------------------------------------------------------
+float ofxAudioUnitWaveformOverview::getProgress() const
+// ----------------------------------------------------------
+{
+	if(isReady()) return 1;
+	const UInt64 expected = _expected.load(std::memory_order_relaxed);
+	return expected > 0 ? std::min<float>((float)_scanned.load(std::memory_order_relaxed) / expected, 1) : 0;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::wasCached() const
+// ----------------------------------------------------------
+{
+	return isReady() && _cached.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------
+unsigned int ofxAudioUnitWaveformOverview::getChannels() const
+// ----------------------------------------------------------
+{
+	return isReady() ? _channels : 0;
+}
+
+// ----------------------------------------------------------
+Float64 ofxAudioUnitWaveformOverview::getSampleRate() const
+// ----------------------------------------------------------
+{
+	return isReady() ? _sampleRate : 0;
+}
+
+// ----------------------------------------------------------
+UInt64 ofxAudioUnitWaveformOverview::getLength() const
+// ----------------------------------------------------------
+{
+	return isReady() ? _frames : 0;
+}
+
+// ----------------------------------------------------------
+size_t ofxAudioUnitWaveformOverview::getPeaks(unsigned int channel, UInt64 from, UInt64 to, size_t columns, Peak * out) const
+// ----------------------------------------------------------
+{
+	if(!isReady() || channel >= _channels || columns == 0) return 0;
+	to = std::min(to, _frames);
+	if(from >= to) return 0;
+
+	const double span = (double)(to - from) / columns;
+	size_t l = 0;
+	while(l + 1 < _levels.size() && _levels[l + 1].framesPerBin <= span) l++;
+	const Level &level = _levels[l];
+	const Bin * bins = &level.data[channel * level.bins];
+
+	for(size_t column = 0; column < columns; column++) {
+		const UInt64 start = from + (UInt64)(column * span);
+		const UInt64 end = column + 1 == columns ? to : std::max<UInt64>(from + (UInt64)((column + 1) * span), start + 1);
+		const UInt64 first = start / level.framesPerBin;
+		const UInt64 last = std::min((end - 1) / level.framesPerBin, level.bins - 1);
+
+		SInt16 min = bins[first].min;
+		SInt16 max = bins[first].max;
+		double squares = 0;
+		double frames = 0;
+		for(UInt64 b = first; b <= last; b++) {
+			// the last bin of the file can be short
+			const double weight = std::min(level.framesPerBin, _frames - b * level.framesPerBin);
+			min = std::min(min, bins[b].min);
+			max = std::max(max, bins[b].max);
+			squares += weight * bins[b].rms * bins[b].rms;
+			frames += weight;
+		}
+		out[column] = MakePeak(min, max, sqrt(squares / frames));
+	}
+	return columns;
+}
+
+// ----------------------------------------------------------
+std::string ofxAudioUnitWaveformOverview::getSidecarPath(const std::string &filePath, const std::string &cacheDirectory)
+// ----------------------------------------------------------
+{
+	if(cacheDirectory.empty()) return filePath + ".peaks";
+
+	// files of the same name from different directories mustn't collide,
+	// so the name's followed by a hash (FNV-1a) of the whole path
+	UInt64 hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < filePath.size(); i++) {
+		hash = (hash ^ (unsigned char)filePath[i]) * 1099511628211ULL;
+	}
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+
+	const size_t slash = filePath.find_last_of('/');
+	const std::string name = slash == std::string::npos ? filePath : filePath.substr(slash + 1);
+	const std::string directory = cacheDirectory[cacheDirectory.size() - 1] == '/' ? cacheDirectory : cacheDirectory + "/";
+	return directory + name + "." + hex + ".peaks";
+}
+
+#pragma mark - Loading thread
+
+// ----------------------------------------------------------
+void ofxAudioUnitWaveformOverview::run(std::string filePath, std::string sidecarPath)
+// ----------------------------------------------------------
+{
+	UInt64 fileSize = 0;
+	SInt64 modified = 0;
+	if(!FileStamp(filePath, fileSize, modified)) {
+		std::cout << "ofxAudioUnitWaveformOverview couldn't find " << filePath << std::endl;
+		_state.store(StateFailed, std::memory_order_release);
+		return;
+	}
+
+	if(readSidecar(sidecarPath, fileSize, modified)) {
+		_cached.store(true, std::memory_order_relaxed);
+		_state.store(StateReady, std::memory_order_release);
+		return;
+	}
+
+	if(!scan(filePath)) {
+		if(!_cancel.load()) std::cout << "ofxAudioUnitWaveformOverview couldn't read " << filePath << std::endl;
+		_levels.clear();
+		_state.store(StateFailed, std::memory_order_release);
+		return;
+	}
+	_state.store(StateReady, std::memory_order_release);
+
+	// an overview of a file that changed while it was being read (one still
+	// being recorded, say) isn't worth keeping
+	UInt64 sizeAfter = 0;
+	SInt64 modifiedAfter = 0;
+	if(FileStamp(filePath, sizeAfter, modifiedAfter) && sizeAfter == fileSize && modifiedAfter == modified) {
+		writeSidecar(sidecarPath, fileSize, modified);
+	}
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::readSidecar(const std::string &sidecarPath, UInt64 fileSize, SInt64 modified)
+// ----------------------------------------------------------
+{
+	FILE * file = fopen(sidecarPath.c_str(), "rb");
+	if(!file) return false;
+
+	SidecarHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+		&& header.version == kVersion
+		&& header.byteOrder == kByteOrder
+		&& header.fileSize == fileSize
+		&& header.modified == modified
+		&& header.baseFrames == kBaseFrames
+		&& header.levelFactor == kLevelFactor
+		&& header.channels > 0 && header.channels <= kMaxChannels
+		&& header.levels == LevelCount(header.frames);
+
+	// the size has to add up before anything's allocated
+	UInt64 bytes = sizeof(header);
+	for(unsigned int l = 0; ok && l < header.levels; l++) bytes += BinCount(header.frames, l) * header.channels * sizeof(Bin);
+	UInt64 sidecarSize = 0;
+	SInt64 sidecarModified = 0;
+	ok = ok && FileStamp(sidecarPath, sidecarSize, sidecarModified) && sidecarSize == bytes;
+
+	std::vector<Level> levels(ok ? header.levels : 0);
+	for(unsigned int l = 0; ok && l < levels.size(); l++) {
+		levels[l].framesPerBin = FramesPerBin(l);
+		levels[l].bins = BinCount(header.frames, l);
+		levels[l].data.resize(levels[l].bins * header.channels);
+		ok = levels[l].data.empty() || fread(&levels[l].data[0], sizeof(Bin), levels[l].data.size(), file) == levels[l].data.size();
+	}
+	fclose(file);
+	if(!ok) return false;
+
+	_channels = header.channels;
+	_sampleRate = header.sampleRate;
+	_frames = header.frames;
+	_levels.swap(levels);
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::scan(const std::string &filePath)
+// ----------------------------------------------------------
+{
+	Source source;
+	UInt64 expected = 0;
+	if(!source.open(filePath, _channels, _sampleRate, expected) || _channels > kMaxChannels) return false;
+	_expected.store(expected, std::memory_order_relaxed);
+
+	const unsigned int channels = _channels;
+	std::vector<Float32> buffer(channels * kReadFrames);
+	std::vector<Float32 *> planes(channels);
+	for(unsigned int c = 0; c < channels; c++) planes[c] = &buffer[c * kReadFrames];
+
+	// Every level at once, in one pass: a finished bin is folded into the
+	// one above it, which is finished in turn when it's full
+	std::vector<Accumulator> accumulators(kMaxLevels * channels);
+	std::vector<std::vector<Bin> > bins(kMaxLevels * channels);
+	const size_t reserve = expected / kBaseFrames + 1;
+	for(unsigned int c = 0; c < channels; c++) bins[c].reserve(reserve);
+
+	UInt64 frames = 0;
+	for(;;) {
+		if(_cancel.load(std::memory_order_relaxed)) return false;
+		const size_t count = source.read(&planes[0], kReadFrames);
+		if(count == 0) break;
+
+		for(unsigned int c = 0; c < channels; c++) {
+			for(size_t i = 0; i < count;) {
+				Accumulator &finest = accumulators[c];
+				const size_t n = std::min<size_t>(count - i, kBaseFrames - finest.frames);
+				finest.add(planes[c] + i, n);
+				i += n;
+
+				for(unsigned int l = 0; l < kMaxLevels && accumulators[l * channels + c].frames == FramesPerBin(l); l++) {
+					Accumulator &full = accumulators[l * channels + c];
+					if(l + 1 < kMaxLevels) accumulators[(l + 1) * channels + c].add(full);
+					Bin bin;
+					Quantize(full, bin.min, bin.max, bin.rms);
+					bins[l * channels + c].push_back(bin);
+					full.reset();
+				}
+			}
+		}
+		frames += count;
+		_scanned.store(frames, std::memory_order_relaxed);
+	}
+
+	// the partial bins at the end, finest first so each goes into the next
+	for(unsigned int l = 0; l < kMaxLevels; l++) {
+		for(unsigned int c = 0; c < channels; c++) {
+			Accumulator &partial = accumulators[l * channels + c];
+			if(partial.frames == 0) continue;
+			if(l + 1 < kMaxLevels) accumulators[(l + 1) * channels + c].add(partial);
+			Bin bin;
+			Quantize(partial, bin.min, bin.max, bin.rms);
+			bins[l * channels + c].push_back(bin);
+		}
+	}
+
+	_frames = frames;
+	_levels.resize(LevelCount(frames));
+	for(unsigned int l = 0; l < _levels.size(); l++) {
+		Level &level = _levels[l];
+		level.framesPerBin = FramesPerBin(l);
+		level.bins = BinCount(frames, l);
+		level.data.clear();
+		level.data.reserve(level.bins * channels);
+		for(unsigned int c = 0; c < channels; c++) {
+			level.data.insert(level.data.end(), bins[l * channels + c].begin(), bins[l * channels + c].end());
+			std::vector<Bin>().swap(bins[l * channels + c]);
+		}
+	}
+	return true;
+}
+
+// ----------------------------------------------------------
+bool ofxAudioUnitWaveformOverview::writeSidecar(const std::string &sidecarPath, UInt64 fileSize, SInt64 modified) const
+// ----------------------------------------------------------
+{
+	SidecarHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.byteOrder = kByteOrder;
+	header.fileSize = fileSize;
+	header.modified = modified;
+	header.sampleRate = _sampleRate;
+	header.frames = _frames;
+	header.channels = _channels;
+	header.baseFrames = kBaseFrames;
+	header.levelFactor = kLevelFactor;
+	header.levels = _levels.size();
+
+	// written to the side and renamed into place, so another process never
+	// reads half a sidecar
+	const std::string temporaryPath = sidecarPath + ".tmp";
+	FILE * file = fopen(temporaryPath.c_str(), "wb");
+	if(!file) {
+		std::cout << "ofxAudioUnitWaveformOverview couldn't write " << sidecarPath << std::endl;
+		return false;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	for(size_t l = 0; ok && l < _levels.size(); l++) {
+		const std::vector<Bin> &data = _levels[l].data;
+		ok = data.empty() || fwrite(&data[0], sizeof(Bin), data.size(), file) == data.size();
+	}
+	ok = fclose(file) == 0 && ok;
+	ok = ok && rename(temporaryPath.c_str(), sidecarPath.c_str()) == 0;
+
+	if(!ok) {
+		remove(temporaryPath.c_str());
+		std::cout << "ofxAudioUnitWaveformOverview couldn't write " << sidecarPath << std::endl;
+	}
+	return ok;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ofxAudioUnitWaveformOverview summarizes an audio file for drawing: the
+// min, max and RMS of every channel over bins of 256 frames, and again over
+// bins 4, 16, 64... times that, so that a view of any stretch of the file at
+// any width reads a few thousand bins at most.
+
+// load() returns straight away. A thread of its own first looks for a
+// sidecar file holding an overview made earlier, and only if there isn't a
+// good one reads the whole audio file (a block at a time, so it doesn't
+// matter how long it is) and writes one. A sidecar is only used while the
+// audio file has the size and modification time it had when the sidecar was
+// written, so an edited file gets a fresh overview. Levels are kept as 16 bit
+// values, 6 bytes per bin per channel: about 11 MB for an hour of stereo at
+// 48 kHz, which loads in a few milliseconds.
+
+// Sidecars go next to the audio file (with ".peaks" on the end of its name),
+// or in a directory given to load(). If they can't be written the overview
+// is still made, just not kept.
+
+// On Apple platforms files are read with ExtAudioFile, so anything Core
+// Audio can read works. Elsewhere, WAV and RF64 files are read with
+// ofxAudioUnitWavReader.
+
+// load(), clear() and wait() are for the main thread. The getters can be
+// called from anywhere once isReady() says so.
+
+class ofxAudioUnitWaveformOverview
+{
+public:
+	// a column's worth of one channel
+	struct Peak {
+		float min;
+		float max;
+		float rms;
+	};
+
+	static const UInt32 kBaseFrames = 256;  // frames per bin at the finest level
+	static const UInt32 kLevelFactor = 4;   // how much coarser each level is than the last
+
+	ofxAudioUnitWaveformOverview();
+	~ofxAudioUnitWaveformOverview();
+
+	// Abandons whatever was loaded or loading, and starts on filePath
+	void load(const std::string &filePath, const std::string &cacheDirectory = "");
+	void clear();
+
+	// blocks until it's ready or has failed; true if it's ready
+	bool wait();
+
+	const std::string& getFilePath() const {return _filePath;}
+	bool isReady() const;
+	bool hasFailed() const;
+	float getProgress() const; // 0 to 1
+	bool wasCached() const;    // came from the sidecar, rather than the file
+
+	unsigned int getChannels() const;
+	Float64 getSampleRate() const;
+	UInt64 getLength() const; // in frames
+
+	// Frames [from, to) of a channel, split into `columns` peaks, from the
+	// coarsest level with a bin for every column. Zoomed in closer than
+	// kBaseFrames per column, columns repeat bins; draw the samples
+	// themselves there. Returns the number of peaks written, 0 until ready
+	size_t getPeaks(unsigned int channel, UInt64 from, UInt64 to, size_t columns, Peak * out) const;
+
+	static std::string getSidecarPath(const std::string &filePath, const std::string &cacheDirectory = "");
+
+private:
+	// the sidecar's format, as well as how it's kept in memory
+	struct Bin {
+		SInt16 min; // scaled by 32767, rounded outwards
+		SInt16 max;
+		UInt16 rms; // scaled by 65535
+	};
+
+	struct Level {
+		UInt64 framesPerBin;
+		UInt64 bins;
+		std::vector<Bin> data; // channel after channel, bins long each
+	};
+
+	enum State {
+		StateEmpty,
+		StateLoading,
+		StateReady,
+		StateFailed
+	};
+
+	std::string _filePath;
+	std::thread _thread;
+	std::atomic<int> _state;
+	std::atomic<bool> _cancel;
+	std::atomic<UInt64> _scanned;
+	std::atomic<UInt64> _expected;
+	std::atomic<bool> _cached;
+
+	// written by the thread before it sets the state to ready
+	unsigned int _channels;
+	Float64 _sampleRate;
+	UInt64 _frames;
+	std::vector<Level> _levels;
+
+	ofxAudioUnitWaveformOverview(const ofxAudioUnitWaveformOverview &);
+	ofxAudioUnitWaveformOverview& operator=(const ofxAudioUnitWaveformOverview &);
+
+	void run(std::string filePath, std::string sidecarPath);
+	bool readSidecar(const std::string &sidecarPath, UInt64 fileSize, SInt64 modified);
+	bool scan(const std::string &filePath);
+	bool writeSidecar(const std::string &sidecarPath, UInt64 fileSize, SInt64 modified) const;
+};